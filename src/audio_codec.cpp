@@ -0,0 +1,897 @@
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+
+#include "audio_codec.h"
+#include "e3e_detection.h"
+#include "fastmath.h"
+
+/* MSB first bit stream, written 32 bits at a time */
+struct BitWriter
+{
+  uint8_t *p;
+  uint64_t acc;
+  int bits;
+
+  BitWriter(uint8_t *out) : p(out), acc(0), bits(0) {}
+
+  // v < 2^n, n <= 32
+  inline void put(uint32_t v, int n)
+  {
+    acc = (acc << n) | v;
+    bits += n;
+    if (bits >= 32)
+    {
+      bits -= 32;
+      uint32_t w = uint32_t(acc >> bits);
+      p[0] = w >> 24;
+      p[1] = w >> 16;
+      p[2] = w >> 8;
+      p[3] = w;
+      p += 4;
+    }
+  }
+
+  inline void put_signed(int32_t v, int n)
+  {
+    put(uint32_t(v) & ((1u << n) - 1), n);
+  }
+
+  inline void rice(uint32_t u, int k)
+  {
+    uint32_t q = u >> k;
+    uint32_t low = k > 0 ? u & ((1u << k) - 1) : 0;
+
+    if (uint64_t(q) + 1 + k <= 32)
+    {
+      put((1u << k) | low, q + 1 + k);
+      return;
+    }
+
+    for ( ; q >= 32 ; q -= 32)
+      put(0, 32);
+    put(1, q + 1);
+    put(low, k);
+  }
+
+  // pad to a byte, returns the end of the stream
+  uint8_t *finish()
+  {
+    if (bits > 0)
+    {
+      uint32_t w = uint32_t(acc << (32 - bits));
+      for (int b = 0 ; b < bits ; b += 8)
+        *p++ = w >> (24 - b);
+      bits = 0;
+    }
+    return p;
+  }
+};
+
+/* reads past the end give zeros and set overrun */
+struct BitReader
+{
+  const uint8_t *p;
+  const uint8_t *end;
+  uint64_t acc;
+  int bits;
+  uint64_t consumed;
+  uint64_t limit;
+
+  BitReader(const uint8_t *data, size_t size)
+    : p(data), end(data + size), acc(0), bits(0), consumed(0), limit(uint64_t(size) * 8) {}
+
+  inline bool overrun()
+  {
+    return consumed > limit;
+  }
+
+  inline void refill()
+  {
+    while (bits <= 56)
+    {
+      uint64_t b = p < end ? *p++ : 0;
+      acc |= b << (56 - bits);
+      bits += 8;
+    }
+  }
+
+  // n <= 32
+  inline uint32_t get(int n)
+  {
+    if (n == 0)
+      return 0;
+    refill();
+    uint32_t v = uint32_t(acc >> (64 - n));
+    acc <<= n;
+    bits -= n;
+    consumed += n;
+    return v;
+  }
+
+  inline int32_t get_signed(int n)
+  {
+    return int32_t(get(n) << (32 - n)) >> (32 - n);
+  }
+
+  inline uint32_t rice(int k)
+  {
+    uint32_t q = 0;
+    while (true)
+    {
+      refill();
+      if (acc == 0)
+      {
+        q += bits;
+        consumed += bits;
+        bits = 0;
+        if (overrun())
+          return 0;
+        continue;
+      }
+
+      int z = __builtin_clzll(acc);
+      q += z;
+      acc <<= z;
+      acc <<= 1;
+      bits -= z + 1;
+      consumed += z + 1;
+      break;
+    }
+
+    return (q << k) | get(k);
+  }
+};
+
+static inline uint32_t zigzag(int32_t r)
+{
+  return (uint32_t(r) << 1) ^ uint32_t(r >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u)
+{
+  return int32_t(u >> 1) ^ -int32_t(u & 1);
+}
+
+/* u[i] = zigzag(s[i] - ((sum_k q[k] s[i-1-k]) >> shift)) for order <= i < n */
+static void lpc_residual(const int32_t *s, int n, const int32_t *q, int order, int shift, uint32_t *u)
+{
+  int i = order;
+
+#if defined(FASTMATH_AVX2)
+  __m128i vshift = _mm_cvtsi32_si128(shift);
+  for ( ; i + 8 <= n ; i += 8)
+  {
+    __m256i acc = _mm256_setzero_si256();
+    for (int k = 0 ; k < order ; k++)
+      acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_set1_epi32(q[k]),
+            _mm256_loadu_si256((const __m256i *)(s + i - 1 - k))));
+
+    __m256i r = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(s + i)), _mm256_sra_epi32(acc, vshift));
+    __m256i z = _mm256_xor_si256(_mm256_slli_epi32(r, 1), _mm256_srai_epi32(r, 31));
+    _mm256_storeu_si256((__m256i *)(u + i), z);
+  }
+#elif defined(FASTMATH_NEON)
+  int32x4_t vshift = vdupq_n_s32(-shift);
+  for ( ; i + 4 <= n ; i += 4)
+  {
+    int32x4_t acc = vdupq_n_s32(0);
+    for (int k = 0 ; k < order ; k++)
+      acc = vmlaq_s32(acc, vld1q_s32(s + i - 1 - k), vdupq_n_s32(q[k]));
+
+    int32x4_t r = vsubq_s32(vld1q_s32(s + i), vshlq_s32(acc, vshift));
+    int32x4_t z = veorq_s32(vshlq_n_s32(r, 1), vshrq_n_s32(r, 31));
+    vst1q_u32(u + i, vreinterpretq_u32_s32(z));
+  }
+#endif
+
+  for ( ; i < n ; i++)
+  {
+    int32_t acc = 0;
+    for (int k = 0 ; k < order ; k++)
+      acc += q[k] * s[i - 1 - k];
+    u[i] = zigzag(s[i] - (acc >> shift));
+  }
+}
+
+static uint64_t sum_u(const uint32_t *u, int n)
+{
+  int i = 0;
+  uint64_t sum = 0;
+
+#if defined(FASTMATH_AVX2)
+  __m256i acc = _mm256_setzero_si256();
+  for ( ; i + 8 <= n ; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(u + i));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(FASTMATH_NEON)
+  uint64x2_t acc = vdupq_n_u64(0);
+  for ( ; i + 4 <= n ; i += 4)
+    acc = vpadalq_u32(acc, vld1q_u32(u + i));
+  sum = vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+
+  for ( ; i < n ; i++)
+    sum += u[i];
+
+  return sum;
+}
+
+/* out = a - b, or a + b */
+template <bool add>
+static void combine(int32_t *out, const int32_t *a, const int32_t *b, int n)
+{
+  int i = 0;
+
+#if defined(FASTMATH_AVX2)
+  for ( ; i + 8 <= n ; i += 8)
+  {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(out + i), add ? _mm256_add_epi32(va, vb) : _mm256_sub_epi32(va, vb));
+  }
+#elif defined(FASTMATH_NEON)
+  for ( ; i + 4 <= n ; i += 4)
+    vst1q_s32(out + i, add ? vaddq_s32(vld1q_s32(a + i), vld1q_s32(b + i))
+        : vsubq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+#endif
+
+  for ( ; i < n ; i++)
+    out[i] = add ? a[i] + b[i] : a[i] - b[i];
+}
+
+/* s[i] += (sum_k q[k] s[i-1-k]) >> shift, s holding the residuals after the warm-up */
+template <int P>
+static void lpc_synthesis(int32_t *s, int n, const int32_t *q, int shift)
+{
+  for (int i = P ; i < n ; i++)
+  {
+    int32_t acc = 0;
+    for (int k = 0 ; k < P ; k++)
+      acc += q[k] * s[i - 1 - k];
+    s[i] += acc >> shift;
+  }
+}
+
+static void lpc_synthesis(int32_t *s, int n, const int32_t *q, int order, int shift)
+{
+  switch (order)
+  {
+    case 1: lpc_synthesis<1>(s, n, q, shift); break;
+    case 2: lpc_synthesis<2>(s, n, q, shift); break;
+    case 3: lpc_synthesis<3>(s, n, q, shift); break;
+    case 4: lpc_synthesis<4>(s, n, q, shift); break;
+    case 5: lpc_synthesis<5>(s, n, q, shift); break;
+    case 6: lpc_synthesis<6>(s, n, q, shift); break;
+    case 7: lpc_synthesis<7>(s, n, q, shift); break;
+    case 8: lpc_synthesis<8>(s, n, q, shift); break;
+    default: break;
+  }
+}
+
+/* smallest bound n (k + 1) + (sum >> k) of the Rice coded size over k */
+static int rice_parameter(uint64_t sum, int n, uint64_t &bits)
+{
+  int best = 0;
+  bits = UINT64_MAX;
+
+  for (int k = 0 ; k < 32 ; k++)
+  {
+    uint64_t b = uint64_t(n) * (k + 1) + (sum >> k);
+    if (b < bits)
+    {
+      bits = b;
+      best = k;
+    }
+    if ((sum >> k) == 0)
+      break;
+  }
+
+  return best;
+}
+
+AudioEncoder::AudioEncoder(int _channels, int _fs, int _format, int _frame_size, float _scale)
+  : channels(_channels), fs(_fs), format(_format), frame_size(_frame_size), scale(_scale)
+{
+  this->x = (int32_t *)e3e_aligned_malloc(sizeof(int32_t) * _channels * _frame_size);
+  this->side = (int32_t *)e3e_aligned_malloc(sizeof(int32_t) * _frame_size);
+  this->u = (uint32_t *)e3e_aligned_malloc(sizeof(uint32_t) * _frame_size);
+  this->window = (double *)e3e_aligned_malloc(sizeof(double) * _frame_size);
+  this->windowed = (double *)e3e_aligned_malloc(sizeof(double) * _frame_size);
+
+  this->reset();
+}
+
+AudioEncoder::~AudioEncoder()
+{
+  free(this->x);
+  free(this->side);
+  free(this->u);
+  free(this->window);
+  free(this->windowed);
+}
+
+void AudioEncoder::reset()
+{
+  this->n_samples = 0;
+  this->n_bytes = 0;
+  this->window_size = 0;
+}
+
+size_t AudioEncoder::max_frame_bytes()
+{
+  // a subframe is never larger than verbatim, but for the constant of a single sample
+  size_t coded = (size_t(this->channels) * (3 + 16 * this->frame_size) + 7) / 8 + this->channels + 8;
+  size_t raw = size_t(this->channels) * this->frame_size * sizeof(float);
+
+  return AUDIO_CODEC_FRAME_HEADER + (this->format == AUDIO_CODEC_FLOAT32 ? std::max(coded, raw) : coded);
+}
+
+size_t AudioEncoder::write_header(uint8_t *out, uint32_t data_offset)
+{
+  AudioCodecHeader h;
+  memset(&h, 0, sizeof(h));
+
+  memcpy(h.magic, AUDIO_CODEC_MAGIC, 4);
+  h.version = AUDIO_CODEC_VERSION;
+  h.format = this->format;
+  h.channels = this->channels;
+  h.frame_size = this->frame_size;
+  h.fs = this->fs;
+  h.data_offset = data_offset;
+  h.scale = this->scale;
+  h.n_samples = this->n_samples;
+
+  memcpy(out, &h, sizeof(h));
+  return sizeof(h);
+}
+
+size_t AudioEncoder::encode(const int16_t *pcm, int n, uint8_t *out)
+{
+  if (n <= 0 || n > this->frame_size)
+    return 0;
+
+  for (int c = 0 ; c < this->channels ; c++)
+  {
+    int32_t *xc = this->x + c * this->frame_size;
+    for (int i = 0 ; i < n ; i++)
+      xc[i] = pcm[i * this->channels + c];
+  }
+
+  return this->encode_frame(n, out);
+}
+
+size_t AudioEncoder::encode(const float *pcm, int n, uint8_t *out)
+{
+  if (n <= 0 || n > this->frame_size)
+    return 0;
+
+  if (this->format != AUDIO_CODEC_FLOAT32)
+  {
+    std::cerr << "Error: float samples given to an int16 audio encoder." << std::endl;
+    return 0;
+  }
+
+  // coded as int16 only if every sample comes back bit exact
+  bool exact = true;
+  for (int c = 0 ; c < this->channels && exact ; c++)
+  {
+    int32_t *xc = this->x + c * this->frame_size;
+    for (int i = 0 ; i < n ; i++)
+    {
+      float v = pcm[i * this->channels + c];
+      float t = v * this->scale;
+      if (!(t >= -32768.f && t <= 32767.f))
+      {
+        exact = false;
+        break;
+      }
+
+      int32_t q = int32_t(lrintf(t));
+      float back = float(q) / this->scale;
+      if (memcmp(&back, &v, sizeof(float)) != 0)
+      {
+        exact = false;
+        break;
+      }
+      xc[i] = q;
+    }
+  }
+
+  if (exact)
+    return this->encode_frame(n, out);
+
+  size_t bytes = AUDIO_CODEC_FRAME_HEADER + sizeof(float) * n * this->channels;
+  uint32_t frame_bytes = uint32_t(bytes);
+  uint16_t n_samples = uint16_t(n);
+  memcpy(out, &frame_bytes, 4);
+  memcpy(out + 4, &n_samples, 2);
+  out[6] = AUDIO_CODEC_FRAME_FLOAT;
+  out[7] = 0;
+  memcpy(out + AUDIO_CODEC_FRAME_HEADER, pcm, sizeof(float) * n * this->channels);
+
+  this->n_samples += n;
+  this->n_bytes += bytes;
+
+  return bytes;
+}
+
+/* Levinson-Durbin on the autocorrelation r[0..order], lpc[p - 1][k] and err[p] for every order p */
+static void levinson(const double *r, int order, double lpc[][AUDIO_CODEC_MAX_ORDER], double *err)
+{
+  double a[AUDIO_CODEC_MAX_ORDER] = {0};
+  double tmp[AUDIO_CODEC_MAX_ORDER];
+
+  err[0] = r[0];
+  for (int p = 1 ; p <= order ; p++)
+  {
+    double acc = r[p];
+    for (int j = 0 ; j < p - 1 ; j++)
+      acc -= a[j] * r[p - 1 - j];
+    double k = err[p - 1] > 0. ? acc / err[p - 1] : 0.;
+
+    for (int j = 0 ; j < p - 1 ; j++)
+      tmp[j] = a[j] - k * a[p - 2 - j];
+    for (int j = 0 ; j < p - 1 ; j++)
+      a[j] = tmp[j];
+    a[p - 1] = k;
+
+    err[p] = std::max(err[p - 1] * (1. - k * k), 0.);
+    for (int j = 0 ; j < p ; j++)
+      lpc[p - 1][j] = a[j];
+  }
+}
+
+/* quantize to AUDIO_CODEC_PRECISION bits with the rounding errors carried over, returns the shift */
+static int quantize_lpc(const double *lpc, int order, int32_t *q)
+{
+  double cmax = 0.;
+  for (int k = 0 ; k < order ; k++)
+    cmax = std::max(cmax, std::fabs(lpc[k]));
+
+  int e = 0;
+  if (cmax > 0.)
+    frexp(cmax, &e);
+  int shift = std::max(0, std::min(15, AUDIO_CODEC_PRECISION - 1 - e));
+
+  int32_t qmax = (1 << (AUDIO_CODEC_PRECISION - 1)) - 1;
+  int32_t qmin = -(1 << (AUDIO_CODEC_PRECISION - 1));
+  double error = 0.;
+  for (int k = 0 ; k < order ; k++)
+  {
+    double v = lpc[k] * double(1 << shift) + error;
+    int32_t r = std::max(qmin, std::min(qmax, int32_t(lrint(v))));
+    error = v - r;
+    q[k] = r;
+  }
+
+  return shift;
+}
+
+size_t AudioEncoder::encode_frame(int n, uint8_t *out)
+{
+  // a tapered window for the autocorrelation, recomputed when the frame size changes
+  if (n != this->window_size)
+  {
+    int taper = std::max(1, n / 4);
+    for (int i = 0 ; i < n ; i++)
+    {
+      double w = 1.;
+      if (i < taper)
+        w = 0.5 - 0.5 * cos(M_PI * (i + 0.5) / taper);
+      else if (i >= n - taper)
+        w = 0.5 - 0.5 * cos(M_PI * (n - i - 0.5) / taper);
+      this->window[i] = w;
+    }
+    this->window_size = n;
+  }
+
+  BitWriter bw(out + AUDIO_CODEC_FRAME_HEADER);
+  int max_order = std::min(AUDIO_CODEC_MAX_ORDER, n / 4);
+  const int32_t second_order[2] = { 2, -1 };
+
+  for (int c = 0 ; c < this->channels ; c++)
+  {
+    int32_t *xc = this->x + c * this->frame_size;
+
+    // the difference with the previous channel when its second order difference is smaller
+    const int32_t *s = xc;
+    bool use_side = false;
+    if (c > 0 && n > 2)
+    {
+      combine<false>(this->side, xc, xc - this->frame_size, n);
+
+      lpc_residual(xc, n, second_order, 2, 0, this->u);
+      uint64_t cost_x = sum_u(this->u + 2, n - 2);
+      lpc_residual(this->side, n, second_order, 2, 0, this->u);
+      uint64_t cost_side = sum_u(this->u + 2, n - 2);
+
+      if (cost_side < cost_x)
+      {
+        s = this->side;
+        use_side = true;
+      }
+    }
+
+    bool constant = true;
+    for (int i = 1 ; i < n && constant ; i++)
+      constant = s[i] == s[0];
+
+    if (constant)
+    {
+      bw.put(AUDIO_CODEC_CONSTANT, 2);
+      bw.put(use_side, 1);
+      bw.put_signed(s[0], AUDIO_CODEC_SAMPLE_BITS);
+      continue;
+    }
+
+    // autocorrelation of the windowed signal
+    double r[AUDIO_CODEC_MAX_ORDER + 1];
+    double w2 = 0.;
+    for (int i = 0 ; i < n ; i++)
+    {
+      this->windowed[i] = s[i] * this->window[i];
+      w2 += this->window[i] * this->window[i];
+    }
+    for (int lag = 0 ; lag <= max_order ; lag++)
+    {
+      double acc = 0.;
+      for (int i = lag ; i < n ; i++)
+        acc += this->windowed[i] * this->windowed[i - lag];
+      r[lag] = acc;
+    }
+
+    // the order from the estimated residual variance
+    double lpc[AUDIO_CODEC_MAX_ORDER][AUDIO_CODEC_MAX_ORDER];
+    double err[AUDIO_CODEC_MAX_ORDER + 1];
+    levinson(r, max_order, lpc, err);
+
+    int order = 0;
+    double best_bits = 1e300;
+    for (int p = 0 ; p <= max_order ; p++)
+    {
+      double var = err[p] / w2;
+      double per_sample = var > 1. ? std::max(1., 0.5 * log2(var) + 1.) : 1.;
+      double bits = (n - p) * per_sample + p * (AUDIO_CODEC_PRECISION + AUDIO_CODEC_SAMPLE_BITS);
+      if (bits < best_bits)
+      {
+        best_bits = bits;
+        order = p;
+      }
+    }
+
+    int32_t q[AUDIO_CODEC_MAX_ORDER];
+    int shift = order > 0 ? quantize_lpc(lpc[order - 1], order, q) : 0;
+    lpc_residual(s, n, q, order, shift, this->u);
+
+    // the Rice parameters of the partitions and the bound of the coded size
+    int n_partitions = (n + AUDIO_CODEC_PARTITION - 1) / AUDIO_CODEC_PARTITION;
+    int ks[(65536 + AUDIO_CODEC_PARTITION - 1) / AUDIO_CODEC_PARTITION];
+    uint64_t coded = 3 + 8 + order * (AUDIO_CODEC_PRECISION + AUDIO_CODEC_SAMPLE_BITS);
+    for (int p = 0 ; p < n_partitions ; p++)
+    {
+      int start = std::max(order, p * AUDIO_CODEC_PARTITION);
+      int end = std::min(n, (p + 1) * AUDIO_CODEC_PARTITION);
+      uint64_t bits = 0;
+      ks[p] = start < end ? rice_parameter(sum_u(this->u + start, end - start), end - start, bits) : 0;
+      coded += 5 + bits;
+    }
+
+    if (coded >= uint64_t(3 + 16 * n))
+    {
+      bw.put(AUDIO_CODEC_VERBATIM, 2);
+      bw.put(0, 1);
+      for (int i = 0 ; i < n ; i++)
+        bw.put_signed(xc[i], 16);
+      continue;
+    }
+
+    bw.put(AUDIO_CODEC_LPC, 2);
+    bw.put(use_side, 1);
+    bw.put(order, 4);
+    bw.put(shift, 4);
+    for (int k = 0 ; k < order ; k++)
+      bw.put_signed(q[k], AUDIO_CODEC_PRECISION);
+    for (int i = 0 ; i < order ; i++)
+      bw.put_signed(s[i], AUDIO_CODEC_SAMPLE_BITS);
+
+    for (int p = 0 ; p < n_partitions ; p++)
+    {
+      int start = std::max(order, p * AUDIO_CODEC_PARTITION);
+      int end = std::min(n, (p + 1) * AUDIO_CODEC_PARTITION);
+      bw.put(ks[p], 5);
+      for (int i = start ; i < end ; i++)
+        bw.rice(this->u[i], ks[p]);
+    }
+  }
+
+  size_t bytes = bw.finish() - out;
+  uint32_t frame_bytes = uint32_t(bytes);
+  uint16_t n_samples = uint16_t(n);
+  memcpy(out, &frame_bytes, 4);
+  memcpy(out + 4, &n_samples, 2);
+  out[6] = AUDIO_CODEC_FRAME_CODED;
+  out[7] = 0;
+
+  this->n_samples += n;
+  this->n_bytes += bytes;
+
+  return bytes;
+}
+
+AudioDecoder::AudioDecoder()
+{
+  memset(&this->header, 0, sizeof(this->header));
+  this->channels = 0;
+  this->frame_size = 0;
+  this->x = NULL;
+}
+
+AudioDecoder::~AudioDecoder()
+{
+  free(this->x);
+}
+
+bool AudioDecoder::read_header(const uint8_t *data, size_t size)
+{
+  if (size < sizeof(AudioCodecHeader))
+  {
+    std::cerr << "Error: the audio stream is too short for its header." << std::endl;
+    return false;
+  }
+
+  AudioCodecHeader h;
+  memcpy(&h, data, sizeof(h));
+
+  if (memcmp(h.magic, AUDIO_CODEC_MAGIC, 4) != 0 || h.version != AUDIO_CODEC_VERSION)
+  {
+    std::cerr << "Error: not an audio stream of version " << AUDIO_CODEC_VERSION << "." << std::endl;
+    return false;
+  }
+
+  if (h.channels == 0 || h.frame_size == 0 || h.frame_size > 65535 || h.data_offset < sizeof(h)
+      || h.format > AUDIO_CODEC_FLOAT32 || !(h.scale > 0.f))
+  {
+    std::cerr << "Error: invalid audio stream header." << std::endl;
+    return false;
+  }
+
+  this->header = h;
+  this->channels = h.channels;
+  this->frame_size = h.frame_size;
+
+  free(this->x);
+  this->x = (int32_t *)e3e_aligned_malloc(sizeof(int32_t) * h.channels * h.frame_size);
+
+  return true;
+}
+
+size_t AudioDecoder::decode_frame(const uint8_t *data, size_t size, int &n, int &mode)
+{
+  if (this->x == NULL || size < AUDIO_CODEC_FRAME_HEADER)
+    return 0;
+
+  uint32_t frame_bytes;
+  uint16_t n_samples;
+  memcpy(&frame_bytes, data, 4);
+  memcpy(&n_samples, data + 4, 2);
+  mode = data[6];
+  n = n_samples;
+
+  if (frame_bytes > size || frame_bytes < AUDIO_CODEC_FRAME_HEADER || n == 0 || n > this->frame_size)
+    return 0;
+
+  if (mode == AUDIO_CODEC_FRAME_FLOAT)
+    return frame_bytes == AUDIO_CODEC_FRAME_HEADER + sizeof(float) * n * this->channels ? frame_bytes : 0;
+  if (mode != AUDIO_CODEC_FRAME_CODED)
+    return 0;
+
+  BitReader br(data + AUDIO_CODEC_FRAME_HEADER, frame_bytes - AUDIO_CODEC_FRAME_HEADER);
+
+  for (int c = 0 ; c < this->channels && !br.overrun() ; c++)
+  {
+    int32_t *xc = this->x + c * this->frame_size;
+    int type = br.get(2);
+    bool use_side = br.get(1);
+
+    if (use_side && c == 0)
+      return 0;
+
+    if (type == AUDIO_CODEC_CONSTANT)
+    {
+      int32_t v = br.get_signed(AUDIO_CODEC_SAMPLE_BITS);
+      for (int i = 0 ; i < n ; i++)
+        xc[i] = v;
+    }
+    else if (type == AUDIO_CODEC_VERBATIM)
+    {
+      for (int i = 0 ; i < n ; i++)
+        xc[i] = br.get_signed(16);
+    }
+    else if (type == AUDIO_CODEC_LPC)
+    {
+      int order = br.get(4);
+      int shift = br.get(4);
+      if (order > AUDIO_CODEC_MAX_ORDER || order > n)
+        return 0;
+
+      int32_t q[AUDIO_CODEC_MAX_ORDER];
+      for (int k = 0 ; k < order ; k++)
+        q[k] = br.get_signed(AUDIO_CODEC_PRECISION);
+      for (int i = 0 ; i < order ; i++)
+        xc[i] = br.get_signed(AUDIO_CODEC_SAMPLE_BITS);
+
+      int n_partitions = (n + AUDIO_CODEC_PARTITION - 1) / AUDIO_CODEC_PARTITION;
+      for (int p = 0 ; p < n_partitions && !br.overrun() ; p++)
+      {
+        int start = std::max(order, p * AUDIO_CODEC_PARTITION);
+        int end = std::min(n, (p + 1) * AUDIO_CODEC_PARTITION);
+        int k = br.get(5);
+        for (int i = start ; i < end ; i++)
+          xc[i] = unzigzag(br.rice(k));
+      }
+
+      lpc_synthesis(xc, n, q, order, shift);
+    }
+    else
+      return 0;
+
+    if (use_side)
+      combine<true>(xc, xc, xc - this->frame_size, n);
+  }
+
+  if (br.overrun())
+    return 0;
+
+  return frame_bytes;
+}
+
+size_t AudioDecoder::decode(const uint8_t *data, size_t size, int16_t *pcm, int &n)
+{
+  int mode;
+  size_t bytes = this->decode_frame(data, size, n, mode);
+
+  if (bytes == 0)
+  {
+    std::cerr << "Error: invalid audio frame." << std::endl;
+    return 0;
+  }
+
+  if (mode == AUDIO_CODEC_FRAME_FLOAT)
+  {
+    std::cerr << "Error: float audio frame decoded as int16." << std::endl;
+    return 0;
+  }
+
+  for (int c = 0 ; c < this->channels ; c++)
+  {
+    const int32_t *xc = this->x + c * this->frame_size;
+    for (int i = 0 ; i < n ; i++)
+      pcm[i * this->channels + c] = int16_t(xc[i]);
+  }
+
+  return bytes;
+}
+
+size_t AudioDecoder::decode(const uint8_t *data, size_t size, float *pcm, int &n)
+{
+  int mode;
+  size_t bytes = this->decode_frame(data, size, n, mode);
+
+  if (bytes == 0)
+  {
+    std::cerr << "Error: invalid audio frame." << std::endl;
+    return 0;
+  }
+
+  if (mode == AUDIO_CODEC_FRAME_FLOAT)
+  {
+    memcpy(pcm, data + AUDIO_CODEC_FRAME_HEADER, sizeof(float) * n * this->channels);
+    return bytes;
+  }
+
+  // the same expression as the encoder, so that the float frames are bit exact
+  float scale = this->header.scale;
+  for (int c = 0 ; c < this->channels ; c++)
+  {
+    const int32_t *xc = this->x + c * this->frame_size;
+    for (int i = 0 ; i < n ; i++)
+      pcm[i * this->channels + c] = float(xc[i]) / scale;
+  }
+
+  return bytes;
+}
+
+bool audio_codec_compress_raw(const std::string &raw_file, const std::string &out_file, int channels, int fs)
+{
+  std::ifstream fin(raw_file, std::ifstream::binary);
+  if (!fin)
+  {
+    std::cerr << "Error: could not open " << raw_file << std::endl;
+    return false;
+  }
+  std::vector<char> raw((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+  size_t n_samples = raw.size() / (sizeof(float) * channels);
+  if (n_samples * sizeof(float) * channels != raw.size())
+    std::cerr << "Warning: " << raw_file << " ends with a partial sample, it is dropped." << std::endl;
+
+  AudioEncoder enc(channels, fs, AUDIO_CODEC_FLOAT32);
+  std::vector<uint8_t> frame(enc.max_frame_bytes());
+  uint8_t header[sizeof(AudioCodecHeader)];
+
+  std::ofstream fout(out_file, std::ofstream::binary | std::ofstream::trunc);
+  if (!fout)
+  {
+    std::cerr << "Error: could not create " << out_file << std::endl;
+    return false;
+  }
+
+  fout.write((const char *)header, enc.write_header(header));
+
+  const float *pcm = (const float *)raw.data();
+  for (size_t i = 0 ; i < n_samples ; i += enc.frame_size)
+  {
+    int n = int(std::min(size_t(enc.frame_size), n_samples - i));
+    size_t bytes = enc.encode(pcm + i * channels, n, frame.data());
+    fout.write((const char *)frame.data(), bytes);
+  }
+
+  // the header again with the number of samples
+  fout.seekp(0);
+  fout.write((const char *)header, enc.write_header(header));
+
+  return bool(fout);
+}
+
+bool audio_codec_decompress_raw(const std::string &in_file, const std::string &raw_file)
+{
+  std::ifstream fin(in_file, std::ifstream::binary);
+  if (!fin)
+  {
+    std::cerr << "Error: could not open " << in_file << std::endl;
+    return false;
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+  const uint8_t *p = (const uint8_t *)data.data();
+
+  AudioDecoder dec;
+  if (!dec.read_header(p, data.size()))
+    return false;
+
+  std::ofstream fout(raw_file, std::ofstream::binary | std::ofstream::trunc);
+  std::vector<float> pcm(size_t(dec.channels) * dec.frame_size);
+
+  size_t offset = dec.header.data_offset;
+  uint64_t n_samples = 0;
+  while (offset < data.size())
+  {
+    int n;
+    size_t bytes = dec.decode(p + offset, data.size() - offset, pcm.data(), n);
+    if (bytes == 0)
+      return false;
+
+    fout.write((const char *)pcm.data(), sizeof(float) * n * dec.channels);
+    offset += bytes;
+    n_samples += n;
+  }
+
+  if (n_samples != dec.header.n_samples)
+  {
+    std::cerr << "Error: " << in_file << " has " << n_samples << " samples instead of " << dec.header.n_samples << std::endl;
+    return false;
+  }
+
+  return bool(fout);
+}
@@ -0,0 +1,172 @@
+#ifndef __AUDIO_CODEC_H__
+#define __AUDIO_CODEC_H__
+
+/*
+ * Lossless compression of multichannel PCM, for the event clips and the
+ * .raw recordings.
+ *
+ * The stream is a header (AudioCodecHeader) followed by independent
+ * frames of frame_size samples per channel (the last one may be shorter):
+ *
+ *   uint32 frame_bytes, uint16 n_samples, uint8 mode, uint8 reserved
+ *
+ * then, for AUDIO_CODEC_FRAME_CODED, one MSB first bit stream with a
+ * subframe per channel:
+ *
+ *   2 bits type, 1 bit side
+ *   AUDIO_CODEC_CONSTANT  18 bits value
+ *   AUDIO_CODEC_VERBATIM  n_samples x 16 bits
+ *   AUDIO_CODEC_LPC       4 bits order p, 4 bits shift, p x 12 bits
+ *                         coefficients, p x 18 bits warm-up samples, then
+ *                         the residuals by partitions of
+ *                         AUDIO_CODEC_PARTITION samples, each with a 5 bits
+ *                         Rice parameter k and its zigzag mapped residuals
+ *                         (quotient in unary, k low bits)
+ *
+ * where the coded signal s of a side channel is its difference with the
+ * previous channel, which takes most of the correlation between
+ * neighbouring microphones, and the prediction is
+ *
+ *   s[n] = r[n] + ((sum_k q[k] s[n-1-k]) >> shift)
+ *
+ * in int32, which cannot overflow with 12 bits coefficients, order 8 and
+ * 17 bits signals. The encoder picks the side coding when it makes the
+ * second order difference smaller, the LPC order from the Levinson-Durbin
+ * prediction errors, the Rice parameters from an upper bound of the coded
+ * size, and falls back to verbatim when that is smaller.
+ *
+ * FLOAT32 streams are lossless as well: a frame where every sample is
+ * exactly an int16 divided by the scale (the case of the ADC samples) is
+ * coded as int16, the other frames are stored as raw floats
+ * (AUDIO_CODEC_FRAME_FLOAT).
+ *
+ * The residuals (encoder) and the channel differences (both sides) use
+ * AVX2 or NEON when available (same flags as fastmath.h). The synthesis
+ * filter of the decoder is recursive, it is unrolled for every order
+ * instead. Neither the encoder nor the decoder allocate after
+ * construction.
+ *
+ *   AudioEncoder enc(CHANNELS, FS);
+ *   std::vector<uint8_t> frame(enc.max_frame_bytes());
+ *   size_t n = enc.encode(pcm, FRAME_SIZE, frame.data());
+ *
+ *   AudioDecoder dec;
+ *   dec.read_header(data, size);
+ *   size_t used = dec.decode(data + offset, size - offset, pcm, n_samples);
+ */
+
+#include <string>
+#include <stdint.h>
+
+#define AUDIO_CODEC_MAGIC "E3EA"
+#define AUDIO_CODEC_VERSION 1
+
+#define AUDIO_CODEC_MAX_ORDER 8
+#define AUDIO_CODEC_PRECISION 12      // bits of the quantized LPC coefficients
+#define AUDIO_CODEC_SAMPLE_BITS 18    // bits of the constants and warm-up samples
+#define AUDIO_CODEC_PARTITION 256     // samples per Rice parameter
+#define AUDIO_CODEC_FRAME_SIZE 4096   // default samples per channel in a frame
+#define AUDIO_CODEC_FRAME_HEADER 8
+
+enum audio_codec_format
+{
+  AUDIO_CODEC_INT16 = 0,
+  AUDIO_CODEC_FLOAT32
+};
+
+enum audio_codec_frame_mode
+{
+  AUDIO_CODEC_FRAME_CODED = 0,
+  AUDIO_CODEC_FRAME_FLOAT     // raw interleaved float32
+};
+
+enum audio_codec_subframe_type
+{
+  AUDIO_CODEC_CONSTANT = 0,
+  AUDIO_CODEC_VERBATIM,
+  AUDIO_CODEC_LPC
+};
+
+struct AudioCodecHeader
+{
+  char magic[4];
+  uint16_t version;
+  uint16_t format;
+  uint16_t channels;
+  uint16_t reserved;
+  uint32_t frame_size;
+  uint32_t fs;
+  uint32_t data_offset;   // offset of the first frame
+  float scale;            // FLOAT32: sample = int16 / scale
+  uint32_t reserved2;
+  uint64_t n_samples;     // per channel
+};
+
+class AudioEncoder
+{
+  public:
+    int channels;
+    int fs;
+    int format;
+    int frame_size;       // at most 65535
+    float scale;
+
+    uint64_t n_samples;   // samples per channel encoded so far
+    uint64_t n_bytes;     // bytes of the frames encoded so far
+
+    AudioEncoder(int channels, int fs, int format = AUDIO_CODEC_INT16, int frame_size = AUDIO_CODEC_FRAME_SIZE,
+        float scale = 32768.);
+    ~AudioEncoder();
+
+    // start a new stream
+    void reset();
+
+    // bound on the size of a frame
+    size_t max_frame_bytes();
+
+    // the header with the samples encoded so far, sizeof(AudioCodecHeader) bytes
+    size_t write_header(uint8_t *out, uint32_t data_offset = sizeof(AudioCodecHeader));
+
+    // encode n <= frame_size interleaved samples per channel, returns the size of the frame
+    size_t encode(const int16_t *pcm, int n, uint8_t *out);
+    size_t encode(const float *pcm, int n, uint8_t *out);
+
+  private:
+    int32_t *x;           // [channels][frame_size]
+    int32_t *side;        // [frame_size]
+    uint32_t *u;          // zigzag residuals [frame_size]
+    double *window;       // [frame_size]
+    double *windowed;     // [frame_size]
+    int window_size;      // frame size the window was computed for
+
+    size_t encode_frame(int n, uint8_t *out);
+};
+
+class AudioDecoder
+{
+  public:
+    AudioCodecHeader header;
+    int channels;
+    int frame_size;
+
+    AudioDecoder();
+    ~AudioDecoder();
+
+    // check the header and allocate for its frame size, false if invalid
+    bool read_header(const uint8_t *data, size_t size);
+
+    // decode the frame at data, returns its size or 0 if it is invalid, n is the samples per channel
+    size_t decode(const uint8_t *data, size_t size, int16_t *pcm, int &n);
+    size_t decode(const uint8_t *data, size_t size, float *pcm, int &n);
+
+  private:
+    int32_t *x;           // [channels][frame_size]
+
+    size_t decode_frame(const uint8_t *data, size_t size, int &n, int &mode);
+};
+
+// compress a float32 interleaved .raw file, and back
+bool audio_codec_compress_raw(const std::string &raw_file, const std::string &out_file, int channels, int fs);
+bool audio_codec_decompress_raw(const std::string &in_file, const std::string &raw_file);
+
+#endif // __AUDIO_CODEC_H__
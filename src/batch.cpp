@@ -0,0 +1,277 @@
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "srpphat.h"
+#include "mfcc.h"
+#include "work_stealing.h"
+
+/* the objects of one worker, reset at every chunk */
+struct BatchWorker
+{
+  STFT *stft;
+  SRPPHAT *srpphat;
+  MFCC *mfcc;
+};
+
+static inline size_t align_line(size_t x)
+{
+  return (x + E3E_CACHE_LINE - 1) / E3E_CACHE_LINE * E3E_CACHE_LINE;
+}
+
+BatchAnalyzer::BatchAnalyzer(const BatchConfig &_config, int _n_workers)
+  : config(_config), n_chunks(0), n_frames(0), n_steals(0), seconds(0.)
+{
+  this->n_workers = _n_workers > 0 ? _n_workers : std::max(1u, std::thread::hardware_concurrency());
+}
+
+int BatchAnalyzer::warmup_frames()
+{
+  if (this->config.warmup_frames >= 0)
+    return this->config.warmup_frames;
+  return this->config.srp_n_frames + (this->config.preprocessing != PREPROC_NONE ? BATCH_PREPROC_WARMUP : 0);
+}
+
+bool BatchAnalyzer::run(MappedRecording *rec, const std::string &out_file)
+{
+  const BatchConfig &cfg = this->config;
+
+  if (rec->channels != cfg.channels)
+  {
+    std::cerr << "Error: the recording has " << rec->channels << " channels instead of " << cfg.channels << std::endl;
+    return false;
+  }
+
+  uint64_t t0 = e3e_monotonic_ns();
+
+  this->n_frames = rec->n_samples / cfg.fft_size;
+  this->n_chunks = int((this->n_frames + cfg.chunk_frames - 1) / cfg.chunk_frames);
+
+  // the columns
+  std::vector<BatchColumn> columns;
+  auto add_column = [&](const char *name, int type, int width)
+  {
+    BatchColumn col;
+    memset(&col, 0, sizeof(col));
+    strncpy(col.name, name, BATCH_COLUMN_NAME - 1);
+    col.type = type;
+    col.width = width;
+    columns.push_back(col);
+  };
+
+  add_column("argmax", BATCH_INT32, 1);
+  add_column("power", BATCH_FLOAT32, 1);
+  if (cfg.store_spectra)
+    add_column("spectrum", BATCH_FLOAT32, cfg.n_grid);
+  if (cfg.mfcc_size > 0)
+    add_column("features", BATCH_FLOAT32, cfg.mfcc_size * cfg.channels);
+
+  size_t size = align_line(sizeof(BatchFileHeader) + columns.size() * sizeof(BatchColumn));
+  for (size_t i = 0 ; i < columns.size() ; i++)
+  {
+    columns[i].offset = size;
+    size = align_line(size + this->n_frames * columns[i].width * 4);
+  }
+
+  // the file is mapped and every chunk writes its frames in place
+  int fd = open(out_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    std::cerr << "Error: could not create " << out_file << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  if (ftruncate(fd, size) != 0)
+  {
+    std::cerr << "Error: could not size " << out_file << ": " << strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+
+  uint8_t *out = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (out == MAP_FAILED)
+  {
+    std::cerr << "Error: could not map " << out_file << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  BatchFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BATCH_MAGIC, 4);
+  header.version = BATCH_VERSION;
+  header.n_frames = this->n_frames;
+  header.n_columns = columns.size();
+  header.fft_size = cfg.fft_size;
+  header.channels = cfg.channels;
+  header.n_grid = cfg.n_grid;
+  header.mfcc_size = cfg.mfcc_size;
+  header.fs = cfg.fs;
+  memcpy(out, &header, sizeof(header));
+  memcpy(out + sizeof(header), columns.data(), columns.size() * sizeof(BatchColumn));
+
+  int32_t *argmax = (int32_t *)(out + columns[0].offset);
+  float *power = (float *)(out + columns[1].offset);
+  float *spectra = cfg.store_spectra ? (float *)(out + columns[2].offset) : NULL;
+  float *features = cfg.mfcc_size > 0 ? (float *)(out + columns.back().offset) : NULL;
+  int n_features = cfg.mfcc_size * cfg.channels;
+
+  // the G window must fit in the STFT buffer
+  std::vector<BatchWorker> workers(this->n_workers);
+  for (int w = 0 ; w < this->n_workers ; w++)
+  {
+    workers[w].stft = new STFT(cfg.fft_size, cfg.srp_n_frames + 1, cfg.channels);
+    workers[w].stft->set_preprocessing(cfg.preprocessing, cfg.preproc_coef);
+    workers[w].srpphat = new SRPPHAT(workers[w].stft, cfg.config_file, cfg.k_min, cfg.k_len, cfg.n_grid,
+        cfg.srp_n_frames, cfg.fs, cfg.c, cfg.dim);
+    workers[w].mfcc = cfg.mfcc_size > 0 ? new MFCC(cfg.mfcc_size, cfg.fft_size, int(cfg.fs), cfg.fl, cfg.fh) : NULL;
+  }
+
+  int warmup = this->warmup_frames();
+  WorkStealingPool pool(this->n_workers);
+
+  pool.parallel_for(this->n_chunks, [&](int chunk, int w)
+      {
+        BatchWorker &wk = workers[w];
+        uint64_t f0 = uint64_t(chunk) * cfg.chunk_frames;
+        uint64_t f1 = std::min(this->n_frames, f0 + cfg.chunk_frames);
+        uint64_t start = f0 > uint64_t(warmup) ? f0 - warmup : 0;
+
+        wk.stft->set_preprocessing(cfg.preprocessing, cfg.preproc_coef);
+        wk.stft->reset();
+        wk.srpphat->reset();
+
+        for (uint64_t f = start ; f < f1 ; f++)
+        {
+          const void *pcm = rec->block_at(f * cfg.fft_size, cfg.fft_size);
+          if (rec->format == RECORDING_INT16)
+            wk.stft->ingest((const int16_t *)pcm);
+          else
+            wk.stft->ingest((const float *)pcm);
+          wk.stft->transform();
+
+          if (f < f0)
+          {
+            wk.srpphat->update(wk.stft->frame_count - 1);
+            continue;
+          }
+
+          int a = wk.srpphat->process();
+          argmax[f] = a;
+          power[f] = wk.srpphat->spatial_spectrum[a];
+          if (spectra != NULL)
+            memcpy(spectra + f * cfg.n_grid, wk.srpphat->spatial_spectrum, sizeof(float) * cfg.n_grid);
+          if (features != NULL)
+            wk.mfcc->transform_stft(wk.stft, 0, features + f * n_features);
+        }
+      });
+
+  munmap(out, size);
+
+  for (int w = 0 ; w < this->n_workers ; w++)
+  {
+    delete workers[w].mfcc;
+    delete workers[w].srpphat;
+    delete workers[w].stft;
+  }
+
+  this->n_steals = pool.n_steals;
+  this->seconds = double(e3e_monotonic_ns() - t0) * 1e-9;
+
+  return true;
+}
+
+BatchResults::BatchResults() : map(NULL), map_size(0)
+{
+  memset(&this->header, 0, sizeof(this->header));
+}
+
+BatchResults::~BatchResults()
+{
+  this->unload();
+}
+
+bool BatchResults::load(const std::string &path)
+{
+  this->unload();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Error: could not open " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(BatchFileHeader))
+  {
+    std::cerr << "Error: " << path << " is too short for a batch file." << std::endl;
+    close(fd);
+    return false;
+  }
+
+  void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED)
+  {
+    std::cerr << "Error: could not map " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->map = (const uint8_t *)m;
+  this->map_size = st.st_size;
+  memcpy(&this->header, this->map, sizeof(this->header));
+
+  bool valid = memcmp(this->header.magic, BATCH_MAGIC, 4) == 0 && this->header.version == BATCH_VERSION
+    && sizeof(BatchFileHeader) + this->header.n_columns * sizeof(BatchColumn) <= this->map_size;
+
+  for (uint32_t i = 0 ; valid && i < this->header.n_columns ; i++)
+  {
+    BatchColumn col;
+    memcpy(&col, this->map + sizeof(BatchFileHeader) + i * sizeof(BatchColumn), sizeof(col));
+    valid = col.offset + this->header.n_frames * col.width * 4 <= this->map_size;
+  }
+
+  if (!valid)
+  {
+    std::cerr << "Error: " << path << " is not a valid batch file." << std::endl;
+    this->unload();
+    return false;
+  }
+
+  return true;
+}
+
+void BatchResults::unload()
+{
+  if (this->map != NULL)
+    munmap((void *)this->map, this->map_size);
+  this->map = NULL;
+  this->map_size = 0;
+}
+
+const void *BatchResults::column(const std::string &name, int *width)
+{
+  for (uint32_t i = 0 ; this->map != NULL && i < this->header.n_columns ; i++)
+  {
+    BatchColumn col;
+    memcpy(&col, this->map + sizeof(BatchFileHeader) + i * sizeof(BatchColumn), sizeof(col));
+    if (strncmp(col.name, name.c_str(), BATCH_COLUMN_NAME) == 0)
+    {
+      if (width != NULL)
+        *width = col.width;
+      return this->map + col.offset;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,145 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+/*
+ * Offline analysis of long recordings on all the cores.
+ *
+ * The recording is split in chunks of chunk_frames frames that are
+ * processed in parallel by a WorkStealingPool, each worker with its own
+ * STFT, SRPPHAT and MFCC. A chunk starts warmup_frames frames earlier
+ * and the results of these frames are dropped: with at least the
+ * srp_n_frames of the G window the DOA of every frame is the one of a
+ * single pass over the whole recording (up to the rounding of the sliding
+ * sum), the extra frames let the ingest filters settle when there is
+ * preprocessing.
+ *
+ * The results go to a columnar file sized beforehand and mapped, every
+ * chunk writes its frames in place so there is nothing to merge:
+ *
+ *   BatchFileHeader, BatchColumn[n_columns], then the columns, each
+ *   contiguous, aligned on a cache line, with `width` values per frame:
+ *
+ *     "argmax"    int32    1
+ *     "power"     float32  1                   spectrum at argmax
+ *     "spectrum"  float32  n_grid              if store_spectra
+ *     "features"  float32  mfcc_size x channels  if mfcc_size > 0,
+ *                                                [m * channels + c]
+ *
+ * BatchResults maps such a file back.
+ *
+ *   BatchConfig config;
+ *   config.n_grid = 360;
+ *   BatchAnalyzer analyzer(config);
+ *   MappedRecording rec;
+ *   rec.open("archive.raw");
+ *   analyzer.run(&rec, "archive.e3eb");
+ */
+
+#include <string>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "stft.h"
+#include "recording.h"
+
+#define BATCH_MAGIC "E3EB"
+#define BATCH_VERSION 1
+#define BATCH_COLUMN_NAME 16
+
+// frames for the ingest filters to settle
+#define BATCH_PREPROC_WARMUP 16
+
+enum batch_column_type
+{
+  BATCH_INT32 = 0,
+  BATCH_FLOAT32
+};
+
+struct BatchConfig
+{
+  std::string config_file = "./CONFIG";
+  int fft_size = 128;
+  int channels = 8;
+  float fs = 16000.;
+  float c = 343.;
+
+  // SRP-PHAT
+  int k_min = 1;
+  int k_len = 50;
+  int n_grid = 360;
+  int srp_n_frames = 8;
+  int dim = 2;
+  bool store_spectra = true;
+
+  // MFCC of all the channels, none if mfcc_size is 0
+  int mfcc_size = 13;
+  float fl = 0.;
+  float fh = 0.5;
+
+  int preprocessing = PREPROC_NONE;
+  float preproc_coef = 0.;
+
+  int chunk_frames = 2048;
+  int warmup_frames = -1;    // -1 for srp_n_frames, plus BATCH_PREPROC_WARMUP with preprocessing
+};
+
+struct BatchFileHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t n_frames;
+  uint32_t n_columns;
+  uint32_t fft_size;
+  uint32_t channels;
+  uint32_t n_grid;
+  uint32_t mfcc_size;
+  float fs;
+};
+
+struct BatchColumn
+{
+  char name[BATCH_COLUMN_NAME];
+  uint32_t type;
+  uint32_t width;     // values per frame
+  uint64_t offset;    // from the start of the file
+};
+
+class BatchAnalyzer
+{
+  public:
+    BatchConfig config;
+    int n_workers;
+
+    // statistics of the last run
+    int n_chunks;
+    uint64_t n_frames;
+    uint64_t n_steals;
+    double seconds;
+
+    // 0 workers for one per core
+    BatchAnalyzer(const BatchConfig &config, int n_workers = 0);
+
+    // analyze every whole frame of the recording into out_file
+    bool run(MappedRecording *recording, const std::string &out_file);
+
+    int warmup_frames();
+};
+
+class BatchResults
+{
+  public:
+    BatchFileHeader header;
+    const uint8_t *map;
+    size_t map_size;
+
+    BatchResults();
+    ~BatchResults();
+
+    bool load(const std::string &path);
+    void unload();
+
+    // the values of a column, NULL if the file does not have it
+    const void *column(const std::string &name, int *width = NULL);
+};
+
+#endif // __BATCH_H__
@@ -0,0 +1,298 @@
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+#include "bench.h"
+#include "srpphat.h"
+#include "mfcc.h"
+#include "scene.h"
+
+const char *bench_stage_name(int stage)
+{
+  switch (stage)
+  {
+    case BENCH_INGEST:
+      return "ingest";
+    case BENCH_STFT:
+      return "stft";
+    case BENCH_SRP_UPDATE:
+      return "srp_update";
+    case BENCH_SRP_SEARCH:
+      return "srp_search";
+    case BENCH_MFCC:
+      return "mfcc";
+    case BENCH_PIPELINE:
+      return "pipeline";
+    default:
+      return "unknown";
+  }
+}
+
+const char *bench_lut_layout_name(int lut_layout)
+{
+  switch (lut_layout)
+  {
+    case SRP_LUT_BIN_MAJOR:
+      return "bin_major";
+    case SRP_LUT_GRID_MAJOR:
+      return "grid_major";
+    case SRP_LUT_FREE:
+      return "lut_free";
+    default:
+      return "unknown";
+  }
+}
+
+void BenchStats::clear()
+{
+  this->ns.clear();
+  for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+    this->events[e] = 0;
+}
+
+void BenchStats::add_events(const PerfSample &a, const PerfSample &b)
+{
+  for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+    this->events[e] += b.values[e] - a.values[e];
+}
+
+double BenchStats::mean_us() const
+{
+  if (this->ns.empty())
+    return 0.;
+
+  double sum = 0.;
+  for (size_t i = 0 ; i < this->ns.size() ; i++)
+    sum += this->ns[i];
+  return sum / this->ns.size() * 1e-3;
+}
+
+double BenchStats::max_us() const
+{
+  if (this->ns.empty())
+    return 0.;
+  return *std::max_element(this->ns.begin(), this->ns.end()) * 1e-3;
+}
+
+double BenchStats::percentile_us(double p) const
+{
+  if (this->ns.empty())
+    return 0.;
+
+  std::vector<uint64_t> sorted(this->ns);
+  std::sort(sorted.begin(), sorted.end());
+
+  long rank = long(ceil(p / 100. * sorted.size()));
+  rank = std::min(long(sorted.size()), std::max(1l, rank));
+  return sorted[rank - 1] * 1e-3;
+}
+
+BenchRun::BenchRun(const BenchParams &_params) : params(_params), n_pairs(0), perf_events(0), perf_running(0.)
+{
+  int n_bins = this->params.fft_size / 2 + 1;
+  this->params.k_len = std::max(1, std::min(this->params.k_len, n_bins - this->params.k_min));
+  this->frame_us = 1e6 * this->params.fft_size / this->params.fs;
+}
+
+bool BenchRun::run(int frames, int warmup)
+{
+  const BenchParams &p = this->params;
+
+  STFT stft(p.fft_size, p.srp_n_frames + 1, p.channels, p.backend, p.layout);
+  SRPPHAT srpphat(&stft, p.config_file, p.k_min, p.k_len, p.n_grid, p.srp_n_frames, float(p.fs), 343., p.dim);
+  srpphat.set_search_quality(1, p.pair_step, 1);
+  srpphat.set_lut_layout(p.lut_layout);
+  this->n_pairs = (srpphat.n_pairs + p.pair_step - 1) / p.pair_step;
+
+  MFCC *mfcc = p.mfcc_size > 0 ? new MFCC(p.mfcc_size, p.fft_size, p.fs, 0., 0.5, p.backend) : NULL;
+  std::vector<float> features(std::max(1, p.mfcc_size * p.channels));
+
+  // a source moving around the array, generated before the timings
+  int n_input = std::min(frames + warmup, BENCH_MAX_INPUT_FRAMES);
+  std::vector<float> input(size_t(n_input) * p.fft_size * p.channels);
+  SceneGenerator scene(p.config_file, p.channels, p.fs);
+  SceneSource source;
+  source.azimuth_speed = 1.;
+  source.cutoff = 0.5;
+  scene.add_source(source);
+  scene.set_snr(20.);
+  scene.generate(input.data(), n_input * p.fft_size);
+
+  for (int s = 0 ; s < BENCH_N_STAGES ; s++)
+  {
+    this->stages[s].clear();
+    this->stages[s].ns.reserve(frames);
+  }
+
+  // the counters of this thread, the stages run in it
+  PerfCounters perf;
+  this->perf_events = 0;
+  this->perf_running = 0.;
+  if (p.perf && perf.open())
+    for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+      if (perf.has(e))
+        this->perf_events |= 1u << e;
+
+  uint64_t t[BENCH_N_STAGES];
+  PerfSample c[BENCH_N_STAGES];
+  auto mark = [&](int i)
+  {
+    t[i] = e3e_monotonic_ns();
+    if (this->perf_events != 0)
+      perf.read(&c[i]);
+  };
+
+  for (int f = 0 ; f < warmup + frames ; f++)
+  {
+    const float *pcm = &input[size_t(f % n_input) * p.fft_size * p.channels];
+
+    mark(0);
+    stft.ingest(pcm);
+    mark(1);
+    stft.transform();
+    mark(2);
+    srpphat.update(stft.frame_count - 1);
+    mark(3);
+    srpphat.search();
+    mark(4);
+    if (mfcc != NULL)
+      mfcc->transform_stft(&stft, 0, features.data());
+    mark(5);
+
+    if (f < warmup)
+      continue;
+
+    for (int s = 0 ; s < BENCH_PIPELINE ; s++)
+    {
+      this->stages[s].add(t[s + 1] - t[s]);
+      if (this->perf_events != 0)
+        this->stages[s].add_events(c[s], c[s + 1]);
+    }
+    this->stages[BENCH_PIPELINE].add(t[5] - t[0]);
+    if (this->perf_events != 0)
+      this->stages[BENCH_PIPELINE].add_events(c[0], c[5]);
+  }
+
+  PerfSample end;
+  if (this->perf_events != 0 && perf.read(&end) && end.time_enabled > 0)
+    this->perf_running = double(end.time_running) / end.time_enabled;
+
+  delete mfcc;
+
+  return true;
+}
+
+double BenchRun::event_per_frame(int stage, int event) const
+{
+  const BenchStats &st = this->stages[stage];
+  if (!(this->perf_events & (1u << event)) || st.ns.empty() || this->perf_running <= 0.)
+    return -1.;
+
+  // the group is counted or not as a whole, the frames it missed count like the others
+  return double(st.events[event]) / st.ns.size() / this->perf_running;
+}
+
+void bench_csv_header(std::ostream &out, bool perf)
+{
+  out << "stage,fft_size,channels,n_grid,dim,k_len,n_pairs,layout,lut,backend,frames,";
+  out << "mean_us,p50_us,p99_us,max_us,frames_per_s,rtf";
+  if (perf)
+    out << ",cpu_us,cycles,instructions,ipc,l1d_misses,llc_misses,branch_misses";
+  out << std::endl;
+}
+
+void bench_csv(std::ostream &out, const BenchRun &run)
+{
+  const BenchParams &p = run.params;
+
+  for (int s = 0 ; s < BENCH_N_STAGES ; s++)
+  {
+    const BenchStats &st = run.stages[s];
+    if (s == BENCH_MFCC && p.mfcc_size == 0)
+      continue;
+
+    double mean = st.mean_us();
+    out << bench_stage_name(s) << "," << p.fft_size << "," << p.channels << "," << p.n_grid << ",";
+    out << p.dim << "," << p.k_len << "," << run.n_pairs << ",";
+    out << (p.layout == STFT_LAYOUT_PLANAR ? "planar" : "interleaved") << "," << bench_lut_layout_name(p.lut_layout) << ",";
+    out << fft_backend_name(p.backend) << ",";
+    out << st.ns.size() << "," << mean << "," << st.percentile_us(50.) << "," << st.percentile_us(99.) << ",";
+    out << st.max_us() << "," << (mean > 0. ? 1e6 / mean : 0.) << "," << mean / run.frame_us;
+
+    if (p.perf)
+    {
+      // empty for the events that are not counted
+      double v[PERF_N_EVENTS];
+      for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+        v[e] = run.event_per_frame(s, e);
+
+      auto field = [&](double x) { out << ","; if (x >= 0.) out << x; };
+      field(v[PERF_EV_TASK_CLOCK] >= 0. ? v[PERF_EV_TASK_CLOCK] * 1e-3 : -1.);
+      field(v[PERF_EV_CYCLES]);
+      field(v[PERF_EV_INSTRUCTIONS]);
+      field(v[PERF_EV_CYCLES] > 0. && v[PERF_EV_INSTRUCTIONS] >= 0. ? v[PERF_EV_INSTRUCTIONS] / v[PERF_EV_CYCLES] : -1.);
+      field(v[PERF_EV_L1D_MISSES]);
+      field(v[PERF_EV_LLC_MISSES]);
+      field(v[PERF_EV_BRANCH_MISSES]);
+    }
+    out << std::endl;
+  }
+}
+
+bool bench_select_layout(BenchParams &params, int frames, int warmup, std::ostream *log)
+{
+  double best = -1.;
+  int best_layout = params.layout;
+  int best_lut = params.lut_layout;
+
+  for (int layout : { STFT_LAYOUT_INTERLEAVED, STFT_LAYOUT_PLANAR })
+    for (int lut : { SRP_LUT_BIN_MAJOR, SRP_LUT_GRID_MAJOR, SRP_LUT_FREE })
+    {
+      BenchParams p = params;
+      p.layout = layout;
+      p.lut_layout = lut;
+
+      BenchRun run(p);
+      if (!run.run(frames, warmup))
+        return false;
+      if (log != NULL)
+        bench_csv(*log, run);
+
+      // cycles do not depend on the clock frequency of the moment
+      double score = run.event_per_frame(BENCH_PIPELINE, PERF_EV_CYCLES);
+      if (score < 0.)
+        score = run.stages[BENCH_PIPELINE].mean_us();
+
+      if (best < 0. || score < best)
+      {
+        best = score;
+        best_layout = layout;
+        best_lut = lut;
+      }
+    }
+
+  params.layout = best_layout;
+  params.lut_layout = best_lut;
+
+  return true;
+}
+
+bool bench_write_array_config(const std::string &path, int channels, float radius)
+{
+  std::ofstream fout(path);
+  if (!fout)
+  {
+    std::cerr << "Error: could not create " << path << std::endl;
+    return false;
+  }
+
+  fout << "#CHANNEL X_MICS Y_MICS Z_MICS" << std::endl;
+  for (int ch = 0 ; ch < channels ; ch++)
+  {
+    double a = -2. * M_PI * ch / channels;
+    fout << ch << " " << radius * cos(a) << " " << radius * sin(a) << " 0.0" << std::endl;
+  }
+
+  return bool(fout);
+}
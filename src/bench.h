@@ -0,0 +1,145 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+/*
+ * Benchmark of the processing stages, one frame at a time.
+ *
+ * A BenchRun builds the STFT, SRPPHAT and MFCC of a BenchParams, feeds
+ * them with frames of a synthetic scene (see scene.h) generated
+ * beforehand, and times every stage of every frame with the monotonic
+ * clock after some warm-up frames:
+ *
+ *   ingest       STFT::ingest of float32 interleaved samples
+ *   stft         STFT::transform
+ *   srp_update   SRPPHAT::update
+ *   srp_search   SRPPHAT::search
+ *   mfcc         MFCC::transform_stft, all the channels
+ *   pipeline     all of the above
+ *
+ * The results are CSV rows, one per stage, with the mean, p50, p99 and
+ * maximum latency, the frames per second and the real-time factor (the
+ * mean time over the duration of a frame, below 1 keeps up):
+ *
+ *   BenchParams p;
+ *   p.n_grid = 720;
+ *   BenchRun run(p);
+ *   run.run(1000, 100);
+ *   bench_csv_header(std::cout);
+ *   bench_csv(std::cout, run);
+ *
+ * With p.perf the hardware counters of perf_counters.h are also read
+ * around every stage, and the rows get the CPU time, cycles,
+ * instructions, IPC, cache and branch misses per frame (empty for the
+ * events the CPU does not count). The timings then include a read of
+ * the counters, a system call, per stage.
+ *
+ * bench_select_layout runs the pipeline with every STFT layout and SRP
+ * LUT layout and keeps the fastest, in cycles when they are counted.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "stft.h"
+#include "srpphat.h"
+#include "perf_counters.h"
+
+#define BENCH_MATRIX_RADIUS 0.0525   // m
+#define BENCH_MAX_INPUT_FRAMES 256   // distinct input frames, used in a loop
+
+enum bench_stage
+{
+  BENCH_INGEST = 0,
+  BENCH_STFT,
+  BENCH_SRP_UPDATE,
+  BENCH_SRP_SEARCH,
+  BENCH_MFCC,
+  BENCH_PIPELINE,
+  BENCH_N_STAGES
+};
+
+const char *bench_stage_name(int stage);
+
+struct BenchParams
+{
+  std::string config_file = "./CONFIG";
+  int fft_size = 128;
+  int channels = 8;
+  int fs = 16000;
+
+  int n_grid = 360;
+  int dim = 2;
+  int k_min = 1;
+  int k_len = 50;       // reduced to the bins of fft_size
+  int pair_step = 1;    // the search uses every pair_step-th pair
+  int srp_n_frames = 8;
+
+  int mfcc_size = 13;   // 0 for no MFCC
+
+  int backend = FFT_BACKEND_FFTW;
+  int layout = STFT_LAYOUT_INTERLEAVED;
+  int lut_layout = SRP_LUT_BIN_MAJOR;
+
+  bool perf = false;    // count the hardware events of every stage
+};
+
+/* latencies and hardware events of one stage */
+class BenchStats
+{
+  public:
+    std::vector<uint64_t> ns;
+    uint64_t events[PERF_N_EVENTS];   // totals over the frames
+
+    BenchStats() { this->clear(); }
+
+    void clear();
+    void add(uint64_t t) { this->ns.push_back(t); }
+
+    // the events counted from a to b
+    void add_events(const PerfSample &a, const PerfSample &b);
+
+    double mean_us() const;
+    double max_us() const;
+
+    // p in [0, 100], nearest rank
+    double percentile_us(double p) const;
+};
+
+class BenchRun
+{
+  public:
+    BenchParams params;
+    int n_pairs;          // pairs searched
+    double frame_us;      // duration of a frame of audio
+    BenchStats stages[BENCH_N_STAGES];
+
+    uint32_t perf_events; // bit e for the events counted, 0 without p.perf
+    double perf_running;  // fraction of the time the counters ran, below 1 when multiplexed
+
+    BenchRun(const BenchParams &params);
+
+    // time frames frames after warmup frames, false if the stages cannot be built
+    bool run(int frames, int warmup);
+
+    // mean of an event per frame, scaled for the multiplexing, -1 if not counted
+    double event_per_frame(int stage, int event) const;
+};
+
+const char *bench_lut_layout_name(int lut_layout);
+
+// perf for the columns of the hardware events
+void bench_csv_header(std::ostream &out, bool perf = false);
+
+// one row per stage
+void bench_csv(std::ostream &out, const BenchRun &run);
+
+// set params.layout and params.lut_layout to the fastest pipeline, the rows of every run to log
+bool bench_select_layout(BenchParams &params, int frames, int warmup, std::ostream *log = NULL);
+
+// a CONFIG file of a uniform circular array, for other channel counts than the MATRIX Creator
+bool bench_write_array_config(const std::string &path, int channels, float radius = BENCH_MATRIX_RADIUS);
+
+#endif // __BENCH_H__
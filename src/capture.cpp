@@ -0,0 +1,203 @@
+
+#include <iostream>
+#include <unistd.h>
+
+#include "capture.h"
+#include "history.h"
+#include "instrument.h"
+
+CaptureRing::CaptureRing(int _channels, int _block_size, int _n_slots)
+  : channels(_channels), block_size(_block_size), n_slots(_n_slots)
+{
+  this->slot_size = _channels * _block_size;
+  this->slots = (float *)e3e_aligned_malloc(sizeof(float) * this->slot_size * _n_slots);
+  this->own_slots = true;
+
+  for (int i = 0 ; i < this->slot_size * _n_slots ; i++)
+    this->slots[i] = 0.;
+
+  this->info = new CaptureBlockInfo[_n_slots];
+
+  this->head = 0;
+  this->tail = 0;
+  this->overruns = 0;
+  this->underruns = 0;
+  this->sequence = 0;
+}
+
+/* Use the input frames of the STFT as slots */
+CaptureRing::CaptureRing(STFT *stft)
+  : channels(stft->channels), block_size(stft->fft_size), n_slots(stft->n_frames)
+{
+  this->slot_size = stft->n_samples_per_in_frame;
+  this->slots = stft->circ_in_buffer;
+  this->own_slots = false;
+
+  this->info = new CaptureBlockInfo[this->n_slots];
+
+  // block i must land in frame i % n_frames, where the STFT is now
+  this->head = stft->current_frame;
+  this->tail = stft->current_frame;
+  this->overruns = 0;
+  this->underruns = 0;
+  this->sequence = 0;
+}
+
+CaptureRing::~CaptureRing()
+{
+  if (this->own_slots)
+    free(this->slots);
+  delete[] this->info;
+}
+
+float *CaptureRing::write_slot()
+{
+  uint64_t h = this->head.load(std::memory_order_relaxed);
+  uint64_t t = this->tail.load(std::memory_order_acquire);
+
+  if (h - t >= (uint64_t)this->n_slots)
+    return NULL;
+
+  return this->slots + (h % this->n_slots) * this->slot_size;
+}
+
+void CaptureRing::publish(uint64_t timestamp_ns)
+{
+  uint64_t h = this->head.load(std::memory_order_relaxed);
+
+  this->info[h % this->n_slots].sequence = this->sequence++;
+  this->info[h % this->n_slots].timestamp_ns = timestamp_ns;
+
+  this->head.store(h + 1, std::memory_order_release);
+}
+
+/* a block was read but there was no room for it */
+void CaptureRing::drop()
+{
+  this->sequence++;
+  this->overruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+float *CaptureRing::read_slot(CaptureBlockInfo *block_info)
+{
+  uint64_t t = this->tail.load(std::memory_order_relaxed);
+  uint64_t h = this->head.load(std::memory_order_acquire);
+
+  if (t == h)
+    return NULL;
+
+  if (block_info != NULL)
+    *block_info = this->info[t % this->n_slots];
+
+  return this->slots + (t % this->n_slots) * this->slot_size;
+}
+
+/* Wait at most timeout_us for a block, an underrun is counted on timeout */
+float *CaptureRing::wait_read_slot(CaptureBlockInfo *block_info, int timeout_us)
+{
+  float *slot = this->read_slot(block_info);
+  if (slot != NULL)
+    return slot;
+
+  uint64_t deadline = e3e_monotonic_ns() + uint64_t(timeout_us) * 1000;
+
+  while (slot == NULL)
+  {
+    if (e3e_monotonic_ns() > deadline)
+    {
+      this->underruns.fetch_add(1, std::memory_order_relaxed);
+      E3E_COUNT(INSTR_UNDERRUNS, 1);
+      return NULL;
+    }
+
+    // a fraction of a block at 16 kHz
+    usleep(100);
+    slot = this->read_slot(block_info);
+  }
+
+  return slot;
+}
+
+void CaptureRing::release()
+{
+  uint64_t t = this->tail.load(std::memory_order_relaxed);
+  this->tail.store(t + 1, std::memory_order_release);
+}
+
+int CaptureRing::available()
+{
+  return int(this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire));
+}
+
+CaptureThread::CaptureThread(CaptureRing *_ring, std::function<bool(float *block)> _read_block)
+  : ring(_ring), read_block(_read_block)
+{
+  this->running = false;
+  this->drop_buffer = new float[_ring->slot_size];
+  this->history = NULL;
+  this->wait_for_room = false;
+}
+
+CaptureThread::~CaptureThread()
+{
+  this->stop();
+  delete[] this->drop_buffer;
+}
+
+void CaptureThread::set_history(HistoryRing *_history)
+{
+  this->history = _history;
+}
+
+void CaptureThread::start()
+{
+  this->running = true;
+  this->thread = std::thread(&CaptureThread::run, this);
+}
+
+void CaptureThread::stop()
+{
+  this->running = false;
+  if (this->thread.joinable())
+    this->thread.join();
+}
+
+void CaptureThread::run()
+{
+  while (this->running)
+  {
+    float *slot = this->ring->write_slot();
+
+    while (slot == NULL && this->wait_for_room && this->running)
+    {
+      usleep(100);
+      slot = this->ring->write_slot();
+    }
+
+    // the device must still be read to keep the timing when the ring is full
+    bool ok;
+    {
+      E3E_PROBE(INSTR_CAPTURE_READ);
+      ok = this->read_block(slot != NULL ? slot : this->drop_buffer);
+    }
+    uint64_t now = e3e_monotonic_ns();
+
+    if (!ok)
+      break;
+
+    // the history also keeps the blocks the processing has no room for
+    if (this->history != NULL)
+      this->history->push(slot != NULL ? slot : this->drop_buffer, this->ring->sequence, now);
+
+    if (slot != NULL)
+      this->ring->publish(now);
+    else
+    {
+      this->ring->drop();
+      E3E_COUNT(INSTR_OVERRUNS, 1);
+    }
+    E3E_COUNT(INSTR_BLOCKS, 1);
+  }
+
+  this->running = false;
+}
@@ -0,0 +1,126 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+/*
+ * Capture subsystem: a dedicated reader thread fills a lock-free
+ * single-producer/single-consumer ring of multichannel blocks that the
+ * processing thread consumes. A processing spike then only fills the
+ * ring instead of delaying the next read of the microphones.
+ *
+ * The ring can use the input frames of an STFT as its slots. The
+ * reader writes the samples directly where the transform reads them
+ * (zero copy), and the consumer simply calls stft->transform() on the
+ * block it acquired, since block i lives in frame i % n_frames:
+ *
+ *   CaptureRing ring(stft);
+ *   CaptureThread reader(&ring, [&](float *block) { ...; return true; });
+ *   reader.start();
+ *   while (ring.wait_read_slot(&info, timeout_us) != NULL)
+ *   {
+ *     stft->transform();
+ *     ...
+ *     ring.release();
+ *   }
+ *
+ * In that case the past input frames of the STFT (get_td_sample) are
+ * overwritten by the reader as soon as they are released.
+ *
+ * Every block has a sequence number and the monotonic time at which its
+ * read completed. When the ring is full the block is dropped and counted
+ * as an overrun (the sequence numbers then have a gap). A consumer that
+ * waits longer than its timeout for a block counts an underrun.
+ *
+ * The reader can also copy every block, dropped or not, to a HistoryRing
+ * (see history.h) that keeps the raw audio of the last seconds.
+ *
+ * A source without a clock of its own, e.g. a recording replayed as fast
+ * as possible (see mic_array.h), sets wait_for_room: the reader then waits
+ * for the consumer when the ring is full instead of dropping blocks.
+ */
+
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "stft.h"
+
+class HistoryRing;
+
+struct CaptureBlockInfo
+{
+  uint64_t sequence;      // number of the block since the start, including drops
+  uint64_t timestamp_ns;  // monotonic time when the block was read
+};
+
+class CaptureRing
+{
+  public:
+    int channels;
+    int block_size;
+    int n_slots;
+    int slot_size;
+
+    float *slots;
+    bool own_slots;
+    CaptureBlockInfo *info;
+
+    // producer and consumer indices on separate cache lines
+    std::atomic<uint64_t> head;
+    char pad_head[E3E_CACHE_LINE];
+    std::atomic<uint64_t> tail;
+    char pad_tail[E3E_CACHE_LINE];
+
+    std::atomic<uint64_t> overruns;
+    std::atomic<uint64_t> underruns;
+    uint64_t sequence;  // producer side
+
+    CaptureRing(int channels, int block_size, int n_slots);
+    CaptureRing(STFT *stft);
+    ~CaptureRing();
+
+    // producer: the slot to fill, or NULL if the ring is full
+    float *write_slot();
+    void publish(uint64_t timestamp_ns);
+    void drop();
+
+    // consumer: the oldest block, or NULL if the ring is empty
+    float *read_slot(CaptureBlockInfo *block_info = NULL);
+    float *wait_read_slot(CaptureBlockInfo *block_info, int timeout_us);
+    void release();
+
+    int available();
+};
+
+class CaptureThread
+{
+  public:
+    CaptureRing *ring;
+
+    // blocking read of one block of block_size x channels interleaved samples,
+    // returns false to stop the capture
+    std::function<bool(float *block)> read_block;
+
+    std::thread thread;
+    std::atomic<bool> running;
+    float *drop_buffer;
+
+    // the raw audio history, NULL for none
+    HistoryRing *history;
+
+    // wait for a free slot instead of dropping the block, set before start()
+    bool wait_for_room;
+
+    CaptureThread(CaptureRing *ring, std::function<bool(float *block)> read_block);
+    ~CaptureThread();
+
+    // set before start()
+    void set_history(HistoryRing *_history);
+
+    void start();
+    void stop();
+    void run();
+};
+
+#endif // __CAPTURE_H__
@@ -0,0 +1,449 @@
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "classifier.h"
+#include "fastmath.h"
+
+/* sum a[i] b[i] */
+static inline float dot(const float *a, const float *b, int n)
+{
+  int i = 0;
+  float sum = 0.;
+
+#if defined(FASTMATH_AVX2)
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for ( ; i + 16 <= n ; i += 16)
+  {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  for ( ; i + 8 <= n ; i += 8)
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+  s = _mm_add_ps(s, _mm_add_ps(_mm256_castps256_ps128(acc1), _mm256_extractf128_ps(acc1, 1)));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  sum = _mm_cvtss_f32(s);
+#elif defined(FASTMATH_NEON)
+  float32x4_t acc = vdupq_n_f32(0.f);
+  for ( ; i + 4 <= n ; i += 4)
+    acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+  sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1) + vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#endif
+
+  for ( ; i < n ; i++)
+    sum += a[i] * b[i];
+
+  return sum;
+}
+
+/* sum (x[i] - mean[i])^2 inv_var[i] */
+static inline float weighted_distance(const float *x, const float *mean, const float *inv_var, int n)
+{
+  int i = 0;
+  float sum = 0.;
+
+#if defined(FASTMATH_AVX2)
+  __m256 acc = _mm256_setzero_ps();
+  for ( ; i + 8 <= n ; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(mean + i));
+    acc = _mm256_fmadd_ps(_mm256_mul_ps(d, d), _mm256_loadu_ps(inv_var + i), acc);
+  }
+
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  sum = _mm_cvtss_f32(s);
+#elif defined(FASTMATH_NEON)
+  float32x4_t acc = vdupq_n_f32(0.f);
+  for ( ; i + 4 <= n ; i += 4)
+  {
+    float32x4_t d = vsubq_f32(vld1q_f32(x + i), vld1q_f32(mean + i));
+    acc = vmlaq_f32(acc, vmulq_f32(d, d), vld1q_f32(inv_var + i));
+  }
+  sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1) + vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#endif
+
+  for ( ; i < n ; i++)
+  {
+    float d = x[i] - mean[i];
+    sum += d * d * inv_var[i];
+  }
+
+  return sum;
+}
+
+static void activate(int activation, float *x, int n)
+{
+  switch (activation)
+  {
+    case CLASSIFIER_RELU:
+      for (int i = 0 ; i < n ; i++)
+        x[i] = std::max(x[i], 0.f);
+      break;
+
+    case CLASSIFIER_TANH:
+      for (int i = 0 ; i < n ; i++)
+        x[i] = tanhf(x[i]);
+      break;
+
+    case CLASSIFIER_SIGMOID:
+      for (int i = 0 ; i < n ; i++)
+        x[i] = 1.f / (1.f + fast_exp(-x[i]));
+      break;
+
+    case CLASSIFIER_SOFTMAX:
+      {
+        float max = x[0];
+        for (int i = 1 ; i < n ; i++)
+          max = std::max(max, x[i]);
+        for (int i = 0 ; i < n ; i++)
+          x[i] -= max;
+        fast_exp_array(x, x, n);
+        float sum = 0.;
+        for (int i = 0 ; i < n ; i++)
+          sum += x[i];
+        for (int i = 0 ; i < n ; i++)
+          x[i] /= sum;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+uint64_t classifier_layer_n_params(int type, uint64_t in_dim, uint64_t out_dim, uint64_t kernel, uint64_t n_mix)
+{
+  // the dimensions of a file are 32 bits, the products of three of them fit
+  switch (type)
+  {
+    case CLASSIFIER_DENSE:
+      return out_dim * in_dim + out_dim;
+    case CLASSIFIER_CONV1D:
+      return out_dim * kernel * in_dim + out_dim;
+    case CLASSIFIER_GMM:
+      return out_dim * n_mix * (1 + 2 * in_dim);
+    default:
+      return 0;
+  }
+}
+
+Classifier::Classifier()
+  : input_dim(0), n_classes(0), probabilities(NULL), map(NULL), map_size(0),
+    buf_a(NULL), buf_b(NULL), scores(NULL)
+{
+}
+
+Classifier::~Classifier()
+{
+  this->unload();
+}
+
+void Classifier::unload()
+{
+  for (size_t l = 0 ; l < this->layers.size() ; l++)
+    free(this->layers[l].history);
+  this->layers.clear();
+
+  free(this->buf_a);
+  free(this->buf_b);
+  free(this->scores);
+  this->buf_a = this->buf_b = this->scores = NULL;
+  this->probabilities = NULL;
+
+  if (this->map != NULL)
+    munmap(this->map, this->map_size);
+  this->map = NULL;
+  this->map_size = 0;
+
+  this->input_dim = 0;
+  this->n_classes = 0;
+}
+
+bool Classifier::load(const std::string &path)
+{
+  this->unload();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Error: could not open the model " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ClassifierFileHeader))
+  {
+    std::cerr << "Error: the model " << path << " is too small." << std::endl;
+    close(fd);
+    return false;
+  }
+
+  this->map_size = st.st_size;
+  this->map = mmap(NULL, this->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (this->map == MAP_FAILED)
+  {
+    std::cerr << "Error: could not map the model " << path << ": " << strerror(errno) << std::endl;
+    this->map = NULL;
+    this->map_size = 0;
+    return false;
+  }
+
+  const char *base = (const char *)this->map;
+  const ClassifierFileHeader *header = (const ClassifierFileHeader *)base;
+
+  if (memcmp(header->magic, CLASSIFIER_MAGIC, 4) != 0 || header->version != CLASSIFIER_VERSION)
+  {
+    std::cerr << "Error: " << path << " is not a classifier model of version " << CLASSIFIER_VERSION << "." << std::endl;
+    this->unload();
+    return false;
+  }
+
+  uint64_t headers_end = sizeof(ClassifierFileHeader) + uint64_t(header->n_layers) * sizeof(ClassifierLayerHeader);
+  if (header->n_layers == 0 || headers_end > this->map_size)
+  {
+    std::cerr << "Error: the model " << path << " is truncated." << std::endl;
+    this->unload();
+    return false;
+  }
+
+  const ClassifierLayerHeader *lh = (const ClassifierLayerHeader *)(base + sizeof(ClassifierFileHeader));
+
+  int dim = header->input_dim;
+  int max_dim = dim;
+  int max_scores = 1;
+
+  for (uint32_t l = 0 ; l < header->n_layers ; l++)
+  {
+    // the size in 64 bits from the dimensions of the file, every dimension is
+    // then at most the number of parameters, which the mapping bounds
+    uint64_t n_params = classifier_layer_n_params(lh[l].type, lh[l].in_dim, lh[l].out_dim,
+        std::max(1u, lh[l].kernel), std::max(1u, lh[l].n_mix));
+
+    if (lh[l].in_dim == 0 || lh[l].out_dim == 0 || n_params == 0 || n_params != lh[l].n_params
+        || n_params > this->map_size / sizeof(float) || n_params > uint64_t(INT32_MAX)
+        || uint64_t(lh[l].offset) + sizeof(float) * n_params > this->map_size
+        || lh[l].offset % sizeof(float) != 0 || int(lh[l].in_dim) != dim)
+    {
+      std::cerr << "Error: layer " << l << " of the model " << path << " is not valid." << std::endl;
+      this->unload();
+      return false;
+    }
+
+    ClassifierLayer layer;
+    layer.type = lh[l].type;
+    layer.activation = lh[l].activation;
+    layer.in_dim = lh[l].in_dim;
+    layer.out_dim = lh[l].out_dim;
+    layer.kernel = std::max(1u, lh[l].kernel);
+    layer.n_mix = std::max(1u, lh[l].n_mix);
+
+    const float *params = (const float *)(base + lh[l].offset);
+    layer.weights = layer.bias = NULL;
+    layer.gmm_const = layer.gmm_mean = layer.gmm_inv_var = NULL;
+    layer.history = NULL;
+    layer.n_seen = 0;
+
+    if (layer.type == CLASSIFIER_GMM)
+    {
+      int n = layer.out_dim * layer.n_mix;
+      layer.gmm_const = params;
+      layer.gmm_mean = params + n;
+      layer.gmm_inv_var = params + n + n * layer.in_dim;
+      max_scores = std::max(max_scores, layer.n_mix);
+    }
+    else
+    {
+      layer.weights = params;
+      layer.bias = params + n_params - layer.out_dim;
+    }
+
+    if (layer.type == CLASSIFIER_CONV1D)
+    {
+      layer.history = (float *)e3e_aligned_malloc(sizeof(float) * 2 * layer.kernel * layer.in_dim);
+    }
+
+    this->layers.push_back(layer);
+    dim = layer.out_dim;
+    max_dim = std::max(max_dim, dim);
+  }
+
+  this->input_dim = header->input_dim;
+  this->n_classes = dim;
+
+  // the weights are read for every frame, ask for them now
+  madvise(this->map, this->map_size, MADV_WILLNEED);
+
+  this->buf_a = (float *)e3e_aligned_malloc(sizeof(float) * max_dim);
+  this->buf_b = (float *)e3e_aligned_malloc(sizeof(float) * max_dim);
+  this->scores = (float *)e3e_aligned_malloc(sizeof(float) * max_scores);
+
+  this->reset();
+
+  return true;
+}
+
+void Classifier::reset()
+{
+  for (size_t l = 0 ; l < this->layers.size() ; l++)
+  {
+    ClassifierLayer &layer = this->layers[l];
+    layer.n_seen = 0;
+    if (layer.history != NULL)
+      memset(layer.history, 0, sizeof(float) * 2 * layer.kernel * layer.in_dim);
+  }
+}
+
+void Classifier::run_layer(ClassifierLayer &layer, const float *in, float *out)
+{
+  int D = layer.in_dim;
+
+  switch (layer.type)
+  {
+    case CLASSIFIER_DENSE:
+      for (int o = 0 ; o < layer.out_dim ; o++)
+        out[o] = layer.bias[o] + dot(layer.weights + o * D, in, D);
+      break;
+
+    case CLASSIFIER_CONV1D:
+      {
+        // the frame goes twice in the history, the last kernel frames
+        // from the oldest are then at slot + 1
+        int K = layer.kernel;
+        int slot = layer.n_seen % K;
+        memcpy(layer.history + slot * D, in, sizeof(float) * D);
+        memcpy(layer.history + (slot + K) * D, in, sizeof(float) * D);
+        layer.n_seen++;
+
+        const float *window = layer.history + (slot + 1) * D;
+        for (int o = 0 ; o < layer.out_dim ; o++)
+          out[o] = layer.bias[o] + dot(layer.weights + o * K * D, window, K * D);
+      }
+      break;
+
+    case CLASSIFIER_GMM:
+      for (int c = 0 ; c < layer.out_dim ; c++)
+      {
+        float max = -INFINITY;
+        for (int m = 0 ; m < layer.n_mix ; m++)
+        {
+          int g = c * layer.n_mix + m;
+          this->scores[m] = layer.gmm_const[g]
+            - 0.5f * weighted_distance(in, layer.gmm_mean + g * D, layer.gmm_inv_var + g * D, D);
+          max = std::max(max, this->scores[m]);
+        }
+
+        // log sum exp over the mixtures
+        float sum = 0.;
+        for (int m = 0 ; m < layer.n_mix ; m++)
+          sum += fast_exp(this->scores[m] - max);
+        out[c] = max + fast_log(sum);
+      }
+      break;
+  }
+
+  activate(layer.activation, out, layer.out_dim);
+}
+
+const float *Classifier::process(const float *features)
+{
+  const float *in = features;
+  float *out = this->buf_a;
+
+  for (size_t l = 0 ; l < this->layers.size() ; l++)
+  {
+    this->run_layer(this->layers[l], in, out);
+    in = out;
+    out = (out == this->buf_a) ? this->buf_b : this->buf_a;
+  }
+
+  this->probabilities = const_cast<float *>(in);
+  return in;
+}
+
+int Classifier::argmax()
+{
+  if (this->probabilities == NULL)
+    return -1;
+
+  int best = 0;
+  for (int c = 1 ; c < this->n_classes ; c++)
+    if (this->probabilities[c] > this->probabilities[best])
+      best = c;
+  return best;
+}
+
+bool classifier_write(const std::string &path, int input_dim, const std::vector<ClassifierLayerSpec> &layers)
+{
+  std::ofstream fout(path, std::ofstream::binary | std::ofstream::trunc);
+  if (!fout)
+  {
+    std::cerr << "Error: could not write the model " << path << std::endl;
+    return false;
+  }
+
+  ClassifierFileHeader header;
+  memcpy(header.magic, CLASSIFIER_MAGIC, 4);
+  header.version = CLASSIFIER_VERSION;
+  header.input_dim = input_dim;
+  header.n_layers = layers.size();
+
+  // place the parameters after the headers, every layer on a cache line
+  std::vector<ClassifierLayerHeader> lh(layers.size());
+  size_t offset = sizeof(ClassifierFileHeader) + layers.size() * sizeof(ClassifierLayerHeader);
+
+  for (size_t l = 0 ; l < layers.size() ; l++)
+  {
+    const ClassifierLayerSpec &s = layers[l];
+    offset = (offset + E3E_CACHE_LINE - 1) / E3E_CACHE_LINE * E3E_CACHE_LINE;
+
+    lh[l].type = s.type;
+    lh[l].activation = s.activation;
+    lh[l].in_dim = s.in_dim;
+    lh[l].out_dim = s.out_dim;
+    lh[l].kernel = s.kernel;
+    lh[l].n_mix = s.n_mix;
+    lh[l].n_params = s.params.size();
+    lh[l].offset = offset;
+
+    offset += sizeof(float) * s.params.size();
+  }
+
+  fout.write((const char *)&header, sizeof(header));
+  fout.write((const char *)lh.data(), sizeof(ClassifierLayerHeader) * lh.size());
+
+  size_t pos = sizeof(ClassifierFileHeader) + layers.size() * sizeof(ClassifierLayerHeader);
+  const char zeros[E3E_CACHE_LINE] = {0};
+
+  for (size_t l = 0 ; l < layers.size() ; l++)
+  {
+    fout.write(zeros, lh[l].offset - pos);
+    fout.write((const char *)layers[l].params.data(), sizeof(float) * layers[l].params.size());
+    pos = lh[l].offset + sizeof(float) * layers[l].params.size();
+  }
+
+  if (!fout)
+  {
+    std::cerr << "Error: could not write the model " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
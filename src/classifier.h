@@ -0,0 +1,160 @@
+#ifndef __CLASSIFIER_H__
+#define __CLASSIFIER_H__
+
+/*
+ * Small on-device event classifier over feature frames (MFCC, log-mel).
+ *
+ * A model is a chain of layers applied to every frame:
+ *
+ *   CLASSIFIER_DENSE   out = W x + b, W[out_dim][in_dim]
+ *   CLASSIFIER_CONV1D  causal convolution over time with the last `kernel`
+ *                      frames, W[out_dim][kernel][in_dim] (k = 0 is the
+ *                      oldest frame), b[out_dim]. The frames before the
+ *                      start of the stream are zero.
+ *   CLASSIFIER_GMM     log-likelihood of each of out_dim classes under a
+ *                      mixture of n_mix diagonal gaussians, the parameters
+ *                      of class c and mixture m being at index c * n_mix + m
+ *                      in: const[], the log weight with the normalization
+ *                      of the gaussian, mean[][in_dim] and inv_var[][in_dim]
+ *
+ * each followed by an activation, a softmax on the last layer gives the
+ * event probabilities.
+ *
+ * The weight file is mapped in memory and used in place: a header, the
+ * headers of the layers, then the float32 parameters of every layer
+ * aligned on a cache line (see ClassifierFileHeader). classifier_write
+ * creates such a file. All the activations are allocated by load(),
+ * process() does not allocate. The dot products use AVX2/FMA or NEON
+ * when available (same flags as fastmath.h).
+ *
+ *   Classifier clf;
+ *   if (!clf.load("events.e3ec"))
+ *     ...
+ *   const float *p = clf.process(mfcc_frame);  // clf.n_classes probabilities
+ */
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+
+#define CLASSIFIER_MAGIC "E3EC"
+#define CLASSIFIER_VERSION 1
+
+enum classifier_layer_type
+{
+  CLASSIFIER_DENSE = 0,
+  CLASSIFIER_CONV1D,
+  CLASSIFIER_GMM
+};
+
+enum classifier_activation
+{
+  CLASSIFIER_LINEAR = 0,
+  CLASSIFIER_RELU,
+  CLASSIFIER_TANH,
+  CLASSIFIER_SIGMOID,
+  CLASSIFIER_SOFTMAX
+};
+
+/* The file format, little endian */
+struct ClassifierFileHeader
+{
+  char magic[4];         // CLASSIFIER_MAGIC
+  uint32_t version;
+  uint32_t input_dim;
+  uint32_t n_layers;     // followed by n_layers ClassifierLayerHeader
+};
+
+struct ClassifierLayerHeader
+{
+  uint32_t type;
+  uint32_t activation;
+  uint32_t in_dim;
+  uint32_t out_dim;
+  uint32_t kernel;       // CONV1D
+  uint32_t n_mix;        // GMM
+  uint32_t n_params;     // number of floats
+  uint32_t offset;       // of the parameters from the start of the file, multiple of E3E_CACHE_LINE
+};
+
+/* A layer to write with classifier_write */
+struct ClassifierLayerSpec
+{
+  int type;
+  int activation;
+  int in_dim;
+  int out_dim;
+  int kernel;
+  int n_mix;
+  std::vector<float> params;
+};
+
+struct ClassifierLayer
+{
+  int type;
+  int activation;
+  int in_dim;
+  int out_dim;
+  int kernel;
+  int n_mix;
+
+  // DENSE and CONV1D
+  const float *weights;
+  const float *bias;
+
+  // GMM
+  const float *gmm_const;
+  const float *gmm_mean;
+  const float *gmm_inv_var;
+
+  // CONV1D, the last frames twice so that the window is contiguous
+  float *history;
+  long n_seen;
+};
+
+class Classifier
+{
+  public:
+    int input_dim;
+    int n_classes;
+    std::vector<ClassifierLayer> layers;
+
+    // the output of the last frame
+    float *probabilities;
+
+    Classifier();
+    ~Classifier();
+
+    // map a weight file, false (with a message) if it is not valid
+    bool load(const std::string &path);
+    void unload();
+
+    // forget the past frames of the convolutions
+    void reset();
+
+    // one frame of input_dim features, returns n_classes values
+    const float *process(const float *features);
+
+    // index of the largest output of the last frame
+    int argmax();
+
+  private:
+    void *map;
+    size_t map_size;
+
+    // ping-pong activations
+    float *buf_a;
+    float *buf_b;
+    float *scores;   // GMM mixture scores
+
+    void run_layer(ClassifierLayer &layer, const float *in, float *out);
+};
+
+// expected number of parameters of a layer, 0 for an unknown type
+uint64_t classifier_layer_n_params(int type, uint64_t in_dim, uint64_t out_dim, uint64_t kernel, uint64_t n_mix);
+
+bool classifier_write(const std::string &path, int input_dim, const std::vector<ClassifierLayerSpec> &layers);
+
+#endif // __CLASSIFIER_H__
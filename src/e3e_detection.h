@@ -3,8 +3,31 @@
 
 #include <vector>
 #include <complex>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+// size of a cache line, used to align and pad the buffers
+#define E3E_CACHE_LINE 64
 
 typedef std::complex<float> e3e_complex;
 typedef std::vector<std::complex<float>> e3e_complex_vector;
 
+/* allocate memory aligned on a cache line, to be released with free */
+inline void *e3e_aligned_malloc(size_t size, size_t alignment = E3E_CACHE_LINE)
+{
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, alignment, size) != 0)
+    return NULL;
+  return ptr;
+}
+
+/* monotonic time in nanoseconds, for timestamps and timings */
+inline uint64_t e3e_monotonic_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+}
+
 #endif // __E3E_DETECTION_H__
@@ -0,0 +1,288 @@
+#ifndef __FASTMATH_H__
+#define __FASTMATH_H__
+
+/*
+ * Fast single precision log and exp for the feature path.
+ *
+ * fast_log: x = 2^e m with m in [sqrt(1/2), sqrt(2)), then
+ *
+ *   log(x) = e log(2) + 2 atanh(s),  s = (m - 1) / (m + 1),  |s| < 0.172
+ *
+ * with the atanh series up to s^9, e log(2) being split in two terms to
+ * keep its rounding error small. The truncation error is below 1e-9 and
+ * for all the normal positive floats the error is below FAST_LOG_MAX_ERROR,
+ * absolute where |log(x)| <= 1 and relative elsewhere (1.2e-7 measured by
+ * tests/test_fastmath.cpp over the whole range, about one float ulp).
+ * Inputs below FLT_MIN, including 0, give log(FLT_MIN) = -87.34 instead of
+ * -inf. Negative, inf and NaN inputs are not handled.
+ *
+ * fast_exp: x = k log(2) + r with |r| <= log(2) / 2, then
+ *
+ *   exp(x) = 2^k exp(r)
+ *
+ * with the Taylor polynomial of exp(r) up to r^7. The relative error is
+ * below FAST_EXP_MAX_REL_ERROR for x in [-87, 88], the input is clamped
+ * to this range.
+ *
+ * The array versions use AVX2+FMA or NEON when the compiler targets them
+ * (e.g. -mavx2 -mfma, or -mfpu=neon on the Pi, see ARCH in the Makefile),
+ * and the same scalar code otherwise, so all the paths give the same
+ * results up to rounding.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define FASTMATH_AVX2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FASTMATH_NEON 1
+#endif
+
+#define FAST_LOG_MAX_ERROR 1.5e-7f
+#define FAST_EXP_MAX_REL_ERROR 3e-7f
+
+#define FASTMATH_LN2 0.693147180559945f
+// log(2) split in a part exact in float multiplied by small integers and a correction
+#define FASTMATH_LN2_HI 0.693359375f
+#define FASTMATH_LN2_LO -2.12194440e-4f
+#define FASTMATH_LOG2E 1.44269504088896f
+#define FASTMATH_SQRT1_2 0.707106781186548f
+#define FASTMATH_EXP_MIN -87.f
+#define FASTMATH_EXP_MAX 88.f
+
+inline const char *fastmath_isa()
+{
+#if defined(FASTMATH_AVX2)
+  return "avx2";
+#elif defined(FASTMATH_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+inline float fast_log(float x)
+{
+  if (!(x >= FLT_MIN))
+    x = FLT_MIN;
+
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+
+  // split in exponent and mantissa in [1, 2)
+  int e = int((bits >> 23) & 0xff) - 127;
+  bits = (bits & 0x007fffff) | 0x3f800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+
+  // center the mantissa around 1
+  if (m > 2.f * FASTMATH_SQRT1_2)
+  {
+    m *= 0.5f;
+    e++;
+  }
+
+  float s = (m - 1.f) / (m + 1.f);
+  float s2 = s * s;
+  float p = 1.f / 9.f;
+  p = p * s2 + 1.f / 7.f;
+  p = p * s2 + 1.f / 5.f;
+  p = p * s2 + 1.f / 3.f;
+  p = p * s2 + 1.f;
+
+  return float(e) * FASTMATH_LN2_HI + (float(e) * FASTMATH_LN2_LO + 2.f * s * p);
+}
+
+inline float fast_exp(float x)
+{
+  if (x < FASTMATH_EXP_MIN)
+    x = FASTMATH_EXP_MIN;
+  if (x > FASTMATH_EXP_MAX)
+    x = FASTMATH_EXP_MAX;
+
+  // round to nearest
+  float kf = x * FASTMATH_LOG2E;
+  kf = kf >= 0.f ? float(int(kf + 0.5f)) : float(int(kf - 0.5f));
+  float r = (x - kf * FASTMATH_LN2_HI) - kf * FASTMATH_LN2_LO;
+
+  float p = 1.f / 5040.f;
+  p = p * r + 1.f / 720.f;
+  p = p * r + 1.f / 120.f;
+  p = p * r + 1.f / 24.f;
+  p = p * r + 1.f / 6.f;
+  p = p * r + 0.5f;
+  p = p * r + 1.f;
+  p = p * r + 1.f;
+
+  // multiply by 2^k through the exponent bits
+  uint32_t bits = uint32_t(int(kf) + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+
+  return p * scale;
+}
+
+#if defined(FASTMATH_AVX2)
+
+inline __m256 fast_log_avx2(__m256 x)
+{
+  x = _mm256_max_ps(x, _mm256_set1_ps(FLT_MIN));
+
+  __m256i bits = _mm256_castps_si256(x);
+  __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+  __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+        _mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000)));
+
+  __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(2.f * FASTMATH_SQRT1_2), _CMP_GT_OQ);
+  m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+  __m256 ef = _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_and_ps(big, _mm256_set1_ps(1.f)));
+
+  __m256 one = _mm256_set1_ps(1.f);
+  __m256 s = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+  __m256 s2 = _mm256_mul_ps(s, s);
+  __m256 p = _mm256_set1_ps(1.f / 9.f);
+  p = _mm256_fmadd_ps(p, s2, _mm256_set1_ps(1.f / 7.f));
+  p = _mm256_fmadd_ps(p, s2, _mm256_set1_ps(1.f / 5.f));
+  p = _mm256_fmadd_ps(p, s2, _mm256_set1_ps(1.f / 3.f));
+  p = _mm256_fmadd_ps(p, s2, one);
+
+  __m256 lo = _mm256_fmadd_ps(ef, _mm256_set1_ps(FASTMATH_LN2_LO), _mm256_mul_ps(_mm256_add_ps(s, s), p));
+  return _mm256_fmadd_ps(ef, _mm256_set1_ps(FASTMATH_LN2_HI), lo);
+}
+
+inline __m256 fast_exp_avx2(__m256 x)
+{
+  x = _mm256_max_ps(x, _mm256_set1_ps(FASTMATH_EXP_MIN));
+  x = _mm256_min_ps(x, _mm256_set1_ps(FASTMATH_EXP_MAX));
+
+  __m256 kf = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(FASTMATH_LOG2E)),
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(kf, _mm256_set1_ps(FASTMATH_LN2_HI), x);
+  r = _mm256_fnmadd_ps(kf, _mm256_set1_ps(FASTMATH_LN2_LO), r);
+
+  __m256 p = _mm256_set1_ps(1.f / 5040.f);
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.f / 720.f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.f / 120.f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.f / 24.f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.f / 6.f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(0.5f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.f));
+
+  __m256i k = _mm256_cvtps_epi32(kf);
+  __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(k, _mm256_set1_epi32(127)), 23));
+
+  return _mm256_mul_ps(p, scale);
+}
+
+#elif defined(FASTMATH_NEON)
+
+inline float32x4_t fastmath_div_neon(float32x4_t a, float32x4_t b)
+{
+#if defined(__aarch64__)
+  return vdivq_f32(a, b);
+#else
+  // ARMv7 has no vector division, refine the reciprocal estimate twice
+  float32x4_t inv = vrecpeq_f32(b);
+  inv = vmulq_f32(vrecpsq_f32(b, inv), inv);
+  inv = vmulq_f32(vrecpsq_f32(b, inv), inv);
+  return vmulq_f32(a, inv);
+#endif
+}
+
+inline float32x4_t fast_log_neon(float32x4_t x)
+{
+  x = vmaxq_f32(x, vdupq_n_f32(FLT_MIN));
+
+  uint32x4_t bits = vreinterpretq_u32_f32(x);
+  int32x4_t e = vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(127));
+  float32x4_t m = vreinterpretq_f32_u32(vorrq_u32(
+        vandq_u32(bits, vdupq_n_u32(0x007fffff)), vdupq_n_u32(0x3f800000)));
+
+  uint32x4_t big = vcgtq_f32(m, vdupq_n_f32(2.f * FASTMATH_SQRT1_2));
+  m = vbslq_f32(big, vmulq_f32(m, vdupq_n_f32(0.5f)), m);
+  float32x4_t ef = vaddq_f32(vcvtq_f32_s32(e),
+      vreinterpretq_f32_u32(vandq_u32(big, vreinterpretq_u32_f32(vdupq_n_f32(1.f)))));
+
+  float32x4_t one = vdupq_n_f32(1.f);
+  float32x4_t s = fastmath_div_neon(vsubq_f32(m, one), vaddq_f32(m, one));
+  float32x4_t s2 = vmulq_f32(s, s);
+  float32x4_t p = vdupq_n_f32(1.f / 9.f);
+  p = vmlaq_f32(vdupq_n_f32(1.f / 7.f), p, s2);
+  p = vmlaq_f32(vdupq_n_f32(1.f / 5.f), p, s2);
+  p = vmlaq_f32(vdupq_n_f32(1.f / 3.f), p, s2);
+  p = vmlaq_f32(one, p, s2);
+
+  float32x4_t lo = vmlaq_f32(vmulq_f32(vaddq_f32(s, s), p), ef, vdupq_n_f32(FASTMATH_LN2_LO));
+  return vmlaq_f32(lo, ef, vdupq_n_f32(FASTMATH_LN2_HI));
+}
+
+inline float32x4_t fast_exp_neon(float32x4_t x)
+{
+  x = vmaxq_f32(x, vdupq_n_f32(FASTMATH_EXP_MIN));
+  x = vminq_f32(x, vdupq_n_f32(FASTMATH_EXP_MAX));
+
+  // round to nearest: add +-0.5 and truncate
+  float32x4_t t = vmulq_f32(x, vdupq_n_f32(FASTMATH_LOG2E));
+  uint32x4_t neg = vcltq_f32(t, vdupq_n_f32(0.f));
+  t = vaddq_f32(t, vbslq_f32(neg, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f)));
+  int32x4_t k = vcvtq_s32_f32(t);
+  float32x4_t kf = vcvtq_f32_s32(k);
+  float32x4_t r = vmlsq_f32(x, kf, vdupq_n_f32(FASTMATH_LN2_HI));
+  r = vmlsq_f32(r, kf, vdupq_n_f32(FASTMATH_LN2_LO));
+
+  float32x4_t p = vdupq_n_f32(1.f / 5040.f);
+  p = vmlaq_f32(vdupq_n_f32(1.f / 720.f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(1.f / 120.f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(1.f / 24.f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(1.f / 6.f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(0.5f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(1.f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(1.f), p, r);
+
+  float32x4_t scale = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(k, vdupq_n_s32(127)), 23));
+
+  return vmulq_f32(p, scale);
+}
+
+#endif
+
+/* out[i] = fast_log(in[i]), in and out may be the same array */
+inline void fast_log_array(const float *in, float *out, int n)
+{
+  int i = 0;
+
+#if defined(FASTMATH_AVX2)
+  for ( ; i + 8 <= n ; i += 8)
+    _mm256_storeu_ps(out + i, fast_log_avx2(_mm256_loadu_ps(in + i)));
+#elif defined(FASTMATH_NEON)
+  for ( ; i + 4 <= n ; i += 4)
+    vst1q_f32(out + i, fast_log_neon(vld1q_f32(in + i)));
+#endif
+
+  for ( ; i < n ; i++)
+    out[i] = fast_log(in[i]);
+}
+
+/* out[i] = fast_exp(in[i]), in and out may be the same array */
+inline void fast_exp_array(const float *in, float *out, int n)
+{
+  int i = 0;
+
+#if defined(FASTMATH_AVX2)
+  for ( ; i + 8 <= n ; i += 8)
+    _mm256_storeu_ps(out + i, fast_exp_avx2(_mm256_loadu_ps(in + i)));
+#elif defined(FASTMATH_NEON)
+  for ( ; i + 4 <= n ; i += 4)
+    vst1q_f32(out + i, fast_exp_neon(vld1q_f32(in + i)));
+#endif
+
+  for ( ; i < n ; i++)
+    out[i] = fast_exp(in[i]);
+}
+
+#endif // __FASTMATH_H__
@@ -0,0 +1,156 @@
+
+#include <cmath>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "features.h"
+
+DeltaCMVN::DeltaCMVN(int _dim, int _window, float _alpha, bool _normalize_variance)
+  : dim(_dim), window(std::max(1, _window)), alpha(_alpha), normalize_variance(_normalize_variance)
+{
+  this->lookahead = 2 * this->window;
+  this->ring_size = 2 * this->window + 1;
+
+  this->mean = (float *)e3e_aligned_malloc(sizeof(float) * _dim);
+  this->var = (float *)e3e_aligned_malloc(sizeof(float) * _dim);
+  this->cepstra = (float *)e3e_aligned_malloc(sizeof(float) * _dim * this->ring_size);
+  this->deltas = (float *)e3e_aligned_malloc(sizeof(float) * _dim * this->ring_size);
+  this->last = (float *)e3e_aligned_malloc(sizeof(float) * _dim);
+
+  float sum = 0.;
+  for (int n = 1 ; n <= this->window ; n++)
+    sum += n * n;
+  this->scale = 1. / (2. * sum);
+
+  this->reset();
+}
+
+DeltaCMVN::~DeltaCMVN()
+{
+  free(this->mean);
+  free(this->var);
+  free(this->cepstra);
+  free(this->deltas);
+  free(this->last);
+}
+
+void DeltaCMVN::reset()
+{
+  for (int i = 0 ; i < this->dim ; i++)
+  {
+    this->mean[i] = 0.;
+    this->var[i] = 0.;
+  }
+  this->weight = 0.;
+
+  this->n_pushed = 0;
+  this->n_out = 0;
+  this->n_input = 0;
+}
+
+float *DeltaCMVN::cepstrum(long t)
+{
+  return this->cepstra + (t % this->ring_size) * this->dim;
+}
+
+float *DeltaCMVN::delta(long t)
+{
+  return this->deltas + (t % this->ring_size) * this->dim;
+}
+
+bool DeltaCMVN::push(const float *x, float *out)
+{
+  // update the statistics with the new frame
+  this->weight = this->alpha * this->weight + 1.;
+  float g = float(1. / this->weight);
+
+  float *mu = this->mean;
+  float *v = this->var;
+  float *c = this->cepstrum(this->n_pushed);
+
+  // x - mean_t = (1 - g) (x - mean_{t-1}), with a single rounding
+  for (int i = 0 ; i < this->dim ; i++)
+  {
+    float d = x[i] - mu[i];
+    mu[i] += g * d;
+    v[i] = (1.f - g) * (v[i] + g * d * d);
+    c[i] = (1.f - g) * d;
+  }
+
+  if (this->normalize_variance)
+  {
+    for (int i = 0 ; i < this->dim ; i++)
+      c[i] /= sqrtf(v[i] + float(CMVN_EPSILON));
+  }
+
+  memcpy(this->last, c, sizeof(float) * this->dim);
+  this->n_input++;
+
+  return this->advance(out);
+}
+
+bool DeltaCMVN::flush(float *out)
+{
+  if (this->n_input == 0 || this->n_out >= this->n_input)
+    return false;
+
+  memcpy(this->cepstrum(this->n_pushed), this->last, sizeof(float) * this->dim);
+
+  return this->advance(out);
+}
+
+/* the frame n_pushed was just written, compute what it completes */
+bool DeltaCMVN::advance(float *out)
+{
+  long L = this->n_pushed++;
+  int N = this->window;
+
+  // the delta of frame L - N, the frames before 0 are the frame 0
+  long j = L - N;
+  if (j >= 0)
+  {
+    float *d = this->delta(j);
+    for (int i = 0 ; i < this->dim ; i++)
+      d[i] = 0.;
+
+    for (int n = 1 ; n <= N ; n++)
+    {
+      const float *cp = this->cepstrum(j + n);
+      const float *cm = this->cepstrum(std::max(j - n, 0L));
+      float w = n * this->scale;
+
+      for (int i = 0 ; i < this->dim ; i++)
+        d[i] += w * (cp[i] - cm[i]);
+    }
+  }
+
+  // the delta-delta and the output of frame L - 2N
+  long t = L - 2 * N;
+  if (t < 0)
+    return false;
+
+  float *oc = out;
+  float *od = out + this->dim;
+  float *odd = out + 2 * this->dim;
+
+  memcpy(oc, this->cepstrum(t), sizeof(float) * this->dim);
+  memcpy(od, this->delta(t), sizeof(float) * this->dim);
+
+  for (int i = 0 ; i < this->dim ; i++)
+    odd[i] = 0.;
+
+  for (int n = 1 ; n <= N ; n++)
+  {
+    const float *dp = this->delta(t + n);
+    const float *dm = this->delta(std::max(t - n, 0L));
+    float w = n * this->scale;
+
+    for (int i = 0 ; i < this->dim ; i++)
+      odd[i] += w * (dp[i] - dm[i]);
+  }
+
+  this->n_out++;
+
+  return true;
+}
@@ -0,0 +1,91 @@
+#ifndef __FEATURES_H__
+#define __FEATURES_H__
+
+/*
+ * Streaming post-processing of the MFCC: cepstral mean and variance
+ * normalization (CMVN) followed by the deltas and delta-deltas.
+ *
+ * The CMVN statistics are exponentially weighted with the forgetting
+ * factor alpha (time constant of 1 / (1 - alpha) frames). They are updated
+ * with every frame before it is normalized, with a weight that decreases
+ * from 1 so that the first frames are not biased toward zero:
+ *
+ *   w_t = alpha w_{t-1} + 1,  g = 1 / w_t
+ *   mean_t = mean_{t-1} + g (x_t - mean_{t-1})
+ *   var_t = (1 - g) (var_{t-1} + g (x_t - mean_{t-1})^2)
+ *   c_t = (x_t - mean_t) / sqrt(var_t + CMVN_EPSILON)
+ *
+ * The deltas are the usual regression over 2N + 1 frames,
+ *
+ *   d_t = sum_{n=1}^{N} n (c_{t+n} - c_{t-n}) / (2 sum_{n=1}^{N} n^2)
+ *
+ * and the delta-deltas the same regression on the deltas. The frames
+ * before the start are replaced by the first one, so that the output of
+ * frame t is ready when frame t + 2N is pushed (a lookahead of 2N frames).
+ * flush() emits the last 2N frames at the end of a stream by repeating
+ * the last one.
+ *
+ * A frame is a vector of dim values, e.g. the mfcc_size x channels
+ * coefficients of MFCC::transform_stft. The output is c, d and dd one
+ * after the other (3 * dim values). All the memory is allocated by the
+ * constructor, and all the loops run over the dim contiguous values.
+ *
+ *   DeltaCMVN post(MFCC_SIZE * CHANNELS);
+ *   mfcc.transform_stft(stft, 0, coef);
+ *   if (post.push(coef, features))
+ *     ... features of the frame pushed 2N frames ago ...
+ */
+
+#include "e3e_detection.h"
+
+#define DELTA_DEFAULT_WINDOW 2
+#define CMVN_DEFAULT_ALPHA 0.995
+#define CMVN_EPSILON 1e-8
+
+class DeltaCMVN
+{
+  public:
+    int dim;
+    int window;        // N
+    int lookahead;     // 2N
+    float alpha;
+    bool normalize_variance;
+
+    // CMVN statistics
+    float *mean;
+    float *var;
+    double weight;
+
+    // past normalized frames and deltas, 2N + 1 of each
+    int ring_size;
+    float *cepstra;
+    float *deltas;
+    float *last;       // the last normalized frame, repeated by flush
+
+    float scale;       // 1 / (2 sum n^2)
+
+    long n_pushed;     // frames pushed, including the flushed ones
+    long n_out;        // frames emitted
+    long n_input;      // frames pushed by push()
+
+    DeltaCMVN(int dim, int window = DELTA_DEFAULT_WINDOW, float alpha = CMVN_DEFAULT_ALPHA,
+        bool normalize_variance = true);
+    ~DeltaCMVN();
+
+    int out_dim() { return 3 * this->dim; }
+
+    // normalize a new frame, returns true if a frame was written in out
+    bool push(const float *x, float *out);
+
+    // at the end of the stream, returns false when all the frames were emitted
+    bool flush(float *out);
+
+    void reset();
+
+  private:
+    float *cepstrum(long t);
+    float *delta(long t);
+    bool advance(float *out);
+};
+
+#endif // __FEATURES_H__
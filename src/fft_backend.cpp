@@ -0,0 +1,306 @@
+
+#include <iostream>
+#include <algorithm>
+
+#include "fft_backend.h"
+#include "fft_fixed.h"
+#include "planner.h"
+
+/*
+ * FFTW backend
+ *
+ * The plan is created once on aligned scratch arrays and then executed
+ * on the caller's arrays with the new-array execute interface. FFTW only
+ * allows this when the arrays have the same SIMD alignment as at planning
+ * time, so a second plan without alignment assumption is used when some
+ * of the caller's arrays are not aligned. Both are created in the
+ * constructor under planner_mutex(), the transforms never plan.
+ */
+class FFTWRealFFT : public RealFFT
+{
+  public:
+    fftwf_plan plan;
+    fftwf_plan plan_unaligned;
+    float *scratch_in;
+    fftwf_complex *scratch_out;
+
+    FFTWRealFFT(int _n, int _channels, int _ostride, int _odist)
+      : RealFFT(_n, _channels, _ostride, _odist, FFT_BACKEND_FFTW)
+    {
+      this->scratch_in = (float *)fftwf_malloc(sizeof(float) * _n * _channels);
+      this->scratch_out = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * this->out_size());
+
+      std::lock_guard<std::mutex> lock(planner_mutex());
+      this->plan = this->make_plan(planner_flags());
+      this->plan_unaligned = this->make_plan(planner_flags() | FFTW_UNALIGNED);
+    }
+
+    ~FFTWRealFFT()
+    {
+      fftwf_destroy_plan(this->plan);
+      fftwf_destroy_plan(this->plan_unaligned);
+      fftwf_free(this->scratch_in);
+      fftwf_free(this->scratch_out);
+    }
+
+    int out_size()
+    {
+      return (this->n / 2) * this->ostride + (this->channels - 1) * this->odist + 1;
+    }
+
+    fftwf_plan make_plan(unsigned flags)
+    {
+      int dims[] = { this->n };
+      return fftwf_plan_many_dft_r2c(
+          1, dims, this->channels,
+          this->scratch_in, NULL,
+          this->channels, 1,
+          this->scratch_out, NULL,
+          this->ostride, this->odist,
+          flags);
+    }
+
+    bool is_aligned(float *in, e3e_complex *out)
+    {
+      return fftwf_alignment_of(in) == fftwf_alignment_of(this->scratch_in)
+        && fftwf_alignment_of(reinterpret_cast<float *>(out))
+            == fftwf_alignment_of(reinterpret_cast<float *>(this->scratch_out));
+    }
+
+    void forward(float *in, e3e_complex *out)
+    {
+      fftwf_complex *X = reinterpret_cast<fftwf_complex *>(out);
+
+      if (this->is_aligned(in, out))
+        fftwf_execute_dft_r2c(this->plan, in, X);
+      else
+        fftwf_execute_dft_r2c(this->plan_unaligned, in, X);
+    }
+};
+
+class FFTWDCT2 : public DCT2
+{
+  public:
+    fftwf_plan plan;
+    fftwf_plan plan_unaligned;
+    float *scratch_in;
+    float *scratch_out;
+
+    // forward_many of max_many vectors at once
+    fftwf_plan plan_many;
+    int max_many;
+
+    FFTWDCT2(int _n, int _max_many) : DCT2(_n, FFT_BACKEND_FFTW), max_many(_max_many)
+    {
+      this->scratch_in = (float *)fftwf_malloc(sizeof(float) * _n * _max_many);
+      this->scratch_out = (float *)fftwf_malloc(sizeof(float) * _n * _max_many);
+
+      std::lock_guard<std::mutex> lock(planner_mutex());
+      this->plan = fftwf_plan_r2r_1d(_n, this->scratch_in, this->scratch_out,
+          FFTW_REDFT10, planner_flags());
+      this->plan_unaligned = fftwf_plan_r2r_1d(_n, this->scratch_in, this->scratch_out,
+          FFTW_REDFT10, planner_flags() | FFTW_UNALIGNED);
+
+      // one batch size only, the planner runs three times whatever max_many
+      fftwf_r2r_kind kind[] = { FFTW_REDFT10 };
+      this->plan_many = fftwf_plan_many_r2r(1, &this->n, _max_many,
+          this->scratch_in, NULL, 1, this->n,
+          this->scratch_out, NULL, 1, this->n,
+          kind, planner_flags() | FFTW_UNALIGNED);
+    }
+
+    ~FFTWDCT2()
+    {
+      fftwf_destroy_plan(this->plan);
+      fftwf_destroy_plan(this->plan_unaligned);
+      fftwf_destroy_plan(this->plan_many);
+      fftwf_free(this->scratch_in);
+      fftwf_free(this->scratch_out);
+    }
+
+    void forward(float *in, float *out)
+    {
+      if (fftwf_alignment_of(in) == fftwf_alignment_of(this->scratch_in)
+          && fftwf_alignment_of(out) == fftwf_alignment_of(this->scratch_out))
+        fftwf_execute_r2r(this->plan, in, out);
+      else
+        fftwf_execute_r2r(this->plan_unaligned, in, out);
+    }
+
+    /*
+     * The full batches of max_many vectors with the batch plan, the rest
+     * one vector at a time with the unaligned plan. Both are made in the
+     * constructor without alignment assumption so that they run on any
+     * rows of the caller's arrays: no lock and no planning here.
+     */
+    void forward_many(float *in, float *out, int howmany)
+    {
+      int h0 = 0;
+      for ( ; h0 + this->max_many <= howmany ; h0 += this->max_many)
+        fftwf_execute_r2r(this->plan_many, in + h0 * this->n, out + h0 * this->n);
+
+      for ( ; h0 < howmany ; h0++)
+        fftwf_execute_r2r(this->plan_unaligned, in + h0 * this->n, out + h0 * this->n);
+    }
+};
+
+/*
+ * Builtin backend
+ */
+template<int N, int C>
+class BuiltinRealFFT : public RealFFT
+{
+  public:
+    FixedRealFFT<N, C> *impl;
+
+    BuiltinRealFFT(int _ostride, int _odist)
+      : RealFFT(N, C, _ostride, _odist, FFT_BACKEND_BUILTIN)
+    {
+      this->impl = new FixedRealFFT<N, C>;
+    }
+
+    ~BuiltinRealFFT()
+    {
+      delete this->impl;
+    }
+
+    void forward(float *in, e3e_complex *out)
+    {
+      this->impl->forward(in, out, this->ostride, this->odist);
+    }
+};
+
+template<int N>
+class BuiltinDCT2 : public DCT2
+{
+  public:
+    FixedDCT2<N> impl;
+
+    BuiltinDCT2() : DCT2(N, FFT_BACKEND_BUILTIN) {}
+
+    void forward(float *in, float *out)
+    {
+      this->impl.forward(in, out);
+    }
+};
+
+template<int N>
+RealFFT *make_builtin_real_fft(int channels, int ostride, int odist)
+{
+  switch (channels)
+  {
+    case 1:
+      return new BuiltinRealFFT<N, 1>(ostride, odist);
+    case 2:
+      return new BuiltinRealFFT<N, 2>(ostride, odist);
+    case 4:
+      return new BuiltinRealFFT<N, 4>(ostride, odist);
+    case 8:
+      return new BuiltinRealFFT<N, 8>(ostride, odist);
+    default:
+      return NULL;
+  }
+}
+
+RealFFT *make_real_fft(int backend, int n, int channels, int ostride, int odist)
+{
+  RealFFT *fft = NULL;
+
+  if (backend == FFT_BACKEND_BUILTIN)
+  {
+    switch (n)
+    {
+      case 16:
+        fft = make_builtin_real_fft<16>(channels, ostride, odist);
+        break;
+      case 32:
+        fft = make_builtin_real_fft<32>(channels, ostride, odist);
+        break;
+      case 64:
+        fft = make_builtin_real_fft<64>(channels, ostride, odist);
+        break;
+      case 128:
+        fft = make_builtin_real_fft<128>(channels, ostride, odist);
+        break;
+      case 256:
+        fft = make_builtin_real_fft<256>(channels, ostride, odist);
+        break;
+      case 512:
+        fft = make_builtin_real_fft<512>(channels, ostride, odist);
+        break;
+      case 1024:
+        fft = make_builtin_real_fft<1024>(channels, ostride, odist);
+        break;
+      case 2048:
+        fft = make_builtin_real_fft<2048>(channels, ostride, odist);
+        break;
+      case 4096:
+        fft = make_builtin_real_fft<4096>(channels, ostride, odist);
+        break;
+    }
+
+    if (fft == NULL)
+      std::cerr << "Warning: no builtin FFT of size " << n << " for " << channels
+        << " channels, using FFTW." << std::endl;
+  }
+
+  if (fft == NULL)
+    fft = new FFTWRealFFT(n, channels, ostride, odist);
+
+  return fft;
+}
+
+DCT2 *make_dct2(int backend, int n, int max_many)
+{
+  DCT2 *dct = NULL;
+
+  if (backend == FFT_BACKEND_BUILTIN)
+  {
+    switch (n)
+    {
+      case 12:
+        dct = new BuiltinDCT2<12>;
+        break;
+      case 13:
+        dct = new BuiltinDCT2<13>;
+        break;
+      case 14:
+        dct = new BuiltinDCT2<14>;
+        break;
+      case 16:
+        dct = new BuiltinDCT2<16>;
+        break;
+      case 20:
+        dct = new BuiltinDCT2<20>;
+        break;
+      case 24:
+        dct = new BuiltinDCT2<24>;
+        break;
+      case 26:
+        dct = new BuiltinDCT2<26>;
+        break;
+      case 32:
+        dct = new BuiltinDCT2<32>;
+        break;
+      case 40:
+        dct = new BuiltinDCT2<40>;
+        break;
+    }
+
+    if (dct == NULL)
+      std::cerr << "Warning: no builtin DCT of size " << n << ", using FFTW." << std::endl;
+  }
+
+  if (dct == NULL)
+    dct = new FFTWDCT2(n, std::max(1, max_many));
+
+  return dct;
+}
+
+const char *fft_backend_name(int backend)
+{
+  if (backend == FFT_BACKEND_BUILTIN)
+    return "builtin";
+  else
+    return "fftw";
+}
@@ -0,0 +1,72 @@
+#ifndef __FFT_BACKEND_H__
+#define __FFT_BACKEND_H__
+
+/*
+ * The FFT backends behind STFT and MFCC.
+ *
+ * FFT_BACKEND_FFTW uses FFTW plans created with the flags of the planner
+ * (see planner.h), FFT_BACKEND_BUILTIN uses the compile-time specialized
+ * transforms of fft_fixed.h. The builtin backend only exists for some
+ * sizes and channel counts, the factories fall back to FFTW otherwise.
+ */
+
+#include <fftw3.h>
+
+#include "e3e_detection.h"
+
+enum fft_backend_type
+{
+  FFT_BACKEND_FFTW = 0,
+  FFT_BACKEND_BUILTIN
+};
+
+/*
+ * Real-to-complex DFT of `channels` signals of `n` samples stored
+ * interleaved (in[i * channels + c]). Bin k of channel c is written
+ * at out[k * ostride + c * odist].
+ */
+class RealFFT
+{
+  public:
+    int n;
+    int channels;
+    int ostride;
+    int odist;
+    int backend;
+
+    RealFFT(int _n, int _channels, int _ostride, int _odist, int _backend)
+      : n(_n), channels(_channels), ostride(_ostride), odist(_odist), backend(_backend) {}
+    virtual ~RealFFT() {}
+
+    virtual void forward(float *in, e3e_complex *out) = 0;
+};
+
+/* DCT-II of size n with the FFTW REDFT10 convention (no normalization) */
+class DCT2
+{
+  public:
+    int n;
+    int backend;
+
+    DCT2(int _n, int _backend) : n(_n), backend(_backend) {}
+    virtual ~DCT2() {}
+
+    virtual void forward(float *in, float *out) = 0;
+
+    // howmany transforms of contiguous vectors (in[h * n + j]), safe to
+    // call from several threads on different arrays, batched by max_many
+    // of make_dct2
+    virtual void forward_many(float *in, float *out, int howmany)
+    {
+      for (int h = 0 ; h < howmany ; h++)
+        this->forward(in + h * this->n, out + h * this->n);
+    }
+};
+
+RealFFT *make_real_fft(int backend, int n, int channels, int ostride, int odist);
+// max_many: batch of forward_many transformed at once, planned here
+DCT2 *make_dct2(int backend, int n, int max_many = 1);
+
+const char *fft_backend_name(int backend);
+
+#endif // __FFT_BACKEND_H__
@@ -0,0 +1,318 @@
+#ifndef __FFT_FIXED_H__
+#define __FFT_FIXED_H__
+
+/*
+ * Header-only FFT and DCT-II specialized at compile time for small fixed sizes.
+ *
+ * FixedRealFFT<N, C> computes the real-to-complex DFT of C channels of
+ * N real samples stored interleaved (in[n * C + c]), exactly like the
+ * FFTW plan_many plan of STFT. The N real points are packed in an N/2
+ * points complex FFT that is computed with radix-4 (radix-2^2) decimation
+ * in time passes, preceded by one radix-2 pass when log2(N/2) is odd.
+ * All the butterflies operate on the C channels at once so that the inner
+ * loops map to SIMD registers (8 channels of float = one AVX register,
+ * 4 channels = one NEON register).
+ *
+ * FixedDCT2<N> computes the DCT-II with the FFTW REDFT10 convention
+ *   Y[k] = 2 sum_n x[n] cos(pi k (2n + 1) / (2N))
+ * as a product with a compile-time matrix, which is the fastest for the
+ * handful of coefficients of the MFCC.
+ *
+ * All the twiddle factors and the bit reversal permutation are computed
+ * by constexpr functions, no table is built at runtime.
+ */
+
+#include "e3e_detection.h"
+
+namespace fixed_fft
+{
+
+// Compile-time trigonometry
+
+/* sin and cos of x in [0, pi/2] by their Taylor series */
+constexpr double ct_sin_q(double x)
+{
+  double term = x, sum = x;
+  for (int i = 1 ; i < 20 ; i++)
+  {
+    term *= -x * x / ((2 * i) * (2 * i + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double ct_cos_q(double x)
+{
+  double term = 1., sum = 1.;
+  for (int i = 1 ; i < 20 ; i++)
+  {
+    term *= -x * x / ((2 * i - 1) * (2 * i));
+    sum += term;
+  }
+  return sum;
+}
+
+/* cos(2 pi num / den) with the range reduction done on integers */
+constexpr double ct_cos_frac(long num, long den)
+{
+  const double pi = 3.14159265358979323846;
+  num = ((num % den) + den) % den;
+
+  // use the symmetries to go back to the first quadrant
+  if (4 * num <= den)
+    return ct_cos_q(2. * pi * num / den);
+  else if (2 * num <= den)
+    return -ct_sin_q(2. * pi * num / den - pi / 2.);
+  else if (4 * num <= 3 * den)
+    return -ct_cos_q(2. * pi * num / den - pi);
+  else
+    return ct_sin_q(2. * pi * num / den - 3. * pi / 2.);
+}
+
+/* sin(2 pi num / den) */
+constexpr double ct_sin_frac(long num, long den)
+{
+  // sin(x) = cos(x - pi/2)
+  return ct_cos_frac(4 * num - den, 4 * den);
+}
+
+constexpr int ct_log2(int n)
+{
+  int l = 0;
+  while ((1 << l) < n)
+    l++;
+  return l;
+}
+
+// Tables
+
+/* W_N^k = exp(-2i pi k / N) for k < N/2 */
+template<int N>
+struct Twiddles
+{
+  float re[N / 2];
+  float im[N / 2];
+};
+
+template<int N>
+constexpr Twiddles<N> make_twiddles()
+{
+  Twiddles<N> t{};
+  for (int k = 0 ; k < N / 2 ; k++)
+  {
+    t.re[k] = float(ct_cos_frac(k, N));
+    t.im[k] = float(-ct_sin_frac(k, N));
+  }
+  return t;
+}
+
+template<int M>
+struct BitReversal
+{
+  int index[M];
+};
+
+template<int M>
+constexpr BitReversal<M> make_bit_reversal()
+{
+  BitReversal<M> b{};
+  int bits = ct_log2(M);
+  for (int n = 0 ; n < M ; n++)
+  {
+    int r = 0;
+    for (int i = 0 ; i < bits ; i++)
+      if (n & (1 << i))
+        r |= 1 << (bits - 1 - i);
+    b.index[n] = r;
+  }
+  return b;
+}
+
+/* The DCT-II matrix, already multiplied by 2 */
+template<int N>
+struct DCTMatrix
+{
+  float c[N * N];
+};
+
+template<int N>
+constexpr DCTMatrix<N> make_dct_matrix()
+{
+  DCTMatrix<N> m{};
+  for (int k = 0 ; k < N ; k++)
+    for (int n = 0 ; n < N ; n++)
+      m.c[k * N + n] = float(2. * ct_cos_frac(long(k) * (2 * n + 1), 4 * N));
+  return m;
+}
+
+template<int N>
+struct Tables
+{
+  static constexpr Twiddles<N> twiddles = make_twiddles<N>();
+  static constexpr BitReversal<N / 2> bitrev = make_bit_reversal<N / 2>();
+};
+
+template<int N>
+constexpr Twiddles<N> Tables<N>::twiddles;
+
+template<int N>
+constexpr BitReversal<N / 2> Tables<N>::bitrev;
+
+template<int N>
+struct DCTTables
+{
+  static constexpr DCTMatrix<N> matrix = make_dct_matrix<N>();
+};
+
+template<int N>
+constexpr DCTMatrix<N> DCTTables<N>::matrix;
+
+} // namespace fixed_fft
+
+template<int N, int C>
+class FixedRealFFT
+{
+  static_assert(N >= 8 && (N & (N - 1)) == 0, "FixedRealFFT size must be a power of two >= 8");
+
+  static constexpr int M = N / 2;  // size of the complex FFT
+  static constexpr int LOG2M = fixed_fft::ct_log2(M);
+
+  // split real/imaginary work buffers, one row of C channels per point
+  float zr[M * C];
+  float zi[M * C];
+
+  public:
+
+    /*
+     * in:  N x C real samples, interleaved
+     * out: N/2+1 bins of every channel at out[k * ostride + c * odist]
+     */
+    void forward(const float *in, e3e_complex *out, int ostride, int odist)
+    {
+      const fixed_fft::Twiddles<N> &tw = fixed_fft::Tables<N>::twiddles;
+      const int *rev = fixed_fft::Tables<N>::bitrev.index;
+
+      // pack even/odd samples as real/imaginary parts in bit reversed order
+      for (int n = 0 ; n < M ; n++)
+      {
+        const float *x = in + 2 * n * C;
+        float *r = zr + rev[n] * C;
+        float *i = zi + rev[n] * C;
+        for (int c = 0 ; c < C ; c++)
+        {
+          r[c] = x[c];
+          i[c] = x[C + c];
+        }
+      }
+
+      int s = 1;
+
+      // one radix-2 pass with trivial twiddles when the number of stages is odd
+      if (LOG2M % 2 == 1)
+      {
+        for (int b = 0 ; b < M ; b += 2)
+        {
+          float *r0 = zr + b * C, *r1 = r0 + C;
+          float *i0 = zi + b * C, *i1 = i0 + C;
+          for (int c = 0 ; c < C ; c++)
+          {
+            float ar = r0[c], ai = i0[c];
+            r0[c] = ar + r1[c];
+            i0[c] = ai + i1[c];
+            r1[c] = ar - r1[c];
+            i1[c] = ai - i1[c];
+          }
+        }
+        s = 2;
+      }
+
+      // radix-4 passes, from sub-transforms of size s to size 4s
+      for ( ; s < M ; s *= 4)
+      {
+        for (int b = 0 ; b < M ; b += 4 * s)
+          for (int j = 0 ; j < s ; j++)
+          {
+            // w1 = W_{2s}^j, w2 = W_{4s}^j in terms of W_N
+            float w1r = tw.re[j * (N / (2 * s))], w1i = tw.im[j * (N / (2 * s))];
+            float w2r = tw.re[j * (N / (4 * s))], w2i = tw.im[j * (N / (4 * s))];
+
+            float *r0 = zr + (b + j) * C, *r1 = r0 + s * C, *r2 = r1 + s * C, *r3 = r2 + s * C;
+            float *i0 = zi + (b + j) * C, *i1 = i0 + s * C, *i2 = i1 + s * C, *i3 = i2 + s * C;
+
+            for (int c = 0 ; c < C ; c++)
+            {
+              // first radix-2 stage
+              float tr = w1r * r1[c] - w1i * i1[c];
+              float ti = w1r * i1[c] + w1i * r1[c];
+              float y0r = r0[c] + tr, y0i = i0[c] + ti;
+              float y1r = r0[c] - tr, y1i = i0[c] - ti;
+
+              tr = w1r * r3[c] - w1i * i3[c];
+              ti = w1r * i3[c] + w1i * r3[c];
+              float y2r = r2[c] + tr, y2i = i2[c] + ti;
+              float y3r = r2[c] - tr, y3i = i2[c] - ti;
+
+              // second radix-2 stage, the odd branch has an extra -i
+              float ur = w2r * y2r - w2i * y2i;
+              float ui = w2r * y2i + w2i * y2r;
+              float vr = w2r * y3i + w2i * y3r;
+              float vi = -(w2r * y3r - w2i * y3i);
+
+              r0[c] = y0r + ur;
+              i0[c] = y0i + ui;
+              r2[c] = y0r - ur;
+              i2[c] = y0i - ui;
+              r1[c] = y1r + vr;
+              i1[c] = y1i + vi;
+              r3[c] = y1r - vr;
+              i3[c] = y1i - vi;
+            }
+          }
+      }
+
+      // unpack the spectrum of the real signal
+      for (int c = 0 ; c < C ; c++)
+      {
+        out[c * odist] = e3e_complex(zr[c] + zi[c], 0.f);
+        out[M * ostride + c * odist] = e3e_complex(zr[c] - zi[c], 0.f);
+      }
+
+      for (int k = 1 ; k < M ; k++)
+      {
+        const float *ar = zr + k * C, *ai = zi + k * C;
+        const float *br = zr + (M - k) * C, *bi = zi + (M - k) * C;
+        float wr = tw.re[k], wi = tw.im[k];
+        e3e_complex *o = out + k * ostride;
+
+        for (int c = 0 ; c < C ; c++)
+        {
+          float er = 0.5f * (ar[c] + br[c]);
+          float ei = 0.5f * (ai[c] - bi[c]);
+          float odr = 0.5f * (ai[c] + bi[c]);
+          float odi = -0.5f * (ar[c] - br[c]);
+          o[c * odist] = e3e_complex(er + wr * odr - wi * odi, ei + wr * odi + wi * odr);
+        }
+      }
+    }
+};
+
+template<int N>
+class FixedDCT2
+{
+  public:
+
+    void forward(const float *in, float *out)
+    {
+      const float *m = fixed_fft::DCTTables<N>::matrix.c;
+
+      for (int k = 0 ; k < N ; k++)
+      {
+        float acc = 0.f;
+        for (int n = 0 ; n < N ; n++)
+          acc += m[k * N + n] * in[n];
+        out[k] = acc;
+      }
+    }
+};
+
+#endif // __FFT_FIXED_H__
@@ -0,0 +1,555 @@
+
+#include <cmath>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "fixed_point.h"
+
+/* Q15 with the symmetric range [-32767, 32767], so that sums of two products fit in int32 */
+static inline q15_t q15_sym(float x)
+{
+  q15_t v = float_to_q15(x);
+  return v < -Q15_MAX ? -Q15_MAX : v;
+}
+
+static inline int32_t q_abs(int32_t x)
+{
+  return x < 0 ? -x : x;
+}
+
+STFTQ15::STFTQ15(int _fft_size, int _n_frames, int _channels)
+  : fft_size(_fft_size), n_frames(_n_frames), channels(_channels)
+{
+  this->n_bins = _fft_size / 2 + 1;
+  this->n_pairs = (_channels + 1) / 2;
+
+  this->log2_size = 0;
+  while ((1 << this->log2_size) < _fft_size)
+    this->log2_size++;
+
+  int per_line = E3E_CACHE_LINE / sizeof(int16_t);
+  this->channel_stride = ((this->n_bins + per_line - 1) / per_line) * per_line;
+
+  this->n_samples_per_in_frame = _channels * _fft_size;
+  this->n_samples_per_out_frame = _channels * this->channel_stride;
+
+  this->circ_in_buffer = (int16_t *)e3e_aligned_malloc(sizeof(int16_t) * _n_frames * this->n_samples_per_in_frame);
+  this->circ_out_re = (int16_t *)e3e_aligned_malloc(sizeof(int16_t) * _n_frames * this->n_samples_per_out_frame);
+  this->circ_out_im = (int16_t *)e3e_aligned_malloc(sizeof(int16_t) * _n_frames * this->n_samples_per_out_frame);
+  this->exponents = new int[_n_frames * _channels];
+
+  memset(this->circ_in_buffer, 0, sizeof(int16_t) * _n_frames * this->n_samples_per_in_frame);
+  memset(this->circ_out_re, 0, sizeof(int16_t) * _n_frames * this->n_samples_per_out_frame);
+  memset(this->circ_out_im, 0, sizeof(int16_t) * _n_frames * this->n_samples_per_out_frame);
+  for (int i = 0 ; i < _n_frames * _channels ; i++)
+    this->exponents[i] = 0;
+
+  this->current_frame = 0;
+  this->frame_count = 0;
+  this->window = NULL;
+
+  // the complex FFT of fft_size points
+  this->zr = (int16_t *)e3e_aligned_malloc(sizeof(int16_t) * _fft_size);
+  this->zi = (int16_t *)e3e_aligned_malloc(sizeof(int16_t) * _fft_size);
+
+  this->tw_re = new q15_t[_fft_size / 2];
+  this->tw_im = new q15_t[_fft_size / 2];
+  for (int k = 0 ; k < _fft_size / 2 ; k++)
+  {
+    double a = 2. * M_PI * k / _fft_size;
+    this->tw_re[k] = q15_sym(cos(a));
+    this->tw_im[k] = q15_sym(-sin(a));
+  }
+
+  this->bitrev = new int[_fft_size];
+  for (int n = 0 ; n < _fft_size ; n++)
+  {
+    int r = 0;
+    for (int i = 0 ; i < this->log2_size ; i++)
+      if (n & (1 << i))
+        r |= 1 << (this->log2_size - 1 - i);
+    this->bitrev[n] = r;
+  }
+}
+
+STFTQ15::~STFTQ15()
+{
+  free(this->circ_in_buffer);
+  free(this->circ_out_re);
+  free(this->circ_out_im);
+  delete[] this->exponents;
+  delete[] this->window;
+
+  free(this->zr);
+  free(this->zi);
+  delete[] this->tw_re;
+  delete[] this->tw_im;
+  delete[] this->bitrev;
+}
+
+void STFTQ15::set_window(const float *_window)
+{
+  delete[] this->window;
+  this->window = NULL;
+
+  if (_window == NULL)
+    return;
+
+  this->window = new q15_t[this->fft_size];
+  for (int n = 0 ; n < this->fft_size ; n++)
+    this->window[n] = float_to_q15(_window[n]);
+}
+
+int16_t *STFTQ15::get_in_buffer()
+{
+  return this->circ_in_buffer + this->current_frame * this->n_samples_per_in_frame;
+}
+
+/*
+ * FFT of channel ca + j channel cb (cb < 0 for zero) of the interleaved
+ * frame in zr/zi, returns the exponent of the block
+ */
+int STFTQ15::fft_pair(const int16_t *in, int ca, int cb)
+{
+  int N = this->fft_size;
+  int C = this->channels;
+
+  // use the headroom of quiet frames, the maximum goes to [2^13, 2^14)
+  int32_t m = 0;
+  for (int n = 0 ; n < N ; n++)
+  {
+    m = std::max(m, q_abs(in[n * C + ca]));
+    if (cb >= 0)
+      m = std::max(m, q_abs(in[n * C + cb]));
+  }
+
+  int ls = 0;
+  if (m > 0)
+    while ((m << (ls + 1)) < (1 << 14))
+      ls++;
+
+  // window and pack in bit reversed order
+  for (int n = 0 ; n < N ; n++)
+  {
+    int32_t a = in[n * C + ca];
+    int32_t b = cb >= 0 ? in[n * C + cb] : 0;
+
+    if (this->window != NULL)
+    {
+      int32_t w = this->window[n];
+      int32_t rnd = 1 << (14 - ls);
+      a = (a * w + rnd) >> (15 - ls);
+      b = (b * w + rnd) >> (15 - ls);
+    }
+    else
+    {
+      a <<= ls;
+      b <<= ls;
+    }
+
+    this->zr[this->bitrev[n]] = int16_t(a);
+    this->zi[this->bitrev[n]] = int16_t(b);
+  }
+
+  m = 0;
+  for (int n = 0 ; n < N ; n++)
+    m = std::max(m, std::max(q_abs(this->zr[n]), q_abs(this->zi[n])));
+
+  int exponent = -ls;
+
+  // radix-2 decimation in time, the block is scaled before the stages
+  // where the outputs, at most (1 + sqrt(2)) times the inputs, could overflow
+  for (int size = 2 ; size <= N ; size *= 2)
+  {
+    int half = size / 2;
+    int step = N / size;
+
+    int s = 0;
+    if (m >= (1 << 14))
+      s = 2;
+    else if (m >= (1 << 13))
+      s = 1;
+    int32_t rnd = s > 0 ? 1 << (s - 1) : 0;
+    exponent += s;
+
+    m = 0;
+    for (int j = 0 ; j < half ; j++)
+    {
+      int32_t wr = this->tw_re[j * step];
+      int32_t wi = this->tw_im[j * step];
+
+      for (int b = j ; b < N ; b += size)
+      {
+        int i1 = b + half;
+        int32_t br = this->zr[i1], bi = this->zi[i1];
+        int32_t tr = br, ti = bi;
+
+        if (j > 0)
+        {
+          tr = (wr * br - wi * bi + (1 << 14)) >> 15;
+          ti = (wr * bi + wi * br + (1 << 14)) >> 15;
+        }
+
+        int32_t ar = this->zr[b], ai = this->zi[b];
+        int32_t r0 = (ar + tr + rnd) >> s;
+        int32_t i0 = (ai + ti + rnd) >> s;
+        int32_t r1 = (ar - tr + rnd) >> s;
+        int32_t i1v = (ai - ti + rnd) >> s;
+
+        this->zr[b] = int16_t(r0);
+        this->zi[b] = int16_t(i0);
+        this->zr[i1] = int16_t(r1);
+        this->zi[i1] = int16_t(i1v);
+
+        m = std::max(m, std::max(std::max(q_abs(r0), q_abs(i0)), std::max(q_abs(r1), q_abs(i1v))));
+      }
+    }
+  }
+
+  return exponent;
+}
+
+void STFTQ15::transform()
+{
+  int N = this->fft_size;
+  const int16_t *in = this->get_in_buffer();
+
+  int16_t *out_re = this->circ_out_re + this->current_frame * this->n_samples_per_out_frame;
+  int16_t *out_im = this->circ_out_im + this->current_frame * this->n_samples_per_out_frame;
+  int *exps = this->exponents + this->current_frame * this->channels;
+
+  for (int p = 0 ; p < this->n_pairs ; p++)
+  {
+    int ca = 2 * p;
+    int cb = 2 * p + 1 < this->channels ? 2 * p + 1 : -1;
+
+    int e = this->fft_pair(in, ca, cb);
+
+    // separate the spectra of the two real channels
+    //   X_a[k] = (Z[k] + conj(Z[N-k])) / 2,  X_b[k] = (Z[k] - conj(Z[N-k])) / 2j
+    int16_t *ar = out_re + ca * this->channel_stride;
+    int16_t *ai = out_im + ca * this->channel_stride;
+    exps[ca] = e;
+
+    for (int k = 0 ; k < this->n_bins ; k++)
+    {
+      int nk = (N - k) & (N - 1);
+      int32_t zr_k = this->zr[k], zi_k = this->zi[k];
+      int32_t zr_n = this->zr[nk], zi_n = this->zi[nk];
+
+      ar[k] = int16_t((zr_k + zr_n) >> 1);
+      ai[k] = int16_t((zi_k - zi_n) >> 1);
+
+      if (cb >= 0)
+      {
+        out_re[cb * this->channel_stride + k] = int16_t((zi_k + zi_n) >> 1);
+        out_im[cb * this->channel_stride + k] = int16_t((zr_n - zr_k) >> 1);
+      }
+    }
+
+    if (cb >= 0)
+      exps[cb] = e;
+  }
+
+  this->frame_count += 1;
+  this->current_frame += 1;
+  if (this->current_frame == this->n_frames)
+    this->current_frame = 0;
+}
+
+SRPPHATQ15::SRPPHATQ15(STFTQ15 *_stft, SRPPHAT *_geometry)
+  : stft(_stft), geometry(_geometry)
+{
+  this->n_grid = _geometry->n_grid;
+  this->n_pairs = _geometry->n_pairs;
+  this->pairs = _geometry->pairs;
+  this->k_min = _geometry->k_min;
+  this->k_len = _geometry->k_len;
+  this->n_frames = _geometry->n_frames;
+  this->n_cells = this->n_pairs * this->k_len;
+
+  // the steering factors of the float object, one contiguous row per grid point
+  this->tw_re = (q15_t *)e3e_aligned_malloc(sizeof(q15_t) * this->n_grid * this->n_cells);
+  this->tw_im = (q15_t *)e3e_aligned_malloc(sizeof(q15_t) * this->n_grid * this->n_cells);
+
+  for (int n = 0 ; n < this->n_grid ; n++)
+    for (int p = 0 ; p < this->n_pairs ; p++)
+      for (int k = 0 ; k < this->k_len ; k++)
+      {
+        e3e_complex t = _geometry->steering_factor(n, p, k);
+        this->tw_re[n * this->n_cells + p * this->k_len + k] = q15_sym(t.real());
+        this->tw_im[n * this->n_cells + p * this->k_len + k] = q15_sym(t.imag());
+      }
+
+  // the largest cross spectrum is 2 (2^15 N)^2 per frame, keep one spare bit
+  int frames_bits = 0;
+  while ((1 << frames_bits) < this->n_frames)
+    frames_bits++;
+  this->G_frac = 62 - (31 + 2 * _stft->log2_size + frames_bits + 1);
+
+  this->G_re = new int64_t[this->n_cells];
+  this->G_im = new int64_t[this->n_cells];
+  this->u_re = (q15_t *)e3e_aligned_malloc(sizeof(q15_t) * this->n_cells);
+  this->u_im = (q15_t *)e3e_aligned_malloc(sizeof(q15_t) * this->n_cells);
+  for (int i = 0 ; i < this->n_cells ; i++)
+  {
+    this->G_re[i] = this->G_im[i] = 0;
+    this->u_re[i] = this->u_im[i] = 0;
+  }
+
+  this->spatial_spectrum = new int64_t[this->n_grid];
+  for (int n = 0 ; n < this->n_grid ; n++)
+    this->spatial_spectrum[n] = 0;
+  this->argmax = 0;
+}
+
+SRPPHATQ15::~SRPPHATQ15()
+{
+  free(this->tw_re);
+  free(this->tw_im);
+  delete[] this->G_re;
+  delete[] this->G_im;
+  free(this->u_re);
+  free(this->u_im);
+  delete[] this->spatial_spectrum;
+}
+
+int SRPPHATQ15::process()
+{
+  this->update(this->stft->frame_count - 1);
+  return this->search();
+}
+
+/*
+ * Add (sign = 1) or remove (sign = -1) the cross spectra of a frame. The
+ * values only depend on the frame so that the removal is exact.
+ */
+void SRPPHATQ15::accumulate(long frame, int sign)
+{
+  for (int p = 0 ; p < this->n_pairs ; p++)
+  {
+    int i = this->pairs[2 * p];
+    int j = this->pairs[2 * p + 1];
+
+    const int16_t *xi_re = this->stft->re_at(frame, i) + this->k_min;
+    const int16_t *xi_im = this->stft->im_at(frame, i) + this->k_min;
+    const int16_t *xj_re = this->stft->re_at(frame, j) + this->k_min;
+    const int16_t *xj_im = this->stft->im_at(frame, j) + this->k_min;
+    int s = this->stft->exponent_at(frame, i) + this->stft->exponent_at(frame, j) + this->G_frac;
+
+    int64_t *g_re = this->G_re + p * this->k_len;
+    int64_t *g_im = this->G_im + p * this->k_len;
+
+    for (int k = 0 ; k < this->k_len ; k++)
+    {
+      // X_i conj(X_j)
+      int64_t re = int64_t(xi_re[k]) * xj_re[k] + int64_t(xi_im[k]) * xj_im[k];
+      int64_t im = int64_t(xi_im[k]) * xj_re[k] - int64_t(xi_re[k]) * xj_im[k];
+
+      g_re[k] += sign * q_shift(re, s);
+      g_im[k] += sign * q_shift(im, s);
+    }
+  }
+}
+
+/* Update the cross spectra with the frame number `frame` of the STFT */
+void SRPPHATQ15::update(long frame)
+{
+  if (frame < 0)
+    return;
+
+  this->accumulate(frame, 1);
+  if (frame - this->n_frames >= 0)
+    this->accumulate(frame - this->n_frames, -1);
+}
+
+int SRPPHATQ15::search()
+{
+  // PHAT weighting, G / |G| in Q15
+  for (int c = 0 ; c < this->n_cells ; c++)
+  {
+    int64_t gr = this->G_re[c];
+    int64_t gi = this->G_im[c];
+
+    if (gr == 0 && gi == 0)
+    {
+      this->u_re[c] = this->u_im[c] = 0;
+      continue;
+    }
+
+    // bring the largest component to 30 bits
+    uint64_t a = uint64_t(std::max(gr < 0 ? -gr : gr, gi < 0 ? -gi : gi));
+    int sh = 30 - (64 - q_clz64(a));
+    gr = q_shift(gr, sh);
+    gi = q_shift(gi, sh);
+
+    int64_t mag = int64_t(q_isqrt64(uint64_t(gr * gr + gi * gi)));
+    if (mag == 0)
+      mag = 1;
+
+    int64_t ur = (gr * Q15_ONE) / mag;
+    int64_t ui = (gi * Q15_ONE) / mag;
+    this->u_re[c] = q15_t(std::max(int64_t(-Q15_MAX), std::min(int64_t(Q15_MAX), ur)));
+    this->u_im[c] = q15_t(std::max(int64_t(-Q15_MAX), std::min(int64_t(Q15_MAX), ui)));
+  }
+
+  this->argmax = 0;
+  int64_t max = 0;
+
+  const q15_t *ur = this->u_re;
+  const q15_t *ui = this->u_im;
+
+  for (int n = 0 ; n < this->n_grid ; n++)
+  {
+    const q15_t *tr = this->tw_re + n * this->n_cells;
+    const q15_t *ti = this->tw_im + n * this->n_cells;
+
+    int32_t acc_re = 0, acc_im = 0;
+    int c = 0;
+
+#ifdef E3E_Q15_NEON
+    int32x4_t vre = vdupq_n_s32(0);
+    int32x4_t vim = vdupq_n_s32(0);
+
+    for ( ; c + 4 <= this->n_cells ; c += 4)
+    {
+      int16x4_t a = vld1_s16(ur + c);
+      int16x4_t b = vld1_s16(ui + c);
+      int16x4_t x = vld1_s16(tr + c);
+      int16x4_t y = vld1_s16(ti + c);
+
+      int32x4_t pr = vmlsl_s16(vmull_s16(a, x), b, y);
+      int32x4_t pi = vmlal_s16(vmull_s16(a, y), b, x);
+
+      vre = vsraq_n_s32(vre, pr, 15);
+      vim = vsraq_n_s32(vim, pi, 15);
+    }
+
+    acc_re = vgetq_lane_s32(vre, 0) + vgetq_lane_s32(vre, 1) + vgetq_lane_s32(vre, 2) + vgetq_lane_s32(vre, 3);
+    acc_im = vgetq_lane_s32(vim, 0) + vgetq_lane_s32(vim, 1) + vgetq_lane_s32(vim, 2) + vgetq_lane_s32(vim, 3);
+#endif
+
+    // the products of two unit vectors fit in 31 bits, each term is Q15
+    for ( ; c < this->n_cells ; c++)
+    {
+      int32_t pr = int32_t(ur[c]) * tr[c] - int32_t(ui[c]) * ti[c];
+      int32_t pi = int32_t(ur[c]) * ti[c] + int32_t(ui[c]) * tr[c];
+      acc_re += pr >> 15;
+      acc_im += pi >> 15;
+    }
+
+    int64_t power = int64_t(acc_re) * acc_re + int64_t(acc_im) * acc_im;
+    this->spatial_spectrum[n] = power;
+
+    if (power > max)
+    {
+      max = power;
+      this->argmax = n;
+    }
+  }
+
+  return this->argmax;
+}
+
+MFCCQ15::MFCCQ15(MFCC *_mfcc, float input_scale)
+  : mfcc(_mfcc)
+{
+  this->mfcc_size = _mfcc->mfcc_size;
+  this->n_bins = _mfcc->fft_size / 2 + 1;
+
+  // every filter has its own scale, its largest weight in [2^15, 2^16)
+  this->fb_weights = new uint16_t[_mfcc->fb_nnz > 0 ? _mfcc->fb_nnz : 1];
+  this->fb_shift = new int[this->mfcc_size];
+
+  for (int m = 0 ; m < this->mfcc_size ; m++)
+  {
+    const float *w = _mfcc->fb_weights + _mfcc->fb_offset[m];
+    uint16_t *wq = this->fb_weights + _mfcc->fb_offset[m];
+
+    float w_max = 0.;
+    for (int j = 0 ; j < _mfcc->fb_len[m] ; j++)
+      w_max = std::max(w_max, w[j]);
+
+    int s = 0;
+    if (w_max > 0.)
+      s = int(floor(log2(65535. / w_max)));
+    this->fb_shift[m] = s;
+
+    for (int j = 0 ; j < _mfcc->fb_len[m] ; j++)
+      wq[j] = uint16_t(std::min(65535., floor(ldexp(double(w[j]), s) + 0.5)));
+  }
+
+  // the DCT of the MFCC object applied to the unit vectors
+  int N = this->mfcc_size;
+  std::vector<float> unit(N * N, 0.), rows(N * N);
+  for (int j = 0 ; j < N ; j++)
+    unit[j * N + j] = 1.;
+  _mfcc->dct_batch(unit.data(), rows.data(), N);
+
+  this->dct = new int32_t[N * N];
+  for (int i = 0 ; i < N * N ; i++)
+    this->dct[i] = int32_t(floor(ldexp(double(rows[i]), 16) + 0.5));
+
+  this->log_offset = int32_t(floor(2. * log(double(input_scale)) * 65536. + 0.5));
+
+  this->log_mel = new int32_t[N];
+}
+
+MFCCQ15::~MFCCQ15()
+{
+  delete[] this->fb_weights;
+  delete[] this->fb_shift;
+  delete[] this->dct;
+  delete[] this->log_mel;
+}
+
+void MFCCQ15::log_mel_q16(const int16_t *re, const int16_t *im, int exponent, int32_t *out)
+{
+  MFCC *m = this->mfcc;
+
+  for (int i = 0 ; i < this->mfcc_size ; i++)
+  {
+    const uint16_t *w = this->fb_weights + m->fb_offset[i];
+    int start = m->fb_start[i];
+
+    uint64_t acc = 0;
+    for (int j = 0 ; j < m->fb_len[i] ; j++)
+    {
+      int32_t r = re[start + j], q = im[start + j];
+      uint32_t power = uint32_t(r * r) + uint32_t(q * q);
+      acc += uint64_t(w[j]) * power;
+    }
+
+    // log(0) is the log of the smallest energy
+    if (acc == 0)
+      acc = 1;
+
+    // log2 of acc * 2^(2 exponent - shift), then ln
+    int64_t l2 = int64_t(q_log2_q16(acc)) + int64_t(2 * exponent - this->fb_shift[i]) * 65536;
+    out[i] = int32_t((l2 * Q30_LN2 + (int64_t(1) << 29)) >> 30) - this->log_offset;
+  }
+}
+
+void MFCCQ15::transform(const int16_t *re, const int16_t *im, int exponent, int32_t *out)
+{
+  int N = this->mfcc_size;
+
+  this->log_mel_q16(re, im, exponent, this->log_mel);
+
+  for (int k = 0 ; k < N ; k++)
+  {
+    int64_t acc = 0;
+    for (int j = 0 ; j < N ; j++)
+      acc += int64_t(this->dct[j * N + k]) * this->log_mel[j];
+    out[k] = int32_t((acc + (1 << 15)) >> 16);
+  }
+}
+
+void MFCCQ15::transform_stft(STFTQ15 *stft, long frame, int32_t *out)
+{
+  for (int c = 0 ; c < stft->channels ; c++)
+    this->transform(stft->re_at(frame, c), stft->im_at(frame, c), stft->exponent_at(frame, c),
+        out + c * this->mfcc_size);
+}
@@ -0,0 +1,291 @@
+#ifndef __FIXED_POINT_H__
+#define __FIXED_POINT_H__
+
+/*
+ * Fixed-point processing path for targets without a fast FPU.
+ *
+ * The same chain as STFT -> SRPPHAT / MFCC, on integers only once the
+ * objects are built:
+ *
+ *  STFTQ15     int16 interleaved input ring, Q15 window, radix-2 complex
+ *              FFT of two channels at once (x_a + j x_b) with block
+ *              floating point: before every stage the block is shifted
+ *              right by 0, 1 or 2 bits depending on its maximum and the
+ *              shifts are counted in an exponent, so that the spectrum
+ *              of channel c of a frame is X_q * 2^exponent[c] where X_q
+ *              is int16. Quiet frames are shifted left first to use the
+ *              whole range.
+ *
+ *  SRPPHATQ15  same grid, pairs and band as a float SRPPHAT (which only
+ *              provides the geometry). The cross spectra are accumulated
+ *              exactly in int64 (the frame leaving the window subtracts
+ *              exactly what it added), the PHAT weighted cross spectra
+ *              and the steering factors are Q15, the search accumulates
+ *              int32 and the argmax is on int64 powers.
+ *
+ *  MFCCQ15     filterbank of a float MFCC with 16 bits weights, the log
+ *              of the mel energies in Q16 by an integer log2 and a Q16
+ *              DCT, the cepstra are Q16 int32.
+ *
+ * On ARM with NEON (__ARM_NEON) the search kernel, which is most of the
+ * work, uses the 16 x 16 -> 32 bits multiply-accumulate instructions,
+ * the scalar code computes exactly the same values.
+ *
+ *   STFTQ15 stft(FFT_SIZE, NFRAMES, CHANNELS);
+ *   SRPPHATQ15 srp(&stft, &srpphat_geometry);
+ *   MFCCQ15 mfcc_q(&mfcc);
+ *
+ *   memcpy(stft.get_in_buffer(), pcm, ...);
+ *   stft.transform();
+ *   int argmax = srp.process();
+ *   mfcc_q.transform_stft(&stft, stft.frame_count - 1, cepstra);
+ */
+
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "srpphat.h"
+#include "mfcc.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define E3E_Q15_NEON 1
+#endif
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+#define Q15_ONE 32768
+#define Q15_MAX 32767
+
+// ln(2) in Q30
+#define Q30_LN2 744261118
+
+/* float in [-1, 1) to Q15, rounded and saturated */
+inline q15_t float_to_q15(float x)
+{
+  float v = x * float(Q15_ONE);
+  v += v < 0 ? -0.5f : 0.5f;
+  if (v >= float(Q15_MAX))
+    return Q15_MAX;
+  if (v <= -float(Q15_ONE))
+    return -Q15_ONE;
+  return q15_t(v);
+}
+
+inline float q15_to_float(q15_t x)
+{
+  return float(x) / float(Q15_ONE);
+}
+
+/* Q16 to float, for the outputs of MFCCQ15 */
+inline float q16_to_float(int32_t x)
+{
+  return float(x) / 65536.f;
+}
+
+/* number of leading zeros, 64 for 0 */
+inline int q_clz64(uint64_t x)
+{
+  return x == 0 ? 64 : __builtin_clzll(x);
+}
+
+/* v * 2^s, rounded to nearest when s < 0 */
+inline int64_t q_shift(int64_t v, int s)
+{
+  if (s >= 0)
+    return v * (int64_t(1) << s);
+  if (s < -62)
+    return 0;
+  return (v + (int64_t(1) << (-s - 1))) >> (-s);
+}
+
+/* floor(sqrt(x)), digit by digit */
+inline uint64_t q_isqrt64(uint64_t x)
+{
+  uint64_t res = 0;
+  uint64_t bit = uint64_t(1) << 62;
+
+  while (bit > x)
+    bit >>= 2;
+
+  while (bit != 0)
+  {
+    if (x >= res + bit)
+    {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    }
+    else
+      res >>= 1;
+    bit >>= 2;
+  }
+
+  return res;
+}
+
+/*
+ * log2(x) in Q16 for x > 0. The integer part is the position of the
+ * highest bit, the fraction bits are obtained by squaring the mantissa
+ * (in Q30) and renormalizing, one bit per squaring.
+ */
+inline int32_t q_log2_q16(uint64_t x)
+{
+  if (x == 0)
+    return 0;
+
+  int e = 63 - q_clz64(x);
+  uint64_t y = (x << (63 - e)) >> 33;  // mantissa in [1, 2), Q30
+
+  int32_t frac = 0;
+  for (int i = 15 ; i >= 0 ; i--)
+  {
+    y = (y * y) >> 30;
+    if (y >= (uint64_t(1) << 31))
+    {
+      y >>= 1;
+      frac |= 1 << i;
+    }
+  }
+
+  return (int32_t(e) << 16) | frac;
+}
+
+class STFTQ15
+{
+  public:
+    int fft_size;
+    int n_frames;
+    int channels;
+    int n_bins;
+    int log2_size;
+    int n_pairs;          // FFTs per frame, (channels + 1) / 2
+    int channel_stride;   // n_bins padded to a cache line
+
+    int n_samples_per_in_frame;
+    int n_samples_per_out_frame;
+
+    int16_t *circ_in_buffer;  // in[frame][n * channels + c]
+    int16_t *circ_out_re;     // out[frame][c * channel_stride + k]
+    int16_t *circ_out_im;
+    int *exponents;           // exponents[frame * channels + c]
+
+    int current_frame;
+    long frame_count;         // frame f is in slot f % n_frames
+
+    q15_t *window;            // NULL for rectangular
+
+    STFTQ15(int fft_size, int n_frames, int channels);
+    ~STFTQ15();
+
+    int16_t *get_in_buffer();
+    void transform();
+
+    // Q15 copy of a float window of fft_size samples, NULL for rectangular
+    void set_window(const float *window);
+
+    // the spectrum of a channel of the frame number f since the start
+    inline int16_t *re_at(long f, int c)
+    {
+      return this->circ_out_re + (f % this->n_frames) * this->n_samples_per_out_frame + c * this->channel_stride;
+    }
+    inline int16_t *im_at(long f, int c)
+    {
+      return this->circ_out_im + (f % this->n_frames) * this->n_samples_per_out_frame + c * this->channel_stride;
+    }
+    inline int exponent_at(long f, int c)
+    {
+      return this->exponents[(f % this->n_frames) * this->channels + c];
+    }
+
+  private:
+    // work buffers and tables of the complex FFT of fft_size points
+    int16_t *zr;
+    int16_t *zi;
+    q15_t *tw_re;
+    q15_t *tw_im;
+    int *bitrev;
+
+    int fft_pair(const int16_t *in, int ca, int cb);
+};
+
+class SRPPHATQ15
+{
+  public:
+    STFTQ15 *stft;
+    SRPPHAT *geometry;
+
+    int n_grid;
+    int n_pairs;
+    int *pairs;
+    int k_min;
+    int k_len;
+    int n_frames;
+    int n_cells;         // n_pairs * k_len
+
+    // steering factors, tw[n * n_cells + p * k_len + k]
+    q15_t *tw_re;
+    q15_t *tw_im;
+
+    // cross spectra in units of 2^-G_frac, G[p * k_len + k]
+    int64_t *G_re;
+    int64_t *G_im;
+    int G_frac;
+
+    // PHAT weighted cross spectra
+    q15_t *u_re;
+    q15_t *u_im;
+
+    int64_t *spatial_spectrum;
+    int argmax;
+
+    SRPPHATQ15(STFTQ15 *stft, SRPPHAT *geometry);
+    ~SRPPHATQ15();
+
+    // update the cross spectra with the latest frame and search the grid
+    int process();
+
+    void update(long frame);
+    int search();
+
+  private:
+    void accumulate(long frame, int sign);
+};
+
+class MFCCQ15
+{
+  public:
+    MFCC *mfcc;
+    int mfcc_size;
+    int n_bins;
+
+    // the filterbank of the MFCC, the weights of filter m in Q(fb_shift[m])
+    uint16_t *fb_weights;
+    int *fb_shift;
+
+    // the DCT-II matrix in Q16, dct[j * mfcc_size + m]
+    int32_t *dct;
+
+    // 2 ln(input_scale) in Q16, removed from the log energies
+    int32_t log_offset;
+
+    int32_t *log_mel;    // Q16
+
+    /*
+     * input_scale is the gain from the float samples of the float path
+     * to the int16 samples, so that the outputs can be compared
+     */
+    MFCCQ15(MFCC *mfcc, float input_scale = 1.);
+    ~MFCCQ15();
+
+    // log-mel energies (Q16) of one spectrum X_q * 2^exponent
+    void log_mel_q16(const int16_t *re, const int16_t *im, int exponent, int32_t *out);
+
+    // cepstra (Q16) of one spectrum
+    void transform(const int16_t *re, const int16_t *im, int exponent, int32_t *out);
+
+    // cepstra of all the channels of a frame, out[c * mfcc_size + m]
+    void transform_stft(STFTQ15 *stft, long frame, int32_t *out);
+};
+
+#endif // __FIXED_POINT_H__
@@ -0,0 +1,417 @@
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "instrument.h"
+
+HistoryRing::HistoryRing(int _channels, int _block_size, int _n_blocks, float _scale)
+  : channels(_channels), block_size(_block_size), n_blocks(_n_blocks), scale(_scale)
+{
+  this->block_samples = _channels * _block_size;
+
+  this->samples = (int16_t *)e3e_aligned_malloc(sizeof(int16_t) * this->block_samples * _n_blocks);
+  memset(this->samples, 0, sizeof(int16_t) * this->block_samples * _n_blocks);
+
+  this->sequences = new uint64_t[_n_blocks];
+  this->timestamps = new std::atomic<uint64_t>[_n_blocks];
+  for (int i = 0 ; i < _n_blocks ; i++)
+  {
+    this->sequences[i] = 0;
+    this->timestamps[i].store(0, std::memory_order_relaxed);
+  }
+
+  this->head = 0;
+  this->started = 0;
+}
+
+HistoryRing::~HistoryRing()
+{
+  free(this->samples);
+  delete[] this->sequences;
+  delete[] this->timestamps;
+}
+
+void HistoryRing::push(const int16_t *pcm, uint64_t sequence, uint64_t timestamp_ns)
+{
+  uint64_t h = this->head.load(std::memory_order_relaxed);
+
+  // the readers check `started` after their copy
+  this->started.store(h + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  memcpy(this->block(h), pcm, sizeof(int16_t) * this->block_samples);
+  this->sequences[h % this->n_blocks] = sequence;
+  this->timestamps[h % this->n_blocks].store(timestamp_ns, std::memory_order_relaxed);
+
+  this->head.store(h + 1, std::memory_order_release);
+}
+
+void HistoryRing::push(const float *pcm, uint64_t sequence, uint64_t timestamp_ns)
+{
+  uint64_t h = this->head.load(std::memory_order_relaxed);
+
+  this->started.store(h + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  int16_t *out = this->block(h);
+  for (int i = 0 ; i < this->block_samples ; i++)
+  {
+    float v = pcm[i] * this->scale;
+    v = std::max(-32768.f, std::min(32767.f, v));
+    out[i] = int16_t(lrintf(v));
+  }
+  this->sequences[h % this->n_blocks] = sequence;
+  this->timestamps[h % this->n_blocks].store(timestamp_ns, std::memory_order_relaxed);
+
+  this->head.store(h + 1, std::memory_order_release);
+}
+
+uint64_t HistoryRing::oldest()
+{
+  uint64_t h = this->head.load(std::memory_order_acquire);
+  return h > uint64_t(this->n_blocks) ? h - this->n_blocks : 0;
+}
+
+bool HistoryRing::valid(uint64_t b)
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return this->started.load(std::memory_order_relaxed) <= b + this->n_blocks;
+}
+
+uint64_t HistoryRing::find(uint64_t timestamp_ns)
+{
+  uint64_t h = this->head.load(std::memory_order_acquire);
+  uint64_t lo = h > uint64_t(this->n_blocks) ? h - this->n_blocks : 0;
+  uint64_t hi = h;
+
+  // the timestamps increase with the blocks. A block whose slot the writer
+  // started to reuse while searching is gone, all the blocks still there
+  // are after it, so it counts as earlier than timestamp_ns
+  while (lo < hi)
+  {
+    uint64_t mid = lo + (hi - lo) / 2;
+    uint64_t t = this->timestamps[mid % this->n_blocks].load(std::memory_order_relaxed);
+    if (!this->valid(mid) || t < timestamp_ns)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+static inline size_t align_up(size_t x)
+{
+  return (x + HISTORY_IO_ALIGN - 1) / HISTORY_IO_ALIGN * HISTORY_IO_ALIGN;
+}
+
+/* pwrite everything, leaves O_DIRECT for buffered writes if the file system refuses it */
+static bool write_all(int fd, const char *buf, size_t size, off_t offset, bool &direct)
+{
+  while (size > 0)
+  {
+    ssize_t n = pwrite(fd, buf, size, offset);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno == EINVAL && direct)
+      {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        direct = false;
+        continue;
+      }
+
+      std::cerr << "Error: could not write a clip: " << strerror(errno) << std::endl;
+      return false;
+    }
+
+    buf += n;
+    size -= n;
+    offset += n;
+  }
+
+  return true;
+}
+
+/* a WAV header padded with a JUNK chunk to HISTORY_IO_ALIGN bytes, so that the samples are aligned */
+static void wav_header(char *buf, int channels, int fs, uint32_t data_bytes)
+{
+  memset(buf, 0, HISTORY_IO_ALIGN);
+
+  uint32_t u32;
+  uint16_t u16;
+
+  memcpy(buf, "RIFF", 4);
+  u32 = HISTORY_IO_ALIGN - 8 + data_bytes;
+  memcpy(buf + 4, &u32, 4);
+  memcpy(buf + 8, "WAVE", 4);
+
+  memcpy(buf + 12, "fmt ", 4);
+  u32 = 16;
+  memcpy(buf + 16, &u32, 4);
+  u16 = 1;  // PCM
+  memcpy(buf + 20, &u16, 2);
+  u16 = channels;
+  memcpy(buf + 22, &u16, 2);
+  u32 = fs;
+  memcpy(buf + 24, &u32, 4);
+  u32 = fs * channels * 2;
+  memcpy(buf + 28, &u32, 4);
+  u16 = channels * 2;
+  memcpy(buf + 32, &u16, 2);
+  u16 = 16;
+  memcpy(buf + 34, &u16, 2);
+
+  memcpy(buf + 36, "JUNK", 4);
+  u32 = HISTORY_IO_ALIGN - 8 - 44;
+  memcpy(buf + 40, &u32, 4);
+
+  memcpy(buf + HISTORY_IO_ALIGN - 8, "data", 4);
+  memcpy(buf + HISTORY_IO_ALIGN - 4, &data_bytes, 4);
+}
+
+ClipWriter::ClipWriter(HistoryRing *_ring, const std::string &_prefix, int _fs, float pre_seconds, float post_seconds,
+    int max_pending, bool compress)
+  : ring(_ring), prefix(_prefix), fs(_fs), requests(max_pending)
+{
+  this->pre_blocks = int(ceil(pre_seconds * _fs / _ring->block_size));
+  this->post_blocks = int(ceil(post_seconds * _fs / _ring->block_size));
+
+  if (this->pre_blocks >= _ring->n_blocks)
+    std::cerr << "Warning: the history ring is shorter than the pre-trigger span of the clips." << std::endl;
+
+  // frames of whole blocks, close to the default frame size of the codec
+  this->encoder = NULL;
+  this->frame = NULL;
+  this->frame_blocks = 0;
+  size_t chunk_bytes = sizeof(int16_t) * _ring->block_samples;
+  if (compress)
+  {
+    this->frame_blocks = std::max(1, AUDIO_CODEC_FRAME_SIZE / _ring->block_size);
+    this->encoder = new AudioEncoder(_ring->channels, _fs, AUDIO_CODEC_INT16, this->frame_blocks * _ring->block_size);
+    this->frame = (int16_t *)e3e_aligned_malloc(sizeof(int16_t) * this->frame_blocks * _ring->block_samples);
+    chunk_bytes = this->encoder->max_frame_bytes();
+  }
+
+  // room for a block or a frame and what is left of the previous aligned write
+  this->staging_size = std::max(align_up(chunk_bytes + HISTORY_IO_ALIGN), size_t(16 * HISTORY_IO_ALIGN));
+  this->staging = (char *)e3e_aligned_malloc(this->staging_size, HISTORY_IO_ALIGN);
+
+  this->next_id = 0;
+  this->running = false;
+  this->stopping = false;
+
+  this->n_clips = 0;
+  this->n_rejected = 0;
+  this->n_lost_blocks = 0;
+  this->n_bytes = 0;
+  this->direct_io = false;
+}
+
+ClipWriter::~ClipWriter()
+{
+  this->stop();
+  free(this->staging);
+  free(this->frame);
+  delete this->encoder;
+}
+
+bool ClipWriter::trigger(uint64_t timestamp_ns)
+{
+  ClipRequest request;
+  request.timestamp_ns = timestamp_ns;
+  request.block = this->ring->find(timestamp_ns);
+  request.id = this->next_id;
+
+  if (!this->requests.push(request))
+  {
+    this->n_rejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  this->next_id++;
+  return true;
+}
+
+void ClipWriter::start()
+{
+  this->stopping = false;
+  this->running = true;
+  this->thread = std::thread(&ClipWriter::run, this);
+}
+
+void ClipWriter::stop()
+{
+  this->stopping = true;
+  if (this->thread.joinable())
+    this->thread.join();
+  this->running = false;
+}
+
+void ClipWriter::run()
+{
+  ClipRequest request;
+
+  while (true)
+  {
+    if (this->requests.pop(request))
+      this->write_clip(request);
+    else if (this->stopping)
+      break;
+    else
+      usleep(1000);
+  }
+}
+
+bool ClipWriter::write_clip(const ClipRequest &request)
+{
+  E3E_PROBE(INSTR_CLIP_WRITE);
+
+  HistoryRing *r = this->ring;
+  size_t block_bytes = sizeof(int16_t) * r->block_samples;
+
+  // the span around the block of the event, the blocks no longer in the ring are silent
+  uint64_t event = request.block;
+  uint64_t first = event > uint64_t(this->pre_blocks) ? event - this->pre_blocks : 0;
+  uint64_t end = event + 1 + this->post_blocks;
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s_%d.%s", this->prefix.c_str(), request.id, this->encoder ? "e3ea" : "wav");
+
+  bool direct = true;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if (fd < 0 && errno == EINVAL)
+  {
+    direct = false;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (fd < 0)
+  {
+    std::cerr << "Error: could not create the clip " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  bool ok = true;
+  size_t fill = 0;
+  off_t offset = HISTORY_IO_ALIGN;
+  uint64_t n_lost = 0;
+  uint64_t b;
+  int n_frame = 0;
+
+  if (this->encoder)
+    this->encoder->reset();
+
+  // write the aligned part of the staging buffer when n more bytes do not fit
+  auto make_room = [&](size_t n)
+  {
+    if (ok && fill + n > this->staging_size)
+    {
+      size_t aligned = fill / HISTORY_IO_ALIGN * HISTORY_IO_ALIGN;
+      ok = write_all(fd, this->staging, aligned, offset, direct);
+      offset += aligned;
+      memmove(this->staging, this->staging + aligned, fill - aligned);
+      fill -= aligned;
+    }
+  };
+
+  auto encode_frame = [&]()
+  {
+    make_room(this->encoder->max_frame_bytes());
+    fill += this->encoder->encode(this->frame, n_frame * r->block_size, (uint8_t *)this->staging + fill);
+    n_frame = 0;
+  };
+
+  for (b = first ; b < end && ok ; b++)
+  {
+    // wait for the block to be captured, the clip ends there when stopping
+    while (r->head.load(std::memory_order_acquire) <= b)
+    {
+      if (this->stopping)
+        break;
+      usleep(1000);
+    }
+    if (r->head.load(std::memory_order_acquire) <= b)
+      break;
+
+    char *dst;
+    if (this->encoder)
+      dst = (char *)(this->frame + n_frame * r->block_samples);
+    else
+    {
+      make_room(block_bytes);
+      dst = this->staging + fill;
+    }
+
+    memcpy(dst, r->block(b), block_bytes);
+
+    // the block was overwritten during the copy, or before
+    if (!r->valid(b))
+    {
+      memset(dst, 0, block_bytes);
+      n_lost++;
+    }
+
+    if (!this->encoder)
+      fill += block_bytes;
+    else if (++n_frame == this->frame_blocks)
+      encode_frame();
+  }
+
+  if (this->encoder && n_frame > 0)
+    encode_frame();
+
+  uint64_t n_blocks = b - first;
+  uint32_t data_bytes = uint32_t(this->encoder ? this->encoder->n_bytes : n_blocks * block_bytes);
+
+  // the last write is padded and the file truncated to its size
+  if (ok && fill > 0)
+  {
+    size_t n = align_up(fill);
+    memset(this->staging + fill, 0, n - fill);
+    ok = write_all(fd, this->staging, n, offset, direct);
+  }
+
+  if (ok)
+  {
+    if (this->encoder)
+    {
+      memset(this->staging, 0, HISTORY_IO_ALIGN);
+      this->encoder->write_header((uint8_t *)this->staging, HISTORY_IO_ALIGN);
+    }
+    else
+      wav_header(this->staging, r->channels, this->fs, data_bytes);
+    ok = write_all(fd, this->staging, HISTORY_IO_ALIGN, 0, direct);
+  }
+
+  if (ok && ftruncate(fd, HISTORY_IO_ALIGN + data_bytes) != 0)
+    ok = false;
+
+  fdatasync(fd);
+  close(fd);
+
+  this->direct_io = direct;
+  this->n_lost_blocks.fetch_add(n_lost, std::memory_order_relaxed);
+  this->n_bytes.fetch_add(HISTORY_IO_ALIGN + data_bytes, std::memory_order_relaxed);
+  if (ok)
+  {
+    this->n_clips.fetch_add(1, std::memory_order_relaxed);
+    E3E_COUNT(INSTR_CLIPS, 1);
+  }
+
+  if (this->on_clip)
+    this->on_clip(path, n_blocks, n_lost);
+
+  return ok;
+}
@@ -0,0 +1,151 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+/*
+ * Pre-trigger audio history and event clip dumping.
+ *
+ * HistoryRing keeps the last n_blocks blocks of raw multichannel PCM
+ * (int16, interleaved) with their capture sequence numbers and
+ * timestamps, typically several seconds, much more than the STFT keeps.
+ * It has a single writer, the capture thread (see CaptureThread::
+ * set_history), which never waits: the readers copy the blocks and check
+ * afterwards that the writer did not reuse the slots in the meantime.
+ *
+ * ClipWriter dumps the span around an event to a WAV file from its own
+ * thread. trigger() only pushes a request in a lock-free queue, so it can
+ * be called from the processing threads. The writer copies the blocks
+ * as soon as they are captured into an aligned staging buffer and writes
+ * it with O_DIRECT (falling back to buffered writes where the file system
+ * does not support it), so a slow card only delays the clip, the capture
+ * and the processing never wait for it. Blocks that are overwritten
+ * before the writer could copy them are written as silence and counted
+ * in n_lost_blocks: the ring must hold the pre-trigger span plus the
+ * time the storage may lag. With compress, the clips are written with
+ * the lossless codec of audio_codec.h instead (.e3ea files, the frames
+ * starting at HISTORY_IO_ALIGN).
+ *
+ *   HistoryRing history(CHANNELS, FFT_SIZE, 10 * FS / FFT_SIZE);
+ *   reader.set_history(&history);
+ *   ClipWriter clips(&history, "/data/event", FS, 3., 2.);
+ *   clips.start();
+ *   ...
+ *   if (event)
+ *     clips.trigger(frame.timestamp_ns);
+ */
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <functional>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "spsc_queue.h"
+#include "audio_codec.h"
+
+// alignment of the buffers, offsets and sizes of O_DIRECT writes
+#define HISTORY_IO_ALIGN 4096
+
+class HistoryRing
+{
+  public:
+    int channels;
+    int block_size;
+    int n_blocks;
+    int block_samples;   // channels * block_size
+
+    int16_t *samples;    // block b at (b % n_blocks) * block_samples
+    uint64_t *sequences;
+    std::atomic<uint64_t> *timestamps;   // read by find() while the writer reuses the slots
+
+    // number of blocks written, and of blocks the writer started to write
+    std::atomic<uint64_t> head;
+    char pad_head[E3E_CACHE_LINE];
+    std::atomic<uint64_t> started;
+
+    // gain of the float samples, clipped to int16
+    float scale;
+
+    HistoryRing(int channels, int block_size, int n_blocks, float scale = 32767.);
+    ~HistoryRing();
+
+    // writer side
+    void push(const int16_t *pcm, uint64_t sequence, uint64_t timestamp_ns);
+    void push(const float *pcm, uint64_t sequence, uint64_t timestamp_ns);
+
+    // reader side
+    uint64_t oldest();
+    inline int16_t *block(uint64_t b)
+    {
+      return this->samples + (b % this->n_blocks) * this->block_samples;
+    }
+
+    // after copying block b (< head), true if the writer did not start to reuse its slot
+    bool valid(uint64_t b);
+
+    // first block still in the ring captured at or after timestamp_ns, head if none yet
+    uint64_t find(uint64_t timestamp_ns);
+};
+
+struct ClipRequest
+{
+  uint64_t timestamp_ns;  // time of the event
+  uint64_t block;         // its block in the history, found when triggered
+  int id;                 // number of the clip, in the file name
+};
+
+class ClipWriter
+{
+  public:
+    HistoryRing *ring;
+    std::string prefix;   // the clips are prefix_<id>.wav, or .e3ea when compressed
+    int fs;
+    int pre_blocks;
+    int post_blocks;
+
+    SPSCQueue<ClipRequest> requests;
+    int next_id;
+
+    std::thread thread;
+    std::atomic<bool> running;
+
+    // the staging buffer, a multiple of HISTORY_IO_ALIGN
+    char *staging;
+    size_t staging_size;
+
+    // the encoder and the blocks of its current frame, NULL for WAV clips
+    AudioEncoder *encoder;
+    int16_t *frame;
+    int frame_blocks;     // blocks per frame
+
+    // statistics
+    std::atomic<uint64_t> n_clips;
+    std::atomic<uint64_t> n_rejected;     // triggers while the queue was full
+    std::atomic<uint64_t> n_lost_blocks;
+    std::atomic<uint64_t> n_bytes;
+    std::atomic<bool> direct_io;          // O_DIRECT was used for the last clip
+
+    // called from the writer thread after every clip
+    std::function<void(const std::string &path, uint64_t n_blocks, uint64_t n_lost)> on_clip;
+
+    ClipWriter(HistoryRing *ring, const std::string &prefix, int fs, float pre_seconds, float post_seconds,
+        int max_pending = 8, bool compress = false);
+    ~ClipWriter();
+
+    // request the clip around an event, never blocks, false if too many are
+    // pending. From one thread only.
+    bool trigger(uint64_t timestamp_ns);
+
+    void start();
+
+    // write the pending clips (with the blocks captured so far) and stop
+    void stop();
+
+    void run();
+
+  private:
+    std::atomic<bool> stopping;
+    bool write_clip(const ClipRequest &request);
+};
+
+#endif // __HISTORY_H__
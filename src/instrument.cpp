@@ -0,0 +1,432 @@
+
+#include <new>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "instrument.h"
+
+/* the histograms and counters of one thread, written by it only */
+struct InstrumentThread
+{
+  struct Probe
+  {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> buckets[INSTR_N_BUCKETS];
+  };
+
+  std::atomic<bool> in_use;
+  InstrumentThread *next;
+  std::atomic<uint64_t> counters[INSTR_N_COUNTERS];
+  Probe probes[INSTR_N_PROBES];
+};
+
+std::atomic<bool> instrument_enabled(true);
+
+// the blocks are never freed, a thread that ends leaves its block to the next one
+static std::atomic<InstrumentThread *> instrument_threads(NULL);
+static thread_local InstrumentThread *instrument_self = NULL;
+
+struct InstrumentRelease
+{
+  ~InstrumentRelease()
+  {
+    if (instrument_self != NULL)
+      instrument_self->in_use.store(false, std::memory_order_release);
+    instrument_self = NULL;
+  }
+};
+
+/* the only writer, no read-modify-write needed */
+static inline void instrument_add(std::atomic<uint64_t> &a, uint64_t n)
+{
+  a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static InstrumentThread *instrument_attach()
+{
+  // released when the thread ends
+  static thread_local InstrumentRelease release;
+  (void)release;
+
+  for (InstrumentThread *t = instrument_threads.load(std::memory_order_acquire) ; t != NULL ; t = t->next)
+  {
+    bool free_block = false;
+    if (t->in_use.compare_exchange_strong(free_block, true, std::memory_order_acquire))
+      return instrument_self = t;
+  }
+
+  void *mem = e3e_aligned_malloc(sizeof(InstrumentThread));
+  if (mem == NULL)
+    throw std::bad_alloc();
+
+  InstrumentThread *t = new (mem) InstrumentThread();
+  t->in_use.store(true, std::memory_order_relaxed);
+  t->next = instrument_threads.load(std::memory_order_relaxed);
+  while (!instrument_threads.compare_exchange_weak(t->next, t, std::memory_order_release, std::memory_order_relaxed))
+    ;
+
+  return instrument_self = t;
+}
+
+const char *instrument_probe_name(int probe)
+{
+  switch (probe)
+  {
+    case INSTR_CAPTURE_READ:
+      return "capture_read";
+    case INSTR_INGEST:
+      return "ingest";
+    case INSTR_STFT:
+      return "stft";
+    case INSTR_SRP_UPDATE:
+      return "srp_update";
+    case INSTR_SRP_SEARCH:
+      return "srp_search";
+    case INSTR_MFCC:
+      return "mfcc";
+    case INSTR_OUTPUT:
+      return "output";
+    case INSTR_CLIP_WRITE:
+      return "clip_write";
+    default:
+      return "unknown";
+  }
+}
+
+const char *instrument_counter_name(int counter)
+{
+  switch (counter)
+  {
+    case INSTR_BLOCKS:
+      return "blocks";
+    case INSTR_OVERRUNS:
+      return "overruns";
+    case INSTR_UNDERRUNS:
+      return "underruns";
+    case INSTR_CLIPS:
+      return "clips";
+    default:
+      return "unknown";
+  }
+}
+
+double InstrumentHistogram::mean_us() const
+{
+  if (this->count == 0)
+    return 0.;
+  return double(this->sum_ns) / this->count * 1e-3;
+}
+
+double InstrumentHistogram::percentile_us(double p) const
+{
+  if (this->count == 0)
+    return 0.;
+
+  uint64_t rank = uint64_t(ceil(p / 100. * this->count));
+  rank = std::min(this->count, std::max(uint64_t(1), rank));
+
+  uint64_t seen = 0;
+  int b = 0;
+  for ( ; b < INSTR_N_BUCKETS - 1 ; b++)
+  {
+    seen += this->buckets[b];
+    if (seen >= rank)
+      break;
+  }
+
+  uint64_t low = instrument_bucket_value(b);
+  uint64_t width = b + 1 < INSTR_N_BUCKETS ? instrument_bucket_value(b + 1) - low : 1;
+  return std::min(low + (width - 1) / 2, this->max_ns) * 1e-3;
+}
+
+void instrument_enable(bool on)
+{
+  instrument_enabled.store(on, std::memory_order_relaxed);
+}
+
+void instrument_record(int probe, uint64_t ns)
+{
+  InstrumentThread *t = instrument_self != NULL ? instrument_self : instrument_attach();
+  InstrumentThread::Probe &p = t->probes[probe];
+
+  instrument_add(p.count, 1);
+  instrument_add(p.sum_ns, ns);
+  if (ns > p.max_ns.load(std::memory_order_relaxed))
+    p.max_ns.store(ns, std::memory_order_relaxed);
+  instrument_add(p.buckets[instrument_bucket(ns)], 1);
+}
+
+void instrument_count(int counter, uint64_t n)
+{
+  InstrumentThread *t = instrument_self != NULL ? instrument_self : instrument_attach();
+  instrument_add(t->counters[counter], n);
+}
+
+void instrument_snapshot(InstrumentSnapshot *s)
+{
+  memcpy(s->magic, INSTRUMENT_MAGIC, 4);
+  s->version = INSTRUMENT_VERSION;
+  s->timestamp_ns = e3e_monotonic_ns();
+  s->n_threads = 0;
+  s->n_probes = INSTR_N_PROBES;
+  s->n_counters = INSTR_N_COUNTERS;
+  s->n_buckets = INSTR_N_BUCKETS;
+  memset(s->counters, 0, sizeof(s->counters));
+  memset(s->probes, 0, sizeof(s->probes));
+
+  for (InstrumentThread *t = instrument_threads.load(std::memory_order_acquire) ; t != NULL ; t = t->next)
+  {
+    if (t->in_use.load(std::memory_order_relaxed))
+      s->n_threads++;
+
+    for (int c = 0 ; c < INSTR_N_COUNTERS ; c++)
+      s->counters[c] += t->counters[c].load(std::memory_order_relaxed);
+
+    for (int p = 0 ; p < INSTR_N_PROBES ; p++)
+    {
+      const InstrumentThread::Probe &src = t->probes[p];
+      InstrumentHistogram &dst = s->probes[p];
+
+      uint64_t count = src.count.load(std::memory_order_relaxed);
+      if (count == 0)
+        continue;
+
+      // the count is the sum of the buckets, that may be a little ahead of it
+      uint64_t n = 0;
+      for (int b = 0 ; b < INSTR_N_BUCKETS ; b++)
+      {
+        uint64_t v = src.buckets[b].load(std::memory_order_relaxed);
+        dst.buckets[b] += v;
+        n += v;
+      }
+      dst.count += n;
+      dst.sum_ns += src.sum_ns.load(std::memory_order_relaxed);
+      dst.max_ns = std::max(dst.max_ns, src.max_ns.load(std::memory_order_relaxed));
+    }
+  }
+}
+
+void instrument_reset()
+{
+  for (InstrumentThread *t = instrument_threads.load(std::memory_order_acquire) ; t != NULL ; t = t->next)
+  {
+    for (int c = 0 ; c < INSTR_N_COUNTERS ; c++)
+      t->counters[c].store(0, std::memory_order_relaxed);
+
+    for (int p = 0 ; p < INSTR_N_PROBES ; p++)
+    {
+      InstrumentThread::Probe &probe = t->probes[p];
+      probe.count.store(0, std::memory_order_relaxed);
+      probe.sum_ns.store(0, std::memory_order_relaxed);
+      probe.max_ns.store(0, std::memory_order_relaxed);
+      for (int b = 0 ; b < INSTR_N_BUCKETS ; b++)
+        probe.buckets[b].store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool instrument_read(const std::string &path, InstrumentSnapshot *snapshot)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Error: could not open " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  void *m = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(InstrumentSnapshot))
+    m = mmap(NULL, sizeof(InstrumentSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED)
+  {
+    std::cerr << "Error: " << path << " is not a snapshot." << std::endl;
+    return false;
+  }
+
+  const InstrumentSnapshot *shared = (const InstrumentSnapshot *)m;
+  bool ok = false;
+
+  // copy until the exporter did not write during the copy
+  for (int attempt = 0 ; attempt < 1000 && !ok ; attempt++)
+  {
+    uint64_t seq = shared->sequence.load(std::memory_order_acquire);
+    if (seq & 1)
+    {
+      usleep(100);
+      continue;
+    }
+
+    memcpy((void *)snapshot, (const void *)shared, sizeof(InstrumentSnapshot));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    ok = shared->sequence.load(std::memory_order_relaxed) == seq;
+  }
+  munmap(m, sizeof(InstrumentSnapshot));
+
+  if (!ok)
+    std::cerr << "Error: the snapshot " << path << " keeps changing." << std::endl;
+  else if (memcmp(snapshot->magic, INSTRUMENT_MAGIC, 4) != 0 || snapshot->version != INSTRUMENT_VERSION
+           || snapshot->n_probes != INSTR_N_PROBES || snapshot->n_counters != INSTR_N_COUNTERS
+           || snapshot->n_buckets != INSTR_N_BUCKETS)
+  {
+    std::cerr << "Error: " << path << " is not a snapshot of this version." << std::endl;
+    ok = false;
+  }
+
+  return ok;
+}
+
+void instrument_print(std::ostream &out, const InstrumentSnapshot &s)
+{
+  out << "# " << s.n_threads << " threads, at " << s.timestamp_ns << " ns" << std::endl;
+  out << "# probe count mean_us p50_us p99_us p999_us max_us" << std::endl;
+
+  for (int p = 0 ; p < INSTR_N_PROBES ; p++)
+  {
+    const InstrumentHistogram &h = s.probes[p];
+    if (h.count == 0)
+      continue;
+
+    out << instrument_probe_name(p) << " " << h.count << " " << h.mean_us() << " " << h.percentile_us(50.) << " ";
+    out << h.percentile_us(99.) << " " << h.percentile_us(99.9) << " " << h.max_ns * 1e-3 << std::endl;
+  }
+
+  for (int c = 0 ; c < INSTR_N_COUNTERS ; c++)
+    out << instrument_counter_name(c) << " " << s.counters[c] << std::endl;
+}
+
+InstrumentExporter::InstrumentExporter(const std::string &_path, int _period_ms, int _mode)
+  : path(_path), period_ms(_period_ms), mode(_mode)
+{
+  this->running = false;
+  this->n_exports = 0;
+  this->map = NULL;
+  this->map_size = 0;
+  this->snapshot = (InstrumentSnapshot *)e3e_aligned_malloc(sizeof(InstrumentSnapshot));
+  memset((void *)this->snapshot, 0, sizeof(InstrumentSnapshot));
+}
+
+InstrumentExporter::~InstrumentExporter()
+{
+  this->stop();
+  if (this->map != NULL)
+    munmap(this->map, this->map_size);
+  free(this->snapshot);
+}
+
+bool InstrumentExporter::open_mapped()
+{
+  if (this->map != NULL)
+    return true;
+
+  int fd = open(this->path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    std::cerr << "Error: could not create " << this->path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->map_size = sizeof(InstrumentSnapshot);
+  void *m = MAP_FAILED;
+  if (ftruncate(fd, this->map_size) == 0)
+    m = mmap(NULL, this->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED)
+  {
+    std::cerr << "Error: could not map " << this->path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  // a file left by a previous run starts again at an even sequence
+  this->map = (InstrumentSnapshot *)m;
+  this->map->sequence.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+bool InstrumentExporter::export_now()
+{
+  instrument_snapshot(this->snapshot);
+
+  if (this->mode == INSTR_EXPORT_TEXT)
+  {
+    std::string tmp = this->path + ".tmp";
+    std::ofstream fout(tmp);
+    instrument_print(fout, *this->snapshot);
+    fout.close();
+
+    if (!fout || rename(tmp.c_str(), this->path.c_str()) != 0)
+    {
+      std::cerr << "Error: could not write " << this->path << std::endl;
+      remove(tmp.c_str());
+      return false;
+    }
+  }
+  else
+  {
+    if (!this->open_mapped())
+      return false;
+
+    // odd while writing, the readers copy again
+    uint64_t seq = this->map->sequence.load(std::memory_order_relaxed);
+    this->map->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t header = offsetof(InstrumentSnapshot, timestamp_ns);
+    memcpy(this->map->magic, this->snapshot->magic, 4);
+    this->map->version = this->snapshot->version;
+    memcpy((char *)this->map + header, (const char *)this->snapshot + header, sizeof(InstrumentSnapshot) - header);
+
+    this->map->sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  this->n_exports++;
+  return true;
+}
+
+void InstrumentExporter::start()
+{
+  if (this->mode != INSTR_EXPORT_TEXT && !this->open_mapped())
+    return;
+
+  this->running = true;
+  this->thread = std::thread(&InstrumentExporter::run, this);
+}
+
+void InstrumentExporter::stop()
+{
+  this->running = false;
+  if (this->thread.joinable())
+    this->thread.join();
+}
+
+void InstrumentExporter::run()
+{
+  uint64_t next = e3e_monotonic_ns();
+
+  while (this->running)
+  {
+    if (e3e_monotonic_ns() < next)
+    {
+      // checks for a stop every 10 ms
+      usleep(std::min(10000, this->period_ms * 1000));
+      continue;
+    }
+
+    this->export_now();
+    next += uint64_t(this->period_ms) * 1000000;
+  }
+
+  // the last values when stopping
+  this->export_now();
+}
@@ -0,0 +1,216 @@
+#ifndef __INSTRUMENT_H__
+#define __INSTRUMENT_H__
+
+/*
+ * Latency histograms and counters of the hot path.
+ *
+ * The probes time the capture reads, the ingest, STFT::transform, the
+ * update of G and the grid search of SRPPHAT, the MFCC, the output stage
+ * of the pipeline and the writes of the clips. They are compiled in only
+ * with E3E_INSTRUMENT (make INSTRUMENT=-DE3E_INSTRUMENT), otherwise
+ * E3E_PROBE and E3E_COUNT are empty. Compiled in, they are on until
+ * instrument_enable(false), and a disabled probe costs a relaxed load.
+ *
+ *   {
+ *     E3E_PROBE(INSTR_STFT);      // times the end of the scope
+ *     ...
+ *   }
+ *   E3E_COUNT(INSTR_OVERRUNS, 1);
+ *
+ * Every thread records in its own block of histograms and counters, that
+ * only it writes (relaxed atomic stores, no lock, no shared cache line),
+ * and the exporter adds up the blocks of all the threads. A thread that
+ * ends leaves its block to the next new thread, the values are kept.
+ *
+ * The histograms are log-linear like HdrHistogram: the values in ns below
+ * INSTR_SUB are exact, above them every power of two is split in
+ * INSTR_SUB buckets, so a percentile is within 1 / INSTR_SUB (3 %) of
+ * the value, up to 2^INSTR_MAX_BITS ns (18 minutes).
+ *
+ * An InstrumentExporter thread takes a snapshot every period and writes
+ * it to a file: mapped (an InstrumentSnapshot updated in place under a
+ * sequence lock, e.g. in /dev/shm for shared memory, read back with
+ * instrument_read) or text (replaced atomically):
+ *
+ *   InstrumentExporter exporter("/dev/shm/e3e_instrument", 1000);
+ *   exporter.start();
+ */
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <iostream>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+
+#define INSTRUMENT_MAGIC "E3EI"
+#define INSTRUMENT_VERSION 1
+
+#define INSTR_SUB_BITS 5
+#define INSTR_SUB (1 << INSTR_SUB_BITS)
+#define INSTR_MAX_BITS 40
+#define INSTR_N_BUCKETS ((INSTR_MAX_BITS - INSTR_SUB_BITS + 1) * INSTR_SUB)
+
+enum instrument_probe
+{
+  INSTR_CAPTURE_READ = 0,   // read of a block by the capture thread
+  INSTR_INGEST,             // STFT::ingest
+  INSTR_STFT,               // STFT::transform
+  INSTR_SRP_UPDATE,         // SRPPHAT::update
+  INSTR_SRP_SEARCH,         // SRPPHAT::search
+  INSTR_MFCC,               // MFCC of a frame or a batch
+  INSTR_OUTPUT,             // OutputStage of the pipeline
+  INSTR_CLIP_WRITE,         // ClipWriter, a whole clip
+  INSTR_N_PROBES
+};
+
+enum instrument_counter
+{
+  INSTR_BLOCKS = 0,         // blocks captured
+  INSTR_OVERRUNS,           // blocks dropped, the capture ring was full
+  INSTR_UNDERRUNS,          // waits for a block that timed out
+  INSTR_CLIPS,              // clips written
+  INSTR_N_COUNTERS
+};
+
+enum instrument_export_mode
+{
+  INSTR_EXPORT_MAPPED = 0,
+  INSTR_EXPORT_TEXT
+};
+
+const char *instrument_probe_name(int probe);
+const char *instrument_counter_name(int counter);
+
+/* bucket of a value in ns */
+inline int instrument_bucket(uint64_t ns)
+{
+  if (ns < INSTR_SUB)
+    return int(ns);
+  if (ns >> INSTR_MAX_BITS)
+    ns = (uint64_t(1) << INSTR_MAX_BITS) - 1;
+
+  int e = 63 - __builtin_clzll(ns);
+  return (e - INSTR_SUB_BITS + 1) * INSTR_SUB + int((ns >> (e - INSTR_SUB_BITS)) - INSTR_SUB);
+}
+
+/* lowest value of a bucket */
+inline uint64_t instrument_bucket_value(int bucket)
+{
+  if (bucket < INSTR_SUB)
+    return bucket;
+  int b = bucket / INSTR_SUB;
+  return uint64_t(INSTR_SUB + bucket % INSTR_SUB) << (b - 1);
+}
+
+struct InstrumentHistogram
+{
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t buckets[INSTR_N_BUCKETS];
+
+  double mean_us() const;
+
+  // p in [0, 100], the middle of the bucket of the rank, in us
+  double percentile_us(double p) const;
+};
+
+/* the sum of the blocks of all the threads */
+struct InstrumentSnapshot
+{
+  char magic[4];
+  uint32_t version;
+  std::atomic<uint64_t> sequence;   // odd while the exporter writes a mapped snapshot
+  uint64_t timestamp_ns;            // monotonic
+  uint32_t n_threads;
+  uint32_t n_probes;
+  uint32_t n_counters;
+  uint32_t n_buckets;
+  uint64_t counters[INSTR_N_COUNTERS];
+  InstrumentHistogram probes[INSTR_N_PROBES];
+};
+
+extern std::atomic<bool> instrument_enabled;
+
+inline bool instrument_on()
+{
+  return instrument_enabled.load(std::memory_order_relaxed);
+}
+
+void instrument_enable(bool on);
+
+// record a latency or add to a counter in the block of the calling thread
+void instrument_record(int probe, uint64_t ns);
+void instrument_count(int counter, uint64_t n);
+
+// the snapshot of the blocks of all the threads
+void instrument_snapshot(InstrumentSnapshot *snapshot);
+
+// zero all the blocks, while no thread records
+void instrument_reset();
+
+// a snapshot from a mapped file, false if there is none or it is not consistent
+bool instrument_read(const std::string &path, InstrumentSnapshot *snapshot);
+
+// count, mean, p50, p99, p99.9 and max of every probe that recorded, then the counters
+void instrument_print(std::ostream &out, const InstrumentSnapshot &snapshot);
+
+/* times its scope */
+class InstrumentScope
+{
+  public:
+    inline InstrumentScope(int _probe) : probe(_probe), t0(instrument_on() ? e3e_monotonic_ns() : 0) {}
+
+    inline ~InstrumentScope()
+    {
+      if (this->t0 != 0)
+        instrument_record(this->probe, e3e_monotonic_ns() - this->t0);
+    }
+
+  private:
+    int probe;
+    uint64_t t0;
+};
+
+#ifdef E3E_INSTRUMENT
+#define E3E_PROBE_CAT2(a, b) a##b
+#define E3E_PROBE_CAT(a, b) E3E_PROBE_CAT2(a, b)
+#define E3E_PROBE(probe) InstrumentScope E3E_PROBE_CAT(e3e_probe_, __LINE__)(probe)
+#define E3E_COUNT(counter, n) do { if (instrument_on()) instrument_count(counter, n); } while (0)
+#else
+#define E3E_PROBE(probe) do {} while (0)
+#define E3E_COUNT(counter, n) do {} while (0)
+#endif
+
+class InstrumentExporter
+{
+  public:
+    std::string path;
+    int period_ms;
+    int mode;
+
+    std::thread thread;
+    std::atomic<bool> running;
+    uint64_t n_exports;
+
+    InstrumentExporter(const std::string &path, int period_ms = 1000, int mode = INSTR_EXPORT_MAPPED);
+    ~InstrumentExporter();
+
+    void start();
+    void stop();
+
+    // one snapshot now, while the thread of the exporter is not running
+    bool export_now();
+
+  private:
+    InstrumentSnapshot *snapshot;   // taken outside of the sequence lock
+    InstrumentSnapshot *map;        // the mapped file
+    size_t map_size;
+
+    bool open_mapped();
+    void run();
+};
+
+#endif // __INSTRUMENT_H__
@@ -0,0 +1,102 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include "logmel.h"
+#include "fastmath.h"
+
+LogMel::LogMel(MFCC *_mfcc, float *_buffer, int _n_rows, int _n_channels, const int *_channel_map)
+  : mfcc(_mfcc), buffer(_buffer), n_rows(_n_rows), n_channels(_n_channels)
+{
+  this->n_mels = _mfcc->mfcc_size;
+  this->n_bins = _mfcc->fft_size / 2 + 1;
+  this->row_size = _n_channels * this->n_mels;
+  this->n_written = 0;
+
+  this->channel_map = new int[_n_channels];
+  for (int c = 0 ; c < _n_channels ; c++)
+    this->channel_map[c] = _channel_map != NULL ? _channel_map[c] : c;
+
+  // the band actually used by the filterbank
+  this->band_start = this->n_bins;
+  this->band_end = 0;
+  for (int m = 0 ; m < this->n_mels ; m++)
+  {
+    if (_mfcc->fb_len[m] == 0)
+      continue;
+    this->band_start = std::min(this->band_start, _mfcc->fb_start[m]);
+    this->band_end = std::max(this->band_end, _mfcc->fb_start[m] + _mfcc->fb_len[m]);
+  }
+  if (this->band_end < this->band_start)
+    this->band_end = this->band_start;
+
+  this->power = new float[this->n_bins];
+}
+
+LogMel::~LogMel()
+{
+  delete[] this->channel_map;
+  delete[] this->power;
+}
+
+float *LogMel::next_row()
+{
+  return this->buffer + (this->n_written % this->n_rows) * this->row_size;
+}
+
+float *LogMel::latest()
+{
+  if (this->n_written == 0)
+    return NULL;
+  return this->row_at(this->n_written - 1);
+}
+
+float *LogMel::row_at(long frame)
+{
+  return this->buffer + (frame % this->n_rows) * this->row_size;
+}
+
+void LogMel::log_mel(const e3e_complex *X, int stride, float *out)
+{
+  MFCC *m = this->mfcc;
+
+  // the power of the band only
+  for (int k = this->band_start ; k < this->band_end ; k++)
+    this->power[k] = norm(X[k * stride]);
+
+  for (int i = 0 ; i < this->n_mels ; i++)
+  {
+    const float *w = m->fb_weights + m->fb_offset[i];
+    const float *P = this->power + m->fb_start[i];
+
+    float tmp = 0.;
+    for (int j = 0 ; j < m->fb_len[i] ; j++)
+      tmp += w[j] * P[j];
+    out[i] = tmp;
+  }
+
+  if (m->log_mode == MFCC_LOG_FAST)
+    fast_log_array(out, out, this->n_mels);
+  else
+    for (int i = 0 ; i < this->n_mels ; i++)
+      out[i] = log(out[i]);
+}
+
+float *LogMel::process(STFT *stft, long frame)
+{
+  if (frame < 0)
+    frame = stft->frame_count - 1;
+
+  return this->process_spectrum(stft->get_fd_frame_at(frame), stft->bin_stride, stft->channel_stride);
+}
+
+float *LogMel::process_spectrum(const e3e_complex *X, int stride, int channel_stride)
+{
+  float *row = this->next_row();
+
+  for (int c = 0 ; c < this->n_channels ; c++)
+    this->log_mel(X + this->channel_map[c] * channel_stride, stride, row + c * this->n_mels);
+
+  this->n_written++;
+  return row;
+}
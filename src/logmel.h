@@ -0,0 +1,73 @@
+#ifndef __LOGMEL_H__
+#define __LOGMEL_H__
+
+/*
+ * Streaming log-mel spectrogram.
+ *
+ * Uses the filterbank precomputed by an MFCC object (its mfcc_size filters
+ * and its log mode) but stops before the DCT. The bins are read directly
+ * from the output ring of an STFT, in any layout, or from any spectrum
+ * (e.g. the output of a beamformer), and only the power of the bins
+ * covered by the filters is computed.
+ *
+ * The rows are written in a rolling 2D buffer provided by the caller,
+ * n_rows rows of n_channels x n_mels values (buffer[row][c * n_mels + m]),
+ * frame f going to row f % n_rows:
+ *
+ *   float spectrogram[N_ROWS * CHANNELS * MFCC_SIZE];
+ *   LogMel logmel(&mfcc, spectrogram, N_ROWS, CHANNELS);
+ *   ...
+ *   stft->transform();
+ *   logmel.process(stft);
+ *   float *row = logmel.latest();
+ *
+ * Nothing is allocated after the constructor.
+ */
+
+#include "e3e_detection.h"
+#include "stft.h"
+#include "mfcc.h"
+
+class LogMel
+{
+  public:
+    MFCC *mfcc;
+    int n_mels;
+    int n_bins;
+
+    // the rolling buffer
+    float *buffer;
+    int n_rows;
+    int n_channels;
+    int row_size;
+    long n_written;
+
+    // STFT channel of every channel of the rows, NULL for the identity
+    int *channel_map;
+
+    // bins [band_start, band_end) are covered by the filters
+    int band_start;
+    int band_end;
+    float *power;
+
+    LogMel(MFCC *mfcc, float *buffer, int n_rows, int n_channels, const int *channel_map = NULL);
+    ~LogMel();
+
+    // log-mel of the frame of the STFT with this number since the start
+    // (see STFT::get_fd_frame_at), -1 for the most recent one
+    float *process(STFT *stft, long frame = -1);
+
+    // log-mel of spectra of n_bins bins, bin k of channel c at X[k * stride + c * channel_stride]
+    // (e.g. the output of a beamformer), the channel map applies as for the STFT
+    float *process_spectrum(const e3e_complex *X, int stride, int channel_stride = 0);
+
+    // the rows of the buffer
+    float *latest();
+    float *row_at(long frame);  // frame number among the rows written
+
+  private:
+    float *next_row();
+    void log_mel(const e3e_complex *X, int stride, float *out);
+};
+
+#endif // __LOGMEL_H__
@@ -1,8 +1,12 @@
 
 #include <string.h>
+#include <stdlib.h>
 #include <cmath>
+#include <algorithm>
 
 #include "../src/mfcc.h"
+#include "../src/fastmath.h"
+#include "../src/instrument.h"
 
 float mel_scale(float f)
 {
@@ -14,8 +18,9 @@ float inv_mel_scale(float b)
   return 700.*(exp(b/1125.)-1.);
 }
 
-MFCC::MFCC(int _mfcc_size, int _fft_size, int _fs, float _fl, float _fh)
-  : mfcc_size(_mfcc_size), fft_size(_fft_size), fs(_fs), fl(_fl), fh(_fh)
+MFCC::MFCC(int _mfcc_size, int _fft_size, int _fs, float _fl, float _fh, int _backend)
+  : mfcc_size(_mfcc_size), fft_size(_fft_size), fs(_fs), fl(_fl), fh(_fh), backend(_backend),
+    log_mode(MFCC_LOG_EXACT)
 {
   // allocate array of center frequencies
   this->center_freq = new float[_mfcc_size + 2];
@@ -27,21 +32,128 @@ MFCC::MFCC(int _mfcc_size, int _fft_size, int _fs, float _fl, float _fh)
   for (int m = 0 ; m < _mfcc_size + 2 ; m++)
     this->center_freq[m] = scale * inv_mel_scale( a + m * b );
 
-  // allocate buffers for the DCT
-  this->dct_buf_in = new float[_mfcc_size];
-  this->dct_buf_out = new float[_mfcc_size];
+  // precompute the weights of the filters
+  this->build_filterbank();
 
-  // create the DCT-II plan
-  this->dct_plan = fftwf_plan_r2r_1d(_mfcc_size, this->dct_buf_in, this->dct_buf_out,
-                           FFTW_REDFT10, FFTW_ESTIMATE);
+  // create the DCT-II, with the plans of all the batch sizes when there is no matrix
+  this->dct = make_dct2(_backend, _mfcc_size, _mfcc_size <= MFCC_DCT_MATRIX_MAX ? 1 : MFCC_BATCH_VECTORS);
+  this->dct_matrix = NULL;
+  if (_mfcc_size <= MFCC_DCT_MATRIX_MAX)
+    this->build_dct_matrix();
+
+  this->scratch = new MFCCScratch(this);
 
 }
 
 MFCC::~MFCC()
 {
+  delete this->dct;
   delete this->center_freq;
-  delete this->dct_buf_in;
-  delete this->dct_buf_out;
+  delete[] this->fb_start;
+  delete[] this->fb_len;
+  delete[] this->fb_offset;
+  delete[] this->fb_weights;
+  delete[] this->dct_matrix;
+  delete this->scratch;
+}
+
+MFCCScratch::MFCCScratch(MFCC *mfcc, int _n_vectors)
+  : n_bins(mfcc->fft_size / 2 + 1), mfcc_size(mfcc->mfcc_size), n_vectors(0),
+    power(NULL), mel(NULL), log_mel(NULL), cepstra(NULL)
+{
+  this->reserve(_n_vectors);
+}
+
+MFCCScratch::~MFCCScratch()
+{
+  free(this->power);
+  free(this->mel);
+  free(this->log_mel);
+  free(this->cepstra);
+}
+
+void MFCCScratch::reserve(int _n_vectors)
+{
+  if (_n_vectors <= this->n_vectors)
+    return;
+
+  free(this->power);
+  free(this->mel);
+  free(this->log_mel);
+  free(this->cepstra);
+
+  this->n_vectors = _n_vectors;
+  this->power = (float *)e3e_aligned_malloc(sizeof(float) * this->n_bins * _n_vectors);
+  this->mel = (float *)e3e_aligned_malloc(sizeof(float) * this->mfcc_size * _n_vectors);
+  this->log_mel = (float *)e3e_aligned_malloc(sizeof(float) * this->mfcc_size * _n_vectors);
+  this->cepstra = (float *)e3e_aligned_malloc(sizeof(float) * this->mfcc_size * _n_vectors);
+}
+
+/*
+ * The filter m covers the bins from ceil(f[m-1]) to below f[m+1], rising up
+ * to f[m] and falling after. The bins of the two slopes are contiguous so
+ * that every filter is stored as one run of weights.
+ */
+void MFCC::build_filterbank()
+{
+  float *f = this->center_freq;
+  int n_bins = this->fft_size / 2 + 1;
+
+  this->fb_start = new int[this->mfcc_size];
+  this->fb_len = new int[this->mfcc_size];
+  this->fb_offset = new int[this->mfcc_size];
+
+  // count the weights first
+  this->fb_nnz = 0;
+  for (int m = 1 ; m < this->mfcc_size + 1 ; m++)
+  {
+    int start = ceil(f[m-1]);
+    int end = start;
+    while (end < f[m+1] && end < n_bins)
+      end++;
+
+    this->fb_start[m-1] = start;
+    this->fb_len[m-1] = end > start ? end - start : 0;
+    this->fb_offset[m-1] = this->fb_nnz;
+    this->fb_nnz += this->fb_len[m-1];
+  }
+
+  this->fb_weights = new float[this->fb_nnz > 0 ? this->fb_nnz : 1];
+
+  for (int m = 1 ; m < this->mfcc_size + 1 ; m++)
+  {
+    float *w = this->fb_weights + this->fb_offset[m-1];
+    int start = this->fb_start[m-1];
+
+    for (int j = 0 ; j < this->fb_len[m-1] ; j++)
+    {
+      int k = start + j;
+      float c;
+
+      if (k < f[m])
+        c = (k - f[m-1]) / ((f[m+1]-f[m-1]) * (f[m]-f[m-1]));
+      else
+        c = (f[m+1]-k) / ((f[m+1]-f[m-1]) * (f[m+1]-f[m]));
+
+      w[j] = 2 * c;
+    }
+  }
+}
+
+void MFCC::set_log_mode(int mode)
+{
+  this->log_mode = mode;
+}
+
+/* The REDFT10 convention of FFTW, Y[m] = 2 sum_j X[j] cos(pi m (2j + 1) / 2N) */
+void MFCC::build_dct_matrix()
+{
+  int N = this->mfcc_size;
+  this->dct_matrix = new float[N * N];
+
+  for (int j = 0 ; j < N ; j++)
+    for (int m = 0 ; m < N ; m++)
+      this->dct_matrix[j * N + m] = 2. * cos(M_PI * m * (2 * j + 1) / (2. * N));
 }
 
 void MFCC::transform(e3e_complex *arr_fft, float *arr_mfcc, int howmany)
@@ -54,47 +166,159 @@ void MFCC::transform(e3e_complex *arr_fft, float *arr_mfcc, int howmany)
   this->transform_many(arr_fft, istride, idist, arr_mfcc, ostride, odist, howmany);
 }
 
+void MFCC::transform_stft(STFT *stft, int frame, float *arr_mfcc)
+{
+  e3e_complex *X = stft->get_fd_frame(frame);
+  this->transform_many(X, stft->bin_stride, stft->channel_stride,
+      arr_mfcc, stft->channels, 1, stft->channels);
+}
+
 void MFCC::transform_many(e3e_complex *arr_fft, int istride, int idist, float *arr_mfcc, int ostride, int odist, int howmany)
 {
-  // initialize mfcc array to zero
-  memset(arr_mfcc, howmany * this->mfcc_size, sizeof(float));
+  E3E_PROBE(INSTR_MFCC);
 
-  // lighten notation
-  float *f = this->center_freq;
+  MFCCScratch *s = this->scratch;
+  int chunk = s->n_vectors;
 
-  for (int n = 0 ; n < howmany ; n++)
+  for (int n0 = 0 ; n0 < howmany ; n0 += chunk)
   {
-    // the fft array offset
-    int i_fft = n * idist;
-    int i_mfcc = n * odist;
+    int nv = std::min(chunk, howmany - n0);
+
+    // the vectors of the chunk as the channels of a single frame
+    this->log_mel_chunk(arr_fft + n0 * idist, istride, idist, 0, nv, 0, 1, s);
+    this->dct_batch(s->log_mel, s->cepstra, nv);
 
-    // Compute all the output of the critical filters
-    for (int m = 1 ; m < this->mfcc_size + 1 ; m++)
+    // Now copy the output from the DCT to the output buffer
+    for (int n = 0 ; n < nv ; n++)
+      for (int m = 0 ; m < this->mfcc_size ; m++)
+        arr_mfcc[(n0 + n) * odist + m * ostride] = s->cepstra[n * this->mfcc_size + m];
+  }
+}
+
+void MFCC::transform_batch(const e3e_complex *arr_fft, int istride, int idist, int fdist,
+    int channels, int n_frames, float *arr_mfcc, MFCCScratch *s)
+{
+  E3E_PROBE(INSTR_MFCC);
+
+  s->reserve(channels);
+  int chunk = s->n_vectors / channels;
+
+  for (int f0 = 0 ; f0 < n_frames ; f0 += chunk)
+  {
+    int nf = std::min(chunk, n_frames - f0);
+
+    this->log_mel_chunk(arr_fft, istride, idist, fdist, channels, f0, nf, s);
+    this->dct_batch(s->log_mel, arr_mfcc + f0 * channels * this->mfcc_size, nf * channels);
+  }
+}
+
+void MFCC::log_mel_batch(const e3e_complex *arr_fft, int istride, int idist, int fdist,
+    int channels, int n_frames, float *arr_log_mel, MFCCScratch *s)
+{
+  s->reserve(channels);
+  int chunk = s->n_vectors / channels;
+
+  for (int f0 = 0 ; f0 < n_frames ; f0 += chunk)
+  {
+    int nf = std::min(chunk, n_frames - f0);
+    int size = nf * channels * this->mfcc_size;
+
+    this->log_mel_chunk(arr_fft, istride, idist, fdist, channels, f0, nf, s);
+
+    float *out = arr_log_mel + f0 * channels * this->mfcc_size;
+    for (int i = 0 ; i < size ; i++)
+      out[i] = s->log_mel[i];
+  }
+}
+
+void MFCC::log_mel_chunk(const e3e_complex *arr_fft, int istride, int idist, int fdist,
+    int channels, int f0, int nf, MFCCScratch *s)
+{
+  int n_bins = this->fft_size / 2 + 1;
+  int nv = nf * channels;
+
+  // Compute all the power spectra once, sweeping the input contiguously,
+  // the vectors of one bin are stored together
+  float *P = s->power;
+  for (int f = 0 ; f < nf ; f++)
+  {
+    const e3e_complex *X = arr_fft + (f0 + f) * fdist;
+    float *Pf = P + f * channels;
+
+    if (idist == 1)
+    {
+      for (int k = 0 ; k < n_bins ; k++)
+        for (int c = 0 ; c < channels ; c++)
+          Pf[k * nv + c] = norm(X[k * istride + c]);
+    }
+    else
     {
-      float tmp = 0.;
-      for (int k = ceil(f[m-1]) ; k < f[m] ; k++)
-      {
-        float c = (k - f[m-1]) / ((f[m+1]-f[m-1]) * (f[m]-f[m-1]));
-        tmp += 2 * c * norm(arr_fft[i_fft + k * istride]);
-      }
-      for (int k = ceil(f[m]) ; k < f[m+1] ; k++)
-      {
-        float c = (f[m+1]-k) / ((f[m+1]-f[m-1]) * (f[m+1]-f[m]));
-        tmp += 2 * c * norm(arr_fft[i_fft + k * istride]);
-      }
-
-      // fill the DCT buffer
-      this->dct_buf_in[m-1] = log(tmp);
+      for (int c = 0 ; c < channels ; c++)
+        for (int k = 0 ; k < n_bins ; k++)
+          Pf[k * nv + c] = norm(X[c * idist + k * istride]);
+    }
+  }
+
+  // Apply the filterbank to all the vectors at once, the inner loop is over the vectors
+  for (int m = 0 ; m < this->mfcc_size ; m++)
+  {
+    float *out = s->mel + m * nv;
+    const float *w = this->fb_weights + this->fb_offset[m];
+    const float *Pm = P + this->fb_start[m] * nv;
+
+    for (int n = 0 ; n < nv ; n++)
+      out[n] = 0.;
 
+    for (int j = 0 ; j < this->fb_len[m] ; j++)
+    {
+      float wj = w[j];
+      const float *p = Pm + j * nv;
+      for (int n = 0 ; n < nv ; n++)
+        out[n] += wj * p[n];
     }
+  }
+
+  // the log energies, one row per vector
+  if (this->log_mode == MFCC_LOG_FAST)
+  {
+    fast_log_array(s->mel, s->mel, nv * this->mfcc_size);
+    for (int n = 0 ; n < nv ; n++)
+      for (int m = 0 ; m < this->mfcc_size ; m++)
+        s->log_mel[n * this->mfcc_size + m] = s->mel[m * nv + n];
+  }
+  else
+  {
+    for (int n = 0 ; n < nv ; n++)
+      for (int m = 0 ; m < this->mfcc_size ; m++)
+        s->log_mel[n * this->mfcc_size + m] = log(s->mel[m * nv + n]);
+  }
+}
 
-    // Now apply the DCT-II
-    fftwf_execute(this->dct_plan);
+void MFCC::dct_batch(const float *in, float *out, int howmany)
+{
+  int N = this->mfcc_size;
 
-    // Now copy the output from the DCT to the output buffer
-    for (int m = 0 ; m < this->mfcc_size ; m++)
+  if (this->dct_matrix == NULL)
+  {
+    this->dct->forward_many(const_cast<float *>(in), out, howmany);
+    return;
+  }
+
+  // out = in x dct_matrix, the inner loop over the outputs vectorizes
+  for (int h = 0 ; h < howmany ; h++)
+  {
+    const float *x = in + h * N;
+    float *y = out + h * N;
+
+    for (int m = 0 ; m < N ; m++)
+      y[m] = 0.;
+
+    for (int j = 0 ; j < N ; j++)
     {
-      arr_mfcc[i_mfcc + m * ostride] = this->dct_buf_out[m];
+      float xj = x[j];
+      const float *c = this->dct_matrix + j * N;
+      for (int m = 0 ; m < N ; m++)
+        y[m] += xj * c[m];
     }
   }
 }
@@ -6,6 +6,24 @@
  * to the description by Huang-Acera-Hon 6.5.2 (2001)
  * The MFCC are features mimicing the human perception usually
  * used for some learning task.
+ *
+ * The vectors are processed in batches: the power spectra, the mel
+ * filterbank and the log are computed for up to MFCC_BATCH_VECTORS
+ * vectors at once into a log-mel matrix with one row per vector, and the
+ * DCT-II is applied to all the rows together (a matrix product for the
+ * usual small sizes, one FFTW many-plan otherwise).
+ *
+ * The MFCC object only holds the configuration, the buffers of a batch
+ * are in an MFCCScratch, so that several threads can share one MFCC with
+ * one scratch each through transform_batch:
+ *
+ *   MFCC mfcc(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5);
+ *   // in every thread
+ *   MFCCScratch scratch(&mfcc);
+ *   mfcc.transform_batch(X, istride, idist, fdist, channels, n_frames, out, &scratch);
+ *
+ * transform, transform_many and transform_stft use a scratch owned by the
+ * object and are not reentrant.
  */
 
 #include <iostream>
@@ -13,6 +31,42 @@
 #include <fftw3.h>
 
 #include "../src/e3e_detection.h"
+#include "../src/fft_backend.h"
+#include "../src/stft.h"
+
+// number of vectors processed together
+#define MFCC_BATCH_VECTORS 64
+
+// the DCT-II is applied as a matrix product up to this size
+#define MFCC_DCT_MATRIX_MAX 32
+
+// the log of the mel energies, libm or fast_log (see fastmath.h)
+enum mfcc_log_mode
+{
+  MFCC_LOG_EXACT = 0,
+  MFCC_LOG_FAST
+};
+
+class MFCC;
+
+/* The working memory of a batch, one per thread */
+class MFCCScratch
+{
+  public:
+    int n_bins;
+    int mfcc_size;
+    int n_vectors;
+
+    float *power;    // power spectra, bin major (power[k * n_vectors + v])
+    float *mel;      // filter outputs (mel[m * n_vectors + v])
+    float *log_mel;  // log energies, one row per vector (log_mel[v * mfcc_size + m])
+    float *cepstra;  // output of the DCT, same layout
+
+    MFCCScratch(MFCC *mfcc, int n_vectors = MFCC_BATCH_VECTORS);
+    ~MFCCScratch();
+
+    void reserve(int n_vectors);
+};
 
 class MFCC
 {
@@ -21,24 +75,71 @@ class MFCC
     // array of filter center frequencies
     float *center_freq;
 
-    // we need a dct plan
-    fftwf_plan dct_plan;
-    float *dct_buf_in;
-    float *dct_buf_out;
+    // the triangular filters, precomputed as a sparse matrix: filter m
+    // has fb_len[m] weights fb_weights[fb_offset[m] + j] applied to the
+    // bins fb_start[m] + j
+    int *fb_start;
+    int *fb_len;
+    int *fb_offset;
+    float *fb_weights;
+    int fb_nnz;
+
+    // we need a dct, as a matrix (transposed, dct_matrix[j * mfcc_size + m])
+    // for small sizes, NULL otherwise
+    DCT2 *dct;
+    float *dct_matrix;
+
+    // scratch of the non-reentrant functions
+    MFCCScratch *scratch;
 
     int mfcc_size;
     int fft_size;
     int fs;
     float fl;
     float fh;
+    int backend;
+    int log_mode;
 
-    MFCC(int mfcc_size, int fft_size, int fs, float fl, float fh);
+    MFCC(int mfcc_size, int fft_size, int fs, float fl, float fh, int backend = FFT_BACKEND_FFTW);
     ~MFCC();
 
+    void build_filterbank();
+    void build_dct_matrix();
+
+    // MFCC_LOG_FAST trades about 1e-7 of relative error on the log-mel
+    // energies (and log(0) = -87.3 instead of -inf) for a vectorized log
+    void set_log_mode(int mode);
+
     // This function gets an array of several FFT and computes the MFCC
     void transform(e3e_complex *arr_fft, float *arr_mfcc, int howmany);
     void transform_many(e3e_complex *arr_fft, int istride, int idist, float *arr_mfcc, int ostride, int odist, int howmany);
 
+    // MFCC of all the channels of a frame of the STFT (0 is the most recent),
+    // arr_mfcc[m * channels + channel] whatever the layout of the STFT
+    void transform_stft(STFT *stft, int frame, float *arr_mfcc);
+
+    /*
+     * MFCC of n_frames x channels spectra, bin k of channel c of frame f
+     * being arr_fft[f * fdist + c * idist + k * istride]. The output is a
+     * contiguous matrix with one row per vector,
+     * arr_mfcc[(f * channels + c) * mfcc_size + m]. Reentrant with one
+     * scratch per thread.
+     */
+    void transform_batch(const e3e_complex *arr_fft, int istride, int idist, int fdist,
+        int channels, int n_frames, float *arr_mfcc, MFCCScratch *scratch);
+
+    // same but stops before the DCT, the log-mel energies in the same layout
+    void log_mel_batch(const e3e_complex *arr_fft, int istride, int idist, int fdist,
+        int channels, int n_frames, float *arr_log_mel, MFCCScratch *scratch);
+
+    // DCT-II of howmany contiguous vectors of mfcc_size
+    void dct_batch(const float *in, float *out, int howmany);
+
+  private:
+    // log-mel of the frames [f0, f0 + nf) into scratch->log_mel
+    void log_mel_chunk(const e3e_complex *arr_fft, int istride, int idist, int fdist,
+        int channels, int f0, int nf, MFCCScratch *scratch);
+
 };
 
 #endif // __MFCC_H__
@@ -0,0 +1,132 @@
+
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "mic_array.h"
+
+ReplayMicArray::ReplayMicArray(AudioSource *_source, int _block_size, uint64_t _seed)
+  : source(_source), block_size(_block_size), speed(1.), jitter_us(0), drop_rate(0.),
+    device_blocks(MIC_ARRAY_DEVICE_BLOCKS), loop(false),
+    n_blocks(0), n_dropped(0), n_late(0), max_wait_ns(0), seed(_seed)
+{
+  this->channels = _source->channels;
+  this->fs = _source->fs;
+  this->format = _source->format;
+  this->restart();
+}
+
+void ReplayMicArray::restart()
+{
+  this->t0 = 0;
+  this->block = 0;
+  this->ready_ns = 0;
+}
+
+uint64_t ReplayMicArray::period_ns()
+{
+  if (this->speed <= 0.)
+    return 0;
+  return uint64_t(double(this->block_size) * 1e9 / (double(this->fs) * this->speed));
+}
+
+/* splitmix64 of the seed, the block and a salt */
+uint64_t ReplayMicArray::hash(uint64_t salt)
+{
+  uint64_t z = this->seed + (this->block * 2 + salt + 1) * 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+/* the next block of the source, from the start again at the end if looping */
+const void *ReplayMicArray::next()
+{
+  const void *pcm = this->source->read(this->block_size);
+  if (pcm == NULL && this->loop && this->source->seek(0))
+    pcm = this->source->read(this->block_size);
+  return pcm;
+}
+
+const void *ReplayMicArray::read(int n)
+{
+  if (n != this->block_size)
+    return NULL;
+
+  uint64_t period = this->period_ns();
+  uint64_t now = e3e_monotonic_ns();
+  if (this->t0 == 0)
+    this->t0 = now;
+
+  // the blocks the device has overwritten while the reader was late
+  if (period > 0)
+  {
+    uint64_t completed = (now - this->t0) / period;
+    while (completed > this->block + this->device_blocks)
+    {
+      if (this->next() == NULL)
+        return NULL;
+      this->block++;
+      this->n_late++;
+    }
+  }
+
+  // the injected losses, the time of the block passes all the same
+  while (this->drop_rate > 0. && double(this->hash(0) >> 11) * (1. / 9007199254740992.) < this->drop_rate)
+  {
+    if (this->next() == NULL)
+      return NULL;
+    this->block++;
+    this->n_dropped++;
+  }
+
+  const void *pcm = this->next();
+  if (pcm == NULL)
+    return NULL;
+
+  if (period > 0)
+  {
+    // the blocks complete in order, some late by the jitter
+    uint64_t ready = this->t0 + (this->block + 1) * period;
+    if (this->jitter_us > 0)
+      ready += this->hash(1) % (uint64_t(this->jitter_us) * 1000 + 1);
+    ready = std::max(ready, this->ready_ns);
+    this->ready_ns = ready;
+
+    if (now < ready)
+    {
+      struct timespec ts;
+      ts.tv_sec = ready / 1000000000ull;
+      ts.tv_nsec = ready % 1000000000ull;
+      int error;
+      while ((error = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+        ;
+      if (error != 0)
+      {
+        std::cerr << "Error: could not wait for the block of the array: " << strerror(error) << std::endl;
+        return NULL;
+      }
+      this->max_wait_ns = std::max(this->max_wait_ns, ready - now);
+    }
+  }
+
+  this->block++;
+  this->n_blocks++;
+
+  return pcm;
+}
+
+uint64_t ReplayMicArray::tell()
+{
+  return this->source->tell();
+}
+
+bool ReplayMicArray::seek(uint64_t sample)
+{
+  if (!this->source->seek(sample))
+    return false;
+  this->restart();
+  return true;
+}
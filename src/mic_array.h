@@ -0,0 +1,121 @@
+#ifndef __MIC_ARRAY_H__
+#define __MIC_ARRAY_H__
+
+/*
+ * Microphone array devices as AudioSource (see recording.h).
+ *
+ * A device read blocks until the next block of the array is complete,
+ * like MicrophoneArray::Read() of the MATRIX Creator: a reader that keeps
+ * up waits one block period between reads, a late reader gets the blocks
+ * the device still buffers at once, and a reader later than the buffer of
+ * the device loses blocks.
+ *
+ * MatrixMicArray reads the MATRIX Creator (only with E3E_MATRIX_HAL, it
+ * needs matrix_hal and wiringPi). ReplayMicArray replays another source,
+ * e.g. a MappedRecording, with the same blocking and timing, so the whole
+ * capture to output pipeline runs on any Linux box:
+ *
+ *   MappedRecording rec;
+ *   rec.open("test_signal.raw");
+ *   ReplayMicArray mics(&rec, FFT_SIZE);
+ *   mics.jitter_us = 500;         // the blocks complete up to 0.5 ms late
+ *   mics.drop_rate = 0.001;       // and one in a thousand is lost
+ *   CaptureThread reader(&ring, [&](float *block) { return mics.read_to(stft, block); });
+ *
+ * With speed 0 the blocks are returned as fast as they are read, for
+ * throughput tests, and speed 2 replays twice faster than real time. The
+ * jitter and the drops are a hash of the seed and the block number, so
+ * the same seed drops the same blocks however late the reader is. The
+ * lost blocks, injected or because the reader was late, are counted and
+ * skipped in the source, so the samples that follow a loss are the ones
+ * the device would have returned.
+ */
+
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "recording.h"
+
+// blocks kept by the device for a late reader, the MATRIX Creator FIFO
+#define MIC_ARRAY_DEVICE_BLOCKS 4
+
+class ReplayMicArray : public AudioSource
+{
+  public:
+    AudioSource *source;
+    int block_size;
+
+    double speed;           // times real time, 0 for as fast as possible
+    int jitter_us;          // the blocks complete between 0 and jitter_us late
+    double drop_rate;       // probability that a block is lost by the device
+    int device_blocks;      // blocks buffered for a late reader
+    bool loop;              // start over at the end of the source
+
+    // statistics
+    uint64_t n_blocks;      // returned
+    uint64_t n_dropped;     // lost by injection
+    uint64_t n_late;        // lost because the reader was late
+    uint64_t max_wait_ns;   // longest blocking read
+
+    ReplayMicArray(AudioSource *source, int block_size, uint64_t seed = 0);
+
+    // the next block of block_size samples (n must be block_size), blocking
+    // until the device has completed it, NULL at the end or on an error
+    const void *read(int n);
+    uint64_t tell();
+    bool seek(uint64_t sample);
+
+    // the clock starts at the first read after this
+    void restart();
+
+    // block period in ns at the replay speed, 0 for as fast as possible
+    uint64_t period_ns();
+
+  private:
+    uint64_t seed;
+    uint64_t t0;            // 0 until the first read
+    uint64_t block;         // device blocks since the start, including the lost ones
+    uint64_t ready_ns;      // completion time of the last block returned
+
+    const void *next();
+    uint64_t hash(uint64_t salt);
+};
+
+#ifdef E3E_MATRIX_HAL
+
+#include "matrix_hal/microphone_array.h"
+#include "matrix_hal/wishbone_bus.h"
+
+class MatrixMicArray : public AudioSource
+{
+  public:
+    matrix_hal::MicrophoneArray mics;
+    uint64_t position;
+
+    MatrixMicArray(matrix_hal::WishboneBus *bus) : position(0)
+    {
+      this->mics.Setup(bus);
+      this->channels = this->mics.Channels();
+      this->fs = 16000;     // the rate of the driver
+      this->format = RECORDING_INT16;
+    }
+
+    // the driver reads NumberOfSamples() samples per channel at once
+    const void *read(int n)
+    {
+      if (n != int(this->mics.NumberOfSamples()))
+        return NULL;
+      this->mics.Read();
+      this->position += n;
+      return &this->mics.At(0, 0);
+    }
+
+    uint64_t tell()
+    {
+      return this->position;
+    }
+};
+
+#endif // E3E_MATRIX_HAL
+
+#endif // __MIC_ARRAY_H__
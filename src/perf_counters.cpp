@@ -0,0 +1,161 @@
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf_counters.h"
+
+const char *perf_event_name(int event)
+{
+  switch (event)
+  {
+    case PERF_EV_TASK_CLOCK:
+      return "task_clock_ns";
+    case PERF_EV_CYCLES:
+      return "cycles";
+    case PERF_EV_INSTRUCTIONS:
+      return "instructions";
+    case PERF_EV_L1D_MISSES:
+      return "l1d_misses";
+    case PERF_EV_LLC_MISSES:
+      return "llc_misses";
+    case PERF_EV_BRANCH_MISSES:
+      return "branch_misses";
+    default:
+      return "unknown";
+  }
+}
+
+static int perf_open_event(uint32_t type, uint64_t config, int group_fd)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = group_fd < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  // the calling thread on any CPU
+  return int(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+static uint64_t perf_cache_miss(uint64_t cache)
+{
+  return cache | (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8) | (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+}
+
+PerfCounters::PerfCounters()
+{
+  for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+  {
+    this->fds[e] = -1;
+    this->slots[e] = -1;
+  }
+  this->n_open = 0;
+}
+
+PerfCounters::~PerfCounters()
+{
+  this->close();
+}
+
+bool PerfCounters::open()
+{
+  this->close();
+
+  int leader = perf_open_event(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1);
+  if (leader < 0)
+  {
+    std::cerr << "Error: could not open the performance counters: " << strerror(errno) << std::endl;
+    return false;
+  }
+  this->fds[PERF_EV_TASK_CLOCK] = leader;
+  this->slots[PERF_EV_TASK_CLOCK] = this->n_open++;
+
+  struct { int event; uint32_t type; uint64_t config; } hw[] =
+  {
+    { PERF_EV_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_EV_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_EV_L1D_MISSES, PERF_TYPE_HW_CACHE, perf_cache_miss(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_EV_LLC_MISSES, PERF_TYPE_HW_CACHE, perf_cache_miss(PERF_COUNT_HW_CACHE_LL) },
+    // some ARM cores have no last level cache event, the generic one is close
+    { PERF_EV_LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_EV_BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  };
+
+  std::string missing;
+  int error = 0;
+  for (size_t i = 0 ; i < sizeof(hw) / sizeof(hw[0]) ; i++)
+  {
+    int e = hw[i].event;
+    if (this->fds[e] >= 0)
+      continue;
+
+    int fd = perf_open_event(hw[i].type, hw[i].config, leader);
+    if (fd >= 0)
+    {
+      this->fds[e] = fd;
+      this->slots[e] = this->n_open++;
+    }
+    else if (i + 1 == sizeof(hw) / sizeof(hw[0]) || hw[i + 1].event != e)
+    {
+      missing += std::string(missing.empty() ? "" : ", ") + perf_event_name(e);
+      error = errno;
+    }
+  }
+
+  if (!missing.empty())
+  {
+    std::cerr << "Warning: not counted: " << missing << " (" << strerror(error) << ")";
+    if (error == EACCES || error == EPERM)
+      std::cerr << ", see /proc/sys/kernel/perf_event_paranoid";
+    std::cerr << std::endl;
+  }
+
+  ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+  return true;
+}
+
+void PerfCounters::close()
+{
+  // the members before the leader
+  for (int e = PERF_N_EVENTS - 1 ; e >= 0 ; e--)
+  {
+    if (this->fds[e] >= 0)
+      ::close(this->fds[e]);
+    this->fds[e] = -1;
+    this->slots[e] = -1;
+  }
+  this->n_open = 0;
+}
+
+bool PerfCounters::read(PerfSample *sample)
+{
+  memset(sample, 0, sizeof(*sample));
+  if (this->n_open == 0)
+    return false;
+
+  // nr, time_enabled, time_running, then the values in the order of opening
+  uint64_t buf[3 + PERF_N_EVENTS];
+  ssize_t n = ::read(this->fds[PERF_EV_TASK_CLOCK], buf, sizeof(buf));
+  if (n < ssize_t(3 * sizeof(uint64_t)) || buf[0] != uint64_t(this->n_open))
+    return false;
+
+  sample->time_enabled = buf[1];
+  sample->time_running = buf[2];
+  for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+    if (this->slots[e] >= 0)
+      sample->values[e] = buf[3 + this->slots[e]];
+
+  return true;
+}
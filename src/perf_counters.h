@@ -0,0 +1,74 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+/*
+ * Hardware performance counters of the calling thread with
+ * perf_event_open (Linux, x86 and ARM).
+ *
+ * The events are opened as one group, so that they are counted over the
+ * same instructions and read with a single system call: the CPU time of
+ * the thread (a software event, the leader, always there), the cycles,
+ * the instructions, the L1 data and last level cache read misses and the
+ * branch misses, in user space only. An event the CPU, the kernel or the
+ * virtual machine does not count is left out, has() tells which ones are
+ * there; without a PMU only the CPU time is counted.
+ *
+ *   PerfCounters perf;
+ *   PerfSample a, b;
+ *   if (perf.open())
+ *   {
+ *     perf.read(&a);
+ *     ...
+ *     perf.read(&b);
+ *     // b.values[PERF_EV_CYCLES] - a.values[PERF_EV_CYCLES]
+ *   }
+ *
+ * The hardware events need /proc/sys/kernel/perf_event_paranoid at 2 or
+ * below. When there are more events than counters the kernel multiplexes
+ * the group, time_running is then below time_enabled.
+ */
+
+#include <stdint.h>
+
+enum perf_counter_event
+{
+  PERF_EV_TASK_CLOCK = 0,   // ns on the CPU
+  PERF_EV_CYCLES,
+  PERF_EV_INSTRUCTIONS,
+  PERF_EV_L1D_MISSES,       // L1 data cache read misses
+  PERF_EV_LLC_MISSES,       // last level cache read misses, or the generic cache misses
+  PERF_EV_BRANCH_MISSES,
+  PERF_N_EVENTS
+};
+
+const char *perf_event_name(int event);
+
+struct PerfSample
+{
+  uint64_t values[PERF_N_EVENTS];   // 0 for the events that are not counted
+  uint64_t time_enabled;
+  uint64_t time_running;
+};
+
+class PerfCounters
+{
+  public:
+    int fds[PERF_N_EVENTS];      // -1 for the events that are not counted
+    int slots[PERF_N_EVENTS];    // position of the event in a read of the group
+    int n_open;
+
+    PerfCounters();
+    ~PerfCounters();
+
+    // open and start the counters of the calling thread, false if none can be opened
+    bool open();
+    void close();
+
+    bool available() const { return this->n_open > 0; }
+    bool has(int event) const { return this->fds[event] >= 0; }
+
+    // the counts since open, a single read of the group
+    bool read(PerfSample *sample);
+};
+
+#endif // __PERF_COUNTERS_H__
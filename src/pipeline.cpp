@@ -0,0 +1,368 @@
+
+#include <iostream>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "instrument.h"
+
+/* spin a little, then yield, then sleep, while waiting for another stage */
+static void backoff(int &spins)
+{
+  spins++;
+  if (spins < 64)
+    sched_yield();
+  else
+    usleep(50);
+}
+
+bool pipeline_set_thread_params(const std::string &name, int cpu, int priority)
+{
+  bool ok = true;
+  pthread_t self = pthread_self();
+
+  // thread names are limited to 15 characters
+  pthread_setname_np(self, name.substr(0, 15).c_str());
+
+  if (cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int err = pthread_setaffinity_np(self, sizeof(set), &set);
+    if (err != 0)
+    {
+      std::cerr << "Warning: could not pin stage " << name << " to cpu " << cpu
+        << ": " << strerror(err) << std::endl;
+      ok = false;
+    }
+  }
+
+  if (priority > 0)
+  {
+    struct sched_param param;
+    param.sched_priority = priority;
+
+    // SCHED_FIFO needs CAP_SYS_NICE or an rtprio limit, keep running otherwise
+    int err = pthread_setschedparam(self, SCHED_FIFO, &param);
+    if (err != 0)
+    {
+      std::cerr << "Warning: could not set SCHED_FIFO priority " << priority << " for stage "
+        << name << ": " << strerror(err) << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+bool STFTSourceStage::produce(PipelineFrame &frame)
+{
+  CaptureBlockInfo info;
+
+  while (this->ring->wait_read_slot(&info, this->timeout_us) == NULL)
+  {
+    // end of the stream when the reader stopped and the ring is empty
+    if (!this->reader->running && this->ring->available() == 0)
+      return false;
+    if (this->running != NULL && !*this->running)
+      return false;
+  }
+
+  long index = this->stft->frame_count;
+  this->stft->transform();
+  this->ring->release();
+
+  frame.index = index;
+  frame.sequence = info.sequence;
+  frame.timestamp_ns = info.timestamp_ns;
+  frame.argmax = -1;
+  frame.power = 0.;
+  frame.spectrum = NULL;
+  frame.features = NULL;
+  frame.probabilities = NULL;
+
+  return true;
+}
+
+SRPPHATStage::SRPPHATStage(SRPPHAT *_srpphat, int _n_slots, int _max_batch)
+  : PipelineStage("doa", _max_batch), srpphat(_srpphat), n_slots(_n_slots)
+{
+  this->spectra = new float[_n_slots * _srpphat->n_grid];
+}
+
+SRPPHATStage::~SRPPHATStage()
+{
+  delete[] this->spectra;
+}
+
+void SRPPHATStage::process(PipelineFrame *frames, int n)
+{
+  for (int i = 0 ; i < n ; i++)
+    this->srpphat->update(frames[i].index);
+
+  PipelineFrame &last = frames[n - 1];
+  last.argmax = this->srpphat->search();
+  last.power = this->srpphat->spatial_spectrum[last.argmax];
+
+  // keep a copy since the next search overwrites the spatial spectrum
+  int n_grid = this->srpphat->n_grid;
+  last.spectrum = this->spectra + (last.index % this->n_slots) * n_grid;
+  for (int g = 0 ; g < n_grid ; g++)
+    last.spectrum[g] = this->srpphat->spatial_spectrum[g];
+}
+
+int SRPPHATStage::max_frames_in_flight() const
+{
+  // the update drops the frame srp_n_frames back, it must not be overwritten yet
+  return std::min(this->srpphat->stft->n_frames - this->srpphat->n_frames - 1, this->n_slots - 1);
+}
+
+MFCCStage::MFCCStage(MFCC *_mfcc, STFT *_stft, int _n_slots, int _max_batch)
+  : PipelineStage("mfcc", _max_batch), mfcc(_mfcc), stft(_stft), n_slots(_n_slots)
+{
+  this->features = new float[_n_slots * _mfcc->mfcc_size * _stft->channels];
+}
+
+MFCCStage::~MFCCStage()
+{
+  delete[] this->features;
+}
+
+void MFCCStage::process(PipelineFrame *frames, int n)
+{
+  int size = this->mfcc->mfcc_size * this->stft->channels;
+
+  for (int i = 0 ; i < n ; i++)
+  {
+    float *out = this->features + (frames[i].index % this->n_slots) * size;
+
+    this->mfcc->transform_many(this->stft->get_fd_frame_at(frames[i].index),
+        this->stft->bin_stride, this->stft->channel_stride,
+        out, this->stft->channels, 1, this->stft->channels);
+
+    frames[i].features = out;
+  }
+}
+
+int MFCCStage::max_frames_in_flight() const
+{
+  return std::min(this->stft->n_frames - 1, this->n_slots - 1);
+}
+
+ClassifierStage::ClassifierStage(Classifier *_classifier, int _mfcc_size, int _channels, int _channel, int _n_slots)
+  : PipelineStage("classifier"), classifier(_classifier), mfcc_size(_mfcc_size),
+    channels(_channels), channel(_channel), n_slots(_n_slots)
+{
+  this->probabilities = new float[_n_slots * _classifier->n_classes];
+  this->input = new float[_mfcc_size];
+
+  // the model reads input_dim values of the features given to it
+  int dim = _channel >= 0 ? _mfcc_size : _mfcc_size * _channels;
+  this->valid = _classifier->input_dim == dim;
+  if (!this->valid)
+    std::cerr << "Error: the classifier takes " << _classifier->input_dim << " features, the stage gives "
+      << dim << "." << std::endl;
+}
+
+ClassifierStage::~ClassifierStage()
+{
+  delete[] this->probabilities;
+  delete[] this->input;
+}
+
+void ClassifierStage::process(PipelineFrame *frames, int n)
+{
+  int n_classes = this->classifier->n_classes;
+
+  for (int i = 0 ; i < n ; i++)
+  {
+    if (frames[i].features == NULL || !this->valid)
+      continue;
+
+    // the features are coefficient major, features[m * channels + c]
+    const float *x = frames[i].features;
+    if (this->channel >= 0)
+    {
+      for (int m = 0 ; m < this->mfcc_size ; m++)
+        this->input[m] = frames[i].features[m * this->channels + this->channel];
+      x = this->input;
+    }
+
+    const float *p = this->classifier->process(x);
+
+    float *out = this->probabilities + (frames[i].index % this->n_slots) * n_classes;
+    for (int c = 0 ; c < n_classes ; c++)
+      out[c] = p[c];
+
+    frames[i].probabilities = out;
+  }
+}
+
+void OutputStage::process(PipelineFrame *frames, int n)
+{
+  for (int i = 0 ; i < n ; i++)
+  {
+    E3E_PROBE(INSTR_OUTPUT);
+    this->callback(frames[i]);
+  }
+}
+
+Pipeline::Pipeline(int _max_in_flight)
+  : max_in_flight(_max_in_flight)
+{
+  this->running = false;
+  this->produced = 0;
+  this->completed = 0;
+}
+
+Pipeline::~Pipeline()
+{
+  this->stop();
+  for (size_t i = 0 ; i < this->queues.size() ; i++)
+    delete this->queues[i];
+}
+
+void Pipeline::add_stage(PipelineStage *stage)
+{
+  // a queue between the previous stage and this one, one more for the end marker
+  if (this->stages.size() > 0)
+    this->queues.push_back(new SPSCQueue<PipelineFrame>(this->max_in_flight + 1));
+
+  stage->running = &this->running;
+  this->stages.push_back(stage);
+}
+
+bool Pipeline::start()
+{
+  for (size_t i = 0 ; i < this->stages.size() ; i++)
+  {
+    int limit = this->stages[i]->max_frames_in_flight();
+    if (limit >= 0 && this->max_in_flight > limit)
+    {
+      std::cerr << "Error: " << this->max_in_flight << " frames in flight, the stage " << this->stages[i]->name;
+      std::cerr << " allows at most " << limit << "." << std::endl;
+      return false;
+    }
+  }
+
+  this->running = true;
+
+  this->threads.push_back(std::thread(&Pipeline::run_source, this));
+  for (size_t i = 1 ; i < this->stages.size() ; i++)
+    this->threads.push_back(std::thread(&Pipeline::run_stage, this, int(i)));
+
+  return true;
+}
+
+void Pipeline::stop()
+{
+  this->running = false;
+  this->wait();
+}
+
+void Pipeline::wait()
+{
+  for (size_t i = 0 ; i < this->threads.size() ; i++)
+    if (this->threads[i].joinable())
+      this->threads[i].join();
+  this->threads.clear();
+}
+
+void Pipeline::run_source()
+{
+  PipelineStage *stage = this->stages[0];
+  pipeline_set_thread_params(stage->name, stage->cpu, stage->priority);
+
+  PipelineFrame frame;
+  int spins;
+
+  while (this->running)
+  {
+    // do not overwrite the spectra still in use downstream
+    spins = 0;
+    while (this->produced - this->completed >= this->max_in_flight && this->running)
+      backoff(spins);
+
+    if (!this->running || !stage->produce(frame))
+      break;
+
+    this->produced++;
+    stage->n_frames_processed++;
+    stage->n_batches++;
+
+    if (this->queues.size() == 0)
+    {
+      this->completed++;
+      continue;
+    }
+
+    spins = 0;
+    while (!this->queues[0]->push(frame) && this->running)
+      backoff(spins);
+  }
+
+  // tell the other stages that the stream ended
+  if (this->queues.size() > 0)
+  {
+    frame.index = -1;
+    spins = 0;
+    while (!this->queues[0]->push(frame) && this->running)
+      backoff(spins);
+  }
+}
+
+void Pipeline::run_stage(int i)
+{
+  PipelineStage *stage = this->stages[i];
+  pipeline_set_thread_params(stage->name, stage->cpu, stage->priority);
+
+  SPSCQueue<PipelineFrame> *in = this->queues[i - 1];
+  SPSCQueue<PipelineFrame> *out = (i + 1 < (int)this->stages.size()) ? this->queues[i] : NULL;
+
+  std::vector<PipelineFrame> batch(stage->max_batch > 0 ? stage->max_batch : 1);
+  bool end = false;
+  int spins = 0;
+
+  while (!end)
+  {
+    int n = in->pop_many(batch.data(), batch.size());
+
+    if (n == 0)
+    {
+      if (!this->running)
+        break;
+      backoff(spins);
+      continue;
+    }
+    spins = 0;
+
+    // the end marker is always the last frame
+    if (batch[n - 1].index < 0)
+    {
+      end = true;
+      n--;
+    }
+
+    if (n > 0)
+    {
+      stage->process(batch.data(), n);
+      stage->n_frames_processed += n;
+      stage->n_batches++;
+    }
+
+    // forward the frames, and the end marker
+    if (out != NULL)
+    {
+      for (int j = 0 ; j < n + (end ? 1 : 0) ; j++)
+        while (!out->push(batch[j]) && this->running)
+          backoff(spins);
+    }
+    else
+      this->completed += n;
+  }
+}
@@ -0,0 +1,189 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+/*
+ * Staged real-time pipeline.
+ *
+ * Every stage runs in its own thread, optionally pinned to a core and
+ * scheduled SCHED_FIFO, and the stages are connected by bounded lock-free
+ * queues of frame descriptors. The first stage is the source, it produces
+ * the frames (e.g. STFTSourceStage transforms the blocks of a CaptureRing),
+ * the other stages process them in order. A stage that lags behind takes
+ * all the frames waiting in its queue, up to max_batch, in one call.
+ *
+ * The spectra stay in the STFT buffer while the descriptors travel, so the
+ * source is throttled to have at most max_in_flight frames that are not yet
+ * completed by the last stage. With an STFT of n_frames frames and a
+ * SRPPHAT averaging over srp_n_frames, max_in_flight must be at most
+ * n_frames - srp_n_frames - 1 so that no frame in use is overwritten.
+ * The per frame results (spatial spectrum, features) are stored by the
+ * stages in rings of n_slots > max_in_flight entries. start() refuses to
+ * run when a stage allows fewer frames in flight.
+ *
+ *   capture thread -> [STFT] -> [DOA] -> [features] -> [classifier] -> [output]
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <functional>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "spsc_queue.h"
+#include "capture.h"
+#include "stft.h"
+#include "srpphat.h"
+#include "mfcc.h"
+#include "classifier.h"
+
+struct PipelineFrame
+{
+  long index;              // frame number in the STFT, -1 marks the end of the stream
+  uint64_t sequence;       // capture block number
+  uint64_t timestamp_ns;   // capture time of the block
+  int argmax;              // DOA grid point, -1 when the grid was not searched
+  float power;             // spatial spectrum at argmax
+  float *spectrum;         // spatial spectrum, NULL when not searched
+  float *features;         // MFCC of all channels, NULL when not computed
+  float *probabilities;    // event probabilities, NULL when not classified
+};
+
+class PipelineStage
+{
+  public:
+    std::string name;
+    int cpu;        // core to pin the thread to, -1 for none
+    int priority;   // SCHED_FIFO priority, 0 for the normal scheduler
+    int max_batch;
+
+    // statistics
+    uint64_t n_frames_processed;
+    uint64_t n_batches;
+
+    std::atomic<bool> *running;  // set by the pipeline
+
+    PipelineStage(std::string _name, int _max_batch = 1)
+      : name(_name), cpu(-1), priority(0), max_batch(_max_batch),
+        n_frames_processed(0), n_batches(0), running(NULL) {}
+    virtual ~PipelineStage() {}
+
+    // the source produces the frames, false at the end of the stream
+    virtual bool produce(PipelineFrame &frame) { return false; }
+
+    // the other stages process batches of consecutive frames
+    virtual void process(PipelineFrame *frames, int n) {}
+
+    // most frames in flight before the stage overwrites one in use, -1 for no limit
+    virtual int max_frames_in_flight() const { return -1; }
+};
+
+/* Transforms the blocks of a capture ring, the ring slots are the STFT input frames */
+class STFTSourceStage : public PipelineStage
+{
+  public:
+    CaptureRing *ring;
+    CaptureThread *reader;
+    STFT *stft;
+    int timeout_us;
+
+    STFTSourceStage(CaptureRing *_ring, CaptureThread *_reader, STFT *_stft, int _timeout_us = 100000)
+      : PipelineStage("stft"), ring(_ring), reader(_reader), stft(_stft), timeout_us(_timeout_us) {}
+
+    bool produce(PipelineFrame &frame);
+    int max_frames_in_flight() const { return this->stft->n_frames - 1; }
+};
+
+/* Updates G for every frame but only searches the grid for the last frame of a batch */
+class SRPPHATStage : public PipelineStage
+{
+  public:
+    SRPPHAT *srpphat;
+    int n_slots;
+    float *spectra;
+
+    SRPPHATStage(SRPPHAT *_srpphat, int _n_slots, int _max_batch = 4);
+    ~SRPPHATStage();
+
+    void process(PipelineFrame *frames, int n);
+    int max_frames_in_flight() const;
+};
+
+class MFCCStage : public PipelineStage
+{
+  public:
+    MFCC *mfcc;
+    STFT *stft;
+    int n_slots;
+    float *features;
+
+    MFCCStage(MFCC *_mfcc, STFT *_stft, int _n_slots, int _max_batch = 4);
+    ~MFCCStage();
+
+    void process(PipelineFrame *frames, int n);
+    int max_frames_in_flight() const;
+};
+
+/* Event probabilities of the features of one channel, or of all the channels */
+class ClassifierStage : public PipelineStage
+{
+  public:
+    Classifier *classifier;
+    int mfcc_size;
+    int channels;   // of the features
+    int channel;    // -1 to classify the features of all the channels at once
+    int n_slots;
+    float *probabilities;
+    float *input;
+    bool valid;     // false when the model does not take these features, nothing is classified
+
+    ClassifierStage(Classifier *_classifier, int _mfcc_size, int _channels, int _channel, int _n_slots);
+    ~ClassifierStage();
+
+    void process(PipelineFrame *frames, int n);
+    int max_frames_in_flight() const { return this->n_slots - 1; }
+};
+
+class OutputStage : public PipelineStage
+{
+  public:
+    std::function<void(const PipelineFrame &frame)> callback;
+
+    OutputStage(std::function<void(const PipelineFrame &frame)> _callback, int _max_batch = 8)
+      : PipelineStage("output", _max_batch), callback(_callback) {}
+
+    void process(PipelineFrame *frames, int n);
+};
+
+class Pipeline
+{
+  public:
+    std::vector<PipelineStage *> stages;
+    std::vector<SPSCQueue<PipelineFrame> *> queues;
+    std::vector<std::thread> threads;
+
+    int max_in_flight;
+    std::atomic<bool> running;
+    std::atomic<long> produced;
+    std::atomic<long> completed;
+
+    Pipeline(int _max_in_flight);
+    ~Pipeline();
+
+    // the first stage added is the source
+    void add_stage(PipelineStage *stage);
+
+    // false, and nothing is started, when max_in_flight is above the limit of a stage
+    bool start();
+    void stop();   // stop now
+    void wait();   // wait for the end of the stream
+
+    void run_source();
+    void run_stage(int i);
+};
+
+// pin the calling thread and set its real-time priority, returns false on failure
+bool pipeline_set_thread_params(const std::string &name, int cpu, int priority);
+
+#endif // __PIPELINE_H__
@@ -0,0 +1,139 @@
+
+#include <iostream>
+
+#include "planner.h"
+#include "stft.h"
+#include "mfcc.h"
+
+// the planner state shared by all the transforms
+static int planner_effort_level = PLANNER_ESTIMATE;
+static double planner_time_limit = -1.;
+
+std::mutex &planner_mutex()
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+void planner_set_effort(int effort)
+{
+  if (effort < PLANNER_ESTIMATE || effort > PLANNER_EXHAUSTIVE)
+  {
+    std::cerr << "Error: unknown planner effort " << effort << ", using estimate." << std::endl;
+    effort = PLANNER_ESTIMATE;
+  }
+  planner_effort_level = effort;
+}
+
+int planner_get_effort()
+{
+  return planner_effort_level;
+}
+
+void planner_set_time_limit(double seconds)
+{
+  planner_time_limit = seconds;
+
+  // FFTW uses FFTW_NO_TIMELIMIT (-1) to remove the limit
+  if (seconds < 0.)
+    fftwf_set_timelimit(FFTW_NO_TIMELIMIT);
+  else
+    fftwf_set_timelimit(seconds);
+}
+
+double planner_get_time_limit()
+{
+  return planner_time_limit;
+}
+
+unsigned planner_flags()
+{
+  switch (planner_effort_level)
+  {
+    case PLANNER_MEASURE:
+      return FFTW_MEASURE;
+    case PLANNER_PATIENT:
+      return FFTW_PATIENT;
+    case PLANNER_EXHAUSTIVE:
+      return FFTW_EXHAUSTIVE;
+    default:
+      return FFTW_ESTIMATE;
+  }
+}
+
+const char *planner_effort_name(int effort)
+{
+  switch (effort)
+  {
+    case PLANNER_MEASURE:
+      return "measure";
+    case PLANNER_PATIENT:
+      return "patient";
+    case PLANNER_EXHAUSTIVE:
+      return "exhaustive";
+    default:
+      return "estimate";
+  }
+}
+
+/* Import the wisdom from a file, returns false if the file could not be read */
+bool planner_load_wisdom(const std::string &path)
+{
+  return fftwf_import_wisdom_from_filename(path.c_str()) != 0;
+}
+
+/* Export the accumulated wisdom to a file */
+bool planner_save_wisdom(const std::string &path)
+{
+  if (!fftwf_export_wisdom_to_filename(path.c_str()))
+  {
+    std::cerr << "Error: could not write wisdom to " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void planner_forget_wisdom()
+{
+  fftwf_forget_wisdom();
+}
+
+bool planner_init(const std::string &wisdom_path, int effort, double time_limit)
+{
+  planner_set_effort(effort);
+  planner_set_time_limit(time_limit);
+
+  bool loaded = planner_load_wisdom(wisdom_path);
+  if (!loaded && effort != PLANNER_ESTIMATE)
+    std::cerr << "Warning: no wisdom in " << wisdom_path
+      << ", planning with effort '" << planner_effort_name(effort) << "' may be slow." << std::endl;
+
+  return loaded;
+}
+
+/*
+ * Creates all the plans that the library would create for the
+ * given configurations so that the wisdom is accumulated, then save it.
+ * The previous wisdom in the file is loaded first and extended.
+ */
+bool planner_tune(const std::string &wisdom_path, int effort, double time_limit,
+    const std::vector<int> &fft_sizes, const std::vector<int> &channels,
+    const std::vector<int> &mfcc_sizes)
+{
+  planner_init(wisdom_path, effort, time_limit);
+
+  for (size_t i = 0 ; i < fft_sizes.size() ; i++)
+    for (size_t c = 0 ; c < channels.size() ; c++)
+    {
+      // one frame is enough, the plans of all frames are identical
+      STFT engine(fft_sizes[i], 1, channels[c]);
+    }
+
+  for (size_t m = 0 ; m < mfcc_sizes.size() ; m++)
+  {
+    // the DCT plan only depends on the number of coefficients
+    MFCC mfcc(mfcc_sizes[m], fft_sizes.size() > 0 ? fft_sizes[0] : 128, 16000, 0., 0.5);
+  }
+
+  return planner_save_wisdom(wisdom_path);
+}
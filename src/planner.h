@@ -0,0 +1,63 @@
+#ifndef __PLANNER_H__
+#define __PLANNER_H__
+
+/*
+ * Shared FFTW planning facility.
+ *
+ * All the transforms of the library (STFT, MFCC) create their plans
+ * with the flags returned by planner_flags(), so that the planner effort,
+ * the time limit and the wisdom file are chosen in a single place.
+ *
+ * The typical use for a service is
+ *
+ *    planner_init(PLANNER_DEFAULT_WISDOM, PLANNER_MEASURE, 5.);
+ *    ... create STFT and MFCC objects ...
+ *
+ * If the wisdom was previously produced by planner_tune (see
+ * tests/tune_fftw.cpp) for the same sizes, the measured plans are
+ * obtained instantly.
+ */
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fftw3.h>
+
+#define PLANNER_DEFAULT_WISDOM "./e3e_fftw.wisdom"
+
+enum planner_effort
+{
+  PLANNER_ESTIMATE = 0,
+  PLANNER_MEASURE,
+  PLANNER_PATIENT,
+  PLANNER_EXHAUSTIVE
+};
+
+// planner effort and time limit (in seconds, negative means no limit)
+void planner_set_effort(int effort);
+int planner_get_effort();
+void planner_set_time_limit(double seconds);
+double planner_get_time_limit();
+
+// the flags to pass to all the fftwf_plan_* functions
+unsigned planner_flags();
+const char *planner_effort_name(int effort);
+
+// only the execution of the plans is thread safe, plans created while
+// other threads may also plan must be made under this lock
+std::mutex &planner_mutex();
+
+// wisdom persistence
+bool planner_load_wisdom(const std::string &path);
+bool planner_save_wisdom(const std::string &path);
+void planner_forget_wisdom();
+
+// load the wisdom (if present) and set effort and time limit
+bool planner_init(const std::string &wisdom_path, int effort, double time_limit);
+
+// create the plans for all the configured sizes and save the wisdom
+bool planner_tune(const std::string &wisdom_path, int effort, double time_limit,
+    const std::vector<int> &fft_sizes, const std::vector<int> &channels,
+    const std::vector<int> &mfcc_sizes);
+
+#endif // __PLANNER_H__
@@ -0,0 +1,256 @@
+
+#include <algorithm>
+#include <unistd.h>
+
+#include "quality.h"
+
+QualityController::QualityController(SRPPHAT *_srpphat, int frame_size, float fs, std::ostream *_metrics)
+  : srpphat(_srpphat), metrics(_metrics)
+{
+  this->deadline_ns = double(frame_size) / double(fs) * 1e9;
+  this->high_load = QUALITY_HIGH_LOAD;
+  this->low_load = QUALITY_LOW_LOAD;
+  this->max_overruns = QUALITY_MAX_OVERRUNS;
+  this->recover_frames = QUALITY_RECOVER_FRAMES;
+  this->hold_frames = QUALITY_HOLD_FRAMES;
+  this->smoothing = QUALITY_SMOOTHING;
+
+  this->frame = 0;
+  this->load = 0.;
+  this->consecutive_overruns = 0;
+  this->n_low = 0;
+  this->n_hold = 0;
+  this->t_start = 0;
+
+  this->n_overruns = 0;
+  this->n_degrade = 0;
+  this->n_recover = 0;
+  this->max_frame_ns = 0;
+  this->n_events_lost = 0;
+
+  // halve the bins first, then the grid, the pairs, and finally skip searches
+  std::vector<QualityLevel> ladder = {
+    { 1, 1, 1, 1 },
+    { 1, 2, 1, 1 },
+    { 1, 2, 1, 2 },
+    { 1, 2, 2, 2 },
+    { 2, 2, 2, 2 },
+    { 4, 4, 2, 2 },
+    { 8, 4, 2, 4 },
+  };
+  this->set_levels(ladder);
+
+  this->events = NULL;
+  this->writing = false;
+  if (this->metrics != NULL)
+  {
+    *this->metrics << "time_ns,frame,event,level,load,frame_ns,doa_every,k_step,pair_step,grid_step" << std::endl;
+
+    this->events = new SPSCQueue<QualityEvent>(QUALITY_EVENT_QUEUE);
+    this->writing = true;
+    this->writer = std::thread(&QualityController::run_writer, this);
+  }
+}
+
+QualityController::~QualityController()
+{
+  this->close_metrics();
+  delete this->events;
+}
+
+void QualityController::set_levels(const std::vector<QualityLevel> &_levels)
+{
+  this->levels = _levels;
+  this->frames_per_level.assign(_levels.size(), 0);
+  this->level = -1;
+  this->set_level(0);
+}
+
+void QualityController::set_level(int _level)
+{
+  _level = std::max(0, std::min(_level, int(this->levels.size()) - 1));
+  if (_level == this->level)
+    return;
+
+  this->level = _level;
+
+  const QualityLevel &q = this->levels[_level];
+  this->srpphat->set_search_quality(q.k_step, q.pair_step, q.grid_step);
+
+  this->n_low = 0;
+  this->consecutive_overruns = 0;
+  this->n_hold = this->hold_frames;
+}
+
+bool QualityController::search_due()
+{
+  return this->frame % this->levels[this->level].doa_every == 0;
+}
+
+void QualityController::begin_frame()
+{
+  this->t_start = e3e_monotonic_ns();
+}
+
+void QualityController::end_frame()
+{
+  this->update(e3e_monotonic_ns() - this->t_start);
+}
+
+int QualityController::process()
+{
+  this->begin_frame();
+  int argmax = this->process_frame();
+  this->end_frame();
+
+  return argmax;
+}
+
+int QualityController::process_frame()
+{
+  int argmax = -1;
+  this->srpphat->stft->transform();
+  this->srpphat->update(this->srpphat->stft->frame_count - 1);
+  if (this->search_due())
+    argmax = this->srpphat->search();
+
+  return argmax;
+}
+
+void QualityController::update(uint64_t frame_ns)
+{
+  float frame_load = float(frame_ns / this->deadline_ns);
+
+  if (this->frame == 0)
+    this->load = frame_load;
+  else
+    this->load += this->smoothing * (frame_load - this->load);
+
+  this->frames_per_level[this->level]++;
+  this->max_frame_ns = std::max(this->max_frame_ns, frame_ns);
+
+  if (frame_load > 1.)
+  {
+    this->n_overruns++;
+    this->consecutive_overruns++;
+    this->log_event("overrun", frame_ns);
+  }
+  else
+    this->consecutive_overruns = 0;
+
+  if (this->load < this->low_load)
+    this->n_low++;
+  else
+    this->n_low = 0;
+
+  this->frame++;
+
+  if (this->n_hold > 0)
+  {
+    this->n_hold--;
+    return;
+  }
+
+  int last = int(this->levels.size()) - 1;
+
+  if ((this->load > this->high_load || this->consecutive_overruns >= this->max_overruns)
+      && this->level < last)
+  {
+    this->set_level(this->level + 1);
+    this->n_degrade++;
+    this->log_event("degrade", frame_ns);
+  }
+  else if (this->n_low >= this->recover_frames && this->level > 0)
+  {
+    this->set_level(this->level - 1);
+    this->n_recover++;
+    this->log_event("recover", frame_ns);
+  }
+}
+
+void QualityController::log_event(const char *event, uint64_t frame_ns)
+{
+  if (this->metrics == NULL)
+    return;
+
+  QualityEvent e;
+  e.time_ns = e3e_monotonic_ns();
+  e.frame = this->frame;
+  e.event = event;
+  e.level = this->level;
+  e.load = this->load;
+  e.frame_ns = frame_ns;
+  e.q = this->levels[this->level];
+
+  if (this->events == NULL || !this->events->push(e))
+    this->n_events_lost++;
+}
+
+void QualityController::write_events()
+{
+  QualityEvent batch[64];
+  int n, n_written = 0;
+
+  while ((n = this->events->pop_many(batch, 64)) > 0)
+  {
+    for (int i = 0 ; i < n ; i++)
+    {
+      const QualityEvent &e = batch[i];
+      *this->metrics << e.time_ns << "," << e.frame << "," << e.event << ","
+        << e.level << "," << e.load << "," << e.frame_ns << ","
+        << e.q.doa_every << "," << e.q.k_step << "," << e.q.pair_step << "," << e.q.grid_step << '\n';
+    }
+    n_written += n;
+  }
+
+  if (n_written > 0)
+    this->metrics->flush();
+}
+
+void QualityController::run_writer()
+{
+  uint64_t next = e3e_monotonic_ns();
+
+  while (this->writing)
+  {
+    if (e3e_monotonic_ns() < next)
+    {
+      // checks for a stop every 10 ms
+      usleep(std::min(10000, QUALITY_WRITER_PERIOD_MS * 1000));
+      continue;
+    }
+
+    this->write_events();
+    next += uint64_t(QUALITY_WRITER_PERIOD_MS) * 1000000;
+  }
+
+  // the events left when stopping
+  this->write_events();
+}
+
+void QualityController::close_metrics()
+{
+  this->writing = false;
+  if (this->writer.joinable())
+    this->writer.join();
+}
+
+void QualityController::print_summary(std::ostream &out)
+{
+  out << "# Frames: " << this->frame << " deadline: " << this->deadline_ns * 1e-6 << " ms";
+  out << " max: " << this->max_frame_ns * 1e-6 << " ms" << std::endl;
+  out << "# Overruns: " << this->n_overruns << " degrade: " << this->n_degrade;
+  out << " recover: " << this->n_recover;
+  if (this->n_events_lost > 0)
+    out << " events lost: " << this->n_events_lost;
+  out << std::endl;
+
+  for (size_t l = 0 ; l < this->levels.size() ; l++)
+  {
+    const QualityLevel &q = this->levels[l];
+    float pct = this->frame > 0 ? 100. * this->frames_per_level[l] / this->frame : 0.;
+    out << "# level " << l << " (doa_every=" << q.doa_every << " k_step=" << q.k_step;
+    out << " pair_step=" << q.pair_step << " grid_step=" << q.grid_step << "): ";
+    out << this->frames_per_level[l] << " frames (" << pct << "%)" << std::endl;
+  }
+}
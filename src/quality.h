@@ -0,0 +1,156 @@
+#ifndef __QUALITY_H__
+#define __QUALITY_H__
+
+/*
+ * Deadline-aware quality scaling for the DOA.
+ *
+ * Every frame must be processed within its duration, fft_size / fs
+ * (8 ms for 128 samples at 16 kHz), or the capture ring fills up and
+ * blocks are dropped. The controller measures the processing time of
+ * every frame, the STFT included, keeps a smoothed load (time / deadline),
+ * and moves along a ladder of quality levels:
+ *
+ *   - level up (degrade) when the load goes above high_load or when
+ *     max_overruns consecutive frames miss the deadline,
+ *   - level down (recover) when the load stayed below low_load for
+ *     recover_frames frames.
+ *
+ * A level sets the search steps of the SRPPHAT (bins, pairs, grid points)
+ * and runs the grid search only every doa_every frames. G is updated at
+ * every frame in any case. After a change the level is held for
+ * hold_frames frames so that the load reflects it.
+ *
+ * Every adjustment, and every overrun, is written as a CSV line to the
+ * metrics stream (if any):
+ *
+ *   time_ns,frame,event,level,load,frame_ns,doa_every,k_step,pair_step,grid_step
+ *
+ * and the number of frames spent at each level is counted to size the
+ * hardware from real runs (print_summary).
+ *
+ * The frames that are late do not write: the events go through a
+ * preallocated queue to a thread of the controller that writes them and
+ * flushes the stream every QUALITY_WRITER_PERIOD_MS, so that a run that is
+ * killed loses at most the last period. close_metrics(), or the
+ * destructor, writes the events left. The events that find the queue full
+ * are only counted (n_events_lost).
+ *
+ *   QualityController quality(srpphat, FFT_SIZE, FS, &metrics_file);
+ *   ...
+ *   // the input frame of the STFT is filled
+ *   int argmax = quality.process();  // -1 when the grid was not searched
+ */
+
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "spsc_queue.h"
+#include "srpphat.h"
+
+#define QUALITY_HIGH_LOAD 0.8
+#define QUALITY_LOW_LOAD 0.5
+#define QUALITY_MAX_OVERRUNS 2
+#define QUALITY_RECOVER_FRAMES 100
+#define QUALITY_HOLD_FRAMES 20
+#define QUALITY_SMOOTHING 0.1
+#define QUALITY_EVENT_QUEUE 1024
+#define QUALITY_WRITER_PERIOD_MS 100
+
+struct QualityLevel
+{
+  int doa_every;  // search the grid every doa_every frames
+  int k_step;
+  int pair_step;
+  int grid_step;
+};
+
+/* a line of the metrics, copied from the real-time thread to the writer */
+struct QualityEvent
+{
+  uint64_t time_ns;
+  long frame;
+  const char *event;   // a string literal
+  int level;
+  float load;
+  uint64_t frame_ns;
+  QualityLevel q;
+};
+
+class QualityController
+{
+  public:
+    SRPPHAT *srpphat;
+    std::ostream *metrics;
+
+    // levels from the best to the cheapest
+    std::vector<QualityLevel> levels;
+    int level;
+
+    double deadline_ns;
+    float high_load;
+    float low_load;
+    int max_overruns;
+    int recover_frames;
+    int hold_frames;
+    float smoothing;
+
+    // state
+    long frame;
+    float load;            // smoothed processing time / deadline
+    int consecutive_overruns;
+    int n_low;             // consecutive frames below low_load
+    int n_hold;            // frames left before the next change
+    uint64_t t_start;
+
+    // statistics
+    uint64_t n_overruns;
+    uint64_t n_degrade;
+    uint64_t n_recover;
+    uint64_t max_frame_ns;
+    std::vector<uint64_t> frames_per_level;
+    uint64_t n_events_lost;
+
+    // the metrics writer
+    SPSCQueue<QualityEvent> *events;
+    std::thread writer;
+    std::atomic<bool> writing;
+
+    QualityController(SRPPHAT *srpphat, int frame_size, float fs, std::ostream *metrics = NULL);
+    ~QualityController();
+
+    // replace the default ladder, level 0 is the full quality
+    void set_levels(const std::vector<QualityLevel> &levels);
+    void set_level(int level);
+
+    // transform the input frame of the STFT, update G with it and search the grid
+    // when the level allows it, returns the argmax or -1, the time is measured
+    int process();
+
+    // the measured path split in two, for callers that time more than the DOA:
+    // begin_frame(), process_frame() and the rest of the frame, end_frame()
+    void begin_frame();
+    void end_frame();
+    int process_frame();
+
+    // true if the grid must be searched for the current frame
+    bool search_due();
+
+    // account for a frame that took frame_ns, and adapt the level
+    void update(uint64_t frame_ns);
+
+    void print_summary(std::ostream &out);
+
+    // stop the writer and write the events left, the metrics stream can then be read
+    void close_metrics();
+
+  private:
+    void log_event(const char *event, uint64_t frame_ns);
+    void write_events();
+    void run_writer();
+};
+
+#endif // __QUALITY_H__
@@ -0,0 +1,228 @@
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "recording.h"
+
+bool AudioSource::seek_time(double seconds)
+{
+  if (seconds < 0.)
+    return false;
+  return this->seek(uint64_t(llround(seconds * this->fs)));
+}
+
+bool AudioSource::read_to(STFT *stft, float *buf, const int *remap)
+{
+  const void *pcm = this->read(stft->fft_size);
+  if (pcm == NULL)
+    return false;
+
+  if (this->format == RECORDING_INT16)
+  {
+    if (buf == NULL)
+      stft->ingest((const int16_t *)pcm, PCM_INTERLEAVED, remap, this->channels);
+    else
+      stft->ingest_to(buf, (const int16_t *)pcm, PCM_INTERLEAVED, remap, this->channels);
+  }
+  else
+  {
+    if (buf == NULL)
+      stft->ingest((const float *)pcm, PCM_INTERLEAVED, remap, this->channels);
+    else
+      stft->ingest_to(buf, (const float *)pcm, PCM_INTERLEAVED, remap, this->channels);
+  }
+
+  return true;
+}
+
+MappedRecording::MappedRecording(size_t _readahead)
+  : map(NULL), map_size(0), samples(NULL), n_samples(0), position(0), readahead(_readahead), advised(0)
+{
+  this->channels = 0;
+  this->fs = 0;
+  this->format = RECORDING_FLOAT32;
+}
+
+MappedRecording::~MappedRecording()
+{
+  this->close();
+}
+
+bool MappedRecording::open(const std::string &_path, int _channels, int _fs, int _format)
+{
+  this->close();
+
+  int fd = ::open(_path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Error: could not open the recording " << _path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    std::cerr << "Error: the recording " << _path << " is empty." << std::endl;
+    ::close(fd);
+    return false;
+  }
+
+  void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m == MAP_FAILED)
+  {
+    std::cerr << "Error: could not map the recording " << _path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->path = _path;
+  this->map = (const uint8_t *)m;
+  this->map_size = st.st_size;
+
+  // the header if there is one, the given layout otherwise
+  size_t data_offset = 0;
+  RecordingHeader h;
+  if (this->map_size >= sizeof(h) && memcmp(this->map, RECORDING_MAGIC, 4) == 0)
+  {
+    memcpy(&h, this->map, sizeof(h));
+    if (h.version != RECORDING_VERSION || h.channels == 0 || h.format > RECORDING_FLOAT32
+        || h.data_offset < sizeof(h) || h.data_offset > this->map_size)
+    {
+      std::cerr << "Error: invalid header in the recording " << _path << std::endl;
+      this->close();
+      return false;
+    }
+    _channels = h.channels;
+    _fs = h.fs;
+    _format = h.format;
+    data_offset = h.data_offset;
+  }
+
+  if (_channels <= 0 || _format > RECORDING_FLOAT32)
+  {
+    std::cerr << "Error: invalid layout for the recording " << _path << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->channels = _channels;
+  this->fs = _fs;
+  this->format = _format;
+  this->samples = this->map + data_offset;
+  this->n_samples = (this->map_size - data_offset) / this->sample_bytes();
+
+  if ((this->map_size - data_offset) % this->sample_bytes() != 0)
+    std::cerr << "Warning: the recording " << _path << " ends with a partial sample." << std::endl;
+
+  madvise((void *)this->map, this->map_size, MADV_SEQUENTIAL);
+  this->advised = 0;
+  this->position = 0;
+  this->advise(0);
+
+  return true;
+}
+
+void MappedRecording::close()
+{
+  if (this->map != NULL)
+    munmap((void *)this->map, this->map_size);
+
+  this->map = NULL;
+  this->map_size = 0;
+  this->samples = NULL;
+  this->n_samples = 0;
+  this->position = 0;
+}
+
+/* request the pages from the sample to readahead bytes further, half a window before they are needed */
+void MappedRecording::advise(uint64_t sample)
+{
+  size_t start = sample * this->sample_bytes();
+  size_t data_size = this->n_samples * this->sample_bytes();
+
+  if (this->readahead == 0 || start + this->readahead / 2 <= this->advised)
+    return;
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t offset = (this->samples - this->map) + start;
+  size_t aligned = offset / page * page;
+  size_t end = std::min(this->samples - this->map + data_size, offset + this->readahead);
+
+  if (end > aligned)
+    madvise((void *)(this->map + aligned), end - aligned, MADV_WILLNEED);
+  this->advised = end - (this->samples - this->map);
+}
+
+const void *MappedRecording::read(int n)
+{
+  const void *block = this->block_at(this->position, n);
+  if (block == NULL)
+    return NULL;
+
+  this->position += n;
+  this->advise(this->position);
+
+  return block;
+}
+
+uint64_t MappedRecording::tell()
+{
+  return this->position;
+}
+
+bool MappedRecording::seek(uint64_t sample)
+{
+  if (this->map == NULL || sample > this->n_samples)
+    return false;
+
+  this->position = sample;
+  this->advised = 0;
+  this->advise(sample);
+
+  return true;
+}
+
+const void *MappedRecording::block_at(uint64_t sample, int n)
+{
+  if (this->map == NULL || n < 0 || sample + n > this->n_samples)
+    return NULL;
+  return this->samples + sample * this->sample_bytes();
+}
+
+bool recording_write(const std::string &path, const void *pcm, uint64_t n_samples, int channels, int fs, int format)
+{
+  std::ofstream fout(path, std::ofstream::binary | std::ofstream::trunc);
+  if (!fout)
+  {
+    std::cerr << "Error: could not create the recording " << path << std::endl;
+    return false;
+  }
+
+  // the samples start on a cache line
+  RecordingHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, RECORDING_MAGIC, 4);
+  h.version = RECORDING_VERSION;
+  h.format = format;
+  h.channels = channels;
+  h.fs = fs;
+  h.data_offset = E3E_CACHE_LINE;
+
+  char header[E3E_CACHE_LINE] = {0};
+  memcpy(header, &h, sizeof(h));
+  fout.write(header, E3E_CACHE_LINE);
+
+  size_t bytes = size_t(channels) * (format == RECORDING_INT16 ? sizeof(int16_t) : sizeof(float));
+  fout.write((const char *)pcm, n_samples * bytes);
+
+  return bool(fout);
+}
@@ -0,0 +1,126 @@
+#ifndef __RECORDING_H__
+#define __RECORDING_H__
+
+/*
+ * Sources of multichannel audio blocks: recordings and microphones.
+ *
+ * An AudioSource hands out blocks of interleaved samples (int16 or
+ * float32) that stay valid until the next read. It does not copy them
+ * where it can avoid it: MappedRecording returns pointers into the mapped
+ * file, and a microphone source can return the buffer of the driver, e.g.
+ * &mics.At(0, 0) after mics.Read() on the MATRIX Creator. read_to() feeds
+ * a block to an STFT input frame, so a source plugs into a CaptureThread
+ * or a processing loop the same way, live or not:
+ *
+ *   MappedRecording rec;
+ *   if (!rec.open("test_signal.raw"))
+ *     ...
+ *   rec.seek_time(60.);
+ *   CaptureThread reader(&ring, [&](float *block) { return rec.read_to(stft, block); });
+ *
+ * Recordings are raw interleaved samples, optionally after a small
+ * RecordingHeader giving the format, the channels and the sampling
+ * frequency (see recording_write). The files without it, like
+ * tests/synthetic_data/test_signal.raw, take the layout given to open().
+ *
+ * MappedRecording maps the whole file read-only. The kernel is told that
+ * the access is sequential, and the next `readahead` bytes are requested
+ * ahead of the reads (MADV_WILLNEED), so a long recording is streamed
+ * without a system call or a copy per block.
+ */
+
+#include <string>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "stft.h"
+
+#define RECORDING_MAGIC "E3ER"
+#define RECORDING_VERSION 1
+#define RECORDING_READAHEAD (4 << 20)
+
+enum recording_format
+{
+  RECORDING_INT16 = 0,
+  RECORDING_FLOAT32
+};
+
+struct RecordingHeader
+{
+  char magic[4];
+  uint16_t version;
+  uint16_t format;
+  uint16_t channels;
+  uint16_t reserved;
+  uint32_t fs;
+  uint32_t data_offset;   // offset of the first sample
+  uint32_t reserved2;
+};
+
+class AudioSource
+{
+  public:
+    int channels;
+    int fs;
+    int format;
+
+    virtual ~AudioSource() {}
+
+    // the next n interleaved samples per channel, valid until the next read, NULL at the end
+    virtual const void *read(int n) = 0;
+
+    // position in samples per channel, seek returns false if the source cannot seek
+    virtual uint64_t tell() = 0;
+    virtual bool seek(uint64_t sample) { return false; }
+    bool seek_time(double seconds);
+
+    // read fft_size samples into an input frame of the STFT (its current frame if NULL), false at the end
+    bool read_to(STFT *stft, float *buf = NULL, const int *remap = NULL);
+
+    inline size_t sample_bytes()
+    {
+      return size_t(this->channels) * (this->format == RECORDING_INT16 ? sizeof(int16_t) : sizeof(float));
+    }
+};
+
+class MappedRecording : public AudioSource
+{
+  public:
+    std::string path;
+    const uint8_t *map;
+    size_t map_size;
+    const uint8_t *samples;   // first sample
+    uint64_t n_samples;       // per channel
+    uint64_t position;
+
+    size_t readahead;         // bytes requested ahead of the position
+    size_t advised;           // end of the last request, from samples
+
+    MappedRecording(size_t readahead = RECORDING_READAHEAD);
+    ~MappedRecording();
+
+    // a file with a RecordingHeader, or raw samples with the given layout
+    bool open(const std::string &path, int channels = 8, int fs = 16000, int format = RECORDING_FLOAT32);
+    void close();
+
+    const void *read(int n);
+    uint64_t tell();
+    bool seek(uint64_t sample);
+
+    // n samples per channel from any position, NULL past the end
+    const void *block_at(uint64_t sample, int n);
+
+    inline double duration()
+    {
+      return double(this->n_samples) / this->fs;
+    }
+
+  private:
+    void advise(uint64_t sample);
+};
+
+// write n_samples interleaved samples per channel after a RecordingHeader
+bool recording_write(const std::string &path, const void *pcm, uint64_t n_samples, int channels, int fs,
+    int format);
+
+#endif // __RECORDING_H__
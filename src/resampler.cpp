@@ -0,0 +1,187 @@
+
+#include <iostream>
+#include <cmath>
+#include <string.h>
+
+#include "resampler.h"
+
+static int gcd(int a, int b)
+{
+  while (b != 0)
+  {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* zeroth order modified Bessel function of the first kind, for the Kaiser window */
+static double bessel_i0(double x)
+{
+  double sum = 1., term = 1.;
+  for (int k = 1 ; k < 50 ; k++)
+  {
+    term *= (x / (2. * k)) * (x / (2. * k));
+    sum += term;
+    if (term < 1e-12 * sum)
+      break;
+  }
+  return sum;
+}
+
+Resampler::Resampler(int _up, int _down, int _channels, int _max_block, int _taps_per_phase, float _cutoff)
+  : channels(_channels), taps_per_phase(_taps_per_phase), max_block(_max_block), cutoff(_cutoff)
+{
+  // reduce the ratio
+  int g = gcd(_up, _down);
+  this->up = _up / g;
+  this->down = _down / g;
+
+  int T = _taps_per_phase;
+  int K = this->up * T;
+
+  // cutoff normalized to the upsampled rate
+  double fc = 0.5 * _cutoff / double(this->up > this->down ? this->up : this->down);
+  double center = 0.5 * (K - 1);
+  double i0_beta = bessel_i0(RESAMPLER_KAISER_BETA);
+
+  this->phases = new float[K];
+
+  for (int j = 0 ; j < K ; j++)
+  {
+    double t = j - center;
+    double sinc = (t == 0.) ? 1. : sin(2. * M_PI * fc * t) / (2. * M_PI * fc * t);
+    double r = t / (center + 0.5);
+    double w = bessel_i0(RESAMPLER_KAISER_BETA * sqrt(1. - r * r)) / i0_beta;
+
+    // tap j belongs to phase p = j % up at position j / up, stored reversed
+    int p = j % this->up;
+    int tap = j / this->up;
+    this->phases[p * T + (T - 1 - tap)] = float(this->up * 2. * fc * sinc * w);
+  }
+
+  this->buffer = new float[(T - 1 + _max_block) * _channels];
+  this->out_block = new float[this->max_output(_max_block) * _channels];
+
+  this->reset();
+}
+
+Resampler::~Resampler()
+{
+  delete[] this->phases;
+  delete[] this->buffer;
+  delete[] this->out_block;
+}
+
+void Resampler::reset()
+{
+  for (int i = 0 ; i < (this->taps_per_phase - 1) * this->channels ; i++)
+    this->buffer[i] = 0.;
+
+  this->n_in_total = 0;
+  this->u_next = 0;
+  this->stft_fill = 0;
+}
+
+int Resampler::max_output(int n_in)
+{
+  return (int)((long(n_in) * this->up + this->down - 1) / this->down) + 1;
+}
+
+float Resampler::group_delay_in()
+{
+  return 0.5 * (this->up * this->taps_per_phase - 1) / float(this->up);
+}
+
+float Resampler::group_delay_out()
+{
+  return 0.5 * (this->up * this->taps_per_phase - 1) / float(this->down);
+}
+
+int Resampler::process_block(const float *in, int n_in, float *out)
+{
+  int T = this->taps_per_phase;
+  int C = this->channels;
+
+  // the new samples go after the history
+  memcpy(this->buffer + (T - 1) * C, in, sizeof(float) * n_in * C);
+
+  long last = this->n_in_total + n_in - 1;
+  int n_out = 0;
+
+  while (this->u_next / this->up <= last)
+  {
+    long b = this->u_next / this->up;
+    int p = this->u_next % this->up;
+
+    // x[b - T + 1], ..., x[b] with the reversed phase
+    const float *g = this->phases + p * T;
+    const float *x = this->buffer + (b - this->n_in_total) * C;
+    float *y = out + n_out * C;
+
+    for (int ch = 0 ; ch < C ; ch++)
+      y[ch] = 0.;
+
+    for (int t = 0 ; t < T ; t++)
+      for (int ch = 0 ; ch < C ; ch++)
+        y[ch] += g[t] * x[t * C + ch];
+
+    this->u_next += this->down;
+    n_out++;
+  }
+
+  // keep the last T - 1 samples as history
+  this->n_in_total += n_in;
+  memmove(this->buffer, this->buffer + n_in * C, sizeof(float) * (T - 1) * C);
+
+  return n_out;
+}
+
+int Resampler::process(const float *in, int n_in, float *out)
+{
+  int n_out = 0;
+
+  for (int done = 0 ; done < n_in ; done += this->max_block)
+  {
+    int n = n_in - done < this->max_block ? n_in - done : this->max_block;
+    n_out += this->process_block(in + done * this->channels, n, out + n_out * this->channels);
+  }
+
+  return n_out;
+}
+
+int Resampler::feed(STFT *stft, const float *in, int n_in)
+{
+  int C = this->channels;
+  int n_frames = 0;
+
+  if (stft->channels != C)
+  {
+    std::cerr << "Error: the resampler and the STFT have different numbers of channels." << std::endl;
+    return 0;
+  }
+
+  for (int done = 0 ; done < n_in ; done += this->max_block)
+  {
+    int n = n_in - done < this->max_block ? n_in - done : this->max_block;
+    int n_out = this->process_block(in + done * C, n, this->out_block);
+
+    for (int i = 0 ; i < n_out ; i++)
+    {
+      float *buf = stft->get_in_buffer() + this->stft_fill * C;
+      for (int ch = 0 ; ch < C ; ch++)
+        buf[ch] = this->out_block[i * C + ch];
+
+      this->stft_fill++;
+      if (this->stft_fill == stft->fft_size)
+      {
+        stft->transform();
+        this->stft_fill = 0;
+        n_frames++;
+      }
+    }
+  }
+
+  return n_frames;
+}
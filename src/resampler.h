@@ -0,0 +1,80 @@
+#ifndef __RESAMPLER_H__
+#define __RESAMPLER_H__
+
+/*
+ * Multichannel polyphase FIR resampler by a rational factor up / down.
+ *
+ * The anti-aliasing filter is a Kaiser windowed sinc of up * taps_per_phase
+ * taps designed at the rate fs * up, and split in `up` phases of
+ * taps_per_phase taps so that only the needed products are computed.
+ * The filter has linear phase, its group delay is reported by
+ * group_delay_in() (in input samples) and group_delay_out() (in output
+ * samples).
+ *
+ * The samples are interleaved (x[n * channels + c]) and all the channels
+ * are filtered together, the inner loops being over the channels.
+ * The state is kept between calls so that a stream can be processed by
+ * blocks of any size.
+ *
+ * Typical use is to decimate the microphone signals before the STFT:
+ *
+ *   Resampler dec(1, 2, CHANNELS, FFT_SIZE);
+ *   STFT stft(FFT_SIZE, NFRAMES, CHANNELS);
+ *   ...
+ *   dec.feed(&stft, mic_block, n_samples);  // transforms when a frame is full
+ */
+
+#include "e3e_detection.h"
+#include "stft.h"
+
+#define RESAMPLER_DEFAULT_TAPS 32
+#define RESAMPLER_DEFAULT_CUTOFF 0.9
+#define RESAMPLER_KAISER_BETA 8.
+
+class Resampler
+{
+  public:
+    int up;
+    int down;
+    int channels;
+    int taps_per_phase;
+    int max_block;
+    float cutoff;   // fraction of the lowest Nyquist frequency
+
+    // filter phases, up x taps_per_phase, stored in time reversed order
+    float *phases;
+
+    // the last taps_per_phase - 1 input samples followed by the new block
+    float *buffer;
+
+    long n_in_total;   // number of input samples consumed
+    long u_next;       // index of the next output at the upsampled rate
+
+    // output staging and position in the STFT frame for feed()
+    float *out_block;
+    int stft_fill;
+
+    Resampler(int up, int down, int channels, int max_block,
+        int taps_per_phase = RESAMPLER_DEFAULT_TAPS, float cutoff = RESAMPLER_DEFAULT_CUTOFF);
+    ~Resampler();
+
+    // maximum number of outputs for n_in inputs
+    int max_output(int n_in);
+
+    // resample n_in samples, returns the number of samples written in out
+    int process(const float *in, int n_in, float *out);
+
+    // resample and fill the input frames of an STFT, returns the number of transformed frames
+    int feed(STFT *stft, const float *in, int n_in);
+
+    float group_delay_in();
+    float group_delay_out();
+
+    void reset();
+
+  private:
+    // process at most max_block samples, process() and feed() cut the input in such blocks
+    int process_block(const float *in, int n_in, float *out);
+};
+
+#endif // __RESAMPLER_H__
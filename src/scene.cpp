@@ -0,0 +1,428 @@
+
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+
+#include "scene.h"
+#include "srpphat.h"
+
+/* zeroth order modified Bessel function of the first kind, for the Kaiser window */
+static double bessel_i0(double x)
+{
+  double sum = 1., term = 1.;
+  for (int k = 1 ; k < 50 ; k++)
+  {
+    term *= (x / (2. * k)) * (x / (2. * k));
+    sum += term;
+    if (term < 1e-12 * sum)
+      break;
+  }
+  return sum;
+}
+
+SceneGenerator::SceneGenerator(const std::string &config_file, int _channels, int _fs, float _c, uint64_t _seed)
+  : c(_c), snr_db(INFINITY), length(0), latency(0), seed_value(_seed), position(0), history_size(0),
+    read_buffer(NULL), read_buffer_size(0)
+{
+  this->channels = _channels;
+  this->fs = _fs;
+  this->format = RECORDING_FLOAT32;
+
+  this->mics_loc = new float[3 * _channels];
+  for (int i = 0 ; i < 3 * _channels ; i++)
+    this->mics_loc[i] = 0.;
+  if (!read_mic_locs(config_file, this->mics_loc, _channels))
+    std::cerr << "Warning: the microphones of the scene are all at the origin." << std::endl;
+
+  // windowed sinc of every fraction, row SCENE_FRAC_PHASES is a delay of exactly one sample
+  const int T = SCENE_FRAC_TAPS;
+  const double W = T / 2;
+  const double i0_beta = bessel_i0(SCENE_KAISER_BETA);
+  this->frac = (float *)e3e_aligned_malloc(sizeof(float) * (SCENE_FRAC_PHASES + 1) * T);
+  for (int p = 0 ; p <= SCENE_FRAC_PHASES ; p++)
+  {
+    double f = double(p) / SCENE_FRAC_PHASES;
+    double sum = 0.;
+    double w[SCENE_FRAC_TAPS];
+    for (int k = 0 ; k < T ; k++)
+    {
+      double u = W - k - f;
+      double sinc = fabs(u) < 1e-9 ? 1. : sin(M_PI * u) / (M_PI * u);
+      double win = fabs(u) >= W ? 0. : bessel_i0(SCENE_KAISER_BETA * sqrt(1. - (u / W) * (u / W))) / i0_beta;
+      w[k] = sinc * win;
+      sum += w[k];
+    }
+    for (int k = 0 ; k < T ; k++)
+      this->frac[p * T + k] = float(w[k] / sum);
+  }
+
+  this->restart();
+}
+
+SceneGenerator::~SceneGenerator()
+{
+  for (size_t s = 0 ; s < this->history.size() ; s++)
+    free(this->history[s]);
+  free(this->frac);
+  free(this->read_buffer);
+  delete[] this->mics_loc;
+}
+
+int SceneGenerator::add_source(const SceneSource &source)
+{
+  this->sources.push_back(source);
+  this->restart();
+  return int(this->sources.size()) - 1;
+}
+
+void SceneGenerator::set_room(const SceneRoom &_room)
+{
+  this->room = _room;
+  this->restart();
+}
+
+void SceneGenerator::set_snr(float _snr_db)
+{
+  this->snr_db = _snr_db;
+  this->restart();
+}
+
+void SceneGenerator::set_seed(uint64_t seed)
+{
+  this->seed_value = seed;
+  this->restart();
+}
+
+/* 4th order Butterworth low-pass as two biquads */
+static void butterworth4(double cutoff, double *coef)
+{
+  const double q[2] = { 0.54119610, 1.30656296 };
+  double w0 = M_PI * cutoff;
+
+  for (int b = 0 ; b < 2 ; b++)
+  {
+    double alpha = sin(w0) / (2. * q[b]);
+    double a0 = 1. + alpha;
+    coef[b * 5 + 0] = (1. - cos(w0)) / 2. / a0;
+    coef[b * 5 + 1] = (1. - cos(w0)) / a0;
+    coef[b * 5 + 2] = (1. - cos(w0)) / 2. / a0;
+    coef[b * 5 + 3] = -2. * cos(w0) / a0;
+    coef[b * 5 + 4] = (1. - alpha) / a0;
+  }
+}
+
+static inline double biquads(const double *coef, double *state, double x)
+{
+  for (int b = 0 ; b < 2 ; b++)
+  {
+    const double *k = coef + b * 5;
+    double *z = state + b * 2;
+    double y = k[0] * x + z[0];
+    z[0] = k[1] * x - k[3] * y + z[1];
+    z[1] = k[2] * x - k[4] * y;
+    x = y;
+  }
+  return x;
+}
+
+void SceneGenerator::restart()
+{
+  const int T = SCENE_FRAC_TAPS;
+  int n_sources = this->sources.size();
+
+  this->position = 0;
+
+  // the largest delay decides the history to keep
+  float r_max = 0.;
+  for (int m = 0 ; m < this->channels ; m++)
+  {
+    const float *mic = this->mics_loc + 3 * m;
+    r_max = std::max(r_max, sqrtf(mic[0] * mic[0] + mic[1] * mic[1] + mic[2] * mic[2]));
+  }
+  this->latency = T / 2 + int(ceil(r_max * this->fs / this->c)) + 1;
+
+  bool has_room = this->room.size[0] > 0. && this->room.size[1] > 0. && this->room.size[2] > 0.;
+  float room_diag = sqrtf(this->room.size[0] * this->room.size[0] + this->room.size[1] * this->room.size[1]
+      + this->room.size[2] * this->room.size[2]);
+
+  float max_distance = r_max;
+  for (int s = 0 ; s < n_sources ; s++)
+  {
+    float d = this->sources[s].distance + r_max;
+    if (has_room && this->sources[s].distance > 0.)
+      d = std::max(d, (2 * this->room.order + 3) * room_diag);
+    max_distance = std::max(max_distance, d);
+  }
+  this->history_size = this->latency + int(ceil(max_distance * this->fs / this->c)) + T + 1;
+
+  for (size_t s = 0 ; s < this->history.size() ; s++)
+    free(this->history[s]);
+  this->history.resize(n_sources);
+  for (int s = 0 ; s < n_sources ; s++)
+  {
+    int size = this->history_size + SCENE_BLOCK;
+    this->history[s] = (float *)e3e_aligned_malloc(sizeof(float) * size);
+    memset(this->history[s], 0, sizeof(float) * size);
+  }
+
+  // separate generators for every source and for the noise
+  this->source_rng.resize(n_sources);
+  this->noise_scale.assign(n_sources, 1.);
+  this->lp_state.assign(n_sources * 4, 0.);
+  this->lp_coef.assign(n_sources * 10, 0.);
+  this->tone_phase.assign(n_sources, 0.);
+  this->noise_rng.seed(this->seed_value << 16);
+
+  for (int s = 0 ; s < n_sources ; s++)
+  {
+    const SceneSource &src = this->sources[s];
+    this->source_rng[s].seed((this->seed_value << 16) + s + 1);
+    this->tone_phase[s] = 2. * M_PI * this->source_rng[s].uniform();
+
+    if (src.signal == SCENE_NOISE && src.cutoff < 1.)
+    {
+      // unit power after the filter, from the energy of its impulse response
+      double *coef = &this->lp_coef[s * 10];
+      butterworth4(src.cutoff, coef);
+      double state[4] = {0., 0., 0., 0.};
+      double energy = 0.;
+      for (int i = 0 ; i < 16384 ; i++)
+      {
+        double h = biquads(coef, state, i == 0 ? 1. : 0.);
+        energy += h * h;
+      }
+      this->noise_scale[s] = float(1. / sqrt(energy));
+    }
+
+    if (has_room && src.distance > 0.)
+    {
+      float p[3];
+      this->position_at(s, 0, p);
+      for (int v = 0 ; v < 3 ; v++)
+        if (this->room.array_pos[v] + p[v] <= 0. || this->room.array_pos[v] + p[v] >= this->room.size[v])
+        {
+          std::cerr << "Warning: source " << s << " of the scene starts outside of the room." << std::endl;
+          break;
+        }
+    }
+  }
+
+  // the images with at most `order` reflections, (-1)^q x + 2 n L on every axis
+  this->images.clear();
+  if (has_room)
+  {
+    int order = this->room.order;
+    for (int n0 = -order ; n0 <= order + 1 ; n0++)
+      for (int q0 = 0 ; q0 < 2 ; q0++)
+        for (int n1 = -order ; n1 <= order + 1 ; n1++)
+          for (int q1 = 0 ; q1 < 2 ; q1++)
+            for (int n2 = -order ; n2 <= order + 1 ; n2++)
+              for (int q2 = 0 ; q2 < 2 ; q2++)
+              {
+                int r = abs(2 * n0 - q0) + abs(2 * n1 - q1) + abs(2 * n2 - q2);
+                if (r == 0 || r > order)
+                  continue;
+                Image im = { { n0, n1, n2 }, { q0, q1, q2 }, r };
+                this->images.push_back(im);
+              }
+  }
+}
+
+void SceneGenerator::position_at(int s, uint64_t sample, float *p)
+{
+  float azimuth, elevation;
+  this->doa(s, sample, &azimuth, &elevation);
+
+  float r = this->sources[s].distance > 0. ? this->sources[s].distance : 1.;
+  p[0] = r * cosf(elevation) * cosf(azimuth);
+  p[1] = r * cosf(elevation) * sinf(azimuth);
+  p[2] = r * sinf(elevation);
+}
+
+void SceneGenerator::doa(int s, uint64_t sample, float *azimuth, float *elevation)
+{
+  const SceneSource &src = this->sources[s];
+  double a = src.azimuth + src.azimuth_speed * double(sample) / this->fs;
+  *azimuth = float(atan2(sin(a), cos(a)));
+  *elevation = src.elevation;
+}
+
+/* n samples of the dry signal of a source, unit power */
+void SceneGenerator::source_block(int s, float *dry, int n)
+{
+  const SceneSource &src = this->sources[s];
+  SceneRandom &rng = this->source_rng[s];
+
+  if (src.signal == SCENE_TONE)
+  {
+    double w = 2. * M_PI * src.frequency / this->fs;
+    for (int i = 0 ; i < n ; i++)
+      dry[i] = float(M_SQRT2 * sin(this->tone_phase[s] + w * double(this->position + i)));
+  }
+  else if (src.cutoff < 1.)
+  {
+    const double *coef = &this->lp_coef[s * 10];
+    double *state = &this->lp_state[s * 4];
+    float scale = this->noise_scale[s];
+    for (int i = 0 ; i < n ; i++)
+      dry[i] = scale * float(biquads(coef, state, rng.gaussian()));
+  }
+  else
+  {
+    for (int i = 0 ; i < n ; i++)
+      dry[i] = rng.gaussian();
+  }
+}
+
+/* out[i, mic] += g(i) * dry(i - d(i)) for n samples from offset in a block, d and g linear over the block */
+void SceneGenerator::add_path(const float *h, float *out, int mic, float d0, float d1, float g0, float g1,
+    int offset, int n)
+{
+  const int T = SCENE_FRAC_TAPS;
+  float dd = (d1 - d0) / SCENE_BLOCK;
+  float dg = (g1 - g0) / SCENE_BLOCK;
+
+  for (int i = 0 ; i < n ; i++)
+  {
+    float d = d0 + dd * (offset + i);
+    int D = int(d);
+    int p = int((d - D) * SCENE_FRAC_PHASES + 0.5f);
+
+    const float *w = this->frac + p * T;
+    const float *x = h + this->history_size + i - D - T / 2;
+
+    float acc = 0.;
+    for (int k = 0 ; k < T ; k++)
+      acc += w[k] * x[k];
+
+    out[i * this->channels + mic] += (g0 + dg * (offset + i)) * acc;
+  }
+}
+
+void SceneGenerator::generate(float *out, int n)
+{
+  memset(out, 0, sizeof(float) * n * this->channels);
+
+  float k = this->fs / this->c;
+  float beta = sqrtf(std::max(0.f, 1.f - this->room.absorption));
+  const float *a = this->room.array_pos;
+  const float *L = this->room.size;
+
+  float power = 0.;
+  for (size_t s = 0 ; s < this->sources.size() ; s++)
+    power += this->sources[s].gain * this->sources[s].gain;
+  float sigma = std::isfinite(this->snr_db) ? sqrtf(power / powf(10.f, this->snr_db / 10.f)) : 0.;
+
+  for (int done = 0 ; done < n ; )
+  {
+    // the blocks are aligned on the scene so that any size of read gives the same samples
+    int offset = int(this->position % SCENE_BLOCK);
+    int nb = std::min(SCENE_BLOCK - offset, n - done);
+    uint64_t start = this->position - offset;
+    float *o = out + done * this->channels;
+
+    for (int s = 0 ; s < int(this->sources.size()) ; s++)
+    {
+      const SceneSource &src = this->sources[s];
+      float *h = this->history[s];
+      this->source_block(s, h + this->history_size, nb);
+
+      float p[2][3];
+      this->position_at(s, start, p[0]);
+      this->position_at(s, start + SCENE_BLOCK, p[1]);
+
+      for (int m = 0 ; m < this->channels ; m++)
+      {
+        const float *mic = this->mics_loc + 3 * m;
+        float d[2], g[2];
+
+        // direct path
+        for (int e = 0 ; e < 2 ; e++)
+        {
+          if (src.distance <= 0.)
+          {
+            d[e] = this->latency - (mic[0] * p[e][0] + mic[1] * p[e][1] + mic[2] * p[e][2]) * k;
+            g[e] = src.gain;
+          }
+          else
+          {
+            float dx = p[e][0] - mic[0], dy = p[e][1] - mic[1], dz = p[e][2] - mic[2];
+            float r = std::max(1e-3f, sqrtf(dx * dx + dy * dy + dz * dz));
+            d[e] = this->latency + r * k;
+            g[e] = src.gain * src.distance / r;
+          }
+        }
+        this->add_path(h, o, m, d[0], d[1], g[0], g[1], offset, nb);
+
+        if (src.distance <= 0.)
+          continue;
+
+        // reflections, in the coordinates of the room
+        for (size_t i = 0 ; i < this->images.size() ; i++)
+        {
+          const Image &im = this->images[i];
+          float att = powf(beta, float(im.reflections));
+          for (int e = 0 ; e < 2 ; e++)
+          {
+            float r2 = 0.;
+            for (int v = 0 ; v < 3 ; v++)
+            {
+              float x = a[v] + p[e][v];
+              float img = (im.q[v] ? -x : x) + 2.f * im.n[v] * L[v];
+              float delta = img - (a[v] + mic[v]);
+              r2 += delta * delta;
+            }
+            float r = std::max(1e-3f, sqrtf(r2));
+            d[e] = this->latency + r * k;
+            g[e] = src.gain * src.distance * att / r;
+          }
+          this->add_path(h, o, m, d[0], d[1], g[0], g[1], offset, nb);
+        }
+      }
+
+      memmove(h, h + nb, sizeof(float) * this->history_size);
+    }
+
+    if (sigma > 0.)
+      for (int i = 0 ; i < nb * this->channels ; i++)
+        o[i] += sigma * this->noise_rng.gaussian();
+
+    this->position += nb;
+    done += nb;
+  }
+}
+
+const void *SceneGenerator::read(int n)
+{
+  if (n < 0 || (this->length > 0 && this->position + n > this->length))
+    return NULL;
+
+  if (n * this->channels > this->read_buffer_size)
+  {
+    free(this->read_buffer);
+    this->read_buffer_size = n * this->channels;
+    this->read_buffer = (float *)e3e_aligned_malloc(sizeof(float) * this->read_buffer_size);
+  }
+
+  this->generate(this->read_buffer, n);
+  return this->read_buffer;
+}
+
+uint64_t SceneGenerator::tell()
+{
+  return this->position;
+}
+
+bool SceneGenerator::seek(uint64_t sample)
+{
+  if (this->length > 0 && sample > this->length)
+    return false;
+
+  this->restart();
+
+  std::vector<float> skip(SCENE_BLOCK * this->channels);
+  while (this->position < sample)
+    this->generate(skip.data(), int(std::min<uint64_t>(SCENE_BLOCK, sample - this->position)));
+
+  return true;
+}
@@ -0,0 +1,205 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+/*
+ * Synthetic acoustic scenes at the microphones, generated in-process.
+ *
+ * The array geometry is read from the same CONFIG file as SRPPHAT. The
+ * sources are white or low-passed noise, or tones, and can turn around
+ * the array at a constant angular speed. A source is either in the far
+ * field (distance 0), where it reaches the microphones as a plane wave,
+ * or at a distance from the center of the array, where the delays and
+ * the levels follow the distance to every microphone. With a room, the
+ * sources at a distance also reach the microphones through the image
+ * sources of a shoebox room up to a given order of reflections (the far
+ * field sources have no reflections).
+ *
+ * Every path (source or image, microphone) is a fractional delay: a
+ * Kaiser windowed sinc of SCENE_FRAC_TAPS taps tabulated for
+ * SCENE_FRAC_PHASES fractions of a sample, flat within 0.05 dB up to 0.8
+ * times the Nyquist frequency. The delays and the gains of the
+ * moving sources are interpolated over blocks of SCENE_BLOCK samples.
+ * All the signals lag the sources by the constant `latency`.
+ *
+ * White noise is added to every microphone with the SNR given in dB with
+ * respect to the sum of the powers of the sources at the center of the
+ * array (direct path). The source signals and the microphone noise come
+ * from separate generators derived from the seed, so that the same seed
+ * gives the same samples, and adding a source or changing the SNR does not
+ * change the signals of the others.
+ *
+ * The generator is an AudioSource of float32 samples, it feeds an STFT,
+ * a ReplayMicArray or a benchmark without going through a file:
+ *
+ *   SceneGenerator scene("./CONFIG", 8, 16000);
+ *   SceneSource s;
+ *   s.azimuth = M_PI / 3;
+ *   s.azimuth_speed = 0.5;      // rad/s
+ *   scene.add_source(s);
+ *   scene.set_snr(20.);
+ *   scene.length = 60 * 16000;   // read ends after a minute, 0 for never
+ *   while (scene.read_to(stft))
+ *     ...
+ *   scene.doa(0, scene.tell(), &azimuth, &elevation);   // the ground truth
+ */
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+#include "recording.h"
+
+#define SCENE_FRAC_TAPS 16
+#define SCENE_FRAC_PHASES 256
+#define SCENE_KAISER_BETA 5.
+#define SCENE_BLOCK 128
+
+enum scene_signal
+{
+  SCENE_NOISE = 0,    // gaussian, low-passed at cutoff
+  SCENE_TONE          // sine at frequency
+};
+
+struct SceneSource
+{
+  float azimuth = 0.;         // rad, from the x axis as the SRPPHAT grid
+  float elevation = 0.;       // rad
+  float azimuth_speed = 0.;   // rad/s
+  float distance = 0.;        // m from the center of the array, 0 for the far field
+  float gain = 1.;            // rms at the center of the array
+
+  int signal = SCENE_NOISE;
+  float cutoff = 1.;          // of the noise, fraction of the Nyquist frequency, 1 for white
+  float frequency = 1000.;    // of the tone, Hz
+};
+
+struct SceneRoom
+{
+  float size[3] = {0., 0., 0.};       // m, no room if 0
+  float array_pos[3] = {0., 0., 0.};  // center of the array in the room
+  float absorption = 0.5;             // energy absorbed by the walls
+  int order = 1;                      // of the reflections
+};
+
+/* xorshift64* with Box-Muller pairs, the same sequence on every platform */
+class SceneRandom
+{
+  public:
+    SceneRandom(uint64_t seed = 0) { this->seed(seed); }
+
+    void seed(uint64_t s)
+    {
+      // splitmix64 of the seed, never 0
+      uint64_t z = s + 0x9e3779b97f4a7c15ull;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      this->state = (z ^ (z >> 31)) | 1;
+      this->has_spare = false;
+    }
+
+    inline uint64_t next()
+    {
+      this->state ^= this->state >> 12;
+      this->state ^= this->state << 25;
+      this->state ^= this->state >> 27;
+      return this->state * 0x2545f4914f6cdd1dull;
+    }
+
+    // in (0, 1)
+    inline double uniform()
+    {
+      return (double(this->next() >> 11) + 0.5) * (1. / 9007199254740992.);
+    }
+
+    inline float gaussian()
+    {
+      if (this->has_spare)
+      {
+        this->has_spare = false;
+        return this->spare;
+      }
+      double r = sqrt(-2. * log(this->uniform()));
+      double a = 2. * M_PI * this->uniform();
+      this->spare = float(r * sin(a));
+      this->has_spare = true;
+      return float(r * cos(a));
+    }
+
+  private:
+    uint64_t state;
+    float spare;
+    bool has_spare;
+};
+
+class SceneGenerator : public AudioSource
+{
+  public:
+    float c;
+    float *mics_loc;          // x, y, z per channel, from the config
+    std::vector<SceneSource> sources;
+    SceneRoom room;
+    float snr_db;             // INFINITY for no noise
+    uint64_t length;          // samples returned by read, 0 for no end
+    int latency;              // samples
+
+    SceneGenerator(const std::string &config_file, int channels, int fs = 16000, float c = 343., uint64_t seed = 0);
+    ~SceneGenerator();
+
+    // the scene starts over at sample 0 after each of these
+    int add_source(const SceneSource &source);
+    void set_room(const SceneRoom &room);
+    void set_snr(float snr_db);
+    void set_seed(uint64_t seed);
+
+    // n interleaved float32 samples per channel, valid until the next read,
+    // NULL past length
+    const void *read(int n);
+    uint64_t tell();
+
+    // generates the scene again from the start up to the sample
+    bool seek(uint64_t sample);
+
+    // n interleaved samples per channel into out
+    void generate(float *out, int n);
+
+    // the direction of a source at a sample, the ground truth of the DOA
+    void doa(int source, uint64_t sample, float *azimuth, float *elevation);
+
+  private:
+    uint64_t seed_value;
+    uint64_t position;
+
+    // fractional delay filters, SCENE_FRAC_PHASES + 1 rows of SCENE_FRAC_TAPS
+    float *frac;
+
+    // per source: dry signal history of history_size samples then the block
+    int history_size;
+    std::vector<float *> history;
+    std::vector<SceneRandom> source_rng;
+    std::vector<float> noise_scale;
+    std::vector<double> lp_state;   // 2 biquads x 2 states per source
+    std::vector<double> lp_coef;    // 2 biquads x 5 coefficients per source
+    std::vector<double> tone_phase;
+    SceneRandom noise_rng;
+
+    // images of the room: per axis n and q (the image is (-1)^q x + 2 n L) and the reflections
+    struct Image
+    {
+      int n[3];
+      int q[3];
+      int reflections;
+    };
+    std::vector<Image> images;
+
+    float *read_buffer;
+    int read_buffer_size;
+
+    void restart();
+    void source_block(int s, float *dry, int n);
+    void add_path(const float *dry, float *out, int mic, float d0, float d1, float g0, float g1, int offset, int n);
+    void position_at(int s, uint64_t sample, float *p);
+};
+
+#endif // __SCENE_H__
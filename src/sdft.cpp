@@ -0,0 +1,123 @@
+
+#include <iostream>
+#include <cmath>
+
+#include "sdft.h"
+
+SlidingDFT::SlidingDFT(STFT *_stft, int _k_min, int _k_len, int _decimation, float _damping)
+  : stft(_stft), k_min(_k_min), k_len(_k_len), decimation(_decimation), damping(_damping)
+{
+  this->fft_size = _stft->fft_size;
+  this->channels = _stft->channels;
+
+  this->valid = _k_min >= 0 && _k_min + _k_len <= _stft->n_bins;
+  if (!this->valid)
+  {
+    std::cerr << "Error: the band of the sliding DFT exceeds the spectrum." << std::endl;
+    this->history = this->state_re = this->state_im = this->rot_re = this->rot_im = NULL;
+    return;
+  }
+
+  this->history = new float[this->fft_size * this->channels];
+  this->state_re = new float[_k_len * this->channels];
+  this->state_im = new float[_k_len * this->channels];
+
+  // the rotations are stored per channel too so that the loop vectorizes
+  this->rot_re = new float[_k_len * this->channels];
+  this->rot_im = new float[_k_len * this->channels];
+
+  for (int k = 0 ; k < _k_len ; k++)
+  {
+    double omega = 2. * M_PI * double(_k_min + k) / double(this->fft_size);
+    for (int ch = 0 ; ch < this->channels ; ch++)
+    {
+      this->rot_re[k * this->channels + ch] = _damping * cos(omega);
+      this->rot_im[k * this->channels + ch] = _damping * sin(omega);
+    }
+  }
+  this->damping_N = pow(double(_damping), double(this->fft_size));
+
+  this->reset();
+}
+
+SlidingDFT::~SlidingDFT()
+{
+  delete[] this->history;
+  delete[] this->state_re;
+  delete[] this->state_im;
+  delete[] this->rot_re;
+  delete[] this->rot_im;
+}
+
+void SlidingDFT::reset()
+{
+  if (!this->valid)
+    return;
+
+  for (int i = 0 ; i < this->fft_size * this->channels ; i++)
+    this->history[i] = 0.;
+
+  for (int i = 0 ; i < this->k_len * this->channels ; i++)
+    this->state_re[i] = this->state_im[i] = 0.;
+
+  this->history_pos = 0;
+  this->count = 0;
+}
+
+int SlidingDFT::process(const float *x, int n_samples)
+{
+  if (!this->valid)
+    return 0;
+
+  int C = this->channels;
+  int n_out = 0;
+
+  for (int n = 0 ; n < n_samples ; n++)
+  {
+    const float *x_new = x + n * C;
+    float *x_old = this->history + this->history_pos * C;
+
+    // update all the bins of all the channels
+    for (int k = 0 ; k < this->k_len ; k++)
+    {
+      float *sr = this->state_re + k * C;
+      float *si = this->state_im + k * C;
+      const float *wr = this->rot_re + k * C;
+      const float *wi = this->rot_im + k * C;
+
+      for (int ch = 0 ; ch < C ; ch++)
+      {
+        float ar = sr[ch] + x_new[ch] - this->damping_N * x_old[ch];
+        float ai = si[ch];
+        sr[ch] = wr[ch] * ar - wi[ch] * ai;
+        si[ch] = wr[ch] * ai + wi[ch] * ar;
+      }
+    }
+
+    // the newest sample replaces the oldest
+    for (int ch = 0 ; ch < C ; ch++)
+      x_old[ch] = x_new[ch];
+
+    this->history_pos++;
+    if (this->history_pos == this->fft_size)
+      this->history_pos = 0;
+
+    // output a frame
+    this->count++;
+    if (this->count == this->decimation)
+    {
+      e3e_complex *X = this->stft->get_out_buffer();
+
+      for (int k = 0 ; k < this->k_len ; k++)
+        for (int ch = 0 ; ch < C ; ch++)
+          X[this->stft->fd_index(this->k_min + k, ch)] =
+            e3e_complex(this->state_re[k * C + ch], this->state_im[k * C + ch]);
+
+      this->stft->advance();
+      this->count = 0;
+      n_out++;
+    }
+  }
+
+  return n_out;
+}
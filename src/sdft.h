@@ -0,0 +1,69 @@
+#ifndef __SDFT_H__
+#define __SDFT_H__
+
+/*
+ * Sliding DFT front-end.
+ *
+ * Maintains the DFT over the last fft_size samples of only the bins
+ * k_min, ..., k_min + k_len - 1 of all channels, updated at every sample
+ * with the damped recursion of Jacobsen and Lyons
+ *
+ *   S_k[n] = r e^{2i pi k / N} (S_k[n-1] + x[n] - r^N x[n-N])
+ *
+ * The damping factor r < 1 keeps the accumulated rounding errors from
+ * growing (with r = 1 the output is exactly the FFT of the last N samples).
+ *
+ * Every `decimation` samples, the tracked bins are written in the current
+ * output frame of an STFT object, which is then advanced. The consumers
+ * of the STFT (e.g. SRPPHAT) thus work unchanged, with a frame rate of
+ * fs / decimation instead of fs / fft_size. The other bins are left to zero.
+ *
+ * The cost per sample is O(k_len * channels), versus O(fft_size log fft_size
+ * * channels) per block for the FFT, so that narrow bands and frequent
+ * updates are cheaper.
+ */
+
+#include "e3e_detection.h"
+#include "stft.h"
+
+#define SDFT_DEFAULT_DAMPING 0.99999
+
+class SlidingDFT
+{
+  public:
+    STFT *stft;
+
+    int fft_size;
+    int channels;
+    int k_min;
+    int k_len;
+    int decimation;
+    float damping;
+
+    // past input samples, fft_size x channels
+    float *history;
+    int history_pos;
+
+    // state of the bins, k_len x channels, split real/imaginary
+    float *state_re;
+    float *state_im;
+
+    // r e^{2i pi k / N} for every tracked bin and r^N
+    float *rot_re;
+    float *rot_im;
+    float damping_N;
+
+    int count;  // samples since the last frame
+
+    bool valid;  // false when the band is not in the spectrum, nothing is output
+
+    SlidingDFT(STFT *stft, int k_min, int k_len, int decimation, float damping = SDFT_DEFAULT_DAMPING);
+    ~SlidingDFT();
+
+    // interleaved samples, returns the number of frames output to the STFT
+    int process(const float *x, int n_samples);
+
+    void reset();
+};
+
+#endif // __SDFT_H__
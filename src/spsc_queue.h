@@ -0,0 +1,86 @@
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+/*
+ * Bounded lock-free queue for one producer thread and one consumer thread.
+ * The elements are copied in and out, so T should be small (e.g. a frame
+ * descriptor), the bulk data stays in the STFT and feature buffers.
+ */
+
+#include <atomic>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+
+template<typename T>
+class SPSCQueue
+{
+  public:
+    int capacity;
+    T *items;
+
+    std::atomic<uint64_t> head;
+    char pad_head[E3E_CACHE_LINE];
+    std::atomic<uint64_t> tail;
+    char pad_tail[E3E_CACHE_LINE];
+
+    SPSCQueue(int _capacity) : capacity(_capacity)
+    {
+      this->items = new T[_capacity];
+      this->head = 0;
+      this->tail = 0;
+    }
+
+    ~SPSCQueue()
+    {
+      delete[] this->items;
+    }
+
+    // producer side, returns false when the queue is full
+    bool push(const T &item)
+    {
+      uint64_t h = this->head.load(std::memory_order_relaxed);
+      if (h - this->tail.load(std::memory_order_acquire) >= (uint64_t)this->capacity)
+        return false;
+
+      this->items[h % this->capacity] = item;
+      this->head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    // consumer side, returns false when the queue is empty
+    bool pop(T &item)
+    {
+      uint64_t t = this->tail.load(std::memory_order_relaxed);
+      if (t == this->head.load(std::memory_order_acquire))
+        return false;
+
+      item = this->items[t % this->capacity];
+      this->tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    // pop up to max_items at once, returns the number of items
+    int pop_many(T *out, int max_items)
+    {
+      uint64_t t = this->tail.load(std::memory_order_relaxed);
+      uint64_t h = this->head.load(std::memory_order_acquire);
+
+      int n = 0;
+      while (t + n < h && n < max_items)
+      {
+        out[n] = this->items[(t + n) % this->capacity];
+        n++;
+      }
+
+      this->tail.store(t + n, std::memory_order_release);
+      return n;
+    }
+
+    int size()
+    {
+      return int(this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire));
+    }
+};
+
+#endif // __SPSC_QUEUE_H__
@@ -1,5 +1,8 @@
 
+#include <algorithm>
+
 #include "srpphat.h"
+#include "instrument.h"
 
 void sample_sp_rand_points(float ** coordinates, int N_samples){
   srand (time(NULL));
@@ -171,13 +174,23 @@ void sample_sp_even_points_2p5D(float ** coordinates, float **grid_cart, int N_s
   this->spatial_spectrum = new float[n_grid];
 
   // allocatee the twiddle look-up factors
+  this->lut_layout = SRP_LUT_BIN_MAJOR;
+  this->twiddle_lut = NULL;
+  this->steering = NULL;
   this->build_lut();
 
+  // stands for the frames before the start of the stream
+  this->zero_frame = new e3e_complex[stft->n_samples_per_out_frame];
+  for (int i = 0 ; i < stft->n_samples_per_out_frame ; i++)
+    this->zero_frame[i] = 0.;
+
   // allocate G matrix
   this->G = new e3e_complex[k_len * this->n_pairs];
   for (int i = 0 ; i < k_len * this->n_pairs ; i++)
     this->G[i] = 0.;
+  this->G_phat = new e3e_complex[k_len * this->n_pairs];
 
+  this->set_search_quality(1, 1, 1);
 }
 
 SRPPHAT::~SRPPHAT()
@@ -195,51 +208,157 @@ SRPPHAT::~SRPPHAT()
   delete this->mics_loc;
 
   delete this->G;
+  delete[] this->G_phat;
+  delete[] this->zero_frame;
 
-  delete this->twiddle_lut;
+  delete[] this->twiddle_lut;
+  delete[] this->steering;
 }
 
 int SRPPHAT::process()
 {
-  // Update G
-  for (int k = 0 ; k < k_len ; k++)
+  this->update(this->stft->frame_count - 1);
+  return this->search();
+}
+
+/*
+ * Update G with the frame number `frame` of the STFT (see STFT::get_fd_frame_at)
+ * and remove the frame that leaves the window of n_frames
+ */
+void SRPPHAT::update(long frame)
+{
+  if (frame < 0)
+    return;
+
+  E3E_PROBE(INSTR_SRP_UPDATE);
+
+  // the frames before the first one are zero
+  e3e_complex *X_new = this->stft->get_fd_frame_at(frame);
+  e3e_complex *X_old = this->zero_frame;
+  if (frame - this->n_frames >= 0)
+    X_old = this->stft->get_fd_frame_at(frame - this->n_frames);
+
+  // the kernel depends on the layout of the spectra
+  if (this->stft->layout == STFT_LAYOUT_PLANAR)
+  {
+    // the band of every channel is contiguous
+    int cs = this->stft->channel_stride;
+
     for (int p = 0 ; p < this->n_pairs ; p++)
     {
-      int i = this->pairs[p*2];
-      int j = this->pairs[p*2 + 1];
+      e3e_complex *xi_old = X_old + this->pairs[p*2] * cs + this->k_min;
+      e3e_complex *xj_old = X_old + this->pairs[p*2 + 1] * cs + this->k_min;
+      e3e_complex *xi_new = X_new + this->pairs[p*2] * cs + this->k_min;
+      e3e_complex *xj_new = X_new + this->pairs[p*2 + 1] * cs + this->k_min;
 
-      // remove oldest frame
-      e3e_complex xi = this->stft->get_fd_sample(this->n_frames, k + this->k_min, i);
-      e3e_complex xj = this->stft->get_fd_sample(this->n_frames, k + this->k_min, j);
-
-      this->G[k*this->n_pairs + p] -= xi * std::conj(xj);
+      for (int k = 0 ; k < k_len ; k++)
+      {
+        // remove oldest frame, add newest frame
+        this->G[k*this->n_pairs + p] += xi_new[k] * std::conj(xj_new[k]) - xi_old[k] * std::conj(xj_old[k]);
+      }
+    }
+  }
+  else
+  {
+    // all the channels of one bin are contiguous
+    for (int k = 0 ; k < k_len ; k++)
+    {
+      e3e_complex *x_old = X_old + (k + this->k_min) * this->channels;
+      e3e_complex *x_new = X_new + (k + this->k_min) * this->channels;
 
-      // add newest frame
-      xi = this->stft->get_fd_sample(0, k + this->k_min, i);
-      xj = this->stft->get_fd_sample(0, k + this->k_min, j);
+      for (int p = 0 ; p < this->n_pairs ; p++)
+      {
+        int i = this->pairs[p*2];
+        int j = this->pairs[p*2 + 1];
 
-      this->G[k*this->n_pairs + p] += xi * std::conj(xj);
+        // remove oldest frame, add newest frame
+        this->G[k*this->n_pairs + p] += x_new[i] * std::conj(x_new[j]) - x_old[i] * std::conj(x_old[j]);
+      }
     }
+  }
+}
+
+void SRPPHAT::reset()
+{
+  for (int i = 0 ; i < this->k_len * this->n_pairs ; i++)
+    this->G[i] = 0.;
+}
+
+/* Compute the cost function for all grid points from the current G */
+int SRPPHAT::search()
+{
+  E3E_PROBE(INSTR_SRP_SEARCH);
 
-  // Compute the cost function for all grid points
   this->argmax = 0;
   float max = 0.;
 
+  // the PHAT weights once per search rather than once per grid point
+  if (this->lut_layout != SRP_LUT_BIN_MAJOR)
+  {
+    for (int p = 0 ; p < this->n_pairs ; p += this->pair_step)
+      for (int k = 0 ; k < this->k_len ; k += this->k_step)
+      {
+        e3e_complex Gval = this->G[k*this->n_pairs + p];
+        float Gabs = std::abs(Gval);
+        this->G_phat[p * this->k_len + k] = Gabs > 1e-5 ? Gval / Gabs : e3e_complex(0., 0.);
+      }
+  }
+
   for (int n = 0 ; n < this->n_grid ; n++)
   {
+    if (n % this->grid_step != 0)
+    {
+      this->spatial_spectrum[n] = this->spatial_spectrum[n - 1];
+      continue;
+    }
+
     e3e_complex tmp(0,0);
 
-    for (int p = 0 ; p < this->n_pairs ; p++)
+    if (this->lut_layout == SRP_LUT_BIN_MAJOR)
     {
-      for (int k = 0 ; k < this->k_len ; k++)
+      for (int p = 0 ; p < this->n_pairs ; p += this->pair_step)
       {
-        int tw_ind = n + p*this->n_grid + k*this->n_grid*this->n_pairs;
-        int g_ind = k*this->n_pairs + p;
+        for (int k = 0 ; k < this->k_len ; k += this->k_step)
+        {
+          int tw_ind = n + p*this->n_grid + k*this->n_grid*this->n_pairs;
+          int g_ind = k*this->n_pairs + p;
+
+          e3e_complex Gval = this->G[g_ind];
+          float Gabs = std::abs(Gval);
+          if (Gabs > 1e-5)
+            tmp += Gval / Gabs * this->twiddle_lut[tw_ind];
+        }
+      }
+    }
+    else if (this->lut_layout == SRP_LUT_GRID_MAJOR)
+    {
+      for (int p = 0 ; p < this->n_pairs ; p += this->pair_step)
+      {
+        const e3e_complex *g = this->G_phat + p * this->k_len;
+        const e3e_complex *w = this->twiddle_lut + (n * this->n_pairs + p) * this->k_len;
 
-        e3e_complex Gval = this->G[g_ind];
-        float Gabs = std::abs(Gval);
-        if (Gabs > 1e-5)
-          tmp += Gval / Gabs * this->twiddle_lut[tw_ind];
+        for (int k = 0 ; k < this->k_len ; k += this->k_step)
+          tmp += g[k] * w[k];
+      }
+    }
+    else
+    {
+      for (int p = 0 ; p < this->n_pairs ; p += this->pair_step)
+      {
+        const e3e_complex *g = this->G_phat + p * this->k_len;
+        const e3e_complex *s = this->steering + 2 * (n * this->n_pairs + p);
+
+        // from one searched bin to the next the steering vector turns by s[1]^k_step
+        e3e_complex w = s[0];
+        e3e_complex dw = s[1];
+        for (int i = 1 ; i < this->k_step ; i++)
+          dw *= s[1];
+
+        for (int k = 0 ; k < this->k_len ; k += this->k_step)
+        {
+          tmp += g[k] * w;
+          w *= dw;
+        }
       }
     }
 
@@ -255,42 +374,99 @@ int SRPPHAT::process()
   return this->argmax;
 }
 
+void SRPPHAT::set_search_quality(int _k_step, int _pair_step, int _grid_step)
+{
+  this->k_step = std::max(1, std::min(_k_step, this->k_len));
+  this->pair_step = std::max(1, std::min(_pair_step, this->n_pairs));
+  this->grid_step = std::max(1, std::min(_grid_step, this->n_grid));
+}
+
 void SRPPHAT::build_lut()
 {
-  this->twiddle_lut = new e3e_complex[k_len*this->n_pairs*this->n_grid];
+  delete[] this->twiddle_lut;
+  delete[] this->steering;
+  this->twiddle_lut = NULL;
+  this->steering = NULL;
+
+  if (this->lut_layout == SRP_LUT_FREE)
+    this->steering = new e3e_complex[2*this->n_pairs*this->n_grid];
+  else
+    this->twiddle_lut = new e3e_complex[k_len*this->n_pairs*this->n_grid];
+
   e3e_complex imag(0,1);
   float pi = M_PI;
 
-  for (int k = 0 ; k < k_len ; k++)
-    for (int p = 0 ; p < this->n_pairs ; p++)
-      for (int n = 0 ; n < n_grid ; n++)
+  for (int p = 0 ; p < this->n_pairs ; p++)
+    for (int n = 0 ; n < n_grid ; n++)
+    {
+      int i = this->pairs[2*p];
+      int j = this->pairs[2*p + 1];
+
+      float ip = 0.;
+      for (int v = 0 ; v < 3 ; v++)
+      { 
+        float delta = this->mics_loc[j*3+v] - this->mics_loc[i*3+v];
+        ip += delta * this->grid_cart[n][v];
+      }
+
+      if (this->lut_layout == SRP_LUT_FREE)
       {
-        int i = this->pairs[2*p];
-        int j = this->pairs[2*p + 1];
-
-        float ip = 0.;
-        for (int v = 0 ; v < 3 ; v++)
-        { 
-          float delta = this->mics_loc[j*3+v] - this->mics_loc[i*3+v];
-          ip += delta * this->grid_cart[n][v];
-        }
+        // the phase of bin k_min and its increment from bin to bin
+        float step = 2 * pi * this->fs / float(this->fft_size) * ip / this->c;
+        this->steering[2 * (n * this->n_pairs + p)] = std::exp(imag * (step * this->k_min));
+        this->steering[2 * (n * this->n_pairs + p) + 1] = std::exp(imag * step);
+        continue;
+      }
 
+      for (int k = 0 ; k < k_len ; k++)
+      {
         float freq = float(this->k_min + k) / float(this->fft_size) * this->fs;
         float exponent = 2 * pi * freq * ip / this->c;
 
-        int ind = n + p*this->n_grid + k*this->n_grid*this->n_pairs;
+        int ind;
+        if (this->lut_layout == SRP_LUT_GRID_MAJOR)
+          ind = (n * this->n_pairs + p) * this->k_len + k;
+        else
+          ind = n + p*this->n_grid + k*this->n_grid*this->n_pairs;
         this->twiddle_lut[ind] = std::exp(imag * exponent);
       }
+    }
+
+}
 
+e3e_complex SRPPHAT::steering_factor(int n, int p, int k) const
+{
+  if (this->lut_layout == SRP_LUT_GRID_MAJOR)
+    return this->twiddle_lut[(n * this->n_pairs + p) * this->k_len + k];
+  if (this->lut_layout == SRP_LUT_BIN_MAJOR)
+    return this->twiddle_lut[n + p*this->n_grid + k*this->n_grid*this->n_pairs];
+
+  const e3e_complex *s = this->steering + 2 * (n * this->n_pairs + p);
+  return s[0] * std::polar(1.f, k * std::arg(s[1]));
+}
+
+void SRPPHAT::set_lut_layout(int layout)
+{
+  if (layout == this->lut_layout)
+    return;
+
+  this->lut_layout = layout;
+  this->build_lut();
 }
 
 void SRPPHAT::read_mic_locs()
 {
-  std::ifstream fin (this->config_name);
+  if (!::read_mic_locs(this->config_name, this->mics_loc, this->channels))
+    exit(1);
+}
+
+bool read_mic_locs(const std::string &config_file, float *mics_loc, int channels)
+{
+  std::ifstream fin (config_file);
 
   if(!fin){
-    std::cerr << "Failure to open" << std::endl;
-    exit(1);
+    std::cerr << "Failure to open " << config_file << std::endl;
+    return false;
   }  
 
   int ch;
@@ -305,14 +481,18 @@ void SRPPHAT::read_mic_locs()
 
     fin >> x >> y >> z;
 
-    if (ch < 0 || ch >= this->channels)
+    if (ch < 0 || ch >= channels)
+    {
       std::cout << "Error: channel number too large!!!" << std::endl;
+      continue;
+    }
 
-    this->mics_loc[ch*3] = x;
-    this->mics_loc[ch*3 + 1] = y;
-    this->mics_loc[ch*3 + 2] = z;
+    mics_loc[ch*3] = x;
+    mics_loc[ch*3 + 1] = y;
+    mics_loc[ch*3 + 2] = z;
   }
 
   fin.close(); //close the input file
 
+  return true;
 }
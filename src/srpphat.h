@@ -18,6 +18,27 @@
 #include "e3e_detection.h"
 #include "stft.h"
 
+/*
+ * Layout of the steering vectors of the search
+ *
+ *  SRP_LUT_BIN_MAJOR: twiddle_lut[(k * n_pairs + p) * n_grid + n], the
+ *    grid points of one bin and pair are contiguous
+ *  SRP_LUT_GRID_MAJOR: twiddle_lut[(n * n_pairs + p) * k_len + k], the
+ *    bins of one grid point and pair are contiguous, the search reads
+ *    the table in order
+ *  SRP_LUT_FREE: no table, the steering vector of a grid point and pair
+ *    is a rotation from bin to bin, 2 values per grid point and pair
+ *
+ * They give the same spectrum (to the rounding), which one is the fastest
+ * depends on the cache of the CPU, see tests/bench_pipeline select.
+ */
+enum srp_lut_layout
+{
+  SRP_LUT_BIN_MAJOR = 0,
+  SRP_LUT_GRID_MAJOR,
+  SRP_LUT_FREE
+};
+
 class SRPPHAT
 {
   public:
@@ -25,11 +46,15 @@ class SRPPHAT
     float ** grid;
     float ** grid_cart;
     float * spatial_spectrum;
-    e3e_complex *twiddle_lut;
+    e3e_complex *twiddle_lut;  // NULL with SRP_LUT_FREE
+    e3e_complex *steering;     // SRP_LUT_FREE: first bin and rotation per grid point and pair
+    e3e_complex *G_phat;       // G / |G| pair by pair, for the layouts other than SRP_LUT_BIN_MAJOR
+    int lut_layout;
     int n_pairs;
     int *pairs;
 
     e3e_complex *G;
+    e3e_complex *zero_frame;
     STFT * stft;
 
     std::string config_name;
@@ -48,16 +73,43 @@ class SRPPHAT
     float theta;
     int argmax;
 
+    // the search only uses every k_step-th bin and pair_step-th pair and
+    // evaluates every grid_step-th grid point, the skipped points take the
+    // value of the previous one. G is always updated with all bins and pairs
+    // so that the full quality is available again at once
+    int k_step;
+    int pair_step;
+    int grid_step;
+    void set_search_quality(int k_step, int pair_step, int grid_step);
+
     void read_mic_locs();
     void build_lut();
+
+    // rebuilds the steering vectors in another layout (srp_lut_layout)
+    void set_lut_layout(int layout);
+
+    // the steering factor of grid point n, pair p and bin k_min + k, in any layout
+    e3e_complex steering_factor(int n, int p, int k) const;
    
+    // update G with the latest frame and search the grid
     int process();
+
+    // the two phases of process, G can be updated for several
+    // frames before searching the grid
+    void update(long frame);
+    int search();
+
+    // zero G, with STFT::reset to start another stream
+    void reset();
      
     SRPPHAT(STFT * stft, std::string config, int k_min, int k_len, int n_grid, int n_frames, float fs, float c, int dim);
     ~SRPPHAT();
 
 };
 
+// the microphone locations (x, y, z per channel) from a CONFIG file, shared with the scene generator
+bool read_mic_locs(const std::string &config_file, float *mics_loc, int channels);
+
 void sample_sp_randpoints(float ** coordinates, int N_samples);
 void sample_sp_even_points_2D(float ** spherical, float **cartesian, int N_samples);
 void sample_sp_even_points_3D(float ** spherical, float **cartesian, int N_samples);
@@ -1,42 +1,57 @@
 
 #include <iostream>
 #include "stft.h"
+#include "instrument.h"
 
-/* Allocate all the buffers and create the FFTW plans */
-STFT::STFT(int _fft_size, int _n_frames, int _channels)
-: fft_size(_fft_size), n_frames(_n_frames), channels(_channels)
+/* Allocate all the buffers and create the transform */
+STFT::STFT(int _fft_size, int _n_frames, int _channels, int _backend, int _layout)
+: fft_size(_fft_size), n_frames(_n_frames), channels(_channels), backend(_backend), layout(_layout)
 {
-  int dims[] = { _fft_size };
-
   // the size of the input buffer
   this->n_samples_per_in_frame = _channels * _fft_size;
   this->circ_in_buffer_size = _n_frames * this->n_samples_per_in_frame;
 
+  // the layout of the spectra
+  this->n_bins = _fft_size / 2 + 1;
+  if (_layout == STFT_LAYOUT_PLANAR)
+  {
+    // pad every channel to a multiple of the cache line
+    int per_line = E3E_CACHE_LINE / sizeof(e3e_complex);
+    this->bin_stride = 1;
+    this->channel_stride = ((this->n_bins + per_line - 1) / per_line) * per_line;
+  }
+  else
+  {
+    this->bin_stride = _channels;
+    this->channel_stride = 1;
+  }
+
   // the size of the big circular buffer
-  this->n_samples_per_out_frame = _channels * (_fft_size / 2 + 1);
+  this->n_samples_per_out_frame = _channels * this->n_bins;
+  if (_layout == STFT_LAYOUT_PLANAR)
+    this->n_samples_per_out_frame = _channels * this->channel_stride;
   this->circ_out_buffer_size = _n_frames * this->n_samples_per_out_frame;
 
   // allocate the buffers
-  this->circ_in_buffer = new float[this->circ_in_buffer_size];
-  this->circ_out_buffer = new e3e_complex[this->circ_out_buffer_size];
+  this->circ_in_buffer = (float *)e3e_aligned_malloc(sizeof(float) * this->circ_in_buffer_size);
+  this->circ_out_buffer = (e3e_complex *)e3e_aligned_malloc(sizeof(e3e_complex) * this->circ_out_buffer_size);
 
-  // Allocate space for the plans
-  this->plans = new fftwf_plan[_n_frames];
+  // the same transform is used for all the frames
+  this->fft = make_real_fft(_backend, _fft_size, _channels, this->bin_stride, this->channel_stride);
 
-  for (int i = 0 ; i < _n_frames ; i++)
-  {
-    float *in_buffer = this->circ_in_buffer + i * this->n_samples_per_in_frame;
-    fftwf_complex *out_buffer = 
-      reinterpret_cast<fftwf_complex *>(this->circ_out_buffer + i * this->n_samples_per_out_frame);
-
-    this->plans[i] = fftwf_plan_many_dft_r2c(
-        1, dims, _channels,
-        in_buffer, NULL,
-        _channels, 1,
-        out_buffer, NULL,
-        _channels, 1,
-        FFTW_ESTIMATE);
-  }
+  // ingest defaults: no scaling, rectangular window, no preprocessing
+  this->window = NULL;
+  this->ingest_scale = 1.;
+  this->ingest_gain = new float[_fft_size];
+  for (int n = 0 ; n < _fft_size ; n++)
+    this->ingest_gain[n] = 1.;
+
+  this->preprocessing = PREPROC_NONE;
+  this->preproc_coef = 0.;
+  this->preproc_x = new float[_channels];
+  this->preproc_y = new float[_channels];
+  for (int ch = 0 ; ch < _channels ; ch++)
+    this->preproc_x[ch] = this->preproc_y[ch] = 0.;
 
   for (int i = 0 ; i < this->circ_in_buffer_size ; i++)
     this->circ_in_buffer[i] = 0;
@@ -49,9 +64,30 @@ STFT::STFT(int _fft_size, int _n_frames, int _channels)
 /* Here we just delete the dynamically allocated arrays */
 STFT::~STFT()
 {
-  delete this->circ_in_buffer; 
-  delete this->circ_out_buffer;
-  delete this->plans;
+  free(this->circ_in_buffer);
+  free(this->circ_out_buffer);
+  delete this->fft;
+
+  delete[] this->window;
+  delete[] this->ingest_gain;
+  delete[] this->preproc_x;
+  delete[] this->preproc_y;
+}
+
+/* forget the past frames, e.g. to process another part of a recording */
+void STFT::reset()
+{
+  this->frame_count = 0;
+  this->current_frame = 0;
+
+  for (int ch = 0 ; ch < this->channels ; ch++)
+    this->preproc_x[ch] = this->preproc_y[ch] = 0.;
+
+  for (int i = 0 ; i < this->circ_in_buffer_size ; i++)
+    this->circ_in_buffer[i] = 0;
+
+  for (int i = 0 ; i < this->circ_out_buffer_size ; i++)
+    this->circ_out_buffer[i] = 0;
 }
 
 /* return a pointer to the current input buffer */
@@ -72,13 +108,31 @@ e3e_complex *STFT::get_out_buffer()
 /* transform the current frame and returns a pointer to it, then move to the next frame */
 e3e_complex *STFT::transform(void)
 {
+  E3E_PROBE(INSTR_STFT);
+
   // This is a pointer to the chunk of data we will transform
   e3e_complex *ret_buf = this->circ_out_buffer 
-                                + this->current_frame * this->circ_out_buffer_size;
+                                + this->current_frame * this->n_samples_per_out_frame;
+  float *in_buf = this->circ_in_buffer + this->current_frame * this->n_samples_per_in_frame;
   
-  fftwf_execute(this->plans[this->current_frame]);
+  this->fft->forward(in_buf, ret_buf);
+
+  this->advance();
+
+  return ret_buf;
+}
+
+/*
+ * Move to the next frame, this is used by front-ends that fill
+ * the output buffer themselves (e.g. SlidingDFT)
+ */
+e3e_complex *STFT::advance(void)
+{
+  e3e_complex *ret_buf = this->circ_out_buffer 
+                                + this->current_frame * this->n_samples_per_out_frame;
 
   // increment frame counter and loop if necessary
+  this->frame_count += 1;
   this->current_frame += 1;
   if (this->current_frame == this->n_frames)
     this->current_frame = 0;
@@ -86,12 +140,23 @@ e3e_complex *STFT::transform(void)
   return ret_buf;
 }
 
+/* return a pointer to a past frame of the output buffer, 0 is the most recent */
+e3e_complex *STFT::get_fd_frame(int frame)
+{
+  int circular_index = (this->n_frames + this->current_frame - 1 - frame) % this->n_frames;
+  return this->circ_out_buffer + circular_index * this->n_samples_per_out_frame;
+}
+
+/* return a pointer to the frame number f since the start */
+e3e_complex *STFT::get_fd_frame_at(long f)
+{
+  return this->circ_out_buffer + (f % this->n_frames) * this->n_samples_per_out_frame;
+}
+
 /* return a specific sample from the output buffer */
 e3e_complex STFT::get_fd_sample(int frame, int frequency, int channel)
 {
-  int circular_index = (this->n_frames + this->current_frame - 1 - frame) % this->n_frames;
-  int i = circular_index * this->n_samples_per_out_frame + frequency * this->channels + channel;
-  return this->circ_out_buffer[i];
+  return this->get_fd_frame(frame)[this->fd_index(frequency, channel)];
 }
 
 float STFT::get_td_sample(int frame, int index, int channel)
@@ -101,3 +166,158 @@ float STFT::get_td_sample(int frame, int index, int channel)
   return this->circ_in_buffer[i];
 }
 
+
+/*
+ * The ingest kernel. It is specialized on the sample type, the preprocessing,
+ * the PCM layout and the presence of a remap table so that no test is left
+ * in the loop over the channels, which the compiler can then vectorize.
+ */
+template<typename T, int MODE, bool PLANAR, bool REMAP>
+static void ingest_kernel(STFT *stft, const T *pcm, const int *remap, int pcm_channels, float *out)
+{
+  int channels = stft->channels;
+  int fft_size = stft->fft_size;
+  float coef = stft->preproc_coef;
+  float *xs = stft->preproc_x;
+  float *ys = stft->preproc_y;
+
+  for (int n = 0 ; n < fft_size ; n++)
+  {
+    float g = stft->ingest_gain[n];
+    float *y = out + n * channels;
+
+    for (int ch = 0 ; ch < channels ; ch++)
+    {
+      int src = REMAP ? remap[ch] : ch;
+      float x = PLANAR ? float(pcm[src * fft_size + n]) : float(pcm[n * pcm_channels + src]);
+      float v = x;
+
+      if (MODE == PREPROC_DC_REMOVAL)
+      {
+        v = x - xs[ch] + coef * ys[ch];
+        xs[ch] = x;
+        ys[ch] = v;
+      }
+      else if (MODE == PREPROC_PRE_EMPHASIS)
+      {
+        v = x - coef * xs[ch];
+        xs[ch] = x;
+      }
+
+      y[ch] = g * v;
+    }
+  }
+}
+
+template<typename T, int MODE>
+static void ingest_dispatch_layout(STFT *stft, const T *pcm, int layout, const int *remap, int pcm_channels, float *out)
+{
+  if (layout == PCM_PLANAR)
+  {
+    if (remap != NULL)
+      ingest_kernel<T, MODE, true, true>(stft, pcm, remap, pcm_channels, out);
+    else
+      ingest_kernel<T, MODE, true, false>(stft, pcm, remap, pcm_channels, out);
+  }
+  else
+  {
+    if (remap != NULL)
+      ingest_kernel<T, MODE, false, true>(stft, pcm, remap, pcm_channels, out);
+    else
+      ingest_kernel<T, MODE, false, false>(stft, pcm, remap, pcm_channels, out);
+  }
+}
+
+template<typename T>
+static float *ingest_dispatch(STFT *stft, float *out, const T *pcm, int layout, const int *remap, int pcm_channels)
+{
+  E3E_PROBE(INSTR_INGEST);
+
+  if (pcm_channels <= 0)
+    pcm_channels = stft->channels;
+
+  switch (stft->preprocessing)
+  {
+    case PREPROC_DC_REMOVAL:
+      ingest_dispatch_layout<T, PREPROC_DC_REMOVAL>(stft, pcm, layout, remap, pcm_channels, out);
+      break;
+    case PREPROC_PRE_EMPHASIS:
+      ingest_dispatch_layout<T, PREPROC_PRE_EMPHASIS>(stft, pcm, layout, remap, pcm_channels, out);
+      break;
+    default:
+      ingest_dispatch_layout<T, PREPROC_NONE>(stft, pcm, layout, remap, pcm_channels, out);
+      break;
+  }
+
+  return out;
+}
+
+float *STFT::ingest(const int16_t *pcm, int layout, const int *remap, int pcm_channels)
+{
+  return ingest_dispatch<int16_t>(this, this->get_in_buffer(), pcm, layout, remap, pcm_channels);
+}
+
+float *STFT::ingest_to(float *buf, const int16_t *pcm, int layout, const int *remap, int pcm_channels)
+{
+  return ingest_dispatch<int16_t>(this, buf, pcm, layout, remap, pcm_channels);
+}
+
+float *STFT::ingest(const int32_t *pcm, int layout, const int *remap, int pcm_channels)
+{
+  return ingest_dispatch<int32_t>(this, this->get_in_buffer(), pcm, layout, remap, pcm_channels);
+}
+
+float *STFT::ingest_to(float *buf, const int32_t *pcm, int layout, const int *remap, int pcm_channels)
+{
+  return ingest_dispatch<int32_t>(this, buf, pcm, layout, remap, pcm_channels);
+}
+
+float *STFT::ingest(const float *pcm, int layout, const int *remap, int pcm_channels)
+{
+  return ingest_dispatch<float>(this, this->get_in_buffer(), pcm, layout, remap, pcm_channels);
+}
+
+float *STFT::ingest_to(float *buf, const float *pcm, int layout, const int *remap, int pcm_channels)
+{
+  return ingest_dispatch<float>(this, buf, pcm, layout, remap, pcm_channels);
+}
+
+/* recompute the gain applied to every sample by ingest */
+static void update_ingest_gain(STFT *stft)
+{
+  for (int n = 0 ; n < stft->fft_size ; n++)
+    stft->ingest_gain[n] = stft->ingest_scale * (stft->window != NULL ? stft->window[n] : 1.f);
+}
+
+/* set the analysis window (fft_size values, copied), NULL for rectangular */
+void STFT::set_window(const float *_window)
+{
+  delete[] this->window;
+  this->window = NULL;
+
+  if (_window != NULL)
+  {
+    this->window = new float[this->fft_size];
+    for (int n = 0 ; n < this->fft_size ; n++)
+      this->window[n] = _window[n];
+  }
+
+  update_ingest_gain(this);
+}
+
+/* the factor applied to the PCM samples, e.g. 1/32768 for int16 in [-1, 1] */
+void STFT::set_ingest_scale(float scale)
+{
+  this->ingest_scale = scale;
+  update_ingest_gain(this);
+}
+
+void STFT::set_preprocessing(int mode, float coef)
+{
+  this->preprocessing = mode;
+  this->preproc_coef = coef;
+
+  // restart the filters
+  for (int ch = 0 ; ch < this->channels ; ch++)
+    this->preproc_x[ch] = this->preproc_y[ch] = 0.;
+}
@@ -3,9 +3,42 @@
 
 #include <complex>
 #include <cmath>
+#include <stdint.h>
 #include <fftw3.h>
 
 #include "../src/e3e_detection.h"
+#include "../src/fft_backend.h"
+
+/*
+ * Layout of the spectra in the output buffer
+ *
+ *  STFT_LAYOUT_INTERLEAVED: bin-major, X[frequency * channels + channel]
+ *  STFT_LAYOUT_PLANAR: channel-major, X[channel * channel_stride + frequency]
+ *    where channel_stride is the number of bins padded to a multiple of
+ *    a cache line (which is also a multiple of the SIMD width).
+ *
+ * Use fd_index() or get_fd_sample() rather than assuming one of them.
+ */
+enum stft_layout
+{
+  STFT_LAYOUT_INTERLEAVED = 0,
+  STFT_LAYOUT_PLANAR
+};
+
+/* Layout of the PCM blocks given to STFT::ingest */
+enum pcm_layout
+{
+  PCM_INTERLEAVED = 0,  // pcm[sample * pcm_channels + channel]
+  PCM_PLANAR            // pcm[channel * fft_size + sample]
+};
+
+/* Preprocessing applied by STFT::ingest before the window */
+enum ingest_preprocessing
+{
+  PREPROC_NONE = 0,
+  PREPROC_DC_REMOVAL,    // y[n] = x[n] - x[n-1] + coef * y[n-1]
+  PREPROC_PRE_EMPHASIS   // y[n] = x[n] - coef * x[n-1]
+};
 
 class STFT
 {
@@ -14,8 +47,14 @@ class STFT
     int n_frames;
     int frame_size;
     int channels;
+    int backend;
+    int layout;
 
-    fftwf_plan *plans;
+    RealFFT *fft;
+
+    int n_bins;          // fft_size / 2 + 1
+    int bin_stride;      // distance between two bins of one channel
+    int channel_stride;  // distance between two channels of one bin
 
     int n_samples_per_in_frame;
     int n_samples_per_out_frame;
@@ -25,14 +64,62 @@ class STFT
     float *circ_in_buffer;
     e3e_complex *circ_out_buffer;  // circular buffer pointer
     int current_frame = 0;
+    long frame_count = 0;  // number of frames since the start, frame f is in slot f % n_frames
+
+    // ingest configuration and per channel filter state
+    float *window;
+    float ingest_scale;
+    float *ingest_gain;   // scale * window
+    int preprocessing;
+    float preproc_coef;
+    float *preproc_x;     // x[n-1]
+    float *preproc_y;     // y[n-1]
 
-    STFT(int _fft_size, int _n_frames, int _channels);
+    STFT(int _fft_size, int _n_frames, int _channels, int _backend = FFT_BACKEND_FFTW,
+        int _layout = STFT_LAYOUT_INTERLEAVED);
     ~STFT();
 
     float *get_in_buffer();
     e3e_complex *get_out_buffer();
     e3e_complex *transform();
 
+    // move to the next frame without transforming, returns the finished frame
+    e3e_complex *advance();
+
+    /*
+     * Convert, preprocess, window and write one block of fft_size samples
+     * of PCM into the current input buffer in a single pass. remap[channel]
+     * is the channel of the PCM block that goes to `channel` (NULL for
+     * identity) and pcm_channels the number of channels of the PCM
+     * block (0 for the number of channels of the STFT).
+     * Returns the input buffer, transform() still needs to be called.
+     */
+    float *ingest(const int16_t *pcm, int layout = PCM_INTERLEAVED, const int *remap = NULL, int pcm_channels = 0);
+    float *ingest(const int32_t *pcm, int layout = PCM_INTERLEAVED, const int *remap = NULL, int pcm_channels = 0);
+    float *ingest(const float *pcm, int layout = PCM_INTERLEAVED, const int *remap = NULL, int pcm_channels = 0);
+
+    // same as ingest, but into any input frame, e.g. a slot of a CaptureRing
+    float *ingest_to(float *buf, const int16_t *pcm, int layout = PCM_INTERLEAVED, const int *remap = NULL, int pcm_channels = 0);
+    float *ingest_to(float *buf, const int32_t *pcm, int layout = PCM_INTERLEAVED, const int *remap = NULL, int pcm_channels = 0);
+    float *ingest_to(float *buf, const float *pcm, int layout = PCM_INTERLEAVED, const int *remap = NULL, int pcm_channels = 0);
+
+    // back to the start of a stream: zero buffers and filters, frame_count = 0
+    void reset();
+
+    void set_window(const float *_window);
+    void set_ingest_scale(float scale);
+    void set_preprocessing(int mode, float coef);
+
+    // position of a sample in a frame returned by get_fd_frame
+    inline int fd_index(int frequency, int channel)
+    {
+      return frequency * this->bin_stride + channel * this->channel_stride;
+    }
+
+    // frame = 0 is the most recent frame
+    e3e_complex *get_fd_frame(int frame);
+    // the frame number f since the start (must still be in the buffer)
+    e3e_complex *get_fd_frame_at(long f);
     e3e_complex get_fd_sample(int frame, int frequency, int channel);
     float get_td_sample(int frame, int index, int channel);
 
@@ -0,0 +1,139 @@
+#ifndef __WORK_STEALING_H__
+#define __WORK_STEALING_H__
+
+/*
+ * Work-stealing parallel loop over independent tasks.
+ *
+ * Every worker starts with a contiguous range of the task indices and
+ * takes them from the front. A worker whose range is empty steals the
+ * back half of the largest remaining range. A range is one 64-bit word
+ * (begin << 32 | end) updated by compare-and-swap, so the owner and
+ * the thieves never lock, and tasks next to each other (e.g. consecutive
+ * chunks of a recording) mostly run on the same worker.
+ *
+ *   WorkStealingPool pool(n_threads);
+ *   pool.parallel_for(n_chunks, [&](int chunk, int worker) { ... });
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
+
+#include "e3e_detection.h"
+
+class WorkStealingPool
+{
+  public:
+    int n_workers;
+    std::atomic<uint64_t> n_steals;
+
+    // 0 for one worker per core
+    WorkStealingPool(int _n_workers = 0) : n_steals(0)
+    {
+      this->n_workers = _n_workers > 0 ? _n_workers : std::max(1u, std::thread::hardware_concurrency());
+      this->ranges = new Range[this->n_workers];
+    }
+
+    ~WorkStealingPool()
+    {
+      delete[] this->ranges;
+    }
+
+    // task(i, worker) for every i in [0, n), returns when they are all done
+    void parallel_for(int n, const std::function<void(int task, int worker)> &task)
+    {
+      for (int w = 0 ; w < this->n_workers ; w++)
+      {
+        uint64_t begin = uint64_t(n) * w / this->n_workers;
+        uint64_t end = uint64_t(n) * (w + 1) / this->n_workers;
+        this->ranges[w].range.store(pack(begin, end), std::memory_order_relaxed);
+      }
+
+      std::vector<std::thread> threads;
+      for (int w = 1 ; w < this->n_workers ; w++)
+        threads.push_back(std::thread(&WorkStealingPool::work, this, w, std::cref(task)));
+      this->work(0, task);
+
+      for (size_t t = 0 ; t < threads.size() ; t++)
+        threads[t].join();
+    }
+
+  private:
+    struct Range
+    {
+      std::atomic<uint64_t> range;
+      char pad[E3E_CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    };
+    Range *ranges;
+
+    static inline uint64_t pack(uint64_t begin, uint64_t end)
+    {
+      return (begin << 32) | end;
+    }
+
+    // the first task of the range of w, -1 if it is empty
+    int pop(int w)
+    {
+      std::atomic<uint64_t> &r = this->ranges[w].range;
+      uint64_t v = r.load(std::memory_order_acquire);
+
+      while (true)
+      {
+        uint64_t begin = v >> 32, end = v & 0xffffffff;
+        if (begin >= end)
+          return -1;
+        if (r.compare_exchange_weak(v, pack(begin + 1, end), std::memory_order_acq_rel))
+          return int(begin);
+      }
+    }
+
+    // move the back half of the largest range to w, false if nothing is left
+    bool steal(int w)
+    {
+      while (true)
+      {
+        int victim = -1;
+        uint64_t largest = 0, v = 0;
+        for (int i = 0 ; i < this->n_workers ; i++)
+        {
+          uint64_t vi = this->ranges[i].range.load(std::memory_order_acquire);
+          uint64_t begin = vi >> 32, end = vi & 0xffffffff;
+          if (end > begin && end - begin > largest)
+          {
+            largest = end - begin;
+            victim = i;
+            v = vi;
+          }
+        }
+
+        if (victim < 0)
+          return false;
+
+        uint64_t begin = v >> 32, end = v & 0xffffffff;
+        uint64_t mid = begin + (end - begin) / 2;
+        if (this->ranges[victim].range.compare_exchange_strong(v, pack(begin, mid), std::memory_order_acq_rel))
+        {
+          this->ranges[w].range.store(pack(mid, end), std::memory_order_release);
+          this->n_steals.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+    }
+
+    void work(int w, const std::function<void(int task, int worker)> &task)
+    {
+      while (true)
+      {
+        int i = this->pop(w);
+        if (i >= 0)
+          task(i, w);
+        else if (!this->steal(w))
+          break;
+      }
+    }
+};
+
+#endif // __WORK_STEALING_H__
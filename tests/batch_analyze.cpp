@@ -0,0 +1,50 @@
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+#include "../src/recording.h"
+#include "../src/batch.h"
+
+/*
+ * Offline DOA, spatial spectra and MFCC of a long recording on all the
+ * cores, into a columnar file (see src/batch.h).
+ *
+ * Usage: batch_analyze input output.e3eb [threads] [chunk_frames] [n_grid]
+ *
+ *   input         a recording with a header, or float32 8 channels at 16 kHz
+ *   threads       0 for one per core (default)
+ *   chunk_frames  frames per chunk (default 2048)
+ *   n_grid        points of the DOA grid (default 360)
+ */
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: batch_analyze input output.e3eb [threads] [chunk_frames] [n_grid]" << std::endl;
+    return 1;
+  }
+
+  BatchConfig config;
+  int threads = argc > 3 ? atoi(argv[3]) : 0;
+  if (argc > 4)
+    config.chunk_frames = atoi(argv[4]);
+  if (argc > 5)
+    config.n_grid = atoi(argv[5]);
+
+  MappedRecording rec;
+  if (!rec.open(argv[1], config.channels, int(config.fs), RECORDING_FLOAT32))
+    return 1;
+
+  BatchAnalyzer analyzer(config, threads);
+  if (!analyzer.run(&rec, argv[2]))
+    return 1;
+
+  double audio = double(analyzer.n_frames * config.fft_size) / config.fs;
+  std::cout << "# " << analyzer.n_frames << " frames (" << audio << " s) in " << analyzer.n_chunks << " chunks on ";
+  std::cout << analyzer.n_workers << " threads: " << analyzer.seconds << " s, " << audio / analyzer.seconds;
+  std::cout << "x real time, " << analyzer.n_steals << " steals" << std::endl;
+
+  return 0;
+}
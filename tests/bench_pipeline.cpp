@@ -0,0 +1,153 @@
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/fastmath.h"
+#include "../src/bench.h"
+
+/*
+ * Latency of every stage and of the whole pipeline per frame, as CSV on
+ * the standard output (see src/bench.h), sweeping one parameter at a time
+ * around the configuration of the MATRIX Creator (FFT 128, 8 channels,
+ * 360 points in 2D, k_len 50, all the pairs).
+ *
+ * Usage: bench_pipeline [sweep] [frames] [warmup] [perf]
+ *
+ *   sweep   all (default), base, fft, channels, grid, dim, k_len, pairs,
+ *           layout, lut or select
+ *   frames  timed frames per configuration (default 1000)
+ *   warmup  frames before the timings (default 100)
+ *   perf    also count the cycles, instructions, cache and branch misses
+ *           of every stage (see src/perf_counters.h)
+ *
+ * select runs every STFT layout with every SRP LUT layout and prints the
+ * fastest pipeline, in cycles when they are counted.
+ *
+ * The other channel counts use a circular array of the same radius,
+ * written to ./bench_CONFIG_<channels> for the run.
+ */
+
+int main(int argc, char **argv)
+{
+  std::string sweep = argc > 1 ? argv[1] : "all";
+  int frames = argc > 2 ? atoi(argv[2]) : 1000;
+  int warmup = argc > 3 ? atoi(argv[3]) : 100;
+
+  BenchParams base;
+  base.perf = argc > 4 && std::string(argv[4]) == "perf";
+  std::vector<BenchParams> configs;
+
+  if (sweep == "select")
+  {
+    std::cout << "# isa " << fastmath_isa() << ", " << frames << " frames after " << warmup << " of warm-up" << std::endl;
+    bench_csv_header(std::cout, base.perf);
+
+    BenchParams best = base;
+    if (!bench_select_layout(best, frames, warmup, &std::cout))
+      return 1;
+
+    std::cout << "# fastest: stft " << (best.layout == STFT_LAYOUT_PLANAR ? "planar" : "interleaved");
+    std::cout << ", srp lut " << bench_lut_layout_name(best.lut_layout) << std::endl;
+    return 0;
+  }
+
+  if (sweep == "all" || sweep == "base")
+    configs.push_back(base);
+
+  if (sweep == "all" || sweep == "fft")
+    for (int n : { 64, 256, 512, 1024 })
+    {
+      BenchParams p = base;
+      p.fft_size = n;
+      configs.push_back(p);
+    }
+
+  if (sweep == "all" || sweep == "channels")
+    for (int n : { 2, 4, 16 })
+    {
+      BenchParams p = base;
+      p.channels = n;
+      p.config_file = "./bench_CONFIG_" + std::to_string(n);
+      configs.push_back(p);
+    }
+
+  if (sweep == "all" || sweep == "grid")
+    for (int n : { 36, 90, 180, 720 })
+    {
+      BenchParams p = base;
+      p.n_grid = n;
+      configs.push_back(p);
+    }
+
+  if (sweep == "all" || sweep == "dim")
+    for (int n : { 3, 25 })
+    {
+      BenchParams p = base;
+      p.dim = n;
+      configs.push_back(p);
+    }
+
+  if (sweep == "all" || sweep == "k_len")
+    for (int n : { 10, 25, 40 })
+    {
+      BenchParams p = base;
+      p.k_len = n;
+      configs.push_back(p);
+    }
+
+  if (sweep == "all" || sweep == "pairs")
+    for (int n : { 2, 4 })
+    {
+      BenchParams p = base;
+      p.pair_step = n;
+      configs.push_back(p);
+    }
+
+  if (sweep == "all" || sweep == "layout")
+  {
+    BenchParams p = base;
+    p.layout = STFT_LAYOUT_PLANAR;
+    configs.push_back(p);
+  }
+
+  if (sweep == "all" || sweep == "lut")
+    for (int n : { SRP_LUT_GRID_MAJOR, SRP_LUT_FREE })
+    {
+      BenchParams p = base;
+      p.lut_layout = n;
+      configs.push_back(p);
+    }
+
+  if (configs.empty())
+  {
+    std::cerr << "Usage: bench_pipeline [all|base|fft|channels|grid|dim|k_len|pairs|layout|lut|select] [frames] [warmup] [perf]";
+    std::cerr << std::endl;
+    return 1;
+  }
+
+  std::cout << "# isa " << fastmath_isa() << ", " << frames << " frames after " << warmup << " of warm-up" << std::endl;
+  bench_csv_header(std::cout, base.perf);
+
+  for (size_t i = 0 ; i < configs.size() ; i++)
+  {
+    const BenchParams &p = configs[i];
+    bool own_config = p.config_file != base.config_file;
+    if (own_config && !bench_write_array_config(p.config_file, p.channels))
+      return 1;
+
+    BenchRun run(p);
+    bool ok = run.run(frames, warmup);
+
+    if (own_config)
+      remove(p.config_file.c_str());
+    if (!ok)
+      return 1;
+
+    bench_csv(std::cout, run);
+  }
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <stdlib.h>
+
+#include "../src/recording.h"
+#include "../src/scene.h"
+
+/*
+ * Write a synthetic recording of the array of ./CONFIG, the C++
+ * counterpart of tests/synthetic_data/gen_data.py: by default a far field
+ * low-passed noise source at -120 degrees, 20 dB SNR, 10 s.
+ *
+ * Usage: gen_scene output [seconds] [azimuth_deg] [snr_db] [seed] [distance] [room_x room_y room_z]
+ *
+ *   distance  m from the center of the array, 0 for the far field
+ *   room      shoebox room with the array in the middle, first order reflections
+ */
+
+#define CHANNELS 8
+#define FS 16000
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: gen_scene output [seconds] [azimuth_deg] [snr_db] [seed] [distance] [room_x room_y room_z]";
+    std::cerr << std::endl;
+    return 1;
+  }
+
+  double seconds = argc > 2 ? atof(argv[2]) : 10.;
+  SceneSource s;
+  s.azimuth = (argc > 3 ? atof(argv[3]) : -120.) / 180. * M_PI;
+  s.cutoff = 0.5;
+  s.distance = argc > 6 ? atof(argv[6]) : 0.;
+
+  SceneGenerator scene("./CONFIG", CHANNELS, FS, 343., argc > 5 ? atoll(argv[5]) : 0);
+  scene.add_source(s);
+  scene.set_snr(argc > 4 ? atof(argv[4]) : 20.);
+
+  if (argc > 9)
+  {
+    SceneRoom room;
+    for (int v = 0 ; v < 3 ; v++)
+    {
+      room.size[v] = atof(argv[7 + v]);
+      room.array_pos[v] = room.size[v] / 2.;
+    }
+    scene.set_room(room);
+  }
+
+  uint64_t n = uint64_t(seconds * FS);
+  std::vector<float> pcm(n * CHANNELS);
+
+  uint64_t t0 = e3e_monotonic_ns();
+  scene.generate(pcm.data(), int(n));
+  double elapsed = double(e3e_monotonic_ns() - t0) * 1e-9;
+
+  if (!recording_write(argv[1], pcm.data(), n, CHANNELS, FS, RECORDING_FLOAT32))
+    return 1;
+
+  std::cout << "# " << seconds << " s generated in " << elapsed << " s (" << seconds / elapsed;
+  std::cout << "x real time)" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,46 @@
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/instrument.h"
+
+/*
+ * Print the latencies and counters of a snapshot mapped by an
+ * InstrumentExporter (see src/instrument.h), once or every period.
+ *
+ * Usage: instrument_dump [snapshot] [period_ms]
+ *
+ *   snapshot   default /dev/shm/e3e_instrument
+ *   period_ms  print again every period, 0 (default) to print once
+ */
+
+int main(int argc, char **argv)
+{
+  std::string path = argc > 1 ? argv[1] : "/dev/shm/e3e_instrument";
+  int period_ms = argc > 2 ? atoi(argv[2]) : 0;
+
+  InstrumentSnapshot *s = (InstrumentSnapshot *)e3e_aligned_malloc(sizeof(InstrumentSnapshot));
+
+  do
+  {
+    if (!instrument_read(path, s))
+    {
+      free(s);
+      return 1;
+    }
+
+    instrument_print(std::cout, *s);
+    std::cout << std::endl;
+
+    if (period_ms > 0)
+      usleep(period_ms * 1000);
+  }
+  while (period_ms > 0);
+
+  free(s);
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+#include "../src/audio_codec.h"
+
+/*
+ * Lossless compression of the float32 interleaved .raw recordings, e.g.
+ * tests/synthetic_data/test_signal.raw.
+ *
+ * Usage: raw_codec c input.raw output.e3ea [channels] [fs]
+ *        raw_codec d input.e3ea output.raw
+ *
+ *   channels  default 8
+ *   fs        default 16000
+ */
+
+int main(int argc, char **argv)
+{
+  if (argc < 4 || (std::string(argv[1]) != "c" && std::string(argv[1]) != "d"))
+  {
+    std::cerr << "Usage: raw_codec c|d input output [channels] [fs]" << std::endl;
+    return 1;
+  }
+
+  bool ok;
+  if (std::string(argv[1]) == "c")
+  {
+    int channels = argc > 4 ? atoi(argv[4]) : 8;
+    int fs = argc > 5 ? atoi(argv[5]) : 16000;
+    ok = audio_codec_compress_raw(argv[2], argv[3], channels, fs);
+  }
+  else
+    ok = audio_codec_decompress_raw(argv[2], argv[3]);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <string.h>
+#include <stdio.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/audio_codec.h"
+
+/*
+ * Compress 10 s of a source filtered by the array (each microphone gets
+ * it with its own delay and some independent noise) in int16 and
+ * float32, check that decoding gives back the exact samples, and report
+ * the ratio and the speed in MB/s of raw int16 samples against the real
+ * time rate of the array. Float frames that are not int16 go through as
+ * raw floats, corrupted frames are rejected, and the .raw helpers
+ * round trip.
+ */
+
+#define FS 16000
+#define CHANNELS 8
+#define SECONDS 10
+#define RAW_FILE "./test_audio_codec.raw"
+#define CODED_FILE "./test_audio_codec.e3ea"
+#define DECODED_FILE "./test_audio_codec_decoded.raw"
+
+// encoding must be this much faster than real time
+#define MIN_REAL_TIME_FACTOR 10.
+#define MIN_RATIO 1.4
+
+std::vector<int16_t> array_signal(int n)
+{
+  std::mt19937 gen(0);
+  std::normal_distribution<double> noise(0., 1.);
+
+  // a low pass AR(2) source
+  std::vector<double> src(n + 16, 0.);
+  for (int i = 2 ; i < n + 16 ; i++)
+    src[i] = 1.6 * src[i - 1] - 0.7 * src[i - 2] + 300. * noise(gen);
+
+  std::vector<int16_t> pcm(n * CHANNELS);
+  for (int i = 0 ; i < n ; i++)
+    for (int c = 0 ; c < CHANNELS ; c++)
+    {
+      double v = src[i + 16 - (c % 4)] + 20. * noise(gen);
+      pcm[i * CHANNELS + c] = int16_t(std::max(-32768., std::min(32767., round(v))));
+    }
+
+  return pcm;
+}
+
+/* encode all the frames, returns the stream */
+template <typename T>
+std::vector<uint8_t> encode(AudioEncoder &enc, const std::vector<T> &pcm, double &t_encode)
+{
+  int n_samples = pcm.size() / CHANNELS;
+  std::vector<uint8_t> stream(sizeof(AudioCodecHeader));
+  std::vector<uint8_t> frame(enc.max_frame_bytes());
+
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int i = 0 ; i < n_samples ; i += enc.frame_size)
+  {
+    int n = std::min(enc.frame_size, n_samples - i);
+    size_t bytes = enc.encode(&pcm[i * CHANNELS], n, frame.data());
+    stream.insert(stream.end(), frame.begin(), frame.begin() + bytes);
+  }
+  t_encode = double(e3e_monotonic_ns() - t0) * 1e-9;
+
+  enc.write_header(stream.data());
+  return stream;
+}
+
+/* decode all the frames, false on an error */
+template <typename T>
+bool decode(const std::vector<uint8_t> &stream, std::vector<T> &pcm, double &t_decode)
+{
+  AudioDecoder dec;
+  if (!dec.read_header(stream.data(), stream.size()))
+    return false;
+
+  pcm.assign(dec.header.n_samples * dec.channels, 0);
+  size_t offset = dec.header.data_offset;
+  size_t pos = 0;
+
+  uint64_t t0 = e3e_monotonic_ns();
+  while (offset < stream.size())
+  {
+    int n;
+    size_t bytes = dec.decode(&stream[offset], stream.size() - offset, &pcm[pos], n);
+    if (bytes == 0)
+      return false;
+    offset += bytes;
+    pos += n * dec.channels;
+  }
+  t_decode = double(e3e_monotonic_ns() - t0) * 1e-9;
+
+  return pos == pcm.size();
+}
+
+int test_int16(const std::vector<int16_t> &pcm)
+{
+  int errors = 0;
+  double t_encode, t_decode;
+
+  AudioEncoder enc(CHANNELS, FS);
+  std::vector<uint8_t> stream = encode(enc, pcm, t_encode);
+
+  std::vector<int16_t> out;
+  if (!decode(stream, out, t_decode) || out != pcm)
+    errors++;
+
+  double mb = pcm.size() * sizeof(int16_t) * 1e-6;
+  double real_time = double(SECONDS) / t_encode;
+  double ratio = double(pcm.size() * sizeof(int16_t)) / stream.size();
+
+  std::cout << "int16: ratio " << ratio << ", encode " << mb / t_encode << " MB/s (" << real_time;
+  std::cout << "x real time), decode " << mb / t_decode << " MB/s, errors " << errors << std::endl;
+
+  if (!(ratio > MIN_RATIO) || !(real_time > MIN_REAL_TIME_FACTOR))
+    errors++;
+
+  // a truncated or corrupted frame is rejected
+  AudioDecoder dec;
+  dec.read_header(stream.data(), stream.size());
+  std::vector<int16_t> frame(enc.frame_size * CHANNELS);
+  int n;
+  size_t offset = dec.header.data_offset;
+  uint32_t frame_bytes;
+  memcpy(&frame_bytes, &stream[offset], 4);
+
+  std::cout << "  (two invalid frames follow)" << std::endl;
+  if (dec.decode(&stream[offset], frame_bytes - 1, frame.data(), n) != 0)
+    errors++;
+  std::vector<uint8_t> cut(stream.begin() + offset, stream.begin() + offset + frame_bytes);
+  uint32_t short_bytes = frame_bytes / 2;
+  memcpy(&cut[0], &short_bytes, 4);
+  if (dec.decode(cut.data(), cut.size(), frame.data(), n) != 0)
+    errors++;
+
+  return errors;
+}
+
+int test_float32(const std::vector<int16_t> &pcm)
+{
+  int errors = 0;
+  double t_encode, t_decode;
+
+  // ADC samples in float
+  std::vector<float> x(pcm.size());
+  for (size_t i = 0 ; i < pcm.size() ; i++)
+    x[i] = pcm[i] / 32768.f;
+
+  // one frame that is not int16
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> uniform(-1., 1.);
+  for (size_t i = AUDIO_CODEC_FRAME_SIZE * CHANNELS ; i < 2 * AUDIO_CODEC_FRAME_SIZE * CHANNELS ; i++)
+    x[i] = uniform(gen);
+
+  AudioEncoder enc(CHANNELS, FS, AUDIO_CODEC_FLOAT32);
+  std::vector<uint8_t> stream = encode(enc, x, t_encode);
+
+  std::vector<float> out;
+  if (!decode(stream, out, t_decode) || memcmp(out.data(), x.data(), sizeof(float) * x.size()) != 0)
+    errors++;
+
+  double ratio = double(x.size() * sizeof(float)) / stream.size();
+  std::cout << "float32: ratio " << ratio << ", encode " << x.size() * sizeof(float) * 1e-6 / t_encode;
+  std::cout << " MB/s, errors " << errors << std::endl;
+
+  if (!(ratio > 1.8 * MIN_RATIO))
+    errors++;
+
+  return errors;
+}
+
+int test_raw_files(const std::vector<int16_t> &pcm)
+{
+  int errors = 0;
+
+  std::vector<float> x(FS * CHANNELS);
+  for (size_t i = 0 ; i < x.size() ; i++)
+    x[i] = pcm[i] / 32768.f;
+
+  std::ofstream fout(RAW_FILE, std::ofstream::binary | std::ofstream::trunc);
+  fout.write((const char *)x.data(), sizeof(float) * x.size());
+  fout.close();
+
+  if (!audio_codec_compress_raw(RAW_FILE, CODED_FILE, CHANNELS, FS)
+      || !audio_codec_decompress_raw(CODED_FILE, DECODED_FILE))
+    errors++;
+
+  std::ifstream fin(DECODED_FILE, std::ifstream::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+  if (data.size() != sizeof(float) * x.size() || memcmp(data.data(), x.data(), data.size()) != 0)
+    errors++;
+
+  std::cout << ".raw files: errors " << errors << std::endl;
+
+  remove(RAW_FILE);
+  remove(CODED_FILE);
+  remove(DECODED_FILE);
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<int16_t> pcm = array_signal(SECONDS * FS);
+
+  int errors = test_int16(pcm) + test_float32(pcm) + test_raw_files(pcm);
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the audio codec is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
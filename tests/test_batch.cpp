@@ -0,0 +1,199 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/srpphat.h"
+#include "../src/mfcc.h"
+#include "../src/recording.h"
+#include "../src/batch.h"
+#include "../src/work_stealing.h"
+
+/*
+ * Analyze a recording of a source that jumps between positions with the
+ * BatchAnalyzer, in small chunks on several workers, and compare with a
+ * single pass over the recording: the DOA must be the same, the spatial
+ * spectra equal up to the rounding of the sliding sum of G, and the
+ * features equal (exactly without preprocessing). Also check the work-stealing loop on uneven
+ * tasks and report the speedup over one worker.
+ */
+
+#define FS 16000
+#define CHANNELS 8
+#define FFT_SIZE 128
+#define SECONDS 8
+#define CONFIG_FILE "./CONFIG"
+#define RECORDING_FILE "./test_batch.rec"
+#define RESULTS_FILE "./test_batch.e3eb"
+
+#define MAX_SPECTRUM_ERROR 1e-3
+#define MAX_FEATURE_ERROR 1e-4
+
+std::vector<float> make_recording(int n_samples)
+{
+  std::mt19937 gen(0);
+  std::normal_distribution<float> noise(0., 1.);
+  std::uniform_int_distribution<int> delay(0, 4);
+
+  std::vector<float> src(n_samples + 8);
+  for (size_t i = 0 ; i < src.size() ; i++)
+    src[i] = noise(gen);
+
+  // integer delays that change every half second
+  std::vector<float> pcm(n_samples * CHANNELS);
+  int delays[CHANNELS];
+  for (int n = 0 ; n < n_samples ; n++)
+  {
+    if (n % (FS / 2) == 0)
+      for (int c = 0 ; c < CHANNELS ; c++)
+        delays[c] = delay(gen);
+
+    for (int c = 0 ; c < CHANNELS ; c++)
+      pcm[n * CHANNELS + c] = src[n + 8 - delays[c]] + 0.1 * noise(gen);
+  }
+
+  return pcm;
+}
+
+int test_pool()
+{
+  int errors = 0;
+  int n = 1000;
+
+  // tasks of very different lengths, all run exactly once
+  std::vector<std::atomic<int>> runs(n);
+  for (int i = 0 ; i < n ; i++)
+    runs[i] = 0;
+
+  WorkStealingPool pool(4);
+  pool.parallel_for(n, [&](int i, int worker)
+      {
+        volatile double x = 0.;
+        for (int k = 0 ; k < (i < n / 4 ? 20000 : 10) ; k++)
+          x += k;
+        runs[i]++;
+      });
+
+  for (int i = 0 ; i < n ; i++)
+    if (runs[i] != 1)
+      errors++;
+
+  std::cout << "work stealing: " << pool.n_steals << " steals, errors " << errors << std::endl;
+  return errors;
+}
+
+int test_batch(const BatchConfig &config, const std::vector<float> &pcm, const char *name)
+{
+  int errors = 0;
+  int n_frames = pcm.size() / CHANNELS / FFT_SIZE;
+  int n_features = config.mfcc_size * CHANNELS;
+
+  // a single pass
+  STFT stft(FFT_SIZE, config.srp_n_frames + 1, CHANNELS);
+  stft.set_preprocessing(config.preprocessing, config.preproc_coef);
+  SRPPHAT srpphat(&stft, CONFIG_FILE, config.k_min, config.k_len, config.n_grid, config.srp_n_frames, FS, config.c, config.dim);
+  MFCC mfcc(config.mfcc_size, FFT_SIZE, FS, config.fl, config.fh);
+
+  std::vector<int> argmax(n_frames);
+  std::vector<float> spectra(n_frames * config.n_grid);
+  std::vector<float> features(n_frames * n_features);
+
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int f = 0 ; f < n_frames ; f++)
+  {
+    stft.ingest(&pcm[f * FFT_SIZE * CHANNELS]);
+    stft.transform();
+    argmax[f] = srpphat.process();
+    memcpy(&spectra[f * config.n_grid], srpphat.spatial_spectrum, sizeof(float) * config.n_grid);
+    mfcc.transform_stft(&stft, 0, &features[f * n_features]);
+  }
+  double t_single = double(e3e_monotonic_ns() - t0) * 1e-9;
+
+  // chunks of a quarter of second on 4 workers, and on one
+  MappedRecording rec;
+  if (!rec.open(RECORDING_FILE))
+    return 1;
+
+  BatchAnalyzer one(config, 1);
+  BatchAnalyzer parallel(config, 4);
+  if (!one.run(&rec, RESULTS_FILE) || !parallel.run(&rec, RESULTS_FILE))
+    return 1;
+
+  BatchResults results;
+  int width;
+  if (!results.load(RESULTS_FILE) || results.header.n_frames != uint64_t(n_frames))
+    return 1;
+
+  const int32_t *r_argmax = (const int32_t *)results.column("argmax");
+  const float *r_power = (const float *)results.column("power");
+  const float *r_spectra = (const float *)results.column("spectrum", &width);
+  const float *r_features = (const float *)results.column("features");
+  if (r_argmax == NULL || r_power == NULL || r_spectra == NULL || width != config.n_grid || r_features == NULL)
+    return 1;
+
+  int doa_errors = 0;
+  double spectrum_error = 0.;
+  for (int f = 0 ; f < n_frames ; f++)
+  {
+    if (r_argmax[f] != argmax[f])
+      doa_errors++;
+    if (r_power[f] != r_spectra[f * width + r_argmax[f]])
+      errors++;
+
+    float max = *std::max_element(&spectra[f * width], &spectra[(f + 1) * width]);
+    for (int n = 0 ; n < width ; n++)
+      spectrum_error = std::max(spectrum_error, double(std::fabs(r_spectra[f * width + n] - spectra[f * width + n]) / max));
+  }
+
+  double feature_error = 0.;
+  for (size_t i = 0 ; i < features.size() ; i++)
+    feature_error = std::max(feature_error, double(std::fabs(r_features[i] - features[i])));
+
+  std::cout << name << ": " << n_frames << " frames in " << parallel.n_chunks << " chunks, " << parallel.n_steals;
+  std::cout << " steals, DOA differences " << doa_errors << ", spectrum error " << spectrum_error;
+  std::cout << ", features error " << feature_error << std::endl;
+  std::cout << "  single pass " << t_single << " s, 1 worker " << one.seconds << " s, 4 workers " << parallel.seconds;
+  std::cout << " s (" << std::thread::hardware_concurrency() << " cores)" << std::endl;
+
+  if (doa_errors > 0 || !(spectrum_error < MAX_SPECTRUM_ERROR) || !(feature_error < MAX_FEATURE_ERROR))
+    errors++;
+
+  results.unload();
+  remove(RESULTS_FILE);
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<float> pcm = make_recording(SECONDS * FS);
+  recording_write(RECORDING_FILE, pcm.data(), SECONDS * FS, CHANNELS, FS, RECORDING_FLOAT32);
+
+  BatchConfig config;
+  config.config_file = CONFIG_FILE;
+  config.n_grid = 72;
+  config.chunk_frames = FS / FFT_SIZE / 4;
+
+  int errors = test_pool();
+  errors += test_batch(config, pcm, "batch");
+
+  // the DC removal filter settles during the warm-up
+  config.preprocessing = PREPROC_DC_REMOVAL;
+  config.preproc_coef = 0.99;
+  errors += test_batch(config, pcm, "batch with DC removal");
+
+  remove(RECORDING_FILE);
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the batch analyzer is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
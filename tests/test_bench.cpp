@@ -0,0 +1,186 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cmath>
+
+#include "../src/e3e_detection.h"
+#include "../src/bench.h"
+
+/*
+ * Check the statistics of the benchmark harness on known latencies, then
+ * run a short benchmark: every stage must have a latency for every timed
+ * frame, the pipeline must take at least the sum of its stages, and the
+ * CSV must have a row of the same number of fields as the header per
+ * stage. Then the same with the performance counters, which must count
+ * the CPU time of every stage, and the selection of the layouts.
+ */
+
+#define FRAMES 50
+#define WARMUP 10
+
+int count_fields(const std::string &line)
+{
+  int n = 1;
+  for (size_t i = 0 ; i < line.size() ; i++)
+    if (line[i] == ',')
+      n++;
+  return n;
+}
+
+int test_stats()
+{
+  int errors = 0;
+
+  // 1 to 1000 us in a shuffled order
+  BenchStats st;
+  for (int i = 0 ; i < 1000 ; i++)
+    st.add(uint64_t((i * 617) % 1000 + 1) * 1000);
+
+  if (st.percentile_us(50.) != 500. || st.percentile_us(99.) != 990. || st.max_us() != 1000.
+      || fabs(st.mean_us() - 500.5) > 1e-9 || st.percentile_us(0.) != 1.)
+    errors++;
+
+  std::cout << "Stats: p50 " << st.percentile_us(50.) << " p99 " << st.percentile_us(99.) << " max ";
+  std::cout << st.max_us() << " mean " << st.mean_us() << ", errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_run()
+{
+  int errors = 0;
+
+  BenchParams p;
+  p.n_grid = 36;
+  BenchRun run(p);
+  if (!run.run(FRAMES, WARMUP))
+    return 1;
+
+  double sum = 0.;
+  for (int s = 0 ; s < BENCH_N_STAGES ; s++)
+  {
+    if (run.stages[s].ns.size() != FRAMES || run.stages[s].percentile_us(50.) > run.stages[s].max_us())
+      errors++;
+    if (s != BENCH_PIPELINE)
+      sum += run.stages[s].mean_us();
+  }
+  if (run.stages[BENCH_PIPELINE].mean_us() < sum || run.n_pairs != 28)
+    errors++;
+
+  std::ostringstream csv;
+  bench_csv_header(csv);
+  bench_csv(csv, run);
+
+  std::istringstream lines(csv.str());
+  std::string header, line;
+  std::getline(lines, header);
+  int rows = 0;
+  while (std::getline(lines, line))
+  {
+    if (count_fields(line) != count_fields(header))
+      errors++;
+    rows++;
+  }
+  if (rows != BENCH_N_STAGES)
+    errors++;
+
+  std::cout << csv.str();
+  std::cout << "Run: " << rows << " rows, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_perf()
+{
+  int errors = 0;
+
+  BenchParams p;
+  p.n_grid = 36;
+  p.perf = true;
+  BenchRun run(p);
+  if (!run.run(FRAMES, WARMUP))
+    return 1;
+
+  if (!(run.perf_events & (1u << PERF_EV_TASK_CLOCK)) || run.perf_running <= 0. || run.perf_running > 1.)
+    errors++;
+
+  double sum = 0.;
+  for (int s = 0 ; s < BENCH_PIPELINE ; s++)
+  {
+    if (run.event_per_frame(s, PERF_EV_TASK_CLOCK) < 0.)
+      errors++;
+    sum += run.event_per_frame(s, PERF_EV_TASK_CLOCK);
+  }
+  // the CPU time of the search at least, and no more than the time
+  double pipeline = run.event_per_frame(BENCH_PIPELINE, PERF_EV_TASK_CLOCK);
+  if (pipeline < sum * 0.99 || run.event_per_frame(BENCH_SRP_SEARCH, PERF_EV_TASK_CLOCK) <= 0.
+      || pipeline * 1e-3 > run.stages[BENCH_PIPELINE].mean_us() * 1.01)
+    errors++;
+
+  std::ostringstream csv;
+  bench_csv_header(csv, true);
+  bench_csv(csv, run);
+
+  std::istringstream lines(csv.str());
+  std::string header, line;
+  std::getline(lines, header);
+  while (std::getline(lines, line))
+    if (count_fields(line) != count_fields(header))
+      errors++;
+
+  std::cout << csv.str();
+  std::cout << "Perf: pipeline " << pipeline * 1e-3 << " us of CPU, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_select()
+{
+  int errors = 0;
+
+  BenchParams p;
+  p.n_grid = 36;
+  p.mfcc_size = 0;
+  p.layout = -1;
+  p.lut_layout = -1;
+
+  std::ostringstream log;
+  if (!bench_select_layout(p, FRAMES, WARMUP, &log))
+    return 1;
+
+  if ((p.layout != STFT_LAYOUT_INTERLEAVED && p.layout != STFT_LAYOUT_PLANAR)
+      || (p.lut_layout != SRP_LUT_BIN_MAJOR && p.lut_layout != SRP_LUT_GRID_MAJOR && p.lut_layout != SRP_LUT_FREE))
+    errors++;
+
+  // one row per stage and per layout
+  std::istringstream lines(log.str());
+  std::string line;
+  int rows = 0;
+  while (std::getline(lines, line))
+    rows++;
+  if (rows != 6 * (BENCH_N_STAGES - 1))
+    errors++;
+
+  std::cout << "Select: stft " << (p.layout == STFT_LAYOUT_PLANAR ? "planar" : "interleaved");
+  std::cout << ", srp lut " << bench_lut_layout_name(p.lut_layout) << ", errors " << errors << std::endl;
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  int errors = 0;
+
+  errors += test_stats();
+  errors += test_run();
+  errors += test_perf();
+  errors += test_select();
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the benchmark harness is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
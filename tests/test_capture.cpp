@@ -0,0 +1,87 @@
+
+#include <iostream>
+#include <unistd.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/capture.h"
+
+/*
+ * A fast reader and a slow consumer on a capture ring backed by the
+ * input frames of an STFT. Every block is filled with its number so
+ * that the consumer can check the data, the order and that the gaps
+ * match the overrun counter.
+ */
+
+#define FFT_SIZE 128
+#define NFRAMES 8
+#define CHANNELS 8
+#define NBLOCKS 2000
+
+int main(int argc, char **argv)
+{
+  STFT engine(FFT_SIZE, NFRAMES, CHANNELS);
+  CaptureRing ring(&engine);
+
+  int n_read = 0;
+  CaptureThread reader(&ring, [&](float *block)
+      {
+        if (n_read == NBLOCKS)
+          return false;
+
+        for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+          block[i] = float(n_read);
+        n_read++;
+
+        usleep(200);
+        return true;
+      });
+  reader.start();
+
+  CaptureBlockInfo info;
+  uint64_t expected = 0, gaps = 0, received = 0, errors = 0;
+
+  while (reader.running || ring.available() > 0)
+  {
+    float *block = ring.wait_read_slot(&info, 100000);
+    if (block == NULL)
+      continue;
+
+    // zero copy: the block is the current input frame of the STFT
+    if (block != engine.get_in_buffer())
+      errors++;
+
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      if (block[i] != float(info.sequence))
+        errors++;
+
+    if (info.sequence < expected)
+      errors++;
+    gaps += info.sequence - expected;
+    expected = info.sequence + 1;
+
+    engine.transform();
+    received++;
+
+    // simulate a processing spike once in a while
+    usleep(received % 100 == 0 ? 5000 : 20);
+
+    ring.release();
+  }
+
+  reader.stop();
+
+  std::cout << "Received: " << received << " Overruns: " << ring.overruns;
+  std::cout << " Gaps: " << gaps << " Errors: " << errors << std::endl;
+
+  // the blocks dropped after the last one received are not gaps
+  gaps += NBLOCKS - expected;
+
+  if (errors > 0 || gaps != ring.overruns || received + ring.overruns != NBLOCKS)
+  {
+    std::cout << "** Ouch the capture ring is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
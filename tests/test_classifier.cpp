@@ -0,0 +1,338 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <stdio.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/classifier.h"
+#include "../src/pipeline.h"
+
+/*
+ * Write a GMM model and a conv1d + MLP model, map them back and compare
+ * the streamed probabilities with a direct computation in double. Also
+ * check that invalid files are rejected and run the GMM in a
+ * ClassifierStage on the features of one channel.
+ */
+
+#define MFCC_SIZE 13
+#define CHANNELS 4
+#define N_TEST 50
+#define N_SLOTS 8
+
+#define GMM_CLASSES 3
+#define GMM_MIX 2
+
+#define CONV_KERNEL 3
+#define CONV_OUT 16
+#define HIDDEN 8
+#define MLP_CLASSES 4
+
+#define MODEL_FILE "./test_classifier.e3ec"
+
+std::mt19937 gen(0);
+std::normal_distribution<float> noise(0., 1.);
+
+std::vector<float> random_vector(int n, float scale)
+{
+  std::vector<float> v(n);
+  for (int i = 0 ; i < n ; i++)
+    v[i] = scale * noise(gen);
+  return v;
+}
+
+void softmax(std::vector<double> &x)
+{
+  double max = *std::max_element(x.begin(), x.end());
+  double sum = 0.;
+  for (size_t i = 0 ; i < x.size() ; i++)
+    sum += (x[i] = exp(x[i] - max));
+  for (size_t i = 0 ; i < x.size() ; i++)
+    x[i] /= sum;
+}
+
+double max_difference(const float *a, const std::vector<double> &b)
+{
+  double d = 0.;
+  for (size_t i = 0 ; i < b.size() ; i++)
+    d = std::max(d, std::fabs(a[i] - b[i]));
+  return d;
+}
+
+/* GMM with equal priors */
+ClassifierLayerSpec make_gmm()
+{
+  ClassifierLayerSpec s = {CLASSIFIER_GMM, CLASSIFIER_SOFTMAX, MFCC_SIZE, GMM_CLASSES, 0, GMM_MIX, {}};
+  int n = GMM_CLASSES * GMM_MIX;
+
+  std::vector<float> mean = random_vector(n * MFCC_SIZE, 1.);
+  std::vector<float> inv_var(n * MFCC_SIZE);
+  std::vector<float> cst(n);
+
+  for (int g = 0 ; g < n ; g++)
+  {
+    double log_det = 0.;
+    for (int i = 0 ; i < MFCC_SIZE ; i++)
+    {
+      inv_var[g * MFCC_SIZE + i] = 0.5 + std::fabs(noise(gen));
+      log_det += log(inv_var[g * MFCC_SIZE + i] / (2. * M_PI));
+    }
+    cst[g] = log(1. / GMM_MIX) + 0.5 * log_det;
+  }
+
+  s.params.insert(s.params.end(), cst.begin(), cst.end());
+  s.params.insert(s.params.end(), mean.begin(), mean.end());
+  s.params.insert(s.params.end(), inv_var.begin(), inv_var.end());
+
+  return s;
+}
+
+std::vector<double> gmm_reference(const ClassifierLayerSpec &s, const float *x)
+{
+  int n = GMM_CLASSES * GMM_MIX;
+  const float *cst = s.params.data();
+  const float *mean = cst + n;
+  const float *inv_var = mean + n * MFCC_SIZE;
+
+  std::vector<double> ll(GMM_CLASSES);
+  for (int c = 0 ; c < GMM_CLASSES ; c++)
+  {
+    double sum = 0.;
+    for (int m = 0 ; m < GMM_MIX ; m++)
+    {
+      int g = c * GMM_MIX + m;
+      double d2 = 0.;
+      for (int i = 0 ; i < MFCC_SIZE ; i++)
+      {
+        double d = x[i] - mean[g * MFCC_SIZE + i];
+        d2 += d * d * inv_var[g * MFCC_SIZE + i];
+      }
+      sum += exp(cst[g] - 0.5 * d2);
+    }
+    ll[c] = log(sum);
+  }
+
+  softmax(ll);
+  return ll;
+}
+
+int test_gmm()
+{
+  int errors = 0;
+  ClassifierLayerSpec gmm = make_gmm();
+
+  if (!classifier_write(MODEL_FILE, MFCC_SIZE, {gmm}))
+    return 1;
+
+  Classifier clf;
+  if (!clf.load(MODEL_FILE) || clf.n_classes != GMM_CLASSES || clf.input_dim != MFCC_SIZE)
+    return 1;
+
+  double max_error = 0.;
+  std::vector<float> x(MFCC_SIZE);
+
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int t = 0 ; t < N_TEST ; t++)
+  {
+    // frames near the means of random classes
+    int g = t % (GMM_CLASSES * GMM_MIX);
+    for (int i = 0 ; i < MFCC_SIZE ; i++)
+      x[i] = gmm.params[GMM_CLASSES * GMM_MIX + g * MFCC_SIZE + i] + 0.3 * noise(gen);
+
+    const float *p = clf.process(x.data());
+    max_error = std::max(max_error, max_difference(p, gmm_reference(gmm, x.data())));
+  }
+  double t_frame = double(e3e_monotonic_ns() - t0) * 1e-3 / N_TEST;
+
+  std::cout << "GMM: max error " << max_error << ", " << t_frame << " us per frame" << std::endl;
+  if (!(max_error < 1e-5))
+    errors++;
+
+  // the stage classifies one channel of the coefficient major features
+  ClassifierStage stage(&clf, MFCC_SIZE, CHANNELS, 2, N_SLOTS);
+  std::vector<float> features(N_TEST * MFCC_SIZE * CHANNELS);
+  std::vector<PipelineFrame> frames(N_TEST);
+
+  for (int t = 0 ; t < N_TEST ; t++)
+  {
+    for (int i = 0 ; i < MFCC_SIZE * CHANNELS ; i++)
+      features[t * MFCC_SIZE * CHANNELS + i] = noise(gen);
+    frames[t].index = t;
+    frames[t].features = &features[t * MFCC_SIZE * CHANNELS];
+    frames[t].probabilities = NULL;
+  }
+
+  double stage_error = 0.;
+  for (int t = 0 ; t < N_TEST ; t += 4)
+  {
+    int n = std::min(4, N_TEST - t);
+    stage.process(&frames[t], n);
+
+    for (int f = t ; f < t + n ; f++)
+    {
+      for (int i = 0 ; i < MFCC_SIZE ; i++)
+        x[i] = features[f * MFCC_SIZE * CHANNELS + i * CHANNELS + 2];
+      stage_error = std::max(stage_error, max_difference(frames[f].probabilities, gmm_reference(gmm, x.data())));
+    }
+  }
+
+  std::cout << "GMM stage: max error " << stage_error << std::endl;
+  if (!(stage_error < 1e-5) || !stage.valid)
+    errors++;
+
+  // all the channels at once are more features than the model takes
+  ClassifierStage wrong(&clf, MFCC_SIZE, CHANNELS, -1, N_SLOTS);
+  frames[0].probabilities = NULL;
+  wrong.process(&frames[0], 1);
+  std::cout << "GMM stage of all the channels: refused " << !wrong.valid << std::endl;
+  if (wrong.valid || frames[0].probabilities != NULL)
+    errors++;
+
+  return errors;
+}
+
+int test_conv_mlp()
+{
+  int errors = 0;
+
+  ClassifierLayerSpec conv = {CLASSIFIER_CONV1D, CLASSIFIER_RELU, MFCC_SIZE, CONV_OUT, CONV_KERNEL, 0,
+    random_vector(CONV_OUT * CONV_KERNEL * MFCC_SIZE + CONV_OUT, 0.3)};
+  ClassifierLayerSpec hidden = {CLASSIFIER_DENSE, CLASSIFIER_TANH, CONV_OUT, HIDDEN, 0, 0,
+    random_vector(HIDDEN * CONV_OUT + HIDDEN, 0.3)};
+  ClassifierLayerSpec output = {CLASSIFIER_DENSE, CLASSIFIER_SOFTMAX, HIDDEN, MLP_CLASSES, 0, 0,
+    random_vector(MLP_CLASSES * HIDDEN + MLP_CLASSES, 1.)};
+
+  if (!classifier_write(MODEL_FILE, MFCC_SIZE, {conv, hidden, output}))
+    return 1;
+
+  Classifier clf;
+  if (!clf.load(MODEL_FILE) || clf.n_classes != MLP_CLASSES)
+    return 1;
+
+  std::vector<float> x = random_vector(N_TEST * MFCC_SIZE, 1.);
+  double max_error = 0.;
+  double t_total = 0.;
+
+  for (int t = 0 ; t < N_TEST ; t++)
+  {
+    uint64_t t0 = e3e_monotonic_ns();
+    const float *p = clf.process(&x[t * MFCC_SIZE]);
+    t_total += double(e3e_monotonic_ns() - t0);
+
+    // causal convolution, zero before the start
+    std::vector<double> h1(CONV_OUT), h2(HIDDEN), y(MLP_CLASSES);
+    for (int o = 0 ; o < CONV_OUT ; o++)
+    {
+      double acc = conv.params[CONV_OUT * CONV_KERNEL * MFCC_SIZE + o];
+      for (int k = 0 ; k < CONV_KERNEL ; k++)
+      {
+        int f = t - (CONV_KERNEL - 1) + k;
+        if (f < 0)
+          continue;
+        for (int i = 0 ; i < MFCC_SIZE ; i++)
+          acc += conv.params[(o * CONV_KERNEL + k) * MFCC_SIZE + i] * x[f * MFCC_SIZE + i];
+      }
+      h1[o] = std::max(acc, 0.);
+    }
+
+    for (int o = 0 ; o < HIDDEN ; o++)
+    {
+      double acc = hidden.params[HIDDEN * CONV_OUT + o];
+      for (int i = 0 ; i < CONV_OUT ; i++)
+        acc += hidden.params[o * CONV_OUT + i] * h1[i];
+      h2[o] = tanh(acc);
+    }
+
+    for (int o = 0 ; o < MLP_CLASSES ; o++)
+    {
+      double acc = output.params[MLP_CLASSES * HIDDEN + o];
+      for (int i = 0 ; i < HIDDEN ; i++)
+        acc += output.params[o * HIDDEN + i] * h2[i];
+      y[o] = acc;
+    }
+    softmax(y);
+
+    max_error = std::max(max_error, max_difference(p, y));
+  }
+
+  std::cout << "conv1d + MLP: max error " << max_error << ", " << t_total * 1e-3 / N_TEST << " us per frame" << std::endl;
+  if (!(max_error < 1e-5))
+    errors++;
+
+  // after a reset the stream starts over
+  clf.reset();
+  const float *p0 = clf.process(&x[0]);
+  std::vector<float> first(p0, p0 + MLP_CLASSES);
+  clf.reset();
+  const float *again = clf.process(&x[0]);
+  for (int c = 0 ; c < MLP_CLASSES ; c++)
+    if (first[c] != again[c])
+      errors++;
+
+  return errors;
+}
+
+int test_invalid()
+{
+  int errors = 0;
+  Classifier clf;
+
+  // missing file and wrong magic
+  if (clf.load("./no_such_model.e3ec"))
+    errors++;
+
+  std::ofstream fout(MODEL_FILE, std::ofstream::binary | std::ofstream::trunc);
+  fout << "this is not a model, but it is long enough";
+  fout.close();
+  if (clf.load(MODEL_FILE))
+    errors++;
+
+  // parameters that do not match the dimensions
+  ClassifierLayerSpec bad = {CLASSIFIER_DENSE, CLASSIFIER_LINEAR, MFCC_SIZE, 2, 0, 0, random_vector(5, 1.)};
+  classifier_write(MODEL_FILE, MFCC_SIZE, {bad});
+  if (clf.load(MODEL_FILE))
+    errors++;
+
+  // layers that do not chain
+  ClassifierLayerSpec a = {CLASSIFIER_DENSE, CLASSIFIER_RELU, MFCC_SIZE, 4, 0, 0, random_vector(4 * MFCC_SIZE + 4, 1.)};
+  ClassifierLayerSpec b = {CLASSIFIER_DENSE, CLASSIFIER_SOFTMAX, 5, 2, 0, 0, random_vector(2 * 5 + 2, 1.)};
+  classifier_write(MODEL_FILE, MFCC_SIZE, {a, b});
+  if (clf.load(MODEL_FILE))
+    errors++;
+
+  // dimensions whose product wraps around in 32 bits, 14 * 306783379 = 2^32 + 10
+  ClassifierLayerSpec small = {CLASSIFIER_DENSE, CLASSIFIER_LINEAR, MFCC_SIZE, 2, 0, 0, random_vector(2 * MFCC_SIZE + 2, 1.)};
+  classifier_write(MODEL_FILE, MFCC_SIZE, {small});
+  ClassifierLayerHeader lh;
+  std::fstream fio(MODEL_FILE, std::fstream::binary | std::fstream::in | std::fstream::out);
+  fio.seekg(sizeof(ClassifierFileHeader));
+  fio.read((char *)&lh, sizeof(lh));
+  lh.out_dim = 306783379;
+  lh.n_params = 10;
+  fio.seekp(sizeof(ClassifierFileHeader));
+  fio.write((const char *)&lh, sizeof(lh));
+  fio.close();
+  if (clf.load(MODEL_FILE))
+    errors++;
+
+  std::cout << "invalid models accepted: " << errors << std::endl;
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  int errors = test_gmm() + test_conv_mlp() + test_invalid();
+
+  remove(MODEL_FILE);
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the classifier is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <string.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/fastmath.h"
+
+/*
+ * Measure the error of fast_log over all the normal positive floats
+ * (every 17th one) and of fast_exp over its input range, for the array
+ * versions (SIMD when compiled for it) and the scalar ones, and check
+ * them against the documented bounds. Then compare the speed with the
+ * libm functions.
+ */
+
+#define BLOCK 4096
+#define N_SPEED 1000
+
+int main(int argc, char **argv)
+{
+  std::vector<float> in(BLOCK), out(BLOCK);
+  double log_error = 0., exp_error = 0., scalar_error = 0.;
+
+  std::cout << "# fastmath path: " << fastmath_isa() << std::endl;
+
+  // log, over the bit patterns of the normal positive floats
+  uint32_t first, last;
+  float f = FLT_MIN;
+  memcpy(&first, &f, sizeof(first));
+  f = FLT_MAX;
+  memcpy(&last, &f, sizeof(last));
+
+  int n = 0;
+  for (uint64_t b = first ; b <= last ; b += 17)
+  {
+    uint32_t bits = uint32_t(b);
+    memcpy(&in[n++], &bits, sizeof(float));
+
+    if (n == BLOCK || b + 17 > last)
+    {
+      fast_log_array(in.data(), out.data(), n);
+      for (int i = 0 ; i < n ; i++)
+      {
+        double exact = std::log(double(in[i]));
+        double scale = std::max(1., std::fabs(exact));
+        log_error = std::max(log_error, std::fabs(out[i] - exact) / scale);
+        scalar_error = std::max(scalar_error, std::fabs(fast_log(in[i]) - exact) / scale);
+      }
+      n = 0;
+    }
+  }
+
+  // exp, over the input range
+  int n_exp = 1000000;
+  for (int j = 0 ; j < n_exp ; j += BLOCK)
+  {
+    n = std::min(BLOCK, n_exp - j);
+    for (int i = 0 ; i < n ; i++)
+      in[i] = FASTMATH_EXP_MIN + (FASTMATH_EXP_MAX - FASTMATH_EXP_MIN) * float(j + i) / float(n_exp);
+
+    fast_exp_array(in.data(), out.data(), n);
+    for (int i = 0 ; i < n ; i++)
+    {
+      double exact = std::exp(double(in[i]));
+      exp_error = std::max(exp_error, std::fabs(out[i] - exact) / exact);
+      scalar_error = std::max(scalar_error, std::fabs(fast_exp(in[i]) - exact) / exact);
+    }
+  }
+
+  std::cout << "fast_log max error: " << log_error << " (bound " << FAST_LOG_MAX_ERROR << ")" << std::endl;
+  std::cout << "fast_exp max rel error: " << exp_error << " (bound " << FAST_EXP_MAX_REL_ERROR << ")" << std::endl;
+  std::cout << "scalar max error: " << scalar_error << std::endl;
+
+  // speed on typical mel energies
+  for (int i = 0 ; i < BLOCK ; i++)
+    in[i] = 1e-3f + float(i) * 10.f;
+
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int r = 0 ; r < N_SPEED ; r++)
+    for (int i = 0 ; i < BLOCK ; i++)
+      out[i] = std::log(in[i]);
+  double t_libm = double(e3e_monotonic_ns() - t0) / (N_SPEED * BLOCK);
+  float check = out[BLOCK / 2];
+
+  t0 = e3e_monotonic_ns();
+  for (int r = 0 ; r < N_SPEED ; r++)
+    fast_log_array(in.data(), out.data(), BLOCK);
+  double t_fast = double(e3e_monotonic_ns() - t0) / (N_SPEED * BLOCK);
+  check -= out[BLOCK / 2];
+
+  std::cout << "log: libm " << t_libm << " ns, fast " << t_fast << " ns per value (" << check << ")" << std::endl;
+
+  if (log_error > FAST_LOG_MAX_ERROR || exp_error > FAST_EXP_MAX_REL_ERROR
+      || scalar_error > std::max(FAST_LOG_MAX_ERROR, FAST_EXP_MAX_REL_ERROR))
+  {
+    std::cout << "** Ouch the fast math is not accurate enough!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "../src/e3e_detection.h"
+#include "../src/features.h"
+
+/*
+ * Stream random MFCC-like frames through DeltaCMVN and compare with the
+ * normalization and the regressions computed offline over the whole
+ * sequence (in double precision, with the first and last frames repeated
+ * at the edges).
+ */
+
+#define MFCC_SIZE 13
+#define CHANNELS 8
+#define DIM (MFCC_SIZE * CHANNELS)
+#define N_FRAMES 500
+#define WINDOW 2
+#define ALPHA 0.99
+
+int main(int argc, char **argv)
+{
+  std::mt19937 gen(0);
+  std::normal_distribution<float> noise(0., 1.);
+
+  // frames with an offset and a slow drift per coefficient
+  std::vector<float> x(N_FRAMES * DIM);
+  for (int t = 0 ; t < N_FRAMES ; t++)
+    for (int i = 0 ; i < DIM ; i++)
+      x[t * DIM + i] = 10. * (i % MFCC_SIZE) + 0.01 * t + (1. + i % 3) * noise(gen);
+
+  // streaming
+  DeltaCMVN post(DIM, WINDOW, ALPHA);
+  std::vector<float> out(N_FRAMES * 3 * DIM);
+  int n_out = 0, order_errors = 0;
+
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int t = 0 ; t < N_FRAMES ; t++)
+  {
+    if (post.push(&x[t * DIM], &out[n_out * 3 * DIM]))
+      n_out++;
+    if (t >= 2 * WINDOW && n_out != t - 2 * WINDOW + 1)
+      order_errors++;
+  }
+  double t_push = double(e3e_monotonic_ns() - t0) * 1e-3 / N_FRAMES;
+
+  while (post.flush(&out[n_out * 3 * DIM]))
+    n_out++;
+
+  // offline reference
+  std::vector<double> c((N_FRAMES + 4 * WINDOW) * DIM), d(c.size()), dd(c.size());
+  std::vector<double> mean(DIM, 0.), var(DIM, 0.);
+  double weight = 0.;
+
+  for (int t = 0 ; t < N_FRAMES ; t++)
+  {
+    weight = ALPHA * weight + 1.;
+    double g = 1. / weight;
+    for (int i = 0 ; i < DIM ; i++)
+    {
+      double delta = x[t * DIM + i] - mean[i];
+      mean[i] += g * delta;
+      var[i] = (1. - g) * (var[i] + g * delta * delta);
+      c[(t + 2 * WINDOW) * DIM + i] = (x[t * DIM + i] - mean[i]) / sqrt(var[i] + CMVN_EPSILON);
+    }
+  }
+
+  // repeat the edges
+  for (int t = 0 ; t < 2 * WINDOW ; t++)
+    for (int i = 0 ; i < DIM ; i++)
+    {
+      c[t * DIM + i] = c[2 * WINDOW * DIM + i];
+      c[(N_FRAMES + 2 * WINDOW + t) * DIM + i] = c[(N_FRAMES + 2 * WINDOW - 1) * DIM + i];
+    }
+
+  double norm = 0.;
+  for (int n = 1 ; n <= WINDOW ; n++)
+    norm += 2. * n * n;
+
+  for (int t = WINDOW ; t < N_FRAMES + 3 * WINDOW ; t++)
+    for (int i = 0 ; i < DIM ; i++)
+    {
+      d[t * DIM + i] = 0.;
+      for (int n = 1 ; n <= WINDOW ; n++)
+        d[t * DIM + i] += n * (c[(t + n) * DIM + i] - c[(t - n) * DIM + i]) / norm;
+    }
+
+  // the deltas before the start are the first one
+  for (int t = 0 ; t < WINDOW ; t++)
+    for (int i = 0 ; i < DIM ; i++)
+      d[(t + WINDOW) * DIM + i] = d[2 * WINDOW * DIM + i];
+
+  double max_error = 0.;
+  for (int t = 0 ; t < N_FRAMES ; t++)
+  {
+    int T = t + 2 * WINDOW;
+    for (int i = 0 ; i < DIM ; i++)
+    {
+      double ddv = 0.;
+      for (int n = 1 ; n <= WINDOW ; n++)
+        ddv += n * (d[(T + n) * DIM + i] - d[(T - n) * DIM + i]) / norm;
+
+      const float *o = &out[t * 3 * DIM];
+      max_error = std::max(max_error, std::fabs(o[i] - c[T * DIM + i]) / (1. + std::fabs(c[T * DIM + i])));
+      max_error = std::max(max_error, std::fabs(o[DIM + i] - d[T * DIM + i]) / (1. + std::fabs(d[T * DIM + i])));
+      max_error = std::max(max_error, std::fabs(o[2 * DIM + i] - ddv) / (1. + std::fabs(ddv)));
+    }
+  }
+
+  std::cout << "Frames: " << n_out << " max error: " << max_error;
+  std::cout << " push: " << t_push << " us per frame" << std::endl;
+
+  if (n_out != N_FRAMES || order_errors > 0 || !(max_error < 1e-4))
+  {
+    std::cout << "** Ouch the delta/CMVN stage is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+
+#include <time.h>
+#include <iostream>
+#include <complex>
+#include <cmath>
+#include <vector>
+#include <random>
+
+#include "../src/e3e_detection.h"
+#include "../src/fft_backend.h"
+
+/*
+ * Compares the builtin backend to FFTW for all the sizes
+ * and channel counts it supports.
+ */
+
+std::default_random_engine generator(12345);
+std::uniform_real_distribution<float> dist(-1.,1.);
+
+int main(int argc, char **argv)
+{
+  std::vector<int> fft_size = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+  std::vector<int> channels = { 1, 2, 4, 8 };
+  std::vector<int> dct_size = { 12, 13, 14, 16, 20, 24, 26, 32, 40 };
+  int failures = 0;
+
+  for (size_t i = 0 ; i < fft_size.size() ; i++)
+    for (size_t c = 0 ; c < channels.size() ; c++)
+    {
+      int n = fft_size[i];
+      int ch = channels[c];
+
+      std::vector<float> in(n * ch);
+      std::vector<e3e_complex> X_fftw((n / 2 + 1) * ch), X_builtin((n / 2 + 1) * ch);
+
+      RealFFT *ref = make_real_fft(FFT_BACKEND_FFTW, n, ch, ch, 1);
+      RealFFT *fft = make_real_fft(FFT_BACKEND_BUILTIN, n, ch, ch, 1);
+
+      for (int j = 0 ; j < n * ch ; j++)
+        in[j] = dist(generator);
+
+      ref->forward(in.data(), X_fftw.data());
+      fft->forward(in.data(), X_builtin.data());
+
+      double error = 0., energy = 0.;
+      for (int j = 0 ; j < (n / 2 + 1) * ch ; j++)
+      {
+        error += std::norm(X_fftw[j] - X_builtin[j]);
+        energy += std::norm(X_fftw[j]);
+      }
+
+      bool ok = error / energy < 1e-10;
+      if (!ok)
+        failures++;
+
+      std::cout << "fft " << n << "x" << ch << ": relative error " << error / energy;
+      std::cout << (ok ? "" : "  ** Ouch this is too large!! **") << std::endl;
+
+      delete ref;
+      delete fft;
+    }
+
+  for (size_t i = 0 ; i < dct_size.size() ; i++)
+  {
+    int n = dct_size[i];
+    std::vector<float> in(n), y_fftw(n), y_builtin(n);
+
+    DCT2 *ref = make_dct2(FFT_BACKEND_FFTW, n);
+    DCT2 *dct = make_dct2(FFT_BACKEND_BUILTIN, n);
+
+    for (int j = 0 ; j < n ; j++)
+      in[j] = dist(generator);
+
+    ref->forward(in.data(), y_fftw.data());
+    dct->forward(in.data(), y_builtin.data());
+
+    double error = 0., energy = 0.;
+    for (int j = 0 ; j < n ; j++)
+    {
+      error += (y_fftw[j] - y_builtin[j]) * (y_fftw[j] - y_builtin[j]);
+      energy += y_fftw[j] * y_fftw[j];
+    }
+
+    bool ok = error / energy < 1e-10;
+    if (!ok)
+      failures++;
+
+    std::cout << "dct " << n << ": relative error " << error / energy;
+    std::cout << (ok ? "" : "  ** Ouch this is too large!! **") << std::endl;
+
+    delete ref;
+    delete dct;
+  }
+
+  std::cout << "Failures: " << failures << std::endl;
+
+  return failures > 0;
+}
@@ -0,0 +1,189 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/srpphat.h"
+#include "../src/mfcc.h"
+#include "../src/fixed_point.h"
+
+/*
+ * Conformance of the fixed-point path with the float path. A far field
+ * white noise source is simulated on the array of the CONFIG file (as
+ * tests/synthetic_data/gen_data.py does, with fractional delays and
+ * sensor noise at 20 dB SNR), quantized to int16, and processed by
+ * STFT/SRPPHAT/MFCC on the same samples converted back to float and by
+ * STFTQ15/SRPPHATQ15/MFCCQ15. The DOA must agree within a couple of grid
+ * points and the log-mel energies and cepstra within a small error.
+ */
+
+#define FFT_SIZE 256
+#define CHANNELS 8
+#define NFRAMES 10
+#define FS 16000
+#define N_TEST 60
+
+#define SRP_N_GRID 360
+#define SRP_NFRAMES 8
+#define SRP_K_MIN 2
+#define SRP_K_LEN 60
+#define SRP_DIM 2
+#define DOA_TOLERANCE 2
+
+#define MFCC_SIZE 24
+
+// int16 samples per unit of the float signal
+#define GAIN 3000.
+#define SNR_DB 20.
+
+#define CONFIG_FILE "./CONFIG"
+#define C 343.
+
+#define SINC_HALF 16
+
+/* the microphone signals of a source in direction phi, interleaved */
+std::vector<float> simulate(float phi, int n_samples, float *mics)
+{
+  std::mt19937 gen(1);
+  std::normal_distribution<float> noise(0., 1.);
+
+  int len = n_samples + 2 * SINC_HALF + 8;
+  std::vector<float> src(len);
+  for (int n = 0 ; n < len ; n++)
+    src[n] = noise(gen);
+
+  // far field delays in samples, the earliest microphone has zero delay
+  std::vector<float> delays(CHANNELS);
+  for (int c = 0 ; c < CHANNELS ; c++)
+    delays[c] = -(cos(phi) * mics[3 * c] + sin(phi) * mics[3 * c + 1]) / C * FS;
+  float d_min = *std::min_element(delays.begin(), delays.end());
+
+  float sigma = pow(10., -SNR_DB / 20.);
+
+  std::vector<float> y(n_samples * CHANNELS);
+  for (int c = 0 ; c < CHANNELS ; c++)
+  {
+    float d = delays[c] - d_min;
+
+    // Hann windowed sinc fractional delay
+    for (int n = 0 ; n < n_samples ; n++)
+    {
+      double acc = 0.;
+      for (int t = -SINC_HALF ; t <= SINC_HALF ; t++)
+      {
+        double x = t - (d - floor(d));
+        double h = fabs(x) < 1e-9 ? 1. : sin(M_PI * x) / (M_PI * x);
+        h *= 0.5 + 0.5 * cos(M_PI * x / (SINC_HALF + 1));
+        acc += h * src[n + SINC_HALF + 8 - int(floor(d)) - t];
+      }
+      y[n * CHANNELS + c] = acc + sigma * noise(gen);
+    }
+  }
+
+  return y;
+}
+
+int main(int argc, char **argv)
+{
+  // float path
+  STFT stft(FFT_SIZE, NFRAMES, CHANNELS, FFT_BACKEND_BUILTIN);
+  SRPPHAT srpphat(&stft, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
+  MFCC mfcc(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5);
+  MFCCScratch scratch(&mfcc);
+
+  // fixed-point path
+  STFTQ15 stft_q(FFT_SIZE, NFRAMES, CHANNELS);
+  SRPPHATQ15 srp_q(&stft_q, &srpphat);
+  MFCCQ15 mfcc_q(&mfcc, GAIN);
+
+  // source at -2pi/3 like the synthetic data, grid point 240
+  float phi = -2. * M_PI / 3.;
+  std::vector<float> x = simulate(phi, N_TEST * FFT_SIZE, srpphat.mics_loc);
+
+  std::vector<int16_t> pcm(x.size());
+  for (size_t i = 0 ; i < x.size() ; i++)
+    pcm[i] = int16_t(std::max(-32768., std::min(32767., floor(x[i] * GAIN + 0.5))));
+
+  std::vector<float> log_mel(CHANNELS * MFCC_SIZE), cepstra(CHANNELS * MFCC_SIZE);
+  std::vector<int32_t> log_mel_q(MFCC_SIZE), cepstra_q(CHANNELS * MFCC_SIZE);
+
+  double t_float = 0., t_fixed = 0.;
+  double max_log_error = 0., max_cep_error = 0.;
+  int doa_errors = 0, doa_float = -1, doa_fixed = -1;
+
+  for (int f = 0 ; f < N_TEST ; f++)
+  {
+    const int16_t *block = pcm.data() + f * FFT_SIZE * CHANNELS;
+
+    uint64_t t0 = e3e_monotonic_ns();
+
+    float *in = stft.get_in_buffer();
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      in[i] = float(block[i]) / float(GAIN);
+    stft.transform();
+    doa_float = srpphat.process();
+    mfcc.transform_batch(stft.get_fd_frame(0), stft.bin_stride, stft.channel_stride, 0,
+        CHANNELS, 1, cepstra.data(), &scratch);
+
+    uint64_t t1 = e3e_monotonic_ns();
+
+    int16_t *in_q = stft_q.get_in_buffer();
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      in_q[i] = block[i];
+    stft_q.transform();
+    doa_fixed = srp_q.process();
+    mfcc_q.transform_stft(&stft_q, stft_q.frame_count - 1, cepstra_q.data());
+
+    uint64_t t2 = e3e_monotonic_ns();
+
+    t_float += double(t1 - t0);
+    t_fixed += double(t2 - t1);
+
+    // the DOA once the window of the SRP is full
+    if (f >= SRP_NFRAMES)
+    {
+      int d = std::abs(doa_fixed - doa_float);
+      d = std::min(d, SRP_N_GRID - d);
+      if (d > DOA_TOLERANCE)
+        doa_errors++;
+    }
+
+    mfcc.log_mel_batch(stft.get_fd_frame(0), stft.bin_stride, stft.channel_stride, 0,
+        CHANNELS, 1, log_mel.data(), &scratch);
+
+    for (int c = 0 ; c < CHANNELS ; c++)
+    {
+      mfcc_q.log_mel_q16(stft_q.re_at(f, c), stft_q.im_at(f, c), stft_q.exponent_at(f, c), log_mel_q.data());
+
+      for (int m = 0 ; m < MFCC_SIZE ; m++)
+      {
+        max_log_error = std::max(max_log_error,
+            double(std::fabs(q16_to_float(log_mel_q[m]) - log_mel[c * MFCC_SIZE + m])));
+        max_cep_error = std::max(max_cep_error,
+            double(std::fabs(q16_to_float(cepstra_q[c * MFCC_SIZE + m]) - cepstra[c * MFCC_SIZE + m])));
+      }
+    }
+  }
+
+  std::cout << "DOA float: " << doa_float << " fixed: " << doa_fixed << " disagreements: " << doa_errors << std::endl;
+  std::cout << "max log-mel error: " << max_log_error << " max cepstral error: " << max_cep_error << std::endl;
+  std::cout << "float: " << t_float * 1e-3 / N_TEST << " us per frame, fixed: " << t_fixed * 1e-3 / N_TEST << " us per frame";
+#ifdef E3E_Q15_NEON
+  std::cout << " (NEON)";
+#endif
+  std::cout << std::endl;
+
+  int d_truth = std::abs(doa_fixed - 240);
+  d_truth = std::min(d_truth, SRP_N_GRID - d_truth);
+
+  if (doa_errors > 0 || d_truth > DOA_TOLERANCE || !(max_log_error < 0.05) || !(max_cep_error < 0.1))
+  {
+    std::cout << "** Ouch the fixed-point path is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
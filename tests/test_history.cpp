@@ -0,0 +1,247 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/capture.h"
+#include "../src/history.h"
+#include "../src/audio_codec.h"
+
+/*
+ * A capture thread pushes numbered blocks to a HistoryRing while clips
+ * are triggered. The WAV files must have the span around the event with
+ * the exact samples, or silence for the blocks counted as lost when the
+ * ring is too short for the writer, and the pushes must never wait for
+ * the writer. Also check that a CaptureThread feeds the history with
+ * every block, including the ones dropped by the capture ring. The
+ * compressed clips must decode to the same samples.
+ */
+
+#define FS 16000
+#define BLOCK 128
+#define CHANNELS 8
+#define CLIP_PREFIX "./test_history_clip"
+
+int16_t pattern(uint64_t b, int i)
+{
+  return int16_t((b * 31 + i * 7) % 30000) - 15000;
+}
+
+void fill(std::vector<int16_t> &block, uint64_t b)
+{
+  for (int i = 0 ; i < BLOCK * CHANNELS ; i++)
+    block[i] = pattern(b, i);
+}
+
+/* the samples of a compressed clip, empty if it is invalid */
+std::vector<int16_t> decode_clip(const std::vector<char> &data)
+{
+  std::vector<int16_t> pcm;
+  const uint8_t *p = (const uint8_t *)data.data();
+
+  AudioDecoder dec;
+  if (!dec.read_header(p, data.size()) || dec.header.data_offset != HISTORY_IO_ALIGN
+      || dec.channels != CHANNELS || dec.header.fs != FS)
+    return pcm;
+
+  std::vector<int16_t> frame(dec.frame_size * CHANNELS);
+  size_t offset = dec.header.data_offset;
+  while (offset < data.size())
+  {
+    int n;
+    size_t bytes = dec.decode(p + offset, data.size() - offset, frame.data(), n);
+    if (bytes == 0)
+      return std::vector<int16_t>();
+    pcm.insert(pcm.end(), frame.begin(), frame.begin() + n * CHANNELS);
+    offset += bytes;
+  }
+
+  return pcm;
+}
+
+/* check the header and the blocks [first, first + n_blocks) of a clip, returns the errors */
+int check_clip(const std::string &path, uint64_t first, uint64_t n_blocks, uint64_t n_lost)
+{
+  std::ifstream fin(path, std::ifstream::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+  int errors = 0;
+  size_t block_bytes = BLOCK * CHANNELS * sizeof(int16_t);
+  std::vector<int16_t> pcm;
+
+  if (path.size() > 5 && path.substr(path.size() - 5) == ".e3ea")
+    pcm = decode_clip(data);
+  else
+  {
+    uint16_t channels, bits;
+    uint32_t fs, data_bytes;
+    memcpy(&channels, &data[22], 2);
+    memcpy(&fs, &data[24], 4);
+    memcpy(&bits, &data[34], 2);
+    memcpy(&data_bytes, &data[HISTORY_IO_ALIGN - 4], 4);
+
+    if (memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[HISTORY_IO_ALIGN - 8], "data", 4) != 0
+        || channels != CHANNELS || fs != FS || bits != 16)
+      errors++;
+
+    if (data.size() != HISTORY_IO_ALIGN + data_bytes)
+      return errors + 1;
+
+    pcm.resize(data_bytes / sizeof(int16_t));
+    memcpy(pcm.data(), &data[HISTORY_IO_ALIGN], data_bytes);
+  }
+
+  if (pcm.size() * sizeof(int16_t) != n_blocks * block_bytes)
+    return errors + 1;
+
+  uint64_t silent = 0;
+  for (uint64_t b = 0 ; b < n_blocks ; b++)
+  {
+    const int16_t *x = &pcm[b * BLOCK * CHANNELS];
+
+    bool zero = true, match = true;
+    for (int i = 0 ; i < BLOCK * CHANNELS ; i++)
+    {
+      zero = zero && x[i] == 0;
+      match = match && x[i] == pattern(first + b, i);
+    }
+
+    if (zero)
+      silent++;
+    else if (!match)
+      errors++;
+  }
+
+  if (silent != n_lost)
+    errors++;
+
+  return errors;
+}
+
+int test_clips(int n_ring, int n_push, int event, float pre, float post, int push_sleep_us, bool compress,
+    const char *name)
+{
+  HistoryRing history(CHANNELS, BLOCK, n_ring);
+  ClipWriter clips(&history, CLIP_PREFIX, FS, pre, post, 8, compress);
+
+  std::string clip_path;
+  std::atomic<uint64_t> clip_blocks(0), clip_lost(0);
+  std::atomic<bool> done(false);
+  clips.on_clip = [&](const std::string &path, uint64_t n_blocks, uint64_t n_lost)
+  {
+    clip_path = path;
+    clip_blocks = n_blocks;
+    clip_lost = n_lost;
+    done = true;
+  };
+  clips.start();
+
+  // the capture thread, with a timestamp of 8 ms per block
+  std::vector<int16_t> block(BLOCK * CHANNELS);
+  uint64_t max_push_ns = 0;
+
+  for (int b = 0 ; b < n_push ; b++)
+  {
+    fill(block, b);
+
+    uint64_t t0 = e3e_monotonic_ns();
+    history.push(block.data(), b, uint64_t(b + 1) * 8000000);
+    max_push_ns = std::max(max_push_ns, e3e_monotonic_ns() - t0);
+
+    if (b == event)
+      clips.trigger(uint64_t(b + 1) * 8000000);
+
+    if (push_sleep_us > 0)
+      usleep(push_sleep_us);
+  }
+
+  clips.stop();
+
+  int errors = 0;
+  if (!done)
+    return 1;
+
+  uint64_t first = event - clips.pre_blocks;
+  uint64_t expected = clips.pre_blocks + 1 + clips.post_blocks;
+  if (clip_blocks != expected)
+    errors++;
+
+  errors += check_clip(clip_path, first, clip_blocks, clip_lost);
+  remove(clip_path.c_str());
+
+  std::cout << name << ": blocks " << clip_blocks << " lost " << clip_lost << " direct I/O " << clips.direct_io;
+  std::cout << " max push " << max_push_ns * 1e-3 << " us, " << clips.n_bytes << " bytes, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_capture()
+{
+  int errors = 0;
+  int n_blocks = 500;
+
+  // a consumer that never reads: most blocks are dropped by the capture ring
+  CaptureRing ring(CHANNELS, BLOCK, 4);
+  HistoryRing history(CHANNELS, BLOCK, 1000, 1.);
+
+  int n_read = 0;
+  CaptureThread reader(&ring, [&](float *block)
+      {
+        if (n_read == n_blocks)
+          return false;
+        for (int i = 0 ; i < BLOCK * CHANNELS ; i++)
+          block[i] = pattern(n_read, i);
+        n_read++;
+        return true;
+      });
+  reader.set_history(&history);
+  reader.start();
+
+  while (reader.running)
+    usleep(1000);
+  reader.stop();
+
+  if (history.head != uint64_t(n_blocks) || ring.overruns != uint64_t(n_blocks - 4))
+    errors++;
+
+  for (int b = 0 ; b < n_blocks ; b++)
+  {
+    if (history.sequences[b] != uint64_t(b))
+      errors++;
+    for (int i = 0 ; i < BLOCK * CHANNELS ; i++)
+      if (history.block(b)[i] != pattern(b, i))
+        errors++;
+  }
+
+  std::cout << "capture: history " << history.head << " blocks, overruns " << ring.overruns;
+  std::cout << ", errors " << errors << std::endl;
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  int errors = 0;
+
+  // a ring of 10 s, a clip of 1 s before and 0.5 s after
+  errors += test_clips(1250, 600, 300, 1., 0.5, 100, false, "clip");
+  errors += test_clips(1250, 600, 300, 1., 0.5, 100, true, "compressed clip");
+
+  // the writer cannot keep up with a ring of 32 blocks, but the pushes never wait
+  errors += test_clips(32, 20000, 100, 0.1, 100., 0, false, "short ring");
+
+  errors += test_capture();
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the audio history is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <stdint.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+
+/*
+ * Checks the fused PCM ingest against a plain reference loop
+ * for all the layouts and preprocessing modes.
+ */
+
+#define FFT_SIZE 128
+#define NFRAMES 4
+#define CHANNELS 8
+#define PCM_CHANNELS 10
+
+std::default_random_engine generator(7);
+std::uniform_int_distribution<int> dist(-32768, 32767);
+
+int main(int argc, char **argv)
+{
+  int16_t pcm[FFT_SIZE * PCM_CHANNELS];
+  int remap[CHANNELS] = { 9, 7, 5, 3, 1, 0, 2, 4 };
+  float window[FFT_SIZE];
+  float scale = 1. / 32768.;
+  float coef = 0.97;
+  int failures = 0;
+
+  for (int n = 0 ; n < FFT_SIZE ; n++)
+    window[n] = 0.5 - 0.5 * cos(2 * M_PI * n / FFT_SIZE);
+
+  for (int mode = PREPROC_NONE ; mode <= PREPROC_PRE_EMPHASIS ; mode++)
+    for (int layout = PCM_INTERLEAVED ; layout <= PCM_PLANAR ; layout++)
+    {
+      STFT engine(FFT_SIZE, NFRAMES, CHANNELS);
+      engine.set_window(window);
+      engine.set_ingest_scale(scale);
+      engine.set_preprocessing(mode, coef);
+
+      float x_prev[CHANNELS] = {0}, y_prev[CHANNELS] = {0};
+      double error = 0.;
+
+      // a few blocks so that the filter state is carried over
+      for (int block = 0 ; block < 3 ; block++)
+      {
+        for (int i = 0 ; i < FFT_SIZE * PCM_CHANNELS ; i++)
+          pcm[i] = dist(generator);
+
+        float *buf = engine.ingest(pcm, layout, remap, PCM_CHANNELS);
+
+        for (int n = 0 ; n < FFT_SIZE ; n++)
+          for (int ch = 0 ; ch < CHANNELS ; ch++)
+          {
+            float x;
+            if (layout == PCM_PLANAR)
+              x = pcm[remap[ch] * FFT_SIZE + n];
+            else
+              x = pcm[n * PCM_CHANNELS + remap[ch]];
+
+            float y = x;
+            if (mode == PREPROC_DC_REMOVAL)
+              y = x - x_prev[ch] + coef * y_prev[ch];
+            else if (mode == PREPROC_PRE_EMPHASIS)
+              y = x - coef * x_prev[ch];
+            x_prev[ch] = x;
+            y_prev[ch] = y;
+
+            double e = buf[n * CHANNELS + ch] - scale * window[n] * y;
+            error += e * e;
+          }
+
+        engine.transform();
+      }
+
+      bool ok = error < 1e-8;
+      if (!ok)
+        failures++;
+
+      std::cout << "mode " << mode << " layout " << layout << ": error " << error;
+      std::cout << (ok ? "" : "  ** Ouch this is too large!! **") << std::endl;
+    }
+
+  std::cout << "Failures: " << failures << std::endl;
+
+  return failures > 0;
+}
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/instrument.h"
+#include "../src/stft.h"
+
+/*
+ * Check the buckets of the histograms (every value in its bucket, a bucket
+ * not wider than 1 / INSTR_SUB of its values), the records of several
+ * threads in a snapshot (exact counts, sums and maximum, percentiles
+ * within a bucket), the mapped and text exports, and, when compiled in,
+ * the probes of the STFT on and off. Prints the cost of a probe.
+ */
+
+#define THREADS 4
+#define RECORDS 10000
+#define SNAPSHOT_FILE "./test_instrument.snap"
+#define TEXT_FILE "./test_instrument.txt"
+
+int test_buckets()
+{
+  int errors = 0;
+
+  uint64_t x = 88172645463325252ull;
+  for (int i = 0 ; i < 100000 ; i++)
+  {
+    // values spread over all the powers of two
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    uint64_t v = x >> (24 + i % 40);
+
+    int b = instrument_bucket(v);
+    uint64_t low = instrument_bucket_value(b);
+    uint64_t high = instrument_bucket_value(b + 1);
+    if (b < 0 || b >= INSTR_N_BUCKETS || v < low || v >= high || (high - low) * INSTR_SUB > std::max(low, uint64_t(INSTR_SUB)))
+      errors++;
+  }
+
+  for (int b = 0 ; b < INSTR_N_BUCKETS ; b++)
+    if (instrument_bucket(instrument_bucket_value(b)) != b)
+      errors++;
+
+  if (instrument_bucket(uint64_t(1) << 50) != INSTR_N_BUCKETS - 1)
+    errors++;
+
+  std::cout << "Buckets: " << INSTR_N_BUCKETS << ", errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_record()
+{
+  int errors = 0;
+
+  instrument_reset();
+
+  // thread t records (t + 1) * 1, ..., (t + 1) * RECORDS us
+  std::vector<std::thread> threads;
+  for (int t = 0 ; t < THREADS ; t++)
+    threads.push_back(std::thread([t]()
+    {
+      for (int i = 1 ; i <= RECORDS ; i++)
+        instrument_record(INSTR_OUTPUT, uint64_t(t + 1) * i * 1000);
+      instrument_count(INSTR_CLIPS, t + 1);
+    }));
+  for (int t = 0 ; t < THREADS ; t++)
+    threads[t].join();
+
+  InstrumentSnapshot *s = (InstrumentSnapshot *)e3e_aligned_malloc(sizeof(InstrumentSnapshot));
+  instrument_snapshot(s);
+  const InstrumentHistogram &h = s->probes[INSTR_OUTPUT];
+
+  uint64_t sum = 0;
+  std::vector<double> values;
+  for (int t = 0 ; t < THREADS ; t++)
+    for (int i = 1 ; i <= RECORDS ; i++)
+    {
+      sum += uint64_t(t + 1) * i * 1000;
+      values.push_back((t + 1) * i);
+    }
+  std::sort(values.begin(), values.end());
+
+  if (h.count != THREADS * RECORDS || h.sum_ns != sum || h.max_ns != uint64_t(THREADS) * RECORDS * 1000
+      || s->counters[INSTR_CLIPS] != THREADS * (THREADS + 1) / 2 || s->probes[INSTR_STFT].count != 0)
+    errors++;
+
+  double p[] = { 1., 50., 90., 99., 99.9, 100. };
+  for (double q : p)
+  {
+    double exact = values[size_t(ceil(q / 100. * values.size())) - 1];
+    if (fabs(h.percentile_us(q) - exact) > exact / INSTR_SUB)
+      errors++;
+  }
+
+  std::cout << "Record: " << h.count << " values, p50 " << h.percentile_us(50.) << " us for " << values[values.size() / 2 - 1];
+  std::cout << ", p99 " << h.percentile_us(99.) << " us, errors " << errors << std::endl;
+
+  free(s);
+
+  return errors;
+}
+
+int test_export()
+{
+  int errors = 0;
+
+  InstrumentSnapshot *s = (InstrumentSnapshot *)e3e_aligned_malloc(sizeof(InstrumentSnapshot));
+
+  {
+    InstrumentExporter exporter(SNAPSHOT_FILE, 10);
+    exporter.start();
+    for (int i = 0 ; i < 100 ; i++)
+    {
+      instrument_record(INSTR_CLIP_WRITE, 1000);
+      usleep(500);
+    }
+    exporter.stop();
+
+    if (exporter.n_exports < 2)
+      errors++;
+  }
+
+  if (!instrument_read(SNAPSHOT_FILE, s) || s->probes[INSTR_CLIP_WRITE].count != 100
+      || s->probes[INSTR_OUTPUT].count != THREADS * RECORDS || s->sequence.load() % 2 != 0)
+    errors++;
+
+  InstrumentExporter text(TEXT_FILE, 1000, INSTR_EXPORT_TEXT);
+  if (!text.export_now())
+    errors++;
+
+  std::ifstream fin(TEXT_FILE);
+  std::string line;
+  int lines = 0;
+  bool found = false;
+  while (std::getline(fin, line))
+  {
+    lines++;
+    found |= line.compare(0, 11, "clip_write ") == 0;
+  }
+  if (!found || lines != 2 + 2 + INSTR_N_COUNTERS)
+    errors++;
+
+  remove(SNAPSHOT_FILE);
+  remove(TEXT_FILE);
+  free(s);
+
+  std::cout << "Export: " << lines << " lines of text, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_probes()
+{
+  int errors = 0;
+
+#ifdef E3E_INSTRUMENT
+  InstrumentSnapshot *s = (InstrumentSnapshot *)e3e_aligned_malloc(sizeof(InstrumentSnapshot));
+  STFT stft(128, 4, 8);
+
+  instrument_reset();
+  for (int i = 0 ; i < 50 ; i++)
+    stft.transform();
+
+  instrument_enable(false);
+  for (int i = 0 ; i < 50 ; i++)
+    stft.transform();
+  instrument_enable(true);
+
+  instrument_snapshot(s);
+  if (s->probes[INSTR_STFT].count != 50 || s->probes[INSTR_STFT].max_ns == 0)
+    errors++;
+
+  std::cout << "Probes: stft p50 " << s->probes[INSTR_STFT].percentile_us(50.) << " us, errors " << errors << std::endl;
+  free(s);
+#else
+  std::cout << "Probes: compiled out" << std::endl;
+#endif
+
+  // the cost of an empty probe, on and off
+  const int n = 1000000;
+  double cost[2];
+  for (int on = 0 ; on < 2 ; on++)
+  {
+    instrument_enable(on == 1);
+    uint64_t t0 = e3e_monotonic_ns();
+    for (int i = 0 ; i < n ; i++)
+      InstrumentScope scope(INSTR_CAPTURE_READ);
+    cost[on] = double(e3e_monotonic_ns() - t0) / n;
+  }
+  instrument_enable(true);
+
+  std::cout << "Cost of a probe: " << cost[0] << " ns off, " << cost[1] << " ns on" << std::endl;
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  int errors = 0;
+
+  errors += test_buckets();
+  errors += test_record();
+  errors += test_export();
+  errors += test_probes();
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the instrumentation is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,82 @@
+
+#include <time.h>
+#include <iostream>
+#include <complex>
+#include <cmath>
+#include <random>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/srpphat.h"
+#include "../src/mfcc.h"
+
+/*
+ * Compares the interleaved and the planar layouts of the STFT
+ * for the transform and for the two consumers, SRP-PHAT and MFCC.
+ */
+
+#define FFT_SIZE 128
+#define NFRAMES 100
+#define CHANNELS 8
+#define FS 16000
+#define C 343.
+
+#define SRP_N_GRID 360
+#define SRP_NFRAMES 8
+#define SRP_K_MIN 10
+#define SRP_K_LEN 40
+#define SRP_DIM 2
+
+#define MFCC_SIZE 14
+
+#define CONFIG_FILE "./CONFIG"
+
+std::default_random_engine generator(1);
+std::uniform_real_distribution<float> dist(-1.,1.);
+
+void time_layout(int layout, int backend)
+{
+  STFT engine(FFT_SIZE, NFRAMES, CHANNELS, backend, layout);
+  SRPPHAT srpphat(&engine, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
+  MFCC mfcc(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5, backend);
+  float features[MFCC_SIZE * CHANNELS];
+
+  clock_t t_stft = 0, t_srp = 0, t_mfcc = 0, now;
+
+  for (int frame = 0 ; frame < NFRAMES ; frame++)
+  {
+    float *buf_ptr = engine.get_in_buffer();
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      buf_ptr[i] = dist(generator);
+
+    now = clock();
+    engine.transform();
+    t_stft += clock() - now;
+
+    now = clock();
+    srpphat.process();
+    t_srp += clock() - now;
+
+    now = clock();
+    mfcc.transform_stft(&engine, 0, features);
+    t_mfcc += clock() - now;
+  }
+
+  double scale = 1e6 / CLOCKS_PER_SEC / NFRAMES;
+
+  std::cout << (layout == STFT_LAYOUT_PLANAR ? "planar" : "interleaved") << " ";
+  std::cout << fft_backend_name(backend) << ": ";
+  std::cout << "stft " << t_stft * scale << " us, ";
+  std::cout << "srpphat " << t_srp * scale << " us, ";
+  std::cout << "mfcc " << t_mfcc * scale << " us per frame" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  time_layout(STFT_LAYOUT_INTERLEAVED, FFT_BACKEND_FFTW);
+  time_layout(STFT_LAYOUT_PLANAR, FFT_BACKEND_FFTW);
+  time_layout(STFT_LAYOUT_INTERLEAVED, FFT_BACKEND_BUILTIN);
+  time_layout(STFT_LAYOUT_PLANAR, FFT_BACKEND_BUILTIN);
+
+  return 0;
+}
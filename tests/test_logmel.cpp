@@ -0,0 +1,132 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/mfcc.h"
+#include "../src/logmel.h"
+
+/*
+ * Compare the log-mel rows read from the STFT ring, in both layouts and
+ * with a channel map, of a beamformed spectrum and of two beams side by
+ * side, with the log-mel energies of MFCC::log_mel_batch. Also check that
+ * the rolling buffer keeps the last n_rows rows.
+ */
+
+#define FFT_SIZE 256
+#define CHANNELS 8
+#define NFRAMES 4
+#define MFCC_SIZE 24
+#define N_ROWS 6
+#define N_TEST 50
+#define FS 16000
+
+int run(int layout)
+{
+  STFT stft(FFT_SIZE, NFRAMES, CHANNELS, FFT_BACKEND_FFTW, layout);
+  MFCC mfcc(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5);
+  MFCCScratch scratch(&mfcc);
+
+  int map[CHANNELS];
+  for (int c = 0 ; c < CHANNELS ; c++)
+    map[c] = CHANNELS - 1 - c;
+
+  std::vector<float> spectrogram(N_ROWS * CHANNELS * MFCC_SIZE);
+  LogMel logmel(&mfcc, spectrogram.data(), N_ROWS, CHANNELS, map);
+
+  std::vector<float> beam_rows(N_ROWS * MFCC_SIZE);
+  LogMel beam_logmel(&mfcc, beam_rows.data(), N_ROWS, 1);
+
+  // the beam and its opposite, bin major, swapped by the map
+  int pair_map[2] = { 1, 0 };
+  std::vector<float> pair_rows(N_ROWS * 2 * MFCC_SIZE);
+  LogMel pair_logmel(&mfcc, pair_rows.data(), N_ROWS, 2, pair_map);
+  std::vector<e3e_complex> pair(2 * stft.n_bins);
+
+  std::vector<float> ref(CHANNELS * MFCC_SIZE), beam_ref(MFCC_SIZE);
+  std::vector<float> history(N_TEST * CHANNELS * MFCC_SIZE);
+  std::vector<e3e_complex> beam(stft.n_bins);
+
+  std::mt19937 gen(layout);
+  std::normal_distribution<float> noise(0., 1.);
+
+  int errors = 0;
+
+  for (int f = 0 ; f < N_TEST ; f++)
+  {
+    float *in = stft.get_in_buffer();
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      in[i] = noise(gen);
+    stft.transform();
+
+    float *row = logmel.process(&stft);
+
+    mfcc.log_mel_batch(stft.get_fd_frame(0), stft.bin_stride, stft.channel_stride, 0,
+        CHANNELS, 1, ref.data(), &scratch);
+
+    for (int c = 0 ; c < CHANNELS ; c++)
+      for (int m = 0 ; m < MFCC_SIZE ; m++)
+        if (row[c * MFCC_SIZE + m] != ref[map[c] * MFCC_SIZE + m])
+          errors++;
+
+    for (int i = 0 ; i < CHANNELS * MFCC_SIZE ; i++)
+      history[f * CHANNELS * MFCC_SIZE + i] = row[i];
+
+    // delay and sum with no delay, as a stand-in for a beamformer
+    for (int k = 0 ; k < stft.n_bins ; k++)
+    {
+      beam[k] = 0.;
+      for (int c = 0 ; c < CHANNELS ; c++)
+        beam[k] += stft.get_fd_sample(0, k, c);
+    }
+
+    float *beam_row = beam_logmel.process_spectrum(beam.data(), 1);
+    mfcc.log_mel_batch(beam.data(), 1, 0, 0, 1, 1, beam_ref.data(), &scratch);
+
+    for (int m = 0 ; m < MFCC_SIZE ; m++)
+      if (beam_row[m] != beam_ref[m])
+        errors++;
+
+    for (int k = 0 ; k < stft.n_bins ; k++)
+    {
+      pair[2 * k] = beam[k];
+      pair[2 * k + 1] = beam[k] - 2.f * stft.get_fd_sample(0, k, 0);
+    }
+
+    float *pair_row = pair_logmel.process_spectrum(pair.data(), 2, 1);
+    mfcc.log_mel_batch(pair.data(), 2, 1, 0, 2, 1, ref.data(), &scratch);
+
+    for (int c = 0 ; c < 2 ; c++)
+      for (int m = 0 ; m < MFCC_SIZE ; m++)
+        if (pair_row[c * MFCC_SIZE + m] != ref[pair_map[c] * MFCC_SIZE + m])
+          errors++;
+  }
+
+  // the rolling buffer holds the last N_ROWS frames
+  for (long f = N_TEST - N_ROWS ; f < N_TEST ; f++)
+    for (int i = 0 ; i < CHANNELS * MFCC_SIZE ; i++)
+      if (logmel.row_at(f)[i] != history[f * CHANNELS * MFCC_SIZE + i])
+        errors++;
+
+  if (logmel.latest() != logmel.row_at(N_TEST - 1))
+    errors++;
+
+  std::cout << (layout == STFT_LAYOUT_PLANAR ? "planar" : "interleaved") << ": errors " << errors << std::endl;
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  int errors = run(STFT_LAYOUT_INTERLEAVED) + run(STFT_LAYOUT_PLANAR);
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the log-mel spectrogram is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -11,6 +11,7 @@
 #include "../src/e3e_detection.h"
 #include "../src/stft.h"
 #include "../src/mfcc.h"
+#include "../src/fastmath.h"
 
 #define FFT_SIZE 128
 #define FRAME_SIZE 128
@@ -143,4 +144,25 @@ int main(int argc, char **argv)
 
   std::cout << "Error: " << error / CHANNELS << std::endl;
 
+  // the same with the fast log, against the reference and the exact path
+  MFCC mfcc_fast(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5);
+  mfcc_fast.set_log_mode(MFCC_LOG_FAST);
+  float features_fast[MFCC_SIZE * CHANNELS];
+  mfcc_fast.transform(X, features_fast, CHANNELS);
+
+  double error_fast = 0., max_diff = 0.;
+  for (int i = 0 ; i < MFCC_SIZE ; i++)
+  {
+    for (int c = 0 ; c < CHANNELS ; c++)
+    {
+      float ref = c == 0 ? result1[i] : result2[i];
+      double e = features_fast[i * CHANNELS + c] - ref;
+      error_fast += e*e;
+      max_diff = std::max(max_diff, double(std::fabs(features_fast[i * CHANNELS + c] - features[i * CHANNELS + c])));
+    }
+  }
+
+  std::cout << "Error (fast log, " << fastmath_isa() << "): " << error_fast / CHANNELS;
+  std::cout << " max difference with exact log: " << max_diff << std::endl;
+
 }
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <random>
+#include <cmath>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/mfcc.h"
+
+/*
+ * Compute the MFCC of a long multichannel recording with transform_batch
+ * from several threads sharing one MFCC object, and compare with the
+ * frame by frame transform_many. Both DCT paths are checked: the matrix
+ * product (13 coefficients) and the FFTW many-plan (40 coefficients).
+ */
+
+#define FFT_SIZE 512
+#define CHANNELS 8
+#define N_FRAMES 1000
+#define N_THREADS 4
+#define FS 16000
+
+int check(int mfcc_size, const std::vector<e3e_complex> &spectra, int frame_size)
+{
+  MFCC mfcc(mfcc_size, FFT_SIZE, FS, 0., 0.5);
+  int out_size = mfcc_size * CHANNELS;
+
+  // reference, one frame at a time
+  std::vector<float> ref(N_FRAMES * out_size);
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int f = 0 ; f < N_FRAMES ; f++)
+    mfcc.transform_many(const_cast<e3e_complex *>(spectra.data()) + f * frame_size, CHANNELS, 1,
+        ref.data() + f * out_size, 1, mfcc_size, CHANNELS);
+  double t_ref = (e3e_monotonic_ns() - t0) * 1e-3 / N_FRAMES;
+
+  // the recording split between the threads, one scratch each
+  std::vector<float> out(N_FRAMES * out_size);
+  std::vector<std::thread> threads;
+  int per_thread = (N_FRAMES + N_THREADS - 1) / N_THREADS;
+
+  t0 = e3e_monotonic_ns();
+  for (int t = 0 ; t < N_THREADS ; t++)
+  {
+    threads.push_back(std::thread([&, t]()
+          {
+            MFCCScratch scratch(&mfcc);
+            int f0 = t * per_thread;
+            int nf = std::min(per_thread, N_FRAMES - f0);
+            mfcc.transform_batch(spectra.data() + f0 * frame_size, CHANNELS, 1, frame_size,
+                CHANNELS, nf, out.data() + f0 * out_size, &scratch);
+          }));
+  }
+  for (size_t t = 0 ; t < threads.size() ; t++)
+    threads[t].join();
+  double t_batch = (e3e_monotonic_ns() - t0) * 1e-3 / N_FRAMES;
+
+  double max_error = 0.;
+  for (int i = 0 ; i < N_FRAMES * out_size ; i++)
+  {
+    if (!std::isfinite(out[i]) || !std::isfinite(ref[i]))
+    {
+      max_error = INFINITY;
+      break;
+    }
+
+    double e = std::fabs(out[i] - ref[i]) / (1. + std::fabs(ref[i]));
+    if (e > max_error)
+      max_error = e;
+  }
+
+  std::cout << "mfcc_size " << mfcc_size << ": frame by frame " << t_ref << " us, batch ("
+    << N_THREADS << " threads) " << t_batch << " us per frame, max error " << max_error << std::endl;
+
+  return max_error < 1e-5 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+  STFT engine(FFT_SIZE, 1, CHANNELS);
+  int frame_size = engine.n_samples_per_out_frame;
+
+  std::mt19937 gen(0);
+  std::normal_distribution<float> noise(0., 1.);
+
+  // the spectra of the whole recording
+  std::vector<e3e_complex> spectra(N_FRAMES * frame_size);
+  for (int f = 0 ; f < N_FRAMES ; f++)
+  {
+    float *in = engine.get_in_buffer();
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      in[i] = noise(gen);
+
+    e3e_complex *X = engine.transform();
+    for (int i = 0 ; i < frame_size ; i++)
+      spectra[f * frame_size + i] = X[i];
+  }
+
+  int errors = check(13, spectra, frame_size) + check(40, spectra, frame_size);
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the batched MFCC is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/recording.h"
+#include "../src/mic_array.h"
+
+/*
+ * Replay a recording whose blocks are filled with their number through
+ * ReplayMicArray: in real time the reads must be paced by the block
+ * period plus the jitter, as fast as possible they must not wait, the
+ * injected drops must be the gaps in the numbers and be the same for the
+ * same seed, and a reader later than the buffer of the device must lose
+ * the oldest blocks and then get the buffered ones at once.
+ */
+
+#define FS 16000
+#define CHANNELS 8
+#define BLOCK 128
+#define NBLOCKS 2000
+#define PERIOD_NS (uint64_t(BLOCK) * 1000000000ull / FS)
+
+#define RECORDING_FILE "./test_mic_array.rec"
+
+// the number of a block, -1 if its samples differ
+int block_number(const int16_t *pcm)
+{
+  for (int i = 1 ; i < BLOCK * CHANNELS ; i++)
+    if (pcm[i] != pcm[0])
+      return -1;
+  return pcm[0];
+}
+
+int test_pace(MappedRecording *rec, int jitter_us)
+{
+  int errors = 0;
+  int n = 50;
+
+  rec->seek(0);
+  ReplayMicArray mics(rec, BLOCK);
+  mics.jitter_us = jitter_us;
+
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int b = 0 ; b < n ; b++)
+  {
+    const int16_t *pcm = (const int16_t *)mics.read(BLOCK);
+    if (pcm == NULL || block_number(pcm) != b)
+      errors++;
+  }
+  uint64_t elapsed = e3e_monotonic_ns() - t0;
+
+  // never early, and not more than the jitter and some scheduling late
+  if (elapsed < n * PERIOD_NS || elapsed > n * PERIOD_NS + uint64_t(jitter_us) * 1000 + 20000000)
+    errors++;
+  if (mics.max_wait_ns > PERIOD_NS + uint64_t(jitter_us) * 1000 || mics.n_blocks != uint64_t(n))
+    errors++;
+
+  std::cout << "Real time, jitter " << jitter_us << " us: " << n << " blocks in " << elapsed * 1e-6;
+  std::cout << " ms (" << n * PERIOD_NS * 1e-6 << " ms), longest wait " << mics.max_wait_ns * 1e-6;
+  std::cout << " ms, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_drops(MappedRecording *rec, std::vector<int> *received, uint64_t seed)
+{
+  int errors = 0;
+
+  rec->seek(0);
+  ReplayMicArray mics(rec, BLOCK, seed);
+  mics.speed = 0.;
+  mics.drop_rate = 0.1;
+
+  uint64_t t0 = e3e_monotonic_ns();
+  int expected = 0, gaps = 0;
+  const int16_t *pcm;
+  while ((pcm = (const int16_t *)mics.read(BLOCK)) != NULL)
+  {
+    int b = block_number(pcm);
+    if (b < expected)
+      errors++;
+    gaps += b - expected;
+    expected = b + 1;
+    received->push_back(b);
+  }
+  uint64_t elapsed = e3e_monotonic_ns() - t0;
+
+  // the drops at the very end are not gaps
+  gaps += NBLOCKS - expected;
+
+  if (uint64_t(gaps) != mics.n_dropped || mics.n_blocks + mics.n_dropped != NBLOCKS || mics.n_late != 0)
+    errors++;
+  if (mics.n_dropped < NBLOCKS / 20 || mics.n_dropped > NBLOCKS / 5 || mics.max_wait_ns != 0)
+    errors++;
+
+  std::cout << "As fast as possible, drop rate " << mics.drop_rate << ": " << mics.n_blocks << " blocks in ";
+  std::cout << elapsed * 1e-6 << " ms, " << mics.n_dropped << " dropped, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_late(MappedRecording *rec)
+{
+  int errors = 0;
+  int stall = 10, stall_periods = 12;
+
+  rec->seek(0);
+  ReplayMicArray mics(rec, BLOCK);
+
+  int expected = 0, gaps = 0, fast = 0;
+  for (int b = 0 ; b < 30 ; b++)
+  {
+    uint64_t t0 = e3e_monotonic_ns();
+    const int16_t *pcm = (const int16_t *)mics.read(BLOCK);
+    if (pcm == NULL)
+      return 1;
+
+    // the blocks buffered while the reader was away come at once
+    if (b > stall && b <= stall + MIC_ARRAY_DEVICE_BLOCKS && e3e_monotonic_ns() - t0 < PERIOD_NS / 4)
+      fast++;
+
+    int n = block_number(pcm);
+    if (n < expected)
+      errors++;
+    gaps += n - expected;
+    expected = n + 1;
+
+    if (b == stall)
+      usleep(stall_periods * PERIOD_NS / 1000);
+  }
+
+  // the device keeps MIC_ARRAY_DEVICE_BLOCKS, the others are lost
+  if (uint64_t(gaps) != mics.n_late || mics.n_late < uint64_t(stall_periods - MIC_ARRAY_DEVICE_BLOCKS - 1)
+      || fast < MIC_ARRAY_DEVICE_BLOCKS - 1)
+    errors++;
+
+  std::cout << "Late reader: " << mics.n_late << " blocks lost, " << fast << " buffered, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  int errors = 0;
+
+  std::vector<int16_t> pcm(NBLOCKS * BLOCK * CHANNELS);
+  for (size_t i = 0 ; i < pcm.size() ; i++)
+    pcm[i] = int16_t(i / (BLOCK * CHANNELS));
+  recording_write(RECORDING_FILE, pcm.data(), NBLOCKS * BLOCK, CHANNELS, FS, RECORDING_INT16);
+
+  MappedRecording rec;
+  if (!rec.open(RECORDING_FILE))
+    return 1;
+
+  errors += test_pace(&rec, 0);
+  errors += test_pace(&rec, 2000);
+
+  // the same seed drops the same blocks, another one does not
+  std::vector<int> first, second, other;
+  errors += test_drops(&rec, &first, 1);
+  errors += test_drops(&rec, &second, 1);
+  errors += test_drops(&rec, &other, 2);
+  if (first != second || first == other)
+    errors++;
+
+  errors += test_late(&rec);
+
+  rec.close();
+  remove(RECORDING_FILE);
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the replayed microphone array is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
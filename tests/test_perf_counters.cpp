@@ -0,0 +1,76 @@
+#include <iostream>
+#include <cmath>
+
+#include "../src/e3e_detection.h"
+#include "../src/perf_counters.h"
+
+/*
+ * Count the events of a loop of known length: the CPU time must be there
+ * and within the wall time, and the hardware events, when the CPU and the
+ * kernel count them (not in most virtual machines), must be consistent
+ * with the loop. The events that are not counted are listed.
+ */
+
+#define ITERATIONS 10000000
+
+int main(int argc, char **argv)
+{
+  int errors = 0;
+
+  PerfCounters perf;
+  if (!perf.open() || !perf.has(PERF_EV_TASK_CLOCK))
+  {
+    std::cout << "** Ouch the performance counters are broken!! **" << std::endl;
+    return 1;
+  }
+
+  PerfSample a, b;
+  volatile float x = 1.f;
+
+  uint64_t t0 = e3e_monotonic_ns();
+  if (!perf.read(&a))
+    errors++;
+  for (int i = 0 ; i < ITERATIONS ; i++)
+    x = x * 0.999999f + 1e-7f;
+  if (!perf.read(&b))
+    errors++;
+  uint64_t wall = e3e_monotonic_ns() - t0;
+
+  uint64_t d[PERF_N_EVENTS];
+  for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+    d[e] = b.values[e] - a.values[e];
+
+  if (d[PERF_EV_TASK_CLOCK] == 0 || d[PERF_EV_TASK_CLOCK] > wall || b.time_enabled < a.time_enabled)
+    errors++;
+
+  // a load, a multiply-add and a store at least per iteration
+  if (perf.has(PERF_EV_CYCLES) && d[PERF_EV_CYCLES] < ITERATIONS)
+    errors++;
+  if (perf.has(PERF_EV_INSTRUCTIONS) && d[PERF_EV_INSTRUCTIONS] < 3ull * ITERATIONS)
+    errors++;
+  if (perf.has(PERF_EV_BRANCH_MISSES) && d[PERF_EV_BRANCH_MISSES] > ITERATIONS / 100)
+    errors++;
+
+  for (int e = 0 ; e < PERF_N_EVENTS ; e++)
+  {
+    std::cout << perf_event_name(e) << ": ";
+    if (perf.has(e))
+      std::cout << d[e] << std::endl;
+    else
+      std::cout << "not counted" << std::endl;
+  }
+  std::cout << "Wall time: " << wall << " ns, running " << b.time_running << " of " << b.time_enabled << " ns";
+  std::cout << ", errors " << errors << std::endl;
+
+  perf.close();
+  if (perf.available() || perf.read(&a))
+    errors++;
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the performance counters are broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
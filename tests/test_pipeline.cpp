@@ -0,0 +1,151 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <unistd.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/srpphat.h"
+#include "../src/mfcc.h"
+#include "../src/capture.h"
+#include "../src/pipeline.h"
+
+/*
+ * Run the staged pipeline on blocks of noise generated from their
+ * sequence number, then redo the same processing serially on the blocks
+ * that were received and check that the DOA and the MFCC are the same.
+ * A pipeline with one frame more in flight than the SRPPHAT allows must
+ * not start.
+ */
+
+#define FFT_SIZE 128
+#define CHANNELS 8
+#define NFRAMES 16
+#define NBLOCKS 400
+
+#define FS 16000
+
+#define SRP_N_GRID 60
+#define SRP_NFRAMES 8
+#define SRP_K_MIN 1
+#define SRP_K_LEN 50
+#define SRP_DIM 2
+
+#define MFCC_SIZE 13
+
+#define MAX_IN_FLIGHT (NFRAMES - SRP_NFRAMES - 1)
+
+#define CONFIG_FILE "./CONFIG"
+
+#define C 343.
+
+void fill_block(float *block, uint64_t sequence)
+{
+  std::mt19937 gen(sequence);
+  std::normal_distribution<float> noise(0., 1.);
+
+  for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+    block[i] = noise(gen);
+}
+
+int main(int argc, char **argv)
+{
+  STFT stft(FFT_SIZE, NFRAMES, CHANNELS);
+  SRPPHAT srpphat(&stft, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
+  MFCC mfcc(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5);
+
+  CaptureRing ring(&stft);
+
+  uint64_t n_read = 0;
+  CaptureThread reader(&ring, [&](float *block)
+      {
+        if (n_read == NBLOCKS)
+          return false;
+        fill_block(block, n_read++);
+        usleep(500);
+        return true;
+      });
+
+  // the results, kept by the output stage
+  std::vector<PipelineFrame> frames;
+  std::vector<std::vector<float> > features;
+  uint64_t stride_errors = 0;
+
+  STFTSourceStage source(&ring, &reader, &stft);
+  SRPPHATStage doa(&srpphat, MAX_IN_FLIGHT + 1);
+  MFCCStage mfcc_stage(&mfcc, &stft, MAX_IN_FLIGHT + 1);
+  OutputStage output([&](const PipelineFrame &frame)
+      {
+        if (frame.index != long(frames.size()))
+          stride_errors++;
+        frames.push_back(frame);
+        features.push_back(std::vector<float>(frame.features, frame.features + MFCC_SIZE * CHANNELS));
+      });
+
+  // one frame too many, the SRPPHAT would drop a frame already overwritten
+  bool refused;
+  {
+    Pipeline too_many(MAX_IN_FLIGHT + 1);
+    too_many.add_stage(&source);
+    too_many.add_stage(&doa);
+    refused = !too_many.start();
+  }
+
+  Pipeline pipeline(MAX_IN_FLIGHT);
+  pipeline.add_stage(&source);
+  pipeline.add_stage(&doa);
+  pipeline.add_stage(&mfcc_stage);
+  pipeline.add_stage(&output);
+
+  if (!refused || !pipeline.start())
+  {
+    std::cout << "** Ouch the pipeline is broken!! **" << std::endl;
+    return 1;
+  }
+  reader.start();
+
+  pipeline.wait();
+  reader.stop();
+
+  // serial reference on the blocks that were received
+  STFT ref_stft(FFT_SIZE, NFRAMES, CHANNELS);
+  SRPPHAT ref_srpphat(&ref_stft, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
+  MFCC ref_mfcc(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5);
+  std::vector<float> ref_features(MFCC_SIZE * CHANNELS);
+
+  uint64_t doa_errors = 0, mfcc_errors = 0, n_searched = 0;
+
+  for (size_t f = 0 ; f < frames.size() ; f++)
+  {
+    fill_block(ref_stft.get_in_buffer(), frames[f].sequence);
+    ref_stft.transform();
+    int argmax = ref_srpphat.process();
+
+    if (frames[f].argmax >= 0)
+    {
+      n_searched++;
+      if (frames[f].argmax != argmax || frames[f].power != ref_srpphat.spatial_spectrum[argmax])
+        doa_errors++;
+    }
+
+    ref_mfcc.transform_many(ref_stft.get_fd_frame(0), ref_stft.bin_stride, ref_stft.channel_stride,
+        ref_features.data(), CHANNELS, 1, CHANNELS);
+    for (int i = 0 ; i < MFCC_SIZE * CHANNELS ; i++)
+      if (std::fabs(features[f][i] - ref_features[i]) > 1e-5 * (1. + std::fabs(ref_features[i])))
+        mfcc_errors++;
+  }
+
+  std::cout << "Frames: " << frames.size() << " Overruns: " << ring.overruns;
+  std::cout << " Searched: " << n_searched << " DOA batches: " << doa.n_batches << std::endl;
+  std::cout << "Errors: order " << stride_errors << " DOA " << doa_errors << " MFCC " << mfcc_errors << std::endl;
+
+  if (frames.size() + ring.overruns != NBLOCKS || n_searched == 0
+      || stride_errors > 0 || doa_errors > 0 || mfcc_errors > 0)
+  {
+    std::cout << "** Ouch the pipeline is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <sstream>
+#include <random>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/srpphat.h"
+#include "../src/quality.h"
+
+/*
+ * Drive the quality controller with simulated frame times: an overload
+ * must degrade the DOA down to the cheapest level, and the headroom that
+ * follows must bring it back to the full quality. Then time the search
+ * at every level on noise.
+ */
+
+#define FFT_SIZE 128
+#define CHANNELS 8
+#define NFRAMES 10
+
+#define FS 16000
+
+#define SRP_N_GRID 60
+#define SRP_NFRAMES 8
+#define SRP_K_MIN 1
+#define SRP_K_LEN 50
+#define SRP_DIM 2
+
+#define CONFIG_FILE "./CONFIG"
+
+#define C 343.
+
+int main(int argc, char **argv)
+{
+  STFT stft(FFT_SIZE, NFRAMES, CHANNELS);
+  SRPPHAT srpphat(&stft, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
+
+  std::stringstream metrics;
+  QualityController quality(&srpphat, FFT_SIZE, FS, &metrics);
+
+  uint64_t deadline = uint64_t(quality.deadline_ns);
+  int last = quality.levels.size() - 1;
+  int errors = 0;
+
+  // overload: every frame takes 1.5 deadline
+  for (int f = 0 ; f < 1000 ; f++)
+    quality.update(deadline * 3 / 2);
+
+  if (quality.level != last || srpphat.grid_step != quality.levels[last].grid_step)
+  {
+    std::cout << "Did not degrade, level " << quality.level << std::endl;
+    errors++;
+  }
+
+  // headroom: 20% load
+  for (int f = 0 ; f < 10000 ; f++)
+    quality.update(deadline / 5);
+
+  if (quality.level != 0 || srpphat.k_step != 1 || srpphat.pair_step != 1 || srpphat.grid_step != 1)
+  {
+    std::cout << "Did not recover, level " << quality.level << std::endl;
+    errors++;
+  }
+
+  // every change is logged, once the writer has written everything
+  quality.close_metrics();
+  int n_lines = 0;
+  std::string line;
+  while (std::getline(metrics, line))
+    if (line.find("degrade") != std::string::npos || line.find("recover") != std::string::npos)
+      n_lines++;
+
+  if (n_lines != int(quality.n_degrade + quality.n_recover) || quality.n_degrade != uint64_t(last)
+      || quality.n_events_lost > 0)
+  {
+    std::cout << "Wrong log: " << n_lines << " lines " << quality.n_degrade << " degrade" << std::endl;
+    errors++;
+  }
+
+  quality.print_summary(std::cout);
+
+  // cost of the search at every level
+  std::mt19937 gen(0);
+  std::normal_distribution<float> noise(0., 1.);
+  for (int f = 0 ; f < SRP_NFRAMES ; f++)
+  {
+    float *in = stft.get_in_buffer();
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      in[i] = noise(gen);
+    stft.transform();
+    srpphat.update(stft.frame_count - 1);
+  }
+
+  for (int l = 0 ; l <= last ; l++)
+  {
+    quality.set_level(l);
+
+    int n_search = 20;
+    uint64_t t0 = e3e_monotonic_ns();
+    for (int i = 0 ; i < n_search ; i++)
+      srpphat.search();
+    double t = (e3e_monotonic_ns() - t0) * 1e-6 / n_search;
+
+    std::cout << "level " << l << " search " << t << " ms per frame "
+      << t / quality.levels[l].doa_every << " ms" << std::endl;
+  }
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the quality controller is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <string.h>
+#include <stdio.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/recording.h"
+
+/*
+ * Write recordings with and without a header, in int16 and float32, and
+ * read them back through MappedRecording: the blocks must point into the
+ * file with the right samples, seeking by time must land on the right
+ * sample, the end must be reported without a partial block, and
+ * read_to must feed the STFT like ingest. Also compare the time of a
+ * full pass with ifstream::read.
+ */
+
+#define FS 16000
+#define CHANNELS 8
+#define BLOCK 128
+#define SECONDS 20
+
+#define INT16_FILE "./test_recording_int16.rec"
+#define FLOAT_FILE "./test_recording_float.raw"
+
+int test_int16(const std::vector<int16_t> &pcm)
+{
+  int errors = 0;
+  int n_samples = pcm.size() / CHANNELS;
+
+  recording_write(INT16_FILE, pcm.data(), n_samples, CHANNELS, FS, RECORDING_INT16);
+
+  // the layout given to open is ignored for a file with a header
+  MappedRecording rec;
+  if (!rec.open(INT16_FILE, 2, 8000, RECORDING_FLOAT32))
+    return 1;
+
+  if (rec.channels != CHANNELS || rec.fs != FS || rec.format != RECORDING_INT16
+      || rec.n_samples != uint64_t(n_samples))
+    errors++;
+
+  // whole blocks only, the partial block at the end is not returned
+  int n_blocks = 0;
+  const int16_t *block;
+  while ((block = (const int16_t *)rec.read(BLOCK)) != NULL)
+  {
+    if (memcmp(block, &pcm[n_blocks * BLOCK * CHANNELS], BLOCK * CHANNELS * sizeof(int16_t)) != 0)
+      errors++;
+    n_blocks++;
+  }
+  if (n_blocks != n_samples / BLOCK || rec.tell() != uint64_t(n_blocks * BLOCK))
+    errors++;
+
+  // seek by time
+  if (!rec.seek_time(1.5) || rec.tell() != uint64_t(1.5 * FS))
+    errors++;
+  block = (const int16_t *)rec.read(BLOCK);
+  if (block == NULL || memcmp(block, &pcm[int(1.5 * FS) * CHANNELS], BLOCK * CHANNELS * sizeof(int16_t)) != 0)
+    errors++;
+  if (rec.seek_time(2. * SECONDS) || rec.block_at(n_samples - 1, 2) != NULL)
+    errors++;
+
+  std::cout << "int16 with header: " << n_blocks << " blocks, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_float(const std::vector<int16_t> &pcm)
+{
+  int errors = 0;
+  int n_samples = pcm.size() / CHANNELS;
+
+  std::vector<float> x(pcm.size());
+  for (size_t i = 0 ; i < x.size() ; i++)
+    x[i] = pcm[i] / 32768.f;
+
+  std::ofstream fout(FLOAT_FILE, std::ofstream::binary | std::ofstream::trunc);
+  fout.write((const char *)x.data(), sizeof(float) * x.size());
+  fout.close();
+
+  // headerless, as tests/synthetic_data/test_signal.raw
+  MappedRecording rec;
+  if (!rec.open(FLOAT_FILE, CHANNELS, FS, RECORDING_FLOAT32) || rec.n_samples != uint64_t(n_samples))
+    return 1;
+
+  // read_to gives the same input frames as ingest
+  STFT a(BLOCK, 4, CHANNELS), b(BLOCK, 4, CHANNELS);
+  for (int f = 0 ; f < 10 ; f++)
+  {
+    if (!rec.read_to(&a))
+      errors++;
+    float *expected = b.ingest(&x[f * BLOCK * CHANNELS]);
+    if (memcmp(a.get_in_buffer(), expected, sizeof(float) * a.n_samples_per_in_frame) != 0)
+      errors++;
+    a.transform();
+    b.transform();
+  }
+
+  // a full pass over the recording, mapped and with ifstream::read into a frame
+  double sum = 0.;
+  rec.seek(0);
+  uint64_t t0 = e3e_monotonic_ns();
+  const float *block;
+  while ((block = (const float *)rec.read(BLOCK)) != NULL)
+    for (int i = 0 ; i < BLOCK * CHANNELS ; i++)
+      sum += block[i];
+  double t_mapped = double(e3e_monotonic_ns() - t0) * 1e-6;
+
+  std::vector<float> frame(BLOCK * CHANNELS);
+  std::ifstream fin(FLOAT_FILE, std::ifstream::binary);
+  double sum_read = 0.;
+  t0 = e3e_monotonic_ns();
+  while (fin.read((char *)frame.data(), sizeof(float) * frame.size()))
+    for (int i = 0 ; i < BLOCK * CHANNELS ; i++)
+      sum_read += frame[i];
+  double t_read = double(e3e_monotonic_ns() - t0) * 1e-6;
+
+  if (sum != sum_read)
+    errors++;
+
+  std::cout << "float32 without header: " << rec.duration() << " s, full pass mapped " << t_mapped;
+  std::cout << " ms, ifstream " << t_read << " ms, errors " << errors << std::endl;
+
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  // a little more than SECONDS, so that the last block is partial
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> uniform(-32768, 32767);
+  std::vector<int16_t> pcm((SECONDS * FS + BLOCK / 2) * CHANNELS);
+  for (size_t i = 0 ; i < pcm.size() ; i++)
+    pcm[i] = uniform(gen);
+
+  int errors = test_int16(pcm) + test_float(pcm);
+
+  remove(INT16_FILE);
+  remove(FLOAT_FILE);
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the recording reader is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
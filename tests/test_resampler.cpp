@@ -0,0 +1,76 @@
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+
+#include "../src/e3e_detection.h"
+#include "../src/resampler.h"
+
+/*
+ * Resamples a sine by several ratios and compares to the ideal
+ * output, delayed by the group delay reported by the resampler.
+ */
+
+#define CHANNELS 8
+#define FS 16000
+#define BLOCK 128
+#define NBLOCKS 50
+#define FREQ 1000.
+
+int main(int argc, char **argv)
+{
+  int ratios[][2] = { { 1, 2 }, { 1, 3 }, { 2, 3 }, { 3, 2 }, { 1, 1 } };
+  int failures = 0;
+
+  for (int r = 0 ; r < 5 ; r++)
+  {
+    int up = ratios[r][0];
+    int down = ratios[r][1];
+
+    Resampler rs(up, down, CHANNELS, BLOCK);
+    std::vector<float> in(BLOCK * CHANNELS);
+    std::vector<float> out(rs.max_output(BLOCK) * CHANNELS);
+
+    double error = 0., energy = 0.;
+    long n_in = 0, n_out = 0;
+
+    for (int block = 0 ; block < NBLOCKS ; block++)
+    {
+      // every channel has a different phase
+      for (int n = 0 ; n < BLOCK ; n++)
+        for (int ch = 0 ; ch < CHANNELS ; ch++)
+          in[n * CHANNELS + ch] = sin(2 * M_PI * FREQ * (n_in + n) / FS + ch);
+      n_in += BLOCK;
+
+      int m = rs.process(in.data(), BLOCK, out.data());
+
+      for (int i = 0 ; i < m ; i++, n_out++)
+      {
+        // skip the transient of the filter
+        if (n_out < 4 * rs.group_delay_out())
+          continue;
+
+        double t = double(n_out) * down / up - rs.group_delay_in();
+        for (int ch = 0 ; ch < CHANNELS ; ch++)
+        {
+          double e = out[i * CHANNELS + ch] - sin(2 * M_PI * FREQ * t / FS + ch);
+          error += e * e;
+          energy += 1.;
+        }
+      }
+    }
+
+    double rel = sqrt(error / energy);
+    bool ok = rel < 1e-2;
+    if (!ok)
+      failures++;
+
+    std::cout << up << "/" << down << ": " << n_out << " samples, group delay ";
+    std::cout << rs.group_delay_out() << ", relative error " << rel;
+    std::cout << (ok ? "" : "  ** Ouch this is too large!! **") << std::endl;
+  }
+
+  std::cout << "Failures: " << failures << std::endl;
+
+  return failures > 0;
+}
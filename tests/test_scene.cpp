@@ -0,0 +1,315 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <string.h>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/srpphat.h"
+#include "../src/scene.h"
+
+/*
+ * Generate scenes with the array of ./CONFIG and check them: SRP-PHAT
+ * must find a far field source and follow a moving one, the levels of a
+ * source close to the array must follow the distance to every
+ * microphone, the reflections of a room must add energy without moving
+ * the DOA, the noise must have the requested SNR, and the same seed must
+ * give the same samples, also after a seek. Also report how much faster
+ * than real time the scenes are generated.
+ */
+
+#define FFT_SIZE 128
+#define CHANNELS 8
+#define NFRAMES 10
+#define FS 16000
+#define C 343.
+
+#define SRP_N_GRID 360
+#define SRP_NFRAMES 8
+#define SRP_K_MIN 1
+#define SRP_K_LEN 50
+#define SRP_DIM 2
+
+#define CONFIG_FILE "./CONFIG"
+
+#define MAX_DOA_ERROR 5.   // degrees
+#define MAX_SNR_ERROR 0.3  // dB
+
+float angle_error(float a, float b)
+{
+  return fabs(atan2(sin(a - b), cos(a - b))) / M_PI * 180.;
+}
+
+// run SRP-PHAT on n_frames frames of the scene, the largest DOA error over the last half
+float doa_error(SceneGenerator *scene, int n_frames, int source = 0)
+{
+  STFT stft(FFT_SIZE, NFRAMES, CHANNELS);
+  SRPPHAT srpphat(&stft, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
+
+  float worst = 0.;
+  for (int f = 0 ; f < n_frames && scene->read_to(&stft) ; f++)
+  {
+    stft.transform();
+    int argmax = srpphat.process();
+
+    // the truth at the middle of the G window
+    float azimuth, elevation;
+    scene->doa(source, scene->tell() - (SRP_NFRAMES * FFT_SIZE) / 2, &azimuth, &elevation);
+    if (f >= n_frames / 2)
+      worst = std::max(worst, angle_error(srpphat.grid[argmax][0], azimuth));
+  }
+
+  return worst;
+}
+
+double power(const float *x, int n, int stride = 1)
+{
+  double p = 0.;
+  for (int i = 0 ; i < n ; i++)
+    p += double(x[i * stride]) * x[i * stride];
+  return p / n;
+}
+
+int test_doa()
+{
+  int errors = 0;
+
+  SceneSource s;
+  s.azimuth = -2. * M_PI / 3.;
+  s.cutoff = 0.5;
+
+  SceneGenerator far(CONFIG_FILE, CHANNELS, FS, C, 1);
+  far.add_source(s);
+  far.set_snr(20.);
+  float e_far = doa_error(&far, 40);
+
+  s.azimuth = 1.;
+  s.azimuth_speed = M_PI / 2.;
+  SceneGenerator moving(CONFIG_FILE, CHANNELS, FS, C, 2);
+  moving.add_source(s);
+  moving.set_snr(20.);
+  float e_moving = doa_error(&moving, 120);
+
+  s.azimuth = 2.5;
+  s.azimuth_speed = 0.;
+  s.distance = 0.5;
+  SceneGenerator near(CONFIG_FILE, CHANNELS, FS, C, 3);
+  near.add_source(s);
+  near.set_snr(20.);
+  float e_near = doa_error(&near, 40);
+
+  SceneRoom room;
+  room.size[0] = 6.; room.size[1] = 5.; room.size[2] = 3.;
+  room.array_pos[0] = 2.; room.array_pos[1] = 2.5; room.array_pos[2] = 1.2;
+  room.absorption = 0.6;
+  room.order = 2;
+  SceneGenerator reverb(CONFIG_FILE, CHANNELS, FS, C, 3);
+  reverb.add_source(s);
+  reverb.set_room(room);
+  reverb.set_snr(20.);
+  float e_reverb = doa_error(&reverb, 40);
+
+  if (e_far > MAX_DOA_ERROR || e_moving > MAX_DOA_ERROR || e_near > MAX_DOA_ERROR || e_reverb > MAX_DOA_ERROR)
+    errors++;
+
+  std::cout << "DOA error (deg): far field " << e_far << " moving " << e_moving << " near field " << e_near;
+  std::cout << " reverberant " << e_reverb << ", errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_levels()
+{
+  int errors = 0;
+  int n = FS;
+
+  // a source 20 cm away on the axis of microphones 0 and 4
+  SceneSource s;
+  s.distance = 0.2;
+  SceneGenerator scene(CONFIG_FILE, CHANNELS, FS, C, 4);
+  scene.add_source(s);
+  std::vector<float> x(n * CHANNELS);
+  scene.generate(x.data(), n);
+
+  float r0 = s.distance - scene.mics_loc[0], r4 = s.distance - scene.mics_loc[4 * 3];
+  double expected = (r4 / r0) * (r4 / r0);
+  double ratio = power(&x[0], n, CHANNELS) / power(&x[4], n, CHANNELS);
+  if (fabs(ratio / expected - 1.) > 0.05)
+    errors++;
+
+  // the same source in a room
+  SceneRoom room;
+  room.size[0] = 4.; room.size[1] = 4.; room.size[2] = 3.;
+  room.array_pos[0] = 2.; room.array_pos[1] = 2.; room.array_pos[2] = 1.5;
+  room.absorption = 0.3;
+  room.order = 2;
+  scene.set_room(room);
+  std::vector<float> y(n * CHANNELS);
+  scene.generate(y.data(), n);
+  double gain = power(&y[4], n, CHANNELS) / power(&x[4], n, CHANNELS);
+  if (gain < 1.05)
+    errors++;
+
+  std::cout << "Near field power ratio " << ratio << " (" << expected << "), room gain " << gain;
+  std::cout << ", errors " << errors << std::endl;
+
+  return errors;
+}
+
+int test_snr()
+{
+  int errors = 0;
+  int n = 4 * FS;
+  float snr = 10.;
+
+  // with the same seed the sources are the same, the difference is the noise
+  SceneSource s0, s1;
+  s0.azimuth = 0.3;
+  s0.cutoff = 0.7;
+  s1.azimuth = 2.;
+  s1.gain = 0.5;
+  s1.signal = SCENE_TONE;
+  s1.frequency = 440.;
+
+  SceneGenerator clean(CONFIG_FILE, CHANNELS, FS, C, 5), noisy(CONFIG_FILE, CHANNELS, FS, C, 5);
+  clean.add_source(s0);
+  clean.add_source(s1);
+  noisy.add_source(s0);
+  noisy.add_source(s1);
+  noisy.set_snr(snr);
+
+  std::vector<float> x(n * CHANNELS), y(n * CHANNELS);
+  clean.generate(x.data(), n);
+  noisy.generate(y.data(), n);
+  for (size_t i = 0 ; i < y.size() ; i++)
+    y[i] -= x[i];
+
+  double signal = power(x.data(), n * CHANNELS);
+  double measured = 10. * log10((1. + 0.25) / power(y.data(), n * CHANNELS));
+  if (fabs(signal / 1.25 - 1.) > 0.05 || fabs(measured - snr) > MAX_SNR_ERROR)
+    errors++;
+
+  std::cout << "Signal power " << signal << " (1.25), SNR " << measured << " dB (" << snr << "), errors ";
+  std::cout << errors << std::endl;
+
+  return errors;
+}
+
+int test_seed()
+{
+  int errors = 0;
+  int n = 3000, skip = 1234;
+
+  SceneSource s;
+  s.azimuth = 1.;
+  s.azimuth_speed = 1.;
+  s.distance = 1.;
+  s.cutoff = 0.3;
+  SceneRoom room;
+  room.size[0] = 5.; room.size[1] = 5.; room.size[2] = 3.;
+  room.array_pos[0] = 2.5; room.array_pos[1] = 2.5; room.array_pos[2] = 1.5;
+
+  SceneGenerator a(CONFIG_FILE, CHANNELS, FS, C, 7), b(CONFIG_FILE, CHANNELS, FS, C, 7);
+  a.add_source(s);
+  a.set_room(room);
+  a.set_snr(15.);
+  b.add_source(s);
+  b.set_room(room);
+  b.set_snr(15.);
+
+  std::vector<float> x(n * CHANNELS);
+  a.generate(x.data(), n);
+
+  // the same samples by blocks of any size, and after a seek
+  const float *block = (const float *)b.read(skip);
+  if (block == NULL || memcmp(block, x.data(), sizeof(float) * skip * CHANNELS) != 0)
+    errors++;
+  block = (const float *)b.read(n - skip);
+  if (block == NULL || memcmp(block, &x[skip * CHANNELS], sizeof(float) * (n - skip) * CHANNELS) != 0)
+    errors++;
+
+  b.seek(skip);
+  block = (const float *)b.read(100);
+  if (b.tell() != uint64_t(skip + 100) || memcmp(block, &x[skip * CHANNELS], sizeof(float) * 100 * CHANNELS) != 0)
+    errors++;
+
+  // another seed, other samples
+  b.set_seed(8);
+  block = (const float *)b.read(n);
+  if (memcmp(block, x.data(), sizeof(float) * n * CHANNELS) == 0)
+    errors++;
+
+  // the end of the scene
+  b.length = FFT_SIZE * 3;
+  b.seek(0);
+  int blocks = 0;
+  while (b.read(FFT_SIZE) != NULL)
+    blocks++;
+  if (blocks != 3)
+    errors++;
+
+  std::cout << "Seeds and seek: errors " << errors << std::endl;
+
+  return errors;
+}
+
+void test_speed()
+{
+  int seconds = 60;
+  int n = FS;
+  std::vector<float> x(n * CHANNELS);
+
+  SceneSource s0, s1;
+  s0.azimuth_speed = 0.2;
+  s1.azimuth = 2.;
+  s1.cutoff = 0.5;
+
+  SceneGenerator scene(CONFIG_FILE, CHANNELS, FS, C, 9);
+  scene.add_source(s0);
+  scene.add_source(s1);
+  scene.set_snr(20.);
+
+  uint64_t t0 = e3e_monotonic_ns();
+  for (int i = 0 ; i < seconds ; i++)
+    scene.generate(x.data(), n);
+  double far = double(e3e_monotonic_ns() - t0) * 1e-9;
+
+  // near field in a room, first order
+  s0.distance = 1.;
+  s1.distance = 1.5;
+  SceneRoom room;
+  room.size[0] = 6.; room.size[1] = 5.; room.size[2] = 3.;
+  room.array_pos[0] = 3.; room.array_pos[1] = 2.5; room.array_pos[2] = 1.5;
+  SceneGenerator reverb(CONFIG_FILE, CHANNELS, FS, C, 9);
+  reverb.add_source(s0);
+  reverb.add_source(s1);
+  reverb.set_room(room);
+  reverb.set_snr(20.);
+
+  t0 = e3e_monotonic_ns();
+  for (int i = 0 ; i < seconds / 4 ; i++)
+    reverb.generate(x.data(), n);
+  double room_time = double(e3e_monotonic_ns() - t0) * 1e-9;
+
+  std::cout << "Speed, 2 sources: far field " << seconds / far << "x real time, room of order 1 ";
+  std::cout << seconds / 4 / room_time << "x real time" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  int errors = 0;
+
+  errors += test_doa();
+  errors += test_levels();
+  errors += test_snr();
+  errors += test_seed();
+  test_speed();
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the scene generator is broken!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,81 @@
+
+#include <iostream>
+#include <complex>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "../src/e3e_detection.h"
+#include "../src/stft.h"
+#include "../src/sdft.h"
+
+/*
+ * Compares the bins of the sliding DFT to the ones of the FFT
+ * at the block boundaries, with and without damping, and checks that a
+ * band beyond the spectrum is refused.
+ */
+
+#define FFT_SIZE 128
+#define NFRAMES 4
+#define CHANNELS 8
+#define K_MIN 10
+#define K_LEN 40
+#define NBLOCKS 1000
+
+std::default_random_engine generator(3);
+std::uniform_real_distribution<float> dist(-1.,1.);
+
+double relative_error(float damping)
+{
+  STFT ref(FFT_SIZE, NFRAMES, CHANNELS);
+  STFT out(FFT_SIZE, NFRAMES, CHANNELS);
+  SlidingDFT sdft(&out, K_MIN, K_LEN, FFT_SIZE, damping);
+
+  double error = 0., energy = 0.;
+
+  for (int block = 0 ; block < NBLOCKS ; block++)
+  {
+    float *buf = ref.get_in_buffer();
+    for (int i = 0 ; i < FFT_SIZE * CHANNELS ; i++)
+      buf[i] = dist(generator);
+
+    ref.transform();
+    sdft.process(buf, FFT_SIZE);
+
+    // only compare the last block, after the errors had time to accumulate
+    if (block < NBLOCKS - 1)
+      continue;
+
+    for (int k = K_MIN ; k < K_MIN + K_LEN ; k++)
+      for (int ch = 0 ; ch < CHANNELS ; ch++)
+      {
+        error += std::norm(ref.get_fd_sample(0, k, ch) - out.get_fd_sample(0, k, ch));
+        energy += std::norm(ref.get_fd_sample(0, k, ch));
+      }
+  }
+
+  return sqrt(error / energy);
+}
+
+int main(int argc, char **argv)
+{
+  double e_exact = relative_error(1.);
+  double e_damped = relative_error(SDFT_DEFAULT_DAMPING);
+
+  std::cout << "Relative error without damping: " << e_exact << std::endl;
+  std::cout << "Relative error with damping " << SDFT_DEFAULT_DAMPING << ": " << e_damped << std::endl;
+
+  STFT stft(FFT_SIZE, NFRAMES, CHANNELS);
+  SlidingDFT beyond(&stft, K_MIN, FFT_SIZE / 2 + 2 - K_MIN, FFT_SIZE);
+  std::vector<float> zeros(FFT_SIZE * CHANNELS, 0.f);
+  bool refused = !beyond.valid && beyond.process(zeros.data(), FFT_SIZE) == 0;
+  std::cout << "Band beyond the spectrum refused: " << refused << std::endl;
+
+  if (e_damped > 1e-2 || !refused)
+  {
+    std::cout << "** Ouch this is too large!! **" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
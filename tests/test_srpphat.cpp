@@ -2,9 +2,11 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 
 #include "../src/e3e_detection.h"
 #include "../src/srpphat.h"
+#include "../src/recording.h"
 
 #define FFT_SIZE 128
 #define CHANNELS 8
@@ -28,31 +30,44 @@ int main(int argc, char **argv)
   STFT *stft = new STFT(FFT_SIZE, NFRAMES, CHANNELS);
   SRPPHAT *srpphat = new SRPPHAT(stft, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
 
-  if (argc != 2)
+  // the other layouts of the steering vectors must give the same spectrum
+  SRPPHAT *layouts[2];
+  for (int l = 0 ; l < 2 ; l++)
   {
-    std::cerr << "Please provide test signal filename as argument." << std::endl;
+    layouts[l] = new SRPPHAT(stft, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
+    layouts[l]->set_lut_layout(l == 0 ? SRP_LUT_GRID_MAJOR : SRP_LUT_FREE);
+  }
+
+  if (argc < 2)
+  {
+    std::cerr << "Please provide test signal filename as argument (and optionally the start in seconds)." << std::endl;
     return 1;
   }
 
   std::cout << "# Opening file: " << argv[1] << std::endl;
-  std::ifstream fin(argv[1], std::ifstream::in | std::ifstream::binary);
 
-  int count = 0;
+  // float32 samples, the layout is taken from the header if the file has one
+  MappedRecording rec;
+  if (!rec.open(argv[1], CHANNELS, FS, RECORDING_FLOAT32) || rec.channels != CHANNELS)
+    return 1;
 
-  while (!fin.eof() && count < 10*NFRAMES)
+  if (argc > 2 && !rec.seek_time(atof(argv[2])))
   {
-    float sample;
-    int argmax;
-    float *ptr = stft->get_in_buffer();
+    std::cerr << "Cannot start at " << argv[2] << " s, the recording lasts " << rec.duration() << " s." << std::endl;
+    return 1;
+  }
 
-    fin.read((char*)ptr, FFT_SIZE * CHANNELS * sizeof(float));
+  int count = 0;
 
-    if (fin.eof())
-      goto end;
+  while (count < 10*NFRAMES && rec.read_to(stft))
+  {
+    int argmax;
 
     stft->transform();
 
     argmax = srpphat->process();
+    for (int l = 0 ; l < 2 ; l++)
+      layouts[l]->process();
 
     /*
     for (int i = 0 ; i < srpphat->n_grid ; i++)
@@ -70,15 +85,33 @@ int main(int argc, char **argv)
     count++;
   }
 
-end:
+  int errors = 0;
+  for (int l = 0 ; l < 2 ; l++)
+  {
+    float max = srpphat->spatial_spectrum[srpphat->argmax];
+    float diff = 0.;
+    for (int i = 0 ; i < srpphat->n_grid ; i++)
+      diff = std::max(diff, std::abs(layouts[l]->spatial_spectrum[i] - srpphat->spatial_spectrum[i]));
+
+    std::cout << "# LUT layout " << (l == 0 ? "grid major" : "free") << ": argmax " << layouts[l]->argmax;
+    std::cout << " (bin major " << srpphat->argmax << "), max difference " << diff / max << std::endl;
+    if (layouts[l]->argmax != srpphat->argmax || diff > 1e-4 * max)
+      errors++;
+  }
 
   for (int i = 0 ; i < srpphat->n_grid ; i++)
     std::cout << srpphat->grid[i][0] << " " << srpphat->spatial_spectrum[i] << std::endl;
 
-
-  fin.close();
   delete stft;
   delete srpphat;
+  for (int l = 0 ; l < 2 ; l++)
+    delete layouts[l];
+
+  if (errors > 0)
+  {
+    std::cout << "** Ouch the SRP-PHAT LUT layouts are broken!! **" << std::endl;
+    return 1;
+  }
 
   return 0;
 }
@@ -5,6 +5,7 @@
 #include <complex>
 #include <cmath>
 #include <random>
+#include <stdlib.h>
 
 #include <fftw3.h>
 
@@ -33,7 +34,12 @@ int main(int argc, char **argv)
   e3e_complex buf_out[FFT_SIZE/2 + 1];
   fftwf_complex *X = reinterpret_cast<fftwf_complex *>(buf_out);
 
-  STFT engine(FFT_SIZE, NFRAMES, CHANNELS);
+  // optionally test the planar layout: ./test_stft 1
+  int layout = STFT_LAYOUT_INTERLEAVED;
+  if (argc > 1)
+    layout = atoi(argv[1]);
+
+  STFT engine(FFT_SIZE, NFRAMES, CHANNELS, FFT_BACKEND_FFTW, layout);
 
   fftwf_plan p_bac = fftwf_plan_dft_c2r_1d(FFT_SIZE, X, buf_in, FFTW_ESTIMATE);
 
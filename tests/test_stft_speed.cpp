@@ -9,7 +9,9 @@
 
 #include <fftw3.h>
 
+#include "../src/e3e_detection.h"
 #include "../src/stft.h"
+#include "../src/planner.h"
 
 #define FFT_SIZE 512
 #define FRAME_SIZE 512
@@ -27,37 +29,57 @@ float rand_val()
   return dist(generator);
 }
 
-int main(int argc, char **argv)
+/* time the transform of NFRAMES frames of random data with the current planner flags, in us per frame */
+float time_stft(int fft_size, int backend)
 {
-  std::vector<int> fft_size = { 64, 128, 256, 512, 1024, 2048, 4096 };
-  time_t now, ellapsed;
-  STFT *engine;
+  uint64_t now, ellapsed;
+  STFT *engine = new STFT(fft_size, NFRAMES, CHANNELS, backend);
 
-  for (int i = 0 ; i < fft_size.size() ; i++)
+  for (int frame = 0 ; frame < NFRAMES ; frame++)
   {
+    float *buf_ptr = engine->get_in_buffer();
+
+    // fill buffer with random data
+    for (int i = 0 ; i < fft_size ; i++)
+      for (int ch = 0 ; ch < CHANNELS ; ch++)
+        buf_ptr[i*CHANNELS + ch] = rand_val();
 
-    engine = new STFT(fft_size[i], NFRAMES, CHANNELS);
+    engine->transform();
+  }
+
+  // the frames above are the warm-up
+  now = e3e_monotonic_ns();
+  for (int frame = 0 ; frame < NFRAMES ; frame++)
+    engine->transform();
+  ellapsed = e3e_monotonic_ns() - now;
 
+  delete engine;
 
-    for (int frame = 0 ; frame < NFRAMES ; frame++)
-    {
-      float *buf_ptr = engine->get_in_buffer();
+  return float(ellapsed) * 1e-3 / NFRAMES;
+}
 
-      // fill buffer with random data
-      for (int i = 0 ; i < FRAME_SIZE ; i++)
-        for (int ch = 0 ; ch < CHANNELS ; ch++)
-          buf_ptr[i*CHANNELS + ch] = rand_val();
-    }
+int main(int argc, char **argv)
+{
+  std::vector<int> fft_size = { 64, 128, 256, 512, 1024, 2048, 4096 };
+
+  // an optional wisdom file makes the measured plans instant
+  if (argc > 1)
+    planner_load_wisdom(argv[1]);
+
+  std::cout << "# size: fftw estimate, fftw measure, builtin" << std::endl;
+
+  for (int i = 0 ; i < fft_size.size() ; i++)
+  {
+    planner_set_effort(PLANNER_ESTIMATE);
+    float t_estimate = time_stft(fft_size[i], FFT_BACKEND_FFTW);
 
-    now = clock();
-    for (int frame = 0 ; frame < NFRAMES ; frame++)
-      engine->transform();
-    ellapsed = clock() - now;
+    planner_set_effort(PLANNER_MEASURE);
+    float t_measure = time_stft(fft_size[i], FFT_BACKEND_FFTW);
 
-    delete engine;
+    float t_builtin = time_stft(fft_size[i], FFT_BACKEND_BUILTIN);
 
     std::cout << fft_size[i] << ": ";
-    std::cout << float(ellapsed) / NFRAMES << " us, ";
+    std::cout << t_estimate << " us, " << t_measure << " us, " << t_builtin << " us, ";
     std::cout << " n samples @ 16kHz: " << 1000 * 1000 * float(fft_size[i]) / 16000 << " us " << std::endl;
 
   }
@@ -12,22 +12,53 @@
 #include "../src/e3e_detection.h"
 #include "../src/stft.h"
 #include "../src/srpphat.h"
-
-#include <wiringPi.h>
+#include "../src/capture.h"
+#include "../src/quality.h"
+#include "../src/mfcc.h"
+#include "../src/classifier.h"
+#include "../src/pipeline.h"
+#include "../src/recording.h"
+#include "../src/mic_array.h"
+#include "../src/instrument.h"
 
 #include <string>
 #include <iostream>
 #include <valarray>
+#include <fstream>
 #include <unistd.h>
+#include <stdlib.h>
+
+/*
+ * The DOA pipeline from the microphones to the LEDs. With E3E_MATRIX_HAL
+ * it runs on the MATRIX Creator, otherwise (test_trigger_replay) the
+ * microphones are a recording replayed at the pace of the array:
+ *
+ *   test_trigger_replay [recording] [speed] [jitter_us] [drop_rate] [model]
+ *
+ * speed 0 replays as fast as the pipeline goes, and the throughput is
+ * reported at the end of the recording.
+ *
+ * With a classifier model (the first argument on the MATRIX Creator) the
+ * MFCC of every frame are classified within the frame, and the event
+ * class is printed with the DOA and the probabilities when it changes.
+ *
+ * Built with E3E_INSTRUMENT, the latencies of the stages are exported to
+ * /dev/shm/e3e_instrument every second (tests/instrument_dump prints
+ * them) and printed at the end.
+ */
+
+#ifdef E3E_MATRIX_HAL
+#include <wiringPi.h>
 
 #include "matrix_hal/everloop_image.h"
 #include "matrix_hal/everloop.h"
 #include "matrix_hal/microphone_array.h"
 #include "matrix_hal/wishbone_bus.h"
+#endif
 
 #define FFT_SIZE 128
 #define FRAME_SIZE 128
-#define NFRAMES 4
+#define NFRAMES 16  // also the depth of the capture ring
 #define CHANNELS 8
 
 #define FS 16000
@@ -39,7 +70,18 @@
 #define SRP_K_LEN 40
 #define SRP_DIM 2
 #define CONFIG_FILE "./CONFIG"
-
+#define CAPTURE_TIMEOUT_US 100000
+#define QUALITY_METRICS_FILE "./quality_metrics.csv"
+#define MFCC_SIZE 13
+#define REPLAY_FILE "./tests/synthetic_data/test_signal.raw"
+
+#ifdef E3E_MATRIX_HAL
+#define MODEL_ARG 1
+#else
+#define MODEL_ARG 5
+#endif
+
+#ifdef E3E_MATRIX_HAL
 namespace hal = matrix_hal;
 
 void update_LED(float* probs, hal::EverloopImage *image1d)
@@ -103,60 +145,181 @@ void update_LED(float* probs, hal::EverloopImage *image1d)
     */
 
 }
+#endif
 
 int main(int argc,char** argv) 
 {
 
+#ifdef E3E_MATRIX_HAL
   hal::WishboneBus bus;
   bus.SpiInit();
 
-  hal::MicrophoneArray mics;
-  mics.Setup(&bus);
+  MatrixMicArray mics(&bus);
 
   hal::Everloop everloop;
   everloop.Setup(&bus);
 
   hal::EverloopImage image1d;
+#else
+  MappedRecording rec;
+  if (!rec.open(argc > 1 ? argv[1] : REPLAY_FILE, CHANNELS, FS, RECORDING_FLOAT32))
+    return 1;
+
+  ReplayMicArray mics(&rec, FFT_SIZE);
+  mics.speed = argc > 2 ? atof(argv[2]) : 1.;
+  mics.jitter_us = argc > 3 ? atoi(argv[3]) : 0;
+  mics.drop_rate = argc > 4 ? atof(argv[4]) : 0.;
+#endif
 
   std::valarray<int> lookup = {23, 27, 32, 1, 6, 10, 14, 19};
 
-  std::valarray<float> magnitude(mics.Channels());
+  std::valarray<float> magnitude(mics.channels);
 
   STFT *engine = new STFT(FFT_SIZE, NFRAMES, CHANNELS);
   SRPPHAT *srpphat = new SRPPHAT(engine, CONFIG_FILE, SRP_K_MIN, SRP_K_LEN, SRP_N_GRID, SRP_NFRAMES, float(FS), C, SRP_DIM);
 
-  float *buf_ptr;
-  e3e_complex *fd_ptr;
+  // degrade the DOA instead of dropping blocks when the frames take too long
+  std::ofstream quality_metrics(QUALITY_METRICS_FILE);
+  QualityController quality(srpphat, FFT_SIZE, FS, &quality_metrics);
+
   int argmax = 0;
+  int doa = -1;
+
+  // the event classifier on the MFCC of the frames, a model of one channel takes the first microphone
+  Classifier classifier;
+  MFCC *mfcc = NULL;
+  MFCCStage *mfcc_stage = NULL;
+  ClassifierStage *classifier_stage = NULL;
+  int event_class = -1;
+  if (argc > MODEL_ARG)
+  {
+    if (!classifier.load(argv[MODEL_ARG]))
+      return 1;
+    mfcc = new MFCC(MFCC_SIZE, FFT_SIZE, FS, 0., 0.5);
+    mfcc_stage = new MFCCStage(mfcc, engine, 1, 1);
+    classifier_stage = new ClassifierStage(&classifier, MFCC_SIZE, CHANNELS,
+        classifier.input_dim == MFCC_SIZE ? 0 : -1, 1);
+    if (!classifier_stage->valid)
+      return 1;
+  }
 
-  assert(mics.NumberOfSamples() == FFT_SIZE);
+  assert(mics.channels == CHANNELS);
   assert(SRP_N_GRID == 35);
-
-  while (true) 
+#ifdef E3E_MATRIX_HAL
+  // the array reads its own block size, any other read ends the capture
+  if (int(mics.mics.NumberOfSamples()) != FFT_SIZE)
   {
+    std::cerr << "Error: the microphone array reads blocks of " << mics.mics.NumberOfSamples()
+      << " samples, the STFT frames are " << FFT_SIZE << " samples." << std::endl;
+    return 1;
+  }
+#endif
+
+  // the reader thread writes the samples straight into the STFT input frames
+  CaptureRing ring(engine);
+  CaptureThread reader(&ring, [&](float *block)
+      {
+        return mics.read_to(engine, block);
+      });
+#ifndef E3E_MATRIX_HAL
+  // as fast as the processing when the replay has no pace
+  reader.wait_for_room = mics.speed <= 0.;
+#endif
+#ifdef E3E_INSTRUMENT
+  InstrumentExporter exporter("/dev/shm/e3e_instrument", 1000);
+  exporter.start();
+#endif
+  reader.start();
+
+  CaptureBlockInfo info;
+  uint64_t overruns = 0, frames = 0;
+  uint64_t t0 = e3e_monotonic_ns();
+
+  while (reader.running || ring.available() > 0)
+  {
+
+    if (ring.wait_read_slot(&info, CAPTURE_TIMEOUT_US) == NULL)
+    {
+      if (reader.running)
+        std::cerr << "Capture stalled, underruns: " << ring.underruns << std::endl;
+      continue;
+    }
 
-    mics.Read();
     magnitude = 0.0;
     bool trgDetected=false;
 
-    buf_ptr = engine->get_in_buffer();
+    // the STFT of the frame and the classification are timed with the DOA
+    quality.begin_frame();
+    argmax = quality.process_frame();
+
+    PipelineFrame frame = { long(engine->frame_count - 1), info.sequence, info.timestamp_ns, argmax, 0., NULL, NULL, NULL };
+    if (classifier_stage != NULL)
+    {
+      mfcc_stage->process(&frame, 1);
+      classifier_stage->process(&frame, 1);
+    }
+    quality.end_frame();
+
+    if (argmax >= 0)
+      doa = argmax;
 
-    for (unsigned int s = 0; s < mics.NumberOfSamples(); s++) 
-      for (int ch = 0 ; ch < CHANNELS ; ch++)
-        buf_ptr[s*CHANNELS + ch] = mics.At(s, ch);
+    if (frame.probabilities != NULL && classifier.argmax() != event_class)
+    {
+      event_class = classifier.argmax();
+      std::cout << "Frame " << frame.index << ": event " << event_class;
+      if (doa >= 0)
+        std::cout << " azimuth " << srpphat->grid[doa][0] / M_PI * 180. << " deg";
+      std::cout << " probabilities";
+      for (int c = 0 ; c < classifier.n_classes ; c++)
+        std::cout << " " << frame.probabilities[c];
+      std::cout << std::endl;
+    }
 
-    fd_ptr = engine->transform();
+#ifdef E3E_MATRIX_HAL
+    if (argmax >= 0)
+    {
+      update_LED(srpphat->spatial_spectrum, &image1d);
+      everloop.Write(&image1d);
+    }
+#endif
 
-    argmax = srpphat->process();
+    ring.release();
+    frames++;
 
-    update_LED(srpphat->spatial_spectrum, &image1d);
-    everloop.Write(&image1d);
+    if (ring.overruns != overruns)
+    {
+      overruns = ring.overruns;
+      std::cerr << "Dropped blocks: " << overruns << " (block " << info.sequence << ")" << std::endl;
+    }
 
     //std::cout << srpphat->grid[argmax][0] / M_PI * 180. << std::endl;
     //std::cout << srpphat->spatial_spectrum[argmax] << std::endl;
     
   }
 
+  reader.stop();
+
+  double seconds = double(e3e_monotonic_ns() - t0) * 1e-9;
+  double audio = double(mics.tell()) / FS;
+  std::cout << "Frames: " << frames << " Overruns: " << ring.overruns << " Underruns: " << ring.underruns;
+#ifndef E3E_MATRIX_HAL
+  std::cout << " Device drops: " << mics.n_dropped << " late: " << mics.n_late;
+#endif
+  std::cout << std::endl;
+  std::cout << "Time: " << seconds << " s, " << frames / seconds << " frames/s, ";
+  std::cout << audio / seconds << "x real time" << std::endl;
+
+#ifdef E3E_INSTRUMENT
+  exporter.stop();
+  InstrumentSnapshot *snapshot = (InstrumentSnapshot *)e3e_aligned_malloc(sizeof(InstrumentSnapshot));
+  instrument_snapshot(snapshot);
+  instrument_print(std::cout, *snapshot);
+  free(snapshot);
+#endif
+
+  delete classifier_stage;
+  delete mfcc_stage;
+  delete mfcc;
   delete engine;
 
   return 0;
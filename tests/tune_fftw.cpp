@@ -0,0 +1,49 @@
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+#include "../src/planner.h"
+
+/*
+ * One-shot tuning of the FFTW plans used by the library.
+ *
+ * Usage: tune_fftw [wisdom_file] [effort] [time_limit]
+ *
+ *   wisdom_file  where to store the wisdom (default ./e3e_fftw.wisdom)
+ *   effort       0: estimate, 1: measure, 2: patient, 3: exhaustive (default 2)
+ *   time_limit   time limit per plan in seconds, negative for none (default -1)
+ */
+
+#define CHANNELS 8
+#define MFCC_SIZE 14
+
+int main(int argc, char **argv)
+{
+  std::string wisdom = PLANNER_DEFAULT_WISDOM;
+  int effort = PLANNER_PATIENT;
+  double time_limit = -1.;
+
+  if (argc > 1)
+    wisdom = argv[1];
+  if (argc > 2)
+    effort = atoi(argv[2]);
+  if (argc > 3)
+    time_limit = atof(argv[3]);
+
+  // the sizes used by the tests and the trigger
+  std::vector<int> fft_sizes = { 64, 128, 256, 512 };
+  std::vector<int> channels = { 1, 2, CHANNELS };
+  std::vector<int> mfcc_sizes = { MFCC_SIZE };
+
+  std::cout << "# Tuning with effort '" << planner_effort_name(effort) << "'";
+  std::cout << " into " << wisdom << std::endl;
+
+  if (!planner_tune(wisdom, effort, time_limit, fft_sizes, channels, mfcc_sizes))
+    return 1;
+
+  std::cout << "# Done." << std::endl;
+
+  return 0;
+}